@@ -0,0 +1,225 @@
+#include <math.h>
+#include "pixconv_impl.h"
+
+#ifdef __aarch64__
+#include <sys/auxv.h>
+#ifndef HWCAP_SVE
+#define HWCAP_SVE (1 << 22)
+#endif
+#endif
+
+void rgb24_bgr24_c(const uint8_t *src, uint8_t *dst, size_t n)
+{
+	uint8_t r, b;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		r = src[3 * i];
+		b = src[3 * i + 2];
+
+		dst[3 * i] = b;
+		dst[3 * i + 1] = src[3 * i + 1];
+		dst[3 * i + 2] = r;
+	}
+}
+
+void rgba_bgra_c(const uint8_t *src, uint8_t *dst, size_t n)
+{
+	uint8_t r, b;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		r = src[4 * i];
+		b = src[4 * i + 2];
+
+		dst[4 * i] = b;
+		dst[4 * i + 1] = src[4 * i + 1];
+		dst[4 * i + 2] = r;
+		dst[4 * i + 3] = src[4 * i + 3];
+	}
+}
+
+void rgb24_to_planar_c(const uint8_t *src, uint8_t *r, uint8_t *g,
+		       uint8_t *b, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		r[i] = src[3 * i];
+		g[i] = src[3 * i + 1];
+		b[i] = src[3 * i + 2];
+	}
+}
+
+void planar_to_rgb24_c(const uint8_t *r, const uint8_t *g,
+		       const uint8_t *b, uint8_t *dst, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		dst[3 * i] = r[i];
+		dst[3 * i + 1] = g[i];
+		dst[3 * i + 2] = b[i];
+	}
+}
+
+void u8_to_f32_c(const uint8_t *src, float *dst, size_t n, float scale)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = (float)src[i] * scale;
+}
+
+void f32_to_u8_c(const float *src, uint8_t *dst, size_t n, float scale)
+{
+	float v;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		v = src[i] * scale;
+		/* written so that NaN ends up as 0, like the SIMD kernels */
+		v = v > 0.0f ? v : 0.0f;
+		v = v < 255.0f ? v : 255.0f;
+		dst[i] = (uint8_t)lrintf(v);
+	}
+}
+
+const struct pixconv_ops pixconv_scalar_ops = {
+	.rgb24_bgr24 = rgb24_bgr24_c,
+	.rgba_bgra = rgba_bgra_c,
+	.rgb24_to_planar = rgb24_to_planar_c,
+	.planar_to_rgb24 = planar_to_rgb24_c,
+	.u8_to_f32 = u8_to_f32_c,
+	.f32_to_u8 = f32_to_u8_c,
+};
+
+static const char *const isa_names[PIXCONV_NR_ISA] = {
+	[PIXCONV_SCALAR] = "scalar",
+	[PIXCONV_SSSE3] = "ssse3",
+	[PIXCONV_AVX2] = "avx2",
+	[PIXCONV_NEON] = "neon",
+	[PIXCONV_SVE] = "sve",
+};
+
+static const struct pixconv_ops *ops;
+static enum pixconv_isa cur_isa;
+
+static const struct pixconv_ops *isa_ops(enum pixconv_isa isa)
+{
+	switch (isa) {
+	case PIXCONV_SCALAR:
+		return &pixconv_scalar_ops;
+#if defined(__x86_64__) || defined(__i386__)
+	case PIXCONV_SSSE3:
+		return &pixconv_ssse3_ops;
+	case PIXCONV_AVX2:
+		return &pixconv_avx2_ops;
+#endif
+#ifdef __aarch64__
+	case PIXCONV_NEON:
+		return &pixconv_neon_ops;
+	case PIXCONV_SVE:
+		return &pixconv_sve_ops;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+int pixconv_isa_supported(enum pixconv_isa isa)
+{
+	if ((unsigned int)isa >= PIXCONV_NR_ISA || !isa_ops(isa))
+		return 0;
+
+	switch (isa) {
+#if defined(__x86_64__) || defined(__i386__)
+	case PIXCONV_SSSE3:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("ssse3");
+	case PIXCONV_AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+#ifdef __aarch64__
+	case PIXCONV_SVE:
+		return !!(getauxval(AT_HWCAP) & HWCAP_SVE);
+#endif
+	default:
+		return 1;
+	}
+}
+
+int pixconv_set_isa(enum pixconv_isa isa)
+{
+	if (!pixconv_isa_supported(isa))
+		return -1;
+
+	cur_isa = isa;
+	ops = isa_ops(isa);
+	return 0;
+}
+
+enum pixconv_isa pixconv_get_isa(void)
+{
+	int isa;
+
+	if (!ops) {
+		/* later entries are the wider kernels of the same family */
+		for (isa = PIXCONV_NR_ISA - 1; isa > PIXCONV_SCALAR; isa--)
+			if (!pixconv_set_isa(isa))
+				break;
+		if (isa == PIXCONV_SCALAR)
+			pixconv_set_isa(PIXCONV_SCALAR);
+	}
+
+	return cur_isa;
+}
+
+const char *pixconv_isa_name(enum pixconv_isa isa)
+{
+	if ((unsigned int)isa >= PIXCONV_NR_ISA)
+		return "unknown";
+
+	return isa_names[isa];
+}
+
+static inline const struct pixconv_ops *get_ops(void)
+{
+	if (!ops)
+		pixconv_get_isa();
+
+	return ops;
+}
+
+void pixconv_rgb24_bgr24(const uint8_t *src, uint8_t *dst, size_t npixels)
+{
+	get_ops()->rgb24_bgr24(src, dst, npixels);
+}
+
+void pixconv_rgba_bgra(const uint8_t *src, uint8_t *dst, size_t npixels)
+{
+	get_ops()->rgba_bgra(src, dst, npixels);
+}
+
+void pixconv_rgb24_to_planar(const uint8_t *src, uint8_t *r, uint8_t *g,
+			     uint8_t *b, size_t npixels)
+{
+	get_ops()->rgb24_to_planar(src, r, g, b, npixels);
+}
+
+void pixconv_planar_to_rgb24(const uint8_t *r, const uint8_t *g,
+			     const uint8_t *b, uint8_t *dst, size_t npixels)
+{
+	get_ops()->planar_to_rgb24(r, g, b, dst, npixels);
+}
+
+void pixconv_u8_to_f32(const uint8_t *src, float *dst, size_t n, float scale)
+{
+	get_ops()->u8_to_f32(src, dst, n, scale);
+}
+
+void pixconv_f32_to_u8(const float *src, uint8_t *dst, size_t n, float scale)
+{
+	get_ops()->f32_to_u8(src, dst, n, scale);
+}
@@ -0,0 +1,51 @@
+#ifndef PIXCONV_H
+#define PIXCONV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Pixel format conversions for packed 8-bit images. Lengths are in
+ * pixels (or elements for the u8/f32 ones) and may be any value; the
+ * SIMD kernels finish the part that does not fill a vector in C.
+ *
+ * The channel swaps are their own inverse and may run in place
+ * (src == dst). Other buffers must not overlap.
+ */
+
+enum pixconv_isa {
+	PIXCONV_SCALAR,
+	PIXCONV_SSSE3,
+	PIXCONV_AVX2,
+	PIXCONV_NEON,
+	PIXCONV_SVE,
+	PIXCONV_NR_ISA,
+};
+
+void pixconv_rgb24_bgr24(const uint8_t *src, uint8_t *dst, size_t npixels);
+#define pixconv_bgr24_rgb24 pixconv_rgb24_bgr24
+
+void pixconv_rgba_bgra(const uint8_t *src, uint8_t *dst, size_t npixels);
+#define pixconv_bgra_rgba pixconv_rgba_bgra
+
+void pixconv_rgb24_to_planar(const uint8_t *src, uint8_t *r, uint8_t *g,
+			     uint8_t *b, size_t npixels);
+void pixconv_planar_to_rgb24(const uint8_t *r, const uint8_t *g,
+			     const uint8_t *b, uint8_t *dst, size_t npixels);
+
+/* dst = src * scale */
+void pixconv_u8_to_f32(const uint8_t *src, float *dst, size_t n, float scale);
+/* dst = src * scale, clamped to 0..255 and rounded to nearest even; NaN gives 0 */
+void pixconv_f32_to_u8(const float *src, uint8_t *dst, size_t n, float scale);
+
+/*
+ * The best kernels the CPU supports are picked on first use.
+ * pixconv_set_isa() forces another set, it returns -1 if the CPU or the
+ * build does not support it.
+ */
+int pixconv_isa_supported(enum pixconv_isa isa);
+int pixconv_set_isa(enum pixconv_isa isa);
+enum pixconv_isa pixconv_get_isa(void);
+const char *pixconv_isa_name(enum pixconv_isa isa);
+
+#endif
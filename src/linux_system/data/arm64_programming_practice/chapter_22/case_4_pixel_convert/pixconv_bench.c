@@ -0,0 +1,229 @@
+/*
+ * Checks every kernel set the CPU supports against the C version, then
+ * times each conversion on 1920x1080 frames.
+ *
+ *   make && ./pixconv_bench [frames]
+ *   make CROSS_COMPILE=aarch64-linux-gnu- LDFLAGS=-static
+ *   qemu-aarch64 -cpu max,sve=on ./pixconv_bench 10
+ *
+ * Times under qemu only compare the kernels with each other.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pixconv.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define IMAGE_SIZE (WIDTH * HEIGHT)
+/* lengths 0..MAX_ODD check the tails */
+#define MAX_ODD 200
+
+static uint8_t *rgb, *out, *ref, *planes, *ref_planes;
+static float *fin, *fout, *ref_fout;
+
+static unsigned long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void fill_random(uint8_t *p, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		p[i] = rand() & 0xff;
+}
+
+/* run conversion op (0..5) on n pixels/elements with the current kernels */
+static void run(int op, size_t n, int in_place)
+{
+	const uint8_t *src = in_place ? out : rgb;
+
+	switch (op) {
+	case 0:
+		pixconv_rgb24_bgr24(src, out, n);
+		break;
+	case 1:
+		pixconv_rgba_bgra(src, out, n);
+		break;
+	case 2:
+		pixconv_rgb24_to_planar(rgb, planes, planes + n, planes + 2 * n, n);
+		break;
+	case 3:
+		pixconv_planar_to_rgb24(rgb, rgb + n, rgb + 2 * n, out, n);
+		break;
+	case 4:
+		pixconv_u8_to_f32(rgb, fout, n, 1.0f / 255.0f);
+		break;
+	case 5:
+		pixconv_f32_to_u8(fin, out, n, 255.0f);
+		break;
+	}
+}
+
+static const char *const op_names[] = {
+	"rgb24<->bgr24", "rgba<->bgra", "rgb24->planar",
+	"planar->rgb24", "u8->f32", "f32->u8",
+};
+
+/* bytes read and written per pixel/element, for the throughput */
+static const int op_bytes[] = { 6, 8, 6, 6, 5, 5 };
+
+#define NR_OPS (sizeof(op_names) / sizeof(op_names[0]))
+
+/* input of f32->u8: values around and outside 0..1, plus NaN and inf */
+static void fill_float(float *p, size_t n)
+{
+	static const float special[] = {
+		-1.0f, -0.0f, 0.5f / 255.0f, 1.5f / 255.0f, 254.5f / 255.0f,
+		1.0f, 2.0f, 1e30f, -1e30f, __builtin_nanf(""), __builtin_inff(),
+	};
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (i % 17 == 0)
+			p[i] = special[(i / 17) % (sizeof(special) / sizeof(special[0]))];
+		else
+			p[i] = (rand() % 3000 - 1000) / 1000.0f;
+	}
+}
+
+static int check(enum pixconv_isa isa, int op, size_t n, int in_place)
+{
+	size_t bytes = op == 1 ? 4 * n : 3 * n;
+
+	/* C reference */
+	pixconv_set_isa(PIXCONV_SCALAR);
+	if (in_place)
+		memcpy(out, rgb, bytes);
+	run(op, n, in_place);
+	memcpy(ref, out, bytes);
+	memcpy(ref_planes, planes, 3 * n);
+	memcpy(ref_fout, fout, n * sizeof(float));
+
+	/* poison the outputs so a kernel that skips a pixel is caught */
+	pixconv_set_isa(isa);
+	memset(out, 0x5a, bytes);
+	memset(planes, 0x5a, 3 * n);
+	memset(fout, 0x5a, n * sizeof(float));
+	if (in_place)
+		memcpy(out, rgb, bytes);
+	run(op, n, in_place);
+
+	switch (op) {
+	case 2:
+		return memcmp(ref_planes, planes, 3 * n);
+	case 4:
+		return memcmp(ref_fout, fout, n * sizeof(float));
+	case 5:
+		return memcmp(ref, out, n);
+	default:
+		return memcmp(ref, out, bytes);
+	}
+}
+
+static int check_isa(enum pixconv_isa isa)
+{
+	size_t n;
+	int op, errors = 0;
+
+	for (op = 0; op < (int)NR_OPS; op++) {
+		for (n = 0; n <= MAX_ODD; n++) {
+			if (check(isa, op, n, 0) || (op < 2 && check(isa, op, n, 1))) {
+				printf("  %s: %s differs from C for %zu pixels\n",
+				       pixconv_isa_name(isa), op_names[op], n);
+				errors++;
+				break;
+			}
+		}
+		if (check(isa, op, IMAGE_SIZE, 0)) {
+			printf("  %s: %s differs from C for a full frame\n",
+			       pixconv_isa_name(isa), op_names[op]);
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long start, ns[PIXCONV_NR_ISA][NR_OPS];
+	int frames = argc > 1 ? atoi(argv[1]) : 100;
+	int isa, op, f, errors = 0;
+
+	if (frames <= 0)
+		frames = 1;
+
+	rgb = malloc(IMAGE_SIZE * 4);
+	out = malloc(IMAGE_SIZE * 4);
+	ref = malloc(IMAGE_SIZE * 4);
+	planes = malloc(IMAGE_SIZE * 3);
+	ref_planes = malloc(IMAGE_SIZE * 3);
+	fin = malloc(IMAGE_SIZE * sizeof(float));
+	fout = malloc(IMAGE_SIZE * sizeof(float));
+	ref_fout = malloc(IMAGE_SIZE * sizeof(float));
+	if (!rgb || !out || !ref || !planes || !ref_planes || !fin || !fout ||
+	    !ref_fout)
+		return 1;
+
+	fill_random(rgb, IMAGE_SIZE * 4);
+	fill_float(fin, IMAGE_SIZE);
+	printf("default kernels: %s\n", pixconv_isa_name(pixconv_get_isa()));
+
+	for (isa = PIXCONV_SCALAR; isa < PIXCONV_NR_ISA; isa++) {
+		if (!pixconv_isa_supported(isa))
+			continue;
+		errors += check_isa(isa);
+	}
+	if (errors) {
+		printf("%d conversions differ from the C version\n", errors);
+		return 1;
+	}
+	printf("all kernels match the C version\n\n");
+
+	memset(ns, 0, sizeof(ns));
+	for (isa = PIXCONV_SCALAR; isa < PIXCONV_NR_ISA; isa++) {
+		if (pixconv_set_isa(isa))
+			continue;
+		for (op = 0; op < (int)NR_OPS; op++) {
+			/* one untimed frame to fault the pages in */
+			run(op, IMAGE_SIZE, 0);
+			start = now_ns();
+			for (f = 0; f < frames; f++)
+				run(op, IMAGE_SIZE, 0);
+			ns[isa][op] = now_ns() - start;
+		}
+	}
+
+	printf("%dx%d, %d frames, ms/frame (GB/s, speedup over C)\n",
+	       WIDTH, HEIGHT, frames);
+	for (op = 0; op < (int)NR_OPS; op++) {
+		printf("%-14s", op_names[op]);
+		for (isa = PIXCONV_SCALAR; isa < PIXCONV_NR_ISA; isa++) {
+			if (!ns[isa][op])
+				continue;
+			printf("  %s %.3f (%.1f, %.1fx)", pixconv_isa_name(isa),
+			       ns[isa][op] / 1e6 / frames,
+			       (double)op_bytes[op] * IMAGE_SIZE * frames / ns[isa][op],
+			       (double)ns[PIXCONV_SCALAR][op] / ns[isa][op]);
+		}
+		printf("\n");
+	}
+
+	free(rgb);
+	free(out);
+	free(ref);
+	free(planes);
+	free(ref_planes);
+	free(fin);
+	free(fout);
+	free(ref_fout);
+
+	return 0;
+}
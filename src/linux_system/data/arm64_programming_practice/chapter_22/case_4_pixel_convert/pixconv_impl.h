@@ -0,0 +1,34 @@
+#ifndef PIXCONV_IMPL_H
+#define PIXCONV_IMPL_H
+
+#include "pixconv.h"
+
+struct pixconv_ops {
+	void (*rgb24_bgr24)(const uint8_t *src, uint8_t *dst, size_t n);
+	void (*rgba_bgra)(const uint8_t *src, uint8_t *dst, size_t n);
+	void (*rgb24_to_planar)(const uint8_t *src, uint8_t *r, uint8_t *g,
+				uint8_t *b, size_t n);
+	void (*planar_to_rgb24)(const uint8_t *r, const uint8_t *g,
+				const uint8_t *b, uint8_t *dst, size_t n);
+	void (*u8_to_f32)(const uint8_t *src, float *dst, size_t n, float scale);
+	void (*f32_to_u8)(const float *src, uint8_t *dst, size_t n, float scale);
+};
+
+/* C versions, also used by the SIMD kernels for the tail */
+void rgb24_bgr24_c(const uint8_t *src, uint8_t *dst, size_t n);
+void rgba_bgra_c(const uint8_t *src, uint8_t *dst, size_t n);
+void rgb24_to_planar_c(const uint8_t *src, uint8_t *r, uint8_t *g,
+		       uint8_t *b, size_t n);
+void planar_to_rgb24_c(const uint8_t *r, const uint8_t *g,
+		       const uint8_t *b, uint8_t *dst, size_t n);
+void u8_to_f32_c(const uint8_t *src, float *dst, size_t n, float scale);
+void f32_to_u8_c(const float *src, uint8_t *dst, size_t n, float scale);
+
+extern const struct pixconv_ops pixconv_scalar_ops;
+extern const struct pixconv_ops pixconv_ssse3_ops;
+extern const struct pixconv_ops pixconv_avx2_ops;
+extern const struct pixconv_ops pixconv_neon_ops;
+/* only built when the compiler targets SVE, see Makefile */
+extern const struct pixconv_ops pixconv_sve_ops __attribute__((weak));
+
+#endif
@@ -0,0 +1,140 @@
+/*
+ * NEON kernels, the ld3/st3 version of ../case_1_rgb24_bgr24 extended
+ * to the other formats. NEON is always there on aarch64.
+ */
+#ifdef __aarch64__
+
+#include <arm_neon.h>
+#include "pixconv_impl.h"
+
+static void rgb24_bgr24_neon(const uint8_t *src, uint8_t *dst, size_t n)
+{
+	uint8x16x3_t rgb, bgr;
+	size_t i;
+
+	for (i = 0; n - i >= 16; i += 16) {
+		rgb = vld3q_u8(src + 3 * i);
+
+		bgr.val[0] = rgb.val[2];
+		bgr.val[1] = rgb.val[1];
+		bgr.val[2] = rgb.val[0];
+
+		vst3q_u8(dst + 3 * i, bgr);
+	}
+
+	rgb24_bgr24_c(src + 3 * i, dst + 3 * i, n - i);
+}
+
+static void rgba_bgra_neon(const uint8_t *src, uint8_t *dst, size_t n)
+{
+	uint8x16x4_t rgba, bgra;
+	size_t i;
+
+	for (i = 0; n - i >= 16; i += 16) {
+		rgba = vld4q_u8(src + 4 * i);
+
+		bgra.val[0] = rgba.val[2];
+		bgra.val[1] = rgba.val[1];
+		bgra.val[2] = rgba.val[0];
+		bgra.val[3] = rgba.val[3];
+
+		vst4q_u8(dst + 4 * i, bgra);
+	}
+
+	rgba_bgra_c(src + 4 * i, dst + 4 * i, n - i);
+}
+
+static void rgb24_to_planar_neon(const uint8_t *src, uint8_t *r,
+				 uint8_t *g, uint8_t *b, size_t n)
+{
+	uint8x16x3_t rgb;
+	size_t i;
+
+	for (i = 0; n - i >= 16; i += 16) {
+		rgb = vld3q_u8(src + 3 * i);
+
+		vst1q_u8(r + i, rgb.val[0]);
+		vst1q_u8(g + i, rgb.val[1]);
+		vst1q_u8(b + i, rgb.val[2]);
+	}
+
+	rgb24_to_planar_c(src + 3 * i, r + i, g + i, b + i, n - i);
+}
+
+static void planar_to_rgb24_neon(const uint8_t *r, const uint8_t *g,
+				 const uint8_t *b, uint8_t *dst, size_t n)
+{
+	uint8x16x3_t rgb;
+	size_t i;
+
+	for (i = 0; n - i >= 16; i += 16) {
+		rgb.val[0] = vld1q_u8(r + i);
+		rgb.val[1] = vld1q_u8(g + i);
+		rgb.val[2] = vld1q_u8(b + i);
+
+		vst3q_u8(dst + 3 * i, rgb);
+	}
+
+	planar_to_rgb24_c(r + i, g + i, b + i, dst + 3 * i, n - i);
+}
+
+static void u8_to_f32_neon(const uint8_t *src, float *dst, size_t n,
+			   float scale)
+{
+	uint8x16_t v;
+	uint16x8_t lo, hi;
+	size_t i;
+
+	for (i = 0; n - i >= 16; i += 16) {
+		v = vld1q_u8(src + i);
+		lo = vmovl_u8(vget_low_u8(v));
+		hi = vmovl_u8(vget_high_u8(v));
+
+		vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_u32(
+			vmovl_u16(vget_low_u16(lo))), scale));
+		vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_u32(
+			vmovl_u16(vget_high_u16(lo))), scale));
+		vst1q_f32(dst + i + 8, vmulq_n_f32(vcvtq_f32_u32(
+			vmovl_u16(vget_low_u16(hi))), scale));
+		vst1q_f32(dst + i + 12, vmulq_n_f32(vcvtq_f32_u32(
+			vmovl_u16(vget_high_u16(hi))), scale));
+	}
+
+	u8_to_f32_c(src + i, dst + i, n - i, scale);
+}
+
+/*
+ * fcvtnu rounds to nearest even and saturates (negative and NaN give 0),
+ * the narrowing moves saturate the rest to 255.
+ */
+static void f32_to_u8_neon(const float *src, uint8_t *dst, size_t n,
+			   float scale)
+{
+	uint32x4_t q0, q1, q2, q3;
+	uint16x8_t lo, hi;
+	size_t i;
+
+	for (i = 0; n - i >= 16; i += 16) {
+		q0 = vcvtnq_u32_f32(vmulq_n_f32(vld1q_f32(src + i), scale));
+		q1 = vcvtnq_u32_f32(vmulq_n_f32(vld1q_f32(src + i + 4), scale));
+		q2 = vcvtnq_u32_f32(vmulq_n_f32(vld1q_f32(src + i + 8), scale));
+		q3 = vcvtnq_u32_f32(vmulq_n_f32(vld1q_f32(src + i + 12), scale));
+
+		lo = vcombine_u16(vqmovn_u32(q0), vqmovn_u32(q1));
+		hi = vcombine_u16(vqmovn_u32(q2), vqmovn_u32(q3));
+		vst1q_u8(dst + i, vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi)));
+	}
+
+	f32_to_u8_c(src + i, dst + i, n - i, scale);
+}
+
+const struct pixconv_ops pixconv_neon_ops = {
+	.rgb24_bgr24 = rgb24_bgr24_neon,
+	.rgba_bgra = rgba_bgra_neon,
+	.rgb24_to_planar = rgb24_to_planar_neon,
+	.planar_to_rgb24 = planar_to_rgb24_neon,
+	.u8_to_f32 = u8_to_f32_neon,
+	.f32_to_u8 = f32_to_u8_neon,
+};
+
+#endif
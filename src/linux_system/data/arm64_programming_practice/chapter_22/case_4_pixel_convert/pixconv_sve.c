@@ -0,0 +1,119 @@
+/*
+ * SVE kernels, the ld3b/st3b loop of ../../chapter_23/example_rgb24_bgr24
+ * written with ACLE intrinsics. whilelt builds the predicate for the last
+ * partial vector, so unlike the NEON and x86 kernels these need no C
+ * tail and work for any vector length.
+ *
+ * This file is built with -march=armv8-a+sve and only called when the
+ * kernel reports HWCAP_SVE.
+ */
+#ifdef __ARM_FEATURE_SVE
+
+#include <arm_sve.h>
+#include "pixconv_impl.h"
+
+static void rgb24_bgr24_sve(const uint8_t *src, uint8_t *dst, size_t n)
+{
+	svuint8x3_t rgb;
+	svbool_t pg;
+	size_t i;
+
+	for (i = 0; i < n; i += svcntb()) {
+		pg = svwhilelt_b8_u64(i, n);
+		rgb = svld3_u8(pg, src + 3 * i);
+		svst3_u8(pg, dst + 3 * i, svcreate3_u8(svget3_u8(rgb, 2),
+						       svget3_u8(rgb, 1),
+						       svget3_u8(rgb, 0)));
+	}
+}
+
+static void rgba_bgra_sve(const uint8_t *src, uint8_t *dst, size_t n)
+{
+	svuint8x4_t rgba;
+	svbool_t pg;
+	size_t i;
+
+	for (i = 0; i < n; i += svcntb()) {
+		pg = svwhilelt_b8_u64(i, n);
+		rgba = svld4_u8(pg, src + 4 * i);
+		svst4_u8(pg, dst + 4 * i, svcreate4_u8(svget4_u8(rgba, 2),
+						       svget4_u8(rgba, 1),
+						       svget4_u8(rgba, 0),
+						       svget4_u8(rgba, 3)));
+	}
+}
+
+static void rgb24_to_planar_sve(const uint8_t *src, uint8_t *r,
+				uint8_t *g, uint8_t *b, size_t n)
+{
+	svuint8x3_t rgb;
+	svbool_t pg;
+	size_t i;
+
+	for (i = 0; i < n; i += svcntb()) {
+		pg = svwhilelt_b8_u64(i, n);
+		rgb = svld3_u8(pg, src + 3 * i);
+		svst1_u8(pg, r + i, svget3_u8(rgb, 0));
+		svst1_u8(pg, g + i, svget3_u8(rgb, 1));
+		svst1_u8(pg, b + i, svget3_u8(rgb, 2));
+	}
+}
+
+static void planar_to_rgb24_sve(const uint8_t *r, const uint8_t *g,
+				const uint8_t *b, uint8_t *dst, size_t n)
+{
+	svbool_t pg;
+	size_t i;
+
+	for (i = 0; i < n; i += svcntb()) {
+		pg = svwhilelt_b8_u64(i, n);
+		svst3_u8(pg, dst + 3 * i, svcreate3_u8(svld1_u8(pg, r + i),
+						       svld1_u8(pg, g + i),
+						       svld1_u8(pg, b + i)));
+	}
+}
+
+static void u8_to_f32_sve(const uint8_t *src, float *dst, size_t n,
+			  float scale)
+{
+	svfloat32_t v;
+	svbool_t pg;
+	size_t i;
+
+	for (i = 0; i < n; i += svcntw()) {
+		pg = svwhilelt_b32_u64(i, n);
+		/* ld1b zero-extends each byte into a 32-bit lane */
+		v = svcvt_f32_u32_x(pg, svld1ub_u32(pg, src + i));
+		svst1_f32(pg, dst + i, svmul_n_f32_x(pg, v, scale));
+	}
+}
+
+static void f32_to_u8_sve(const float *src, uint8_t *dst, size_t n,
+			  float scale)
+{
+	svfloat32_t v;
+	svbool_t pg;
+	size_t i;
+
+	for (i = 0; i < n; i += svcntw()) {
+		pg = svwhilelt_b32_u64(i, n);
+		v = svmul_n_f32_x(pg, svld1_f32(pg, src + i), scale);
+		/* fmaxnm/fminnm prefer the number over NaN */
+		v = svmaxnm_n_f32_x(pg, v, 0.0f);
+		v = svminnm_n_f32_x(pg, v, 255.0f);
+		v = svrintn_f32_x(pg, v);
+		/* st1b keeps the low byte of each 32-bit lane */
+		svst1b_u32(pg, dst + i, svcvt_u32_f32_x(pg, v));
+	}
+}
+
+const struct pixconv_ops pixconv_sve_ops = {
+	.rgb24_bgr24 = rgb24_bgr24_sve,
+	.rgba_bgra = rgba_bgra_sve,
+	.rgb24_to_planar = rgb24_to_planar_sve,
+	.planar_to_rgb24 = planar_to_rgb24_sve,
+	.u8_to_f32 = u8_to_f32_sve,
+	.f32_to_u8 = f32_to_u8_sve,
+};
+
+#endif
@@ -0,0 +1,407 @@
+/*
+ * SSSE3 and AVX2 kernels. They are built with target attributes so the
+ * rest of the program keeps the default -march, and only run after
+ * pixconv.c has checked the CPU.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+#include "pixconv_impl.h"
+
+#define SSSE3 __attribute__((target("ssse3")))
+#define AVX2 __attribute__((target("avx2")))
+
+/*
+ * pshufb masks. A 16-byte window holds four whole RGB24 pixels and 4
+ * bytes of the next one; those 4 bytes are copied unchanged, so a store
+ * of the full window puts back what was there and the swap still works
+ * in place.
+ */
+static const uint8_t rgb_swap_mask[16] = {
+	2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 12, 13, 14, 15
+};
+
+static const uint8_t rgba_swap_mask[16] = {
+	2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+};
+
+/*
+ * 16 RGB24 pixels are 48 bytes, three vectors. Channel c of pixel i is
+ * byte 3 * i + c, that is byte 3 * i + c - 16 * k of vector k.
+ */
+#define DI(c, k, i) \
+	(3 * (i) + (c) - 16 * (k) >= 0 && 3 * (i) + (c) - 16 * (k) < 16 ? \
+	 3 * (i) + (c) - 16 * (k) : 0x80)
+#define DEINT_MASK(c, k) { \
+	DI(c, k, 0), DI(c, k, 1), DI(c, k, 2), DI(c, k, 3), \
+	DI(c, k, 4), DI(c, k, 5), DI(c, k, 6), DI(c, k, 7), \
+	DI(c, k, 8), DI(c, k, 9), DI(c, k, 10), DI(c, k, 11), \
+	DI(c, k, 12), DI(c, k, 13), DI(c, k, 14), DI(c, k, 15) }
+
+/* byte j of output vector k is channel (16 * k + j) % 3 of pixel (16 * k + j) / 3 */
+#define IN(k, c, j) \
+	((16 * (k) + (j)) % 3 == (c) ? (16 * (k) + (j)) / 3 : 0x80)
+#define INT_MASK(k, c) { \
+	IN(k, c, 0), IN(k, c, 1), IN(k, c, 2), IN(k, c, 3), \
+	IN(k, c, 4), IN(k, c, 5), IN(k, c, 6), IN(k, c, 7), \
+	IN(k, c, 8), IN(k, c, 9), IN(k, c, 10), IN(k, c, 11), \
+	IN(k, c, 12), IN(k, c, 13), IN(k, c, 14), IN(k, c, 15) }
+
+/* [channel][source vector] */
+static const uint8_t deint_mask[3][3][16] = {
+	{ DEINT_MASK(0, 0), DEINT_MASK(0, 1), DEINT_MASK(0, 2) },
+	{ DEINT_MASK(1, 0), DEINT_MASK(1, 1), DEINT_MASK(1, 2) },
+	{ DEINT_MASK(2, 0), DEINT_MASK(2, 1), DEINT_MASK(2, 2) },
+};
+
+/* [output vector][channel] */
+static const uint8_t int_mask[3][3][16] = {
+	{ INT_MASK(0, 0), INT_MASK(0, 1), INT_MASK(0, 2) },
+	{ INT_MASK(1, 0), INT_MASK(1, 1), INT_MASK(1, 2) },
+	{ INT_MASK(2, 0), INT_MASK(2, 1), INT_MASK(2, 2) },
+};
+
+#define LOAD128(p) _mm_loadu_si128((const __m128i *)(p))
+#define STORE128(p, v) _mm_storeu_si128((__m128i *)(p), (v))
+
+/* ---------------------------------------------------------------- SSSE3 */
+
+SSSE3 static void rgb24_bgr24_ssse3(const uint8_t *src, uint8_t *dst, size_t n)
+{
+	__m128i m = LOAD128(rgb_swap_mask);
+	__m128i v0, v1, v2, v3;
+	size_t i = 0;
+
+	/*
+	 * Four overlapping windows 12 bytes apart do 16 pixels. All loads
+	 * come first and the stores go in ascending order, so in place each
+	 * window's copied tail is overwritten by the next store.
+	 */
+	for (; n - i >= 18; i += 16) {
+		v0 = LOAD128(src + 3 * i);
+		v1 = LOAD128(src + 3 * i + 12);
+		v2 = LOAD128(src + 3 * i + 24);
+		v3 = LOAD128(src + 3 * i + 36);
+		STORE128(dst + 3 * i, _mm_shuffle_epi8(v0, m));
+		STORE128(dst + 3 * i + 12, _mm_shuffle_epi8(v1, m));
+		STORE128(dst + 3 * i + 24, _mm_shuffle_epi8(v2, m));
+		STORE128(dst + 3 * i + 36, _mm_shuffle_epi8(v3, m));
+	}
+	for (; n - i >= 6; i += 4)
+		STORE128(dst + 3 * i, _mm_shuffle_epi8(LOAD128(src + 3 * i), m));
+
+	rgb24_bgr24_c(src + 3 * i, dst + 3 * i, n - i);
+}
+
+SSSE3 static void rgba_bgra_ssse3(const uint8_t *src, uint8_t *dst, size_t n)
+{
+	__m128i m = LOAD128(rgba_swap_mask);
+	__m128i v0, v1, v2, v3;
+	size_t i = 0;
+
+	for (; n - i >= 16; i += 16) {
+		v0 = LOAD128(src + 4 * i);
+		v1 = LOAD128(src + 4 * i + 16);
+		v2 = LOAD128(src + 4 * i + 32);
+		v3 = LOAD128(src + 4 * i + 48);
+		STORE128(dst + 4 * i, _mm_shuffle_epi8(v0, m));
+		STORE128(dst + 4 * i + 16, _mm_shuffle_epi8(v1, m));
+		STORE128(dst + 4 * i + 32, _mm_shuffle_epi8(v2, m));
+		STORE128(dst + 4 * i + 48, _mm_shuffle_epi8(v3, m));
+	}
+	for (; n - i >= 4; i += 4)
+		STORE128(dst + 4 * i, _mm_shuffle_epi8(LOAD128(src + 4 * i), m));
+
+	rgba_bgra_c(src + 4 * i, dst + 4 * i, n - i);
+}
+
+SSSE3 static void rgb24_to_planar_ssse3(const uint8_t *src, uint8_t *r,
+					uint8_t *g, uint8_t *b, size_t n)
+{
+	uint8_t *plane[3] = { r, g, b };
+	__m128i m[3][3], v[3], out;
+	size_t i = 0;
+	int c, k;
+
+	for (c = 0; c < 3; c++)
+		for (k = 0; k < 3; k++)
+			m[c][k] = LOAD128(deint_mask[c][k]);
+
+	for (; n - i >= 16; i += 16) {
+		v[0] = LOAD128(src + 3 * i);
+		v[1] = LOAD128(src + 3 * i + 16);
+		v[2] = LOAD128(src + 3 * i + 32);
+		for (c = 0; c < 3; c++) {
+			out = _mm_or_si128(_mm_shuffle_epi8(v[0], m[c][0]),
+					   _mm_shuffle_epi8(v[1], m[c][1]));
+			out = _mm_or_si128(out, _mm_shuffle_epi8(v[2], m[c][2]));
+			STORE128(plane[c] + i, out);
+		}
+	}
+
+	rgb24_to_planar_c(src + 3 * i, r + i, g + i, b + i, n - i);
+}
+
+SSSE3 static void planar_to_rgb24_ssse3(const uint8_t *r, const uint8_t *g,
+					const uint8_t *b, uint8_t *dst, size_t n)
+{
+	__m128i m[3][3], v[3], out;
+	size_t i = 0;
+	int c, k;
+
+	for (k = 0; k < 3; k++)
+		for (c = 0; c < 3; c++)
+			m[k][c] = LOAD128(int_mask[k][c]);
+
+	for (; n - i >= 16; i += 16) {
+		v[0] = LOAD128(r + i);
+		v[1] = LOAD128(g + i);
+		v[2] = LOAD128(b + i);
+		for (k = 0; k < 3; k++) {
+			out = _mm_or_si128(_mm_shuffle_epi8(v[0], m[k][0]),
+					   _mm_shuffle_epi8(v[1], m[k][1]));
+			out = _mm_or_si128(out, _mm_shuffle_epi8(v[2], m[k][2]));
+			STORE128(dst + 3 * i + 16 * k, out);
+		}
+	}
+
+	planar_to_rgb24_c(r + i, g + i, b + i, dst + 3 * i, n - i);
+}
+
+SSSE3 static void u8_to_f32_ssse3(const uint8_t *src, float *dst, size_t n,
+				  float scale)
+{
+	__m128 k = _mm_set1_ps(scale);
+	__m128i zero = _mm_setzero_si128();
+	__m128i v, lo, hi;
+	size_t i = 0;
+
+	for (; n - i >= 16; i += 16) {
+		v = LOAD128(src + i);
+		lo = _mm_unpacklo_epi8(v, zero);
+		hi = _mm_unpackhi_epi8(v, zero);
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(
+			_mm_unpacklo_epi16(lo, zero)), k));
+		_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(
+			_mm_unpackhi_epi16(lo, zero)), k));
+		_mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(
+			_mm_unpacklo_epi16(hi, zero)), k));
+		_mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(
+			_mm_unpackhi_epi16(hi, zero)), k));
+	}
+
+	u8_to_f32_c(src + i, dst + i, n - i, scale);
+}
+
+/*
+ * Clamp before converting: maxps returns its second operand when the
+ * first is NaN, and out-of-range floats would convert to INT_MIN.
+ * cvtps2dq rounds to nearest even under the default MXCSR, like lrintf().
+ */
+SSSE3 static inline __m128i f32_to_i32_ssse3(const float *src, __m128 k)
+{
+	__m128 v = _mm_mul_ps(_mm_loadu_ps(src), k);
+
+	v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.0f));
+	return _mm_cvtps_epi32(v);
+}
+
+SSSE3 static void f32_to_u8_ssse3(const float *src, uint8_t *dst, size_t n,
+				  float scale)
+{
+	__m128 k = _mm_set1_ps(scale);
+	__m128i q0, q1, q2, q3;
+	size_t i = 0;
+
+	for (; n - i >= 16; i += 16) {
+		q0 = f32_to_i32_ssse3(src + i, k);
+		q1 = f32_to_i32_ssse3(src + i + 4, k);
+		q2 = f32_to_i32_ssse3(src + i + 8, k);
+		q3 = f32_to_i32_ssse3(src + i + 12, k);
+		STORE128(dst + i, _mm_packus_epi16(_mm_packs_epi32(q0, q1),
+						   _mm_packs_epi32(q2, q3)));
+	}
+
+	f32_to_u8_c(src + i, dst + i, n - i, scale);
+}
+
+const struct pixconv_ops pixconv_ssse3_ops = {
+	.rgb24_bgr24 = rgb24_bgr24_ssse3,
+	.rgba_bgra = rgba_bgra_ssse3,
+	.rgb24_to_planar = rgb24_to_planar_ssse3,
+	.planar_to_rgb24 = planar_to_rgb24_ssse3,
+	.u8_to_f32 = u8_to_f32_ssse3,
+	.f32_to_u8 = f32_to_u8_ssse3,
+};
+
+/* ----------------------------------------------------------------- AVX2 */
+
+#define LOAD256(p) _mm256_loadu_si256((const __m256i *)(p))
+#define STORE256(p, v) _mm256_storeu_si256((__m256i *)(p), (v))
+/* two 16-byte pieces into the low and high lane */
+#define LOAD2X128(lo, hi) \
+	_mm256_inserti128_si256(_mm256_castsi128_si256(LOAD128(lo)), LOAD128(hi), 1)
+
+AVX2 static void rgb24_bgr24_avx2(const uint8_t *src, uint8_t *dst, size_t n)
+{
+	/*
+	 * vpshufb does not cross 128-bit lanes: spread the 24 bytes of 8
+	 * pixels to 12 per lane (the spare dwords 6 and 7 ride along in
+	 * the top of each lane), swap, then gather them back. The last 8
+	 * bytes stored are the source's own, as in the SSSE3 version.
+	 */
+	const __m256i spread = _mm256_setr_epi32(0, 1, 2, 6, 3, 4, 5, 7);
+	const __m256i gather = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+	const __m256i m = _mm256_broadcastsi128_si256(LOAD128(rgb_swap_mask));
+	__m256i v0, v1;
+	size_t i = 0;
+
+	for (; n - i >= 19; i += 16) {
+		v0 = LOAD256(src + 3 * i);
+		v1 = LOAD256(src + 3 * i + 24);
+		v0 = _mm256_permutevar8x32_epi32(v0, spread);
+		v1 = _mm256_permutevar8x32_epi32(v1, spread);
+		v0 = _mm256_shuffle_epi8(v0, m);
+		v1 = _mm256_shuffle_epi8(v1, m);
+		STORE256(dst + 3 * i, _mm256_permutevar8x32_epi32(v0, gather));
+		STORE256(dst + 3 * i + 24, _mm256_permutevar8x32_epi32(v1, gather));
+	}
+
+	rgb24_bgr24_ssse3(src + 3 * i, dst + 3 * i, n - i);
+}
+
+AVX2 static void rgba_bgra_avx2(const uint8_t *src, uint8_t *dst, size_t n)
+{
+	const __m256i m = _mm256_broadcastsi128_si256(LOAD128(rgba_swap_mask));
+	__m256i v0, v1;
+	size_t i = 0;
+
+	for (; n - i >= 16; i += 16) {
+		v0 = LOAD256(src + 4 * i);
+		v1 = LOAD256(src + 4 * i + 32);
+		STORE256(dst + 4 * i, _mm256_shuffle_epi8(v0, m));
+		STORE256(dst + 4 * i + 32, _mm256_shuffle_epi8(v1, m));
+	}
+
+	rgba_bgra_ssse3(src + 4 * i, dst + 4 * i, n - i);
+}
+
+/*
+ * The planar kernels run the SSSE3 algorithm in both lanes: the low lane
+ * handles pixels 0-15 and the high lane pixels 16-31, so each plane comes
+ * out as 32 contiguous bytes.
+ */
+AVX2 static void rgb24_to_planar_avx2(const uint8_t *src, uint8_t *r,
+				      uint8_t *g, uint8_t *b, size_t n)
+{
+	uint8_t *plane[3] = { r, g, b };
+	__m256i m[3][3], v[3], out;
+	size_t i = 0;
+	int c, k;
+
+	for (c = 0; c < 3; c++)
+		for (k = 0; k < 3; k++)
+			m[c][k] = _mm256_broadcastsi128_si256(LOAD128(deint_mask[c][k]));
+
+	for (; n - i >= 32; i += 32) {
+		for (k = 0; k < 3; k++)
+			v[k] = LOAD2X128(src + 3 * i + 16 * k,
+					 src + 3 * i + 48 + 16 * k);
+		for (c = 0; c < 3; c++) {
+			out = _mm256_or_si256(_mm256_shuffle_epi8(v[0], m[c][0]),
+					      _mm256_shuffle_epi8(v[1], m[c][1]));
+			out = _mm256_or_si256(out, _mm256_shuffle_epi8(v[2], m[c][2]));
+			STORE256(plane[c] + i, out);
+		}
+	}
+
+	rgb24_to_planar_ssse3(src + 3 * i, r + i, g + i, b + i, n - i);
+}
+
+AVX2 static void planar_to_rgb24_avx2(const uint8_t *r, const uint8_t *g,
+				      const uint8_t *b, uint8_t *dst, size_t n)
+{
+	__m256i m[3][3], v[3], out;
+	size_t i = 0;
+	int c, k;
+
+	for (k = 0; k < 3; k++)
+		for (c = 0; c < 3; c++)
+			m[k][c] = _mm256_broadcastsi128_si256(LOAD128(int_mask[k][c]));
+
+	for (; n - i >= 32; i += 32) {
+		v[0] = LOAD256(r + i);
+		v[1] = LOAD256(g + i);
+		v[2] = LOAD256(b + i);
+		for (k = 0; k < 3; k++) {
+			out = _mm256_or_si256(_mm256_shuffle_epi8(v[0], m[k][0]),
+					      _mm256_shuffle_epi8(v[1], m[k][1]));
+			out = _mm256_or_si256(out, _mm256_shuffle_epi8(v[2], m[k][2]));
+			STORE128(dst + 3 * i + 16 * k, _mm256_castsi256_si128(out));
+			STORE128(dst + 3 * i + 48 + 16 * k,
+				 _mm256_extracti128_si256(out, 1));
+		}
+	}
+
+	planar_to_rgb24_ssse3(r + i, g + i, b + i, dst + 3 * i, n - i);
+}
+
+AVX2 static void u8_to_f32_avx2(const uint8_t *src, float *dst, size_t n,
+				float scale)
+{
+	__m256 k = _mm256_set1_ps(scale);
+	__m256i v;
+	size_t i = 0;
+	int j;
+
+	for (; n - i >= 32; i += 32) {
+		for (j = 0; j < 32; j += 8) {
+			v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + i + j)));
+			_mm256_storeu_ps(dst + i + j, _mm256_mul_ps(_mm256_cvtepi32_ps(v), k));
+		}
+	}
+
+	u8_to_f32_ssse3(src + i, dst + i, n - i, scale);
+}
+
+AVX2 static inline __m256i f32_to_i32_avx2(const float *src, __m256 k)
+{
+	__m256 v = _mm256_mul_ps(_mm256_loadu_ps(src), k);
+
+	v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()),
+			  _mm256_set1_ps(255.0f));
+	return _mm256_cvtps_epi32(v);
+}
+
+AVX2 static void f32_to_u8_avx2(const float *src, uint8_t *dst, size_t n,
+				float scale)
+{
+	/* the packs work per lane, this puts the 4-byte groups back in order */
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	__m256 k = _mm256_set1_ps(scale);
+	__m256i q0, q1, q2, q3, v;
+	size_t i = 0;
+
+	for (; n - i >= 32; i += 32) {
+		q0 = f32_to_i32_avx2(src + i, k);
+		q1 = f32_to_i32_avx2(src + i + 8, k);
+		q2 = f32_to_i32_avx2(src + i + 16, k);
+		q3 = f32_to_i32_avx2(src + i + 24, k);
+		v = _mm256_packus_epi16(_mm256_packs_epi32(q0, q1),
+					_mm256_packs_epi32(q2, q3));
+		STORE256(dst + i, _mm256_permutevar8x32_epi32(v, order));
+	}
+
+	f32_to_u8_ssse3(src + i, dst + i, n - i, scale);
+}
+
+const struct pixconv_ops pixconv_avx2_ops = {
+	.rgb24_bgr24 = rgb24_bgr24_avx2,
+	.rgba_bgra = rgba_bgra_avx2,
+	.rgb24_to_planar = rgb24_to_planar_avx2,
+	.planar_to_rgb24 = planar_to_rgb24_avx2,
+	.u8_to_f32 = u8_to_f32_avx2,
+	.f32_to_u8 = f32_to_u8_avx2,
+};
+
+#endif
@@ -54,7 +54,8 @@ struct buffer_head *start_buffer = (struct buffer_head *) &end;
 /* 缓冲区Hash表数组 */
 struct buffer_head *hash_table[NR_HASH];
 
-/* 空闲缓冲块链表头指针 */
+/* 空闲缓冲块链表头指针。链表中只有未被引用(b_count为0)的缓冲块，按释放的先后排成LRU顺序：
+ 表头是最久未用的块，表尾是最近释放的块。链表为空时为NULL。 */
 static struct buffer_head *free_list;
 
 /* 等待空闲缓冲块而睡眠的任务队列 */
@@ -81,6 +82,7 @@ static inline void wait_on_buffer(struct buffer_head * bh)
 {
 	cli();
 	while (bh->b_lock) {	/* 如果已被上锁则进程进入睡眠，等待其解锁 */
+		blk_unplug();		/* 它的请求可能还在被塞住的队列中，先让设备开始工作 */
 		sleep_on(&bh->b_wait);
 	}
 	sti();
@@ -226,19 +228,90 @@ void check_disk_change(int dev)
 // hash队列是双向链表结构，空闲缓冲块队列是双向循环链表结构。
 //
 // hash表的主要作用是减少查找比较元素所花费的时间。通过在元素的存储位置与关键字之间建立一个对应
-// 关系(hash函数)，我们就可以直接通过函数计算立刻查询到指定的元素。建立函数的方法有多种，这里，
-// Linux0.12主要采用了关键字除余数法。因为我们寻找的缓冲块有两个条件，即设备号dev和缓冲块号
-// block，因此设计的hash函数肯定需要包含这两个关键值。这里两个关键字的异或操作只是计算关键值的
-// 一种方法。再对关键值进行MOD运算就可以保证函数计算得到的值都处于函数数组项范围内。
-#define _hashfn(dev, block) (((unsigned)(dev ^ block)) % NR_HASH)
+// 关系(hash函数)，我们就可以直接通过函数计算立刻查询到指定的元素。因为我们寻找的缓冲块有两个条
+// 件，即设备号dev和缓冲块号block，因此设计的hash函数肯定需要包含这两个关键值。
+//
+// 原来的(dev ^ block) % 307中，dev的次设备号只影响低几位，相邻设备的块容易落到同一队列。这里把
+// dev放到高16位再与block异或，然后乘以黄金分割常数(乘法散列)，取乘积的高NR_HASH_BITS位作为下
+// 标，使关键值的每一位都能影响结果，并且不需要除法。
+#define _hashfn(dev, block) \
+	(((((unsigned)(dev) << 16) ^ (unsigned)(block)) * 0x9E3779B1U) >> (32 - NR_HASH_BITS))
 #define hash(dev, block) 	hash_table[_hashfn(dev, block)]
 
 /**
- * 从hash队列和空闲缓冲队列中移走缓冲块。
+ * 将缓冲块从LRU空闲链表中移除
  * @param[in]	bh		要移除的缓冲区头指针
  * @retval 		void
  */
-static inline void remove_from_queues(struct buffer_head * bh)
+static inline void lru_remove(struct buffer_head * bh)
+{
+	if (!(bh->b_prev_free) || !(bh->b_next_free)) {
+		panic("Free block list corrupted");
+	}
+	if (bh->b_next_free == bh) {		/* 链表中只有这一块 */
+		free_list = NULL;
+	} else {
+		bh->b_prev_free->b_next_free = bh->b_next_free;
+		bh->b_next_free->b_prev_free = bh->b_prev_free;
+		/* 如果空闲链表头指向本缓冲区，则让其指向下一缓冲区 */
+		if (free_list == bh) {
+			free_list = bh->b_next_free;
+		}
+	}
+	bh->b_prev_free = bh->b_next_free = NULL;
+}
+
+/**
+ * 将缓冲块放到LRU空闲链表尾部(最近使用端)
+ * @param[in]	bh		要插入的缓冲区头指针
+ * @retval 		void
+ */
+static inline void lru_add_tail(struct buffer_head * bh)
+{
+	if (!free_list) {
+		free_list = bh;
+		bh->b_next_free = bh->b_prev_free = bh;
+		return;
+	}
+	bh->b_next_free = free_list;
+	bh->b_prev_free = free_list->b_prev_free;
+	free_list->b_prev_free->b_next_free = bh;
+	free_list->b_prev_free = bh;
+}
+
+/**
+ * 增加缓冲块的引用。被引用的缓冲块不能被替换，因此离开LRU空闲链表。
+ * @param[in]	bh		缓冲区头指针
+ * @retval 		void
+ */
+static inline void get_buffer(struct buffer_head * bh)
+{
+	if (!bh->b_count++) {
+		lru_remove(bh);
+	}
+}
+
+/**
+ * 减少缓冲块的引用。最后一个引用释放后，缓冲块作为最近使用的块回到LRU空闲链表尾部。
+ * @param[in]	bh		缓冲区头指针
+ * @retval 		void
+ */
+static inline void put_buffer(struct buffer_head * bh)
+{
+	if (!(bh->b_count--)) {
+		panic("Trying to free free buffer");
+	}
+	if (!bh->b_count) {
+		lru_add_tail(bh);
+	}
+}
+
+/**
+ * 从hash队列中移走缓冲块。
+ * @param[in]	bh		要移除的缓冲区头指针
+ * @retval 		void
+ */
+static inline void remove_from_hash(struct buffer_head * bh)
 {
 	/* remove from hash-queue */
 	/* 从hash队列中移除缓冲块 */
@@ -252,32 +325,15 @@ static inline void remove_from_queues(struct buffer_head * bh)
 	if (hash(bh->b_dev,bh->b_blocknr) == bh) {
 		hash(bh->b_dev,bh->b_blocknr) = bh->b_next;
 	}
-	/* remove from free list */
-	/* 从空闲缓冲块表中移除缓冲块 */
-	if (!(bh->b_prev_free) || !(bh->b_next_free)) {
-		panic("Free block list corrupted");
-	}
-	bh->b_prev_free->b_next_free = bh->b_next_free;
-	bh->b_next_free->b_prev_free = bh->b_prev_free;
-	/* 如果空闲链表头指向本缓冲区，则让其指向下一缓冲区 */
-	if (free_list == bh) {
-		free_list = bh->b_next_free;
-	}
 }
 
 /**
- * 将缓冲块插入空闲链表尾部，同时放入hash队列中
+ * 将缓冲块放入hash队列中
  * @param[in]	bh		要插入的缓冲区头指针
  * @retval 		void
  */
-static inline void insert_into_queues(struct buffer_head * bh)
+static inline void insert_into_hash(struct buffer_head * bh)
 {
-	/* put at end of free list */
-	/* 放在空闲链表末尾处 */
-	bh->b_next_free = free_list;
-	bh->b_prev_free = free_list->b_prev_free;
-	free_list->b_prev_free->b_next_free = bh;
-	free_list->b_prev_free = bh;
 	/* put the buffer in new hash-queue if it has a device */
 	/* 如果该缓冲块对应一个设备,则将其插入新hash队列中 */
 	bh->b_prev = NULL;
@@ -338,12 +394,12 @@ struct buffer_head * get_hash_table(int dev, int block)
 		if (!(bh = find_buffer(dev, block))) {
 			return NULL;
 		}
-		bh->b_count ++;
+		get_buffer(bh);
 		wait_on_buffer(bh);
 		if (bh->b_dev == dev && bh->b_blocknr == block) {
 			return bh;
 		}
-		bh->b_count--;
+		put_buffer(bh);
 		#if 0
 		// Q: 上面为什么不是这样? 
 		// A: bh->b_count先自增，会告诉系统，这个块还要用，别释放。
@@ -390,20 +446,20 @@ repeat:
 	if ((bh = get_hash_table(dev, block))) {
 		return bh;
 	}
-	tmp = free_list;
-	do {
-		if (tmp->b_count) {
-			continue;
-		}
-		if (!bh || BADNESS(tmp) < BADNESS(bh)) {
-			bh = tmp;
-			if (!BADNESS(tmp)) {
-				break;
+	/* 空闲链表中都是未被引用的块，从最久未用的表头开始找，通常表头的块就是干净且未上锁的，
+	 不用再扫描整个缓冲区。只有表头附近都是脏块或正在读写的块时才继续向后找BADNESS最小的。 */
+	if ((tmp = free_list)) {
+		do {
+			if (!bh || BADNESS(tmp) < BADNESS(bh)) {
+				bh = tmp;
+				if (!BADNESS(tmp)) {
+					break;
+				}
 			}
-		}
-	/* and repeat until we find something good */
-	/* 重复操作直到找到适合的缓冲块 */
-	} while ((tmp = tmp->b_next_free) != free_list);
+		/* and repeat until we find something good */
+		/* 重复操作直到找到适合的缓冲块 */
+		} while ((tmp = tmp->b_next_free) != free_list);
+	}
 	if (!bh) {
 		sleep_on(&buffer_wait);
 		goto repeat;
@@ -434,11 +490,12 @@ repeat:
 	bh->b_dirt = 0;
 	bh->b_uptodate = 0;
 	/* 从hash队列和空闲块链表中移出该缓冲头，让该缓冲区用于指定块。然后根据此新设备号和块号重新
-	 插入空闲链表和hash队列新位置处，并最终返回缓冲头指针。*/
-	remove_from_queues(bh);
+	 插入hash队列新位置处，并最终返回缓冲头指针。该块被引用期间不在空闲链表中。*/
+	lru_remove(bh);
+	remove_from_hash(bh);
 	bh->b_dev = dev;
 	bh->b_blocknr = block;
-	insert_into_queues(bh);
+	insert_into_hash(bh);
 	return bh;
 }
 
@@ -454,12 +511,116 @@ void brelse(struct buffer_head * buf)
 		return;
 	}
 	wait_on_buffer(buf);
-	if (!(buf->b_count--)) {
-		panic("Trying to free free buffer");
-	}
+	put_buffer(buf);
 	wake_up(&buffer_wait);
 }
 
+/*
+ * 自适应顺序预读
+ * 记录最近几个顺序读流(设备号和期望的下一块号)。bread()读的块正好是某个流期望的下一块时，认为
+ * 是顺序读：若该块不在高速缓冲中，就把预读窗口加倍(最多RA_MAX_BLOCKS块)，并对后面窗口内的块发
+ * 出预读请求。之后流读到上一个预读窗口的中间时，不等缺块就接着预读紧随其后的下一个窗口，让读盘
+ * 和进程处理重叠。不连续的读取会开始一个新流，窗口从0开始，因此随机读不会产生预读。
+ */
+#define NR_RA_STREAMS	4		/* 同时跟踪的顺序读流个数 */
+#define RA_MIN_BLOCKS	2		/* 确认顺序读后的初始预读窗口 */
+#define RA_MAX_BLOCKS	16		/* 预读窗口上限(块) */
+
+static struct ra_stream {
+	int dev;
+	int next;				/* 期望读取的下一块号 */
+	int window;				/* 当前预读窗口(块)，0表示还未确认是顺序读 */
+	int ahead;				/* 已预读到的块号(不含) */
+	int trigger;			/* 读到该块时预读下一个窗口 */
+} ra_streams[NR_RA_STREAMS];
+
+static int ra_replace = 0;	/* 下一个被替换的流 */
+
+/**
+ * 记录一次读取并返回需要预读的块数
+ * @param[in]	dev		设备号
+ * @param[in]	block	块号
+ * @param[in]	miss	该块是否不在高速缓冲中
+ * @param[out]	start	第一个预读块号
+ * @retval		需要预读的块数(从*start开始)，0表示不预读
+ */
+static int ra_update(int dev, int block, int miss, int * start)
+{
+	struct ra_stream * ra;
+	int i;
+
+	for (i = 0; i < NR_RA_STREAMS; i++) {
+		ra = &ra_streams[i];
+		if (ra->dev != dev || ra->next != block) {
+			continue;
+		}
+		ra->next = block + 1;
+		if (ra->window && block < ra->ahead) {
+			/* 还在上一个窗口里(可能正在读入)，到中间才接着预读后面的窗口 */
+			if (block < ra->trigger) {
+				return 0;
+			}
+			*start = ra->ahead;
+		} else {
+			/* 预读的块已用完，命中说明数据本来就在高速缓冲中 */
+			if (!miss) {
+				return 0;
+			}
+			*start = block + 1;
+		}
+		if (!ra->window) {
+			ra->window = RA_MIN_BLOCKS;
+		} else if (ra->window < RA_MAX_BLOCKS) {
+			ra->window <<= 1;
+		}
+		ra->ahead = *start + ra->window;
+		ra->trigger = *start + ra->window / 2;
+		return ra->window;
+	}
+	/* 不是已知流的延续，替换一个流 */
+	ra = &ra_streams[ra_replace];
+	ra_replace = (ra_replace + 1) % NR_RA_STREAMS;
+	ra->dev = dev;
+	ra->next = block + 1;
+	ra->window = 0;
+	ra->ahead = 0;
+	return 0;
+}
+
+/**
+ * 对[block, block + nr)中不在高速缓冲中的块发出预读请求，不等待读完
+ * @param[in]	dev		设备号
+ * @param[in]	block	第一个预读块号
+ * @param[in]	nr		预读块数
+ * @retval		void
+ */
+static void read_ahead(int dev, int block, int nr)
+{
+	extern int * blk_size[];
+	struct buffer_head * tmp;
+	int size;
+
+	/* 不越过设备末端预读，否则驱动会对不存在的块报I/O错误 */
+	if (blk_size[MAJOR(dev)]) {
+		size = blk_size[MAJOR(dev)][MINOR(dev)];
+		if (block + nr > size) {
+			nr = size - block;
+		}
+	}
+	for (; nr > 0; nr--, block++) {
+		if ((tmp = find_buffer(dev, block)) && tmp->b_uptodate) {
+			continue;
+		}
+		if (!(tmp = getblk(dev, block))) {
+			continue;
+		}
+		if (!tmp->b_uptodate) {
+			ll_rw_block(READA, tmp);
+		}
+		put_buffer(tmp);
+	}
+}
+
 /*
  * bread() reads a specified block and returns the buffer that contains
  * it. It returns NULL if the block was unreadable.
@@ -477,14 +638,23 @@ void brelse(struct buffer_head * buf)
 struct buffer_head * bread(int dev, int block)
 {
 	struct buffer_head * bh;
+	int nr_ahead, ahead_start;
 
 	if (!(bh = getblk(dev, block))) {
 		panic("bread: getblk returned NULL\n");
 	}
+	nr_ahead = ra_update(dev, block, !bh->b_uptodate, &ahead_start);
 	if (bh->b_uptodate) {
+		if (nr_ahead) {
+			read_ahead(dev, ahead_start, nr_ahead);
+		}
 		return bh;
 	}
 	ll_rw_block(READ, bh);
+	/* 在等待本块读完之前发出预读请求，让它们和本块一起进入请求队列 */
+	if (nr_ahead) {
+		read_ahead(dev, ahead_start, nr_ahead);
+	}
 	wait_on_buffer(bh);
 	if (bh->b_uptodate) {
 		return bh;
@@ -587,7 +757,7 @@ struct buffer_head * breada(int dev, int first, ...)
 			if (!tmp->b_uptodate) {
 				ll_rw_block(READA, tmp); /* bug修复! 这里的 bh 改为 tmp */
 			}
-			tmp->b_count --; /* 暂时释放掉该预读块 */
+			put_buffer(tmp); /* 暂时释放掉该预读块，不等待其读完 */
 		}
 	}
 	va_end(args);
@@ -627,6 +797,7 @@ void buffer_init(long buffer_end)
 		h->b_wait = NULL;
 		h->b_next = NULL;
 		h->b_prev = NULL;
+		h->b_reqnext = NULL;
 		h->b_data = (char *) b;
 		/* 以下两句形成双向链表 */
 		h->b_prev_free = h - 1;
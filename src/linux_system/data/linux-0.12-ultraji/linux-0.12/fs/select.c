@@ -100,7 +100,7 @@ static void free_wait(select_table * p)
 	for (i = 0; i < p->nr ; i++) {
 		tpp = p->entry[i].wait_address;
 		while (*tpp && *tpp != current) {
-			(*tpp)->state = 0;
+			wake_up_process(*tpp);
 			current->state = TASK_UNINTERRUPTIBLE;
 			schedule();
 		}
@@ -108,7 +108,7 @@ static void free_wait(select_table * p)
 			printk("free_wait: NULL");
 		}
 		if ((*tpp = p->entry[i].old_task)) {
-			(**tpp).state = 0;
+			wake_up_process(*tpp);
 		}
 	}
 	p->nr = 0;
@@ -63,7 +63,8 @@ void buffer_init(long buffer_end);			/* 高速缓冲区初始化 */
 #define NR_INODE 		64					/* 系统同时最多使用i节点个数 */
 #define NR_FILE 		64					/* 系统最多文件个数(文件数组长度) */
 #define NR_SUPER 		8					/* 系统所含超级块个数(超级块数组长度) */
-#define NR_HASH 		307					/* 缓冲区Hash表数组长度 */
+#define NR_HASH_BITS 	10					/* 缓冲区Hash表数组长度的位数 */
+#define NR_HASH 		(1 << NR_HASH_BITS)	/* 缓冲区Hash表数组长度(2的幂) */
 #define NR_BUFFERS 		nr_buffers			/* 系统所含缓冲个数，初始化后不再改变 */
 #define BLOCK_SIZE 		1024				/* 数据块长度(字节值) */
 #define BLOCK_SIZE_BITS 10					/* 数据块长度所占比特位数 */
@@ -113,8 +114,9 @@ struct buffer_head {
 	/* 这四个指针用于缓冲区的管理 */
 	struct buffer_head * b_prev;		/* hash队列上的前一块 */
 	struct buffer_head * b_next;		/* hash队列上的后一块 */
-	struct buffer_head * b_prev_free;	/* 空闲表上的前一块 */
-	struct buffer_head * b_next_free;	/* 空闲表上的后一块 */
+	struct buffer_head * b_prev_free;	/* LRU空闲表上的前一块(更久未用) */
+	struct buffer_head * b_next_free;	/* LRU空闲表上的后一块(更近使用) */
+	struct buffer_head * b_reqnext;		/* 合并请求中的下一块 */
 };
 
 /* 磁盘上的索引节点(i节点)数据结构 */
@@ -277,6 +279,9 @@ extern void ll_rw_block(int rw, struct buffer_head * bh);
 /* 读/写数据页面 */
 extern void ll_rw_page(int rw, int dev, int nr, char * buffer);
 
+/* 启动被塞住(plug)的块设备请求队列 */
+extern void blk_unplug(void);
+
 /* 释放指定缓冲块 */
 extern void brelse(struct buffer_head * buf);
 
@@ -167,6 +167,14 @@ struct task_struct {
 	struct desc_struct ldt[3];		/* 局部描述符表, 0 - 空，1 - 代码段cs，2 - 数据和堆栈段ds&ss */
 /* tss for this task */
 	struct tss_struct tss;			/* 进程的任务状态段信息结构 */
+/* scheduler info, must stay behind tss: INIT_TASK leaves them zero */
+	int nr;							/* 任务号(在task[]中的下标)，switch_to()使用 */
+	int on_rq;						/* 是否挂在运行队列上 */
+	int rq_idx;						/* 所在运行队列的下标 */
+	unsigned long epoch;			/* 最近一次重算counter时的调度轮次 */
+	struct task_struct *rq_next, *rq_prev;		/* 运行队列链表 */
+	unsigned long timer_expires;				/* 任务定时器的到期时刻 */
+	struct task_struct *timer_next, **timer_pprev;	/* 定时轮链表，timer_pprev非空表示已挂入 */
 };
 
 /*
@@ -222,6 +230,10 @@ extern void add_timer(long jiffies, void (*fn)(void));
 extern void sleep_on(struct task_struct ** p);
 extern void interruptible_sleep_on(struct task_struct ** p);
 extern void wake_up(struct task_struct ** p);
+extern void wake_up_process(struct task_struct * p);
+extern void signal_wake_up(struct task_struct * p);
+extern void sched_fork(struct task_struct * p, int nr);
+extern void sched_release(struct task_struct * p);
 extern int in_group_p(gid_t grp);
 
 /*
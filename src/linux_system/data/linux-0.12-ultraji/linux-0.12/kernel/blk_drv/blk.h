@@ -20,15 +20,22 @@
  * paging, 'bh' is NULL, and 'waiting' is used to wait for
  * read/write completion.
  */
+/*
+ * Contiguous block requests are merged: bh..bhtail is the chain (linked
+ * through b_reqnext) of buffers still to transfer, nr_sectors counts all
+ * of them and current_nr_sectors only those left in the first one.
+ */
 struct request {
 	int dev;		/* -1 if no request */
 	int cmd;		/* READ or WRITE */
 	int errors;
 	unsigned long sector;
 	unsigned long nr_sectors;
+	unsigned long current_nr_sectors;
 	char * buffer;
 	struct task_struct * waiting;
 	struct buffer_head * bh;
+	struct buffer_head * bhtail;
 	struct request * next;
 };
 
@@ -42,9 +49,14 @@ struct request {
 ((s1)->dev < (s2)->dev || ((s1)->dev == (s2)->dev && \
 (s1)->sector < (s2)->sector))))
 
+/*
+ * A plugged device has requests queued but request_fn not yet called,
+ * so that a burst of requests can be merged before the first one starts.
+ */
 struct blk_dev_struct {
 	void (*request_fn)(void);
 	struct request * current_request;
+	int plugged;
 };
 
 extern struct blk_dev_struct blk_dev[NR_BLK_DEV];
@@ -52,6 +64,7 @@ extern struct request request[NR_REQUEST];
 extern struct task_struct * wait_for_request;
 
 extern int * blk_size[NR_BLK_DEV];
+extern int max_sectors[NR_BLK_DEV];
 
 #ifdef MAJOR_NR
 
@@ -115,18 +128,35 @@ static void unlock_buffer(struct buffer_head * bh)
 	wake_up(&bh->b_wait);
 }
 
+/*
+ * end_request() finishes the first buffer of CURRENT. If the request was
+ * merged and has more buffers, it moves on to the next one and CURRENT
+ * stays; on error the rest of the failed buffer is skipped.
+ */
 static void end_request(int uptodate)
 {
-	DEVICE_OFF(CURRENT->dev);
-	if (CURRENT->bh) {
-		CURRENT->bh->b_uptodate = uptodate;
-		unlock_buffer(CURRENT->bh);
-	}
+	struct buffer_head * bh;
+
 	if (!uptodate) {
 		printk(DEVICE_NAME " I/O error\n\r");
-		printk("dev %04x, block %d\n\r",CURRENT->dev,
-			CURRENT->bh->b_blocknr);
+		printk("dev %04x, sector %d\n\r",CURRENT->dev,
+			CURRENT->sector);
+		CURRENT->sector += CURRENT->current_nr_sectors;
+		CURRENT->nr_sectors -= CURRENT->current_nr_sectors;
+	}
+	if ((bh = CURRENT->bh)) {
+		CURRENT->bh = bh->b_reqnext;
+		bh->b_reqnext = NULL;
+		bh->b_uptodate = uptodate;
+		unlock_buffer(bh);
+		if ((bh = CURRENT->bh)) {
+			CURRENT->current_nr_sectors = BLOCK_SIZE >> 9;
+			CURRENT->buffer = bh->b_data;
+			CURRENT->errors = 0;
+			return;
+		}
 	}
+	DEVICE_OFF(CURRENT->dev);
 	wake_up(&CURRENT->waiting);
 	wake_up(&wait_for_request);
 	CURRENT->dev = -1;
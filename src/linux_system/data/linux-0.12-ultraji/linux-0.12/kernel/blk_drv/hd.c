@@ -33,6 +33,9 @@ inb_p(0x71); \
 /* Max read/write errors/sector */
 #define MAX_ERRORS	7
 #define MAX_HD		2
+/* Max sectors per merged request: the sector count register is 8 bits,
+ * keep it to whole blocks */
+#define HD_MAX_SECTORS	254
 
 static void recal_intr(void);
 static void bad_rw_intr(void);
@@ -283,6 +286,8 @@ static void read_intr(void)
 	CURRENT->buffer += 512;
 	CURRENT->sector++;
 	if (--CURRENT->nr_sectors) {
+		if (!--CURRENT->current_nr_sectors)
+			end_request(1);		/* next buffer of a merged request */
 		SET_INTR(&read_intr);
 		return;
 	}
@@ -300,6 +305,8 @@ static void write_intr(void)
 	if (--CURRENT->nr_sectors) {
 		CURRENT->sector++;
 		CURRENT->buffer += 512;
+		if (!--CURRENT->current_nr_sectors)
+			end_request(1);		/* next buffer of a merged request */
 		SET_INTR(&write_intr);
 		port_write(HD_DATA,CURRENT->buffer,256);
 		return;
@@ -337,7 +344,7 @@ void do_hd_request(void)
 	INIT_REQUEST;
 	dev = MINOR(CURRENT->dev);
 	block = CURRENT->sector;
-	if (dev >= 5*NR_HD || block+2 > hd[dev].nr_sects) {
+	if (dev >= 5*NR_HD || block+CURRENT->nr_sectors > hd[dev].nr_sects) {
 		end_request(0);
 		goto repeat;
 	}
@@ -378,6 +385,7 @@ void do_hd_request(void)
 void hd_init(void)
 {
 	blk_dev[MAJOR_NR].request_fn = DEVICE_REQUEST;
+	max_sectors[MAJOR_NR] = HD_MAX_SECTORS;
 	set_intr_gate(0x2E,&hd_interrupt);
 	outb_p(inb_p(0x21)&0xfb,0x21);
 	outb(inb_p(0xA1)&0xbf,0xA1);
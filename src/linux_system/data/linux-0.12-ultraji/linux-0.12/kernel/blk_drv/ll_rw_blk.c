@@ -69,6 +69,18 @@ struct blk_dev_struct blk_dev[NR_BLK_DEV] = {
 // 设备号确定的一个子设备上所拥有的数据总数(1块大小 = 1KB).
 int * blk_size[NR_BLK_DEV] = { NULL, NULL, };
 
+/*
+ * max_sectors[MAJOR] is the largest transfer the controller takes in
+ * one request. Requests to devices with a zero entry are not merged and
+ * their queue is never plugged.
+ */
+// 各主设备一次请求最多传输的扇区数,由驱动程序初始化时填入(硬盘见hd.c).为0的设备(软盘,虚拟盘的驱动每次只处理
+// 一个缓冲块)既不合并请求,也不塞住请求队列.
+int max_sectors[NR_BLK_DEV] = { 0, };
+
+// 是否已经设置了启动被塞住队列的定时器.
+static int plug_timer_pending = 0;
+
 // 锁定指定缓冲块
 //
 // 如果指定的缓冲块已经被其他任务锁定,则使自己睡眠(不可中断的等待),直到被执行解锁
@@ -78,6 +90,7 @@ static inline void lock_buffer(struct buffer_head * bh)
 {
 	cli();							/* 清中断许可 */
 	while (bh->b_lock){				/* 如果缓冲区已被锁定则睡眠，直到缓冲区解锁 */
+		blk_unplug();				/* 锁住它的请求可能还在被塞住的队列中 */
 		sleep_on(&bh->b_wait);
 	}
 	bh->b_lock = 1;					/* 立刻锁定缓冲区 */
@@ -95,6 +108,34 @@ static inline void unlock_buffer(struct buffer_head * bh)
 	wake_up(&bh->b_wait);			// 唤醒等待该缓冲区的任务.
 }
 
+// 启动所有被塞住的块设备请求队列.
+// 在等待缓冲块解锁之前(wait_on_buffer())调用,另外在塞住队列后1个滴答由定时器调用,保证被塞住的请求不会一直得不到处理.
+void blk_unplug(void)
+{
+	struct blk_dev_struct * dev;
+	unsigned long flags;
+
+	for (dev = blk_dev ; dev < blk_dev + NR_BLK_DEV ; dev++) {
+		save_flags(flags);
+		cli();
+		if (!dev->plugged) {
+			restore_flags(flags);
+			continue;
+		}
+		dev->plugged = 0;
+		restore_flags(flags);
+		if (dev->current_request)
+			(dev->request_fn)();
+	}
+}
+
+// 塞住队列的定时器到期处理函数.
+static void plug_timeout(void)
+{
+	plug_timer_pending = 0;
+	blk_unplug();
+}
+
 /*
  * add-request adds a request to the linked list.
  * It disables interrupts so that it can muck with the
@@ -126,6 +167,19 @@ static void add_request(struct blk_dev_struct * dev, struct request * req)
 	// 第1个请求项,也是唯一的一个.因此可将块设备当前请求指针直接指向该请求项,并立刻执行相应设备的请求函数.
 	if (!(tmp = dev->current_request)) {
 		dev->current_request = req;
+		// 对于可以合并的请求,先不启动设备而是塞住(plug)队列,让紧接着到来的相邻请求(如breada()和bread_page()一次
+		// 发出的多个请求)合并进来,直到有任务等待缓冲块或者1个滴答后再启动设备.
+		if (req->bh && max_sectors[MAJOR(req->dev)]) {
+			dev->plugged = 1;
+			if (plug_timer_pending) {
+				sti();
+				return;
+			}
+			plug_timer_pending = 1;
+			sti();
+			add_timer(1, plug_timeout);
+			return;
+		}
 		sti();							// 开中断.
 		(dev->request_fn)();			// 执行请求函数,对于硬盘是do_hd_request().
 		return;
@@ -150,6 +204,53 @@ static void add_request(struct blk_dev_struct * dev, struct request * req)
 	sti();
 }
 
+// 尝试把缓冲块合并到队列中已有的相邻请求里.
+// 在同一设备,同一命令的请求中寻找扇区紧接在其后(后向合并)或其前(前向合并)的一项,合并后的扇区数不能超过控制器
+// 的限制max_sectors[].设备正在处理的请求不能再改动;如果队列被塞住,则第一项也还没有开始,同样可以合并.
+// 合并后的请求不能越过设备末端(limit,以扇区计):驱动按整个请求检查范围,越界的请求连其中有效的块也会一起出错.
+// 返回1表示已经合并,0表示需要新的请求项.
+static int attempt_merge(struct blk_dev_struct * dev, int major, int rw, struct buffer_head * bh)
+{
+	struct request * req;
+	unsigned long sector = bh->b_blocknr << 1;
+	unsigned long limit = 0xffffffff;
+
+	if (blk_size[major])
+		limit = blk_size[major][MINOR(bh->b_dev)] << 1;
+
+	cli();
+	if (!(req = dev->current_request)) {
+		sti();
+		return 0;
+	}
+	if (!dev->plugged)
+		req = req->next;
+	for ( ; req ; req = req->next) {
+		if (req->dev != bh->b_dev || req->cmd != rw || !req->bh)
+			continue;
+		if (req->nr_sectors + 2 > max_sectors[major])
+			continue;
+		if (req->sector + req->nr_sectors == sector && sector + 2 <= limit) {
+			bh->b_reqnext = NULL;						// 后向合并:挂到缓冲块链表尾.
+			req->bhtail->b_reqnext = bh;
+			req->bhtail = bh;
+		} else if (req->sector == sector + 2 && req->sector + req->nr_sectors <= limit) {
+			bh->b_reqnext = req->bh;					// 前向合并:成为请求的第一块.
+			req->bh = bh;
+			req->buffer = bh->b_data;
+			req->current_nr_sectors = 2;
+			req->sector = sector;
+		} else
+			continue;
+		req->nr_sectors += 2;
+		bh->b_dirt = 0;
+		sti();
+		return 1;
+	}
+	sti();
+	return 0;
+}
+
 // 创建请求项并插入请求队列中.
 // 参数major是主设备号;rw是指定命令;bh是存放数据的缓冲区头指针.
 static void make_request(int major, int rw, struct buffer_head * bh)
@@ -180,6 +281,9 @@ static void make_request(int major, int rw, struct buffer_head * bh)
 		unlock_buffer(bh);
 		return;
 	}
+	// 能与队列中相邻的请求合并,就不再需要新的请求项.
+	if (max_sectors[major] && attempt_merge(major + blk_dev, major, rw, bh))
+		return;
 repeat:
 	/* we don't allow the write-requests to fill up the queue completely:
 	 * we want some room for reads: they take precedence. The last third
@@ -208,6 +312,7 @@ repeat:
 			unlock_buffer(bh);
 			return;
 		}
+		blk_unplug();									// 请求项可能都在被塞住的队列中.
 		sleep_on(&wait_for_request);					// 否则就睡眠,过会再查看请求队列.
 		goto repeat;
 	}
@@ -220,9 +325,12 @@ repeat:
 	req->errors = 0;									// 操作时产生的错误次数.
 	req->sector = bh->b_blocknr << 1;					// 起始扇区.块号转换成扇区号(1块=2扇区).
 	req->nr_sectors = 2;								// 本请求项需要读写的扇区数.
+	req->current_nr_sectors = 2;						// 第一个缓冲块中需要读写的扇区数.
 	req->buffer = bh->b_data;							// 请求项缓冲区指针指向需读写的数据缓冲区.
 	req->waiting = NULL;								// 任务等待操作执行完成的地方.
 	req->bh = bh;										// 缓冲块头指针.
+	req->bhtail = bh;									// 缓冲块链表尾,后向合并时使用.
+	bh->b_reqnext = NULL;
 	req->next = NULL;									// 指向下一请求项.
 	add_request(major + blk_dev, req);					// 将请求项加入队列中(blk_dev[major],reg).
 }
@@ -265,12 +373,15 @@ repeat:
 	req->errors = 0;									// 读写操作错误计数
 	req->sector = page << 3;							// 起始读写扇区
 	req->nr_sectors = 8;								// 读写扇区数
+	req->current_nr_sectors = 8;						// 整页在一个缓冲区中
 	req->buffer = buffer;								// 数据缓冲区
 	req->waiting = current;								// 当前进程进入该请求等待队列
 	req->bh = NULL;										// 无缓冲块头指针(不用高速缓冲)
+	req->bhtail = NULL;
 	req->next = NULL;									// 下一个请求项指针
 	current->state = TASK_UNINTERRUPTIBLE;				// 置为不可中断状态
 	add_request(major + blk_dev, req);					// 将请求项加入队列中.
+	blk_unplug();										// 队列可能被之前的请求塞住了.
 	// 当前进程需要读取8个扇区的数据因此需要睡眠，因此调用调度程序选择进程运行
 	schedule();
 }
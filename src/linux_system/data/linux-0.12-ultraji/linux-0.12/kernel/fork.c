@@ -199,7 +199,7 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
     }
     current->p_cptr = p;
 
-    p->state = TASK_RUNNING;	/* do this last, just in case */
+    sched_fork(p, nr);	/* do this last, just in case */
 
     return last_pid;
 }
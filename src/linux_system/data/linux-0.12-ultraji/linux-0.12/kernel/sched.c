@@ -61,6 +61,8 @@
 	}
 }
 
+static void show_sched_stats(void);
+
 /* 显示所有进程的进程信息 */
 void show_state(void)
 {
@@ -72,6 +74,7 @@ void show_state(void)
 			show_task(i, task[i]);
 		}
 	}
+	show_sched_stats();
 }
 
 /* PC机8253计数/定时芯片的输入时钟频率约为1.193180MHz。Linux内核希望定时器中断频率
@@ -139,6 +142,311 @@ void math_state_restore()
 	}
 }
 
+/*
+ * 运行队列：就绪任务按counter挂在NR_RUNQ个队列上(counter超出范围的挂在最高的队列)，
+ * runq_bitmap的第i位表示第i个队列非空。最高的非空队列的队首就是counter最大的就绪任务，
+ * schedule()用一条bsrl指令即可找到，不必再扫描整个task[]数组。
+ *
+ * 当前任务不在队列上：它的counter在时钟中断中递减，等schedule()把它切换出去时才按新的
+ * counter入队。离开TASK_RUNNING状态的任务也不立即出队，schedule()取到它时再丢弃，on_rq
+ * 保证同一任务不会重复入队。
+ *
+ * 就绪任务的counter全为0时，原来要给所有任务重算counter = counter/2 + priority。现在只重算
+ * 0号队列中的就绪任务，并把调度轮次sched_epoch加1；睡眠中的任务在被唤醒入队时再按错过的
+ * 轮次补算(update_counter)，结果与逐个重算相同。
+ */
+#define NR_RUNQ		32
+
+struct run_queue {
+	struct task_struct * head;
+	struct task_struct * tail;
+};
+
+static struct run_queue runq[NR_RUNQ];
+static unsigned long runq_bitmap = 0;
+static unsigned long sched_epoch = 0;
+
+/* 取最高的非空队列号，调用者保证runq_bitmap不为0 */
+static inline int runq_first(void)
+{
+	int idx;
+
+	__asm__("bsrl %1,%0":"=r" (idx):"rm" (runq_bitmap));
+	return idx;
+}
+
+/* 按counter把任务挂到对应队列的末尾，counter相同的任务轮流运行 */
+static inline void enqueue_task(struct task_struct * p)
+{
+	struct run_queue * q;
+	int idx = p->counter;
+
+	if (idx >= NR_RUNQ) {
+		idx = NR_RUNQ - 1;
+	}
+	q = runq + idx;
+	p->rq_idx = idx;
+	p->rq_next = NULL;
+	p->rq_prev = q->tail;
+	if (q->tail) {
+		q->tail->rq_next = p;
+	} else {
+		q->head = p;
+	}
+	q->tail = p;
+	runq_bitmap |= 1UL << idx;
+	p->on_rq = 1;
+}
+
+static inline void dequeue_task(struct task_struct * p)
+{
+	struct run_queue * q = runq + p->rq_idx;
+
+	if (p->rq_prev) {
+		p->rq_prev->rq_next = p->rq_next;
+	} else {
+		q->head = p->rq_next;
+	}
+	if (p->rq_next) {
+		p->rq_next->rq_prev = p->rq_prev;
+	} else {
+		q->tail = p->rq_prev;
+	}
+	if (!q->head) {
+		runq_bitmap &= ~(1UL << p->rq_idx);
+	}
+	p->on_rq = 0;
+}
+
+/* 补算任务在睡眠期间错过的各轮counter重算。counter很快收敛到2*priority附近，收敛后即可停止 */
+static inline void update_counter(struct task_struct * p)
+{
+	unsigned long n = sched_epoch - p->epoch;
+	long c;
+
+	while (n--) {
+		c = (p->counter >> 1) + p->priority;
+		if (c == p->counter) {
+			break;
+		}
+		p->counter = c;
+	}
+	p->epoch = sched_epoch;
+}
+
+/* 开始新一轮调度：0号队列中的就绪任务重新获得时间片，移到对应的队列上 */
+static void new_epoch(void)
+{
+	struct task_struct * p, * next;
+
+	sched_epoch++;
+	p = runq[0].head;
+	runq[0].head = runq[0].tail = NULL;
+	runq_bitmap &= ~1UL;
+	for ( ; p ; p = next) {
+		next = p->rq_next;
+		p->on_rq = 0;
+		if (p->state == TASK_RUNNING) {
+			update_counter(p);
+			enqueue_task(p);
+		}
+	}
+}
+
+/**
+ * 把任务置为就绪状态并放入运行队列
+ * 所有把其他任务置为TASK_RUNNING的地方都应调用本函数，否则该任务不会被schedule()选中。
+ * @param[in]	p		任务结构指针
+ * @retval		void
+ */
+void wake_up_process(struct task_struct * p)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	p->state = TASK_RUNNING;
+	if (!p->on_rq && p != current && p != &(init_task.task)) {
+		update_counter(p);
+		enqueue_task(p);
+	}
+	restore_flags(flags);
+}
+
+/**
+ * 任务收到信号后，如果它处于可中断睡眠状态并且信号未被屏蔽，则唤醒它
+ * 原来由schedule()每次扫描所有任务来完成，现在由发送信号的地方调用。
+ * @param[in]	p		任务结构指针
+ * @retval		void
+ */
+void signal_wake_up(struct task_struct * p)
+{
+	if (p->state == TASK_INTERRUPTIBLE &&
+		(p->signal & ~(_BLOCKABLE & p->blocked))) {
+		wake_up_process(p);
+	}
+}
+
+/*
+ * 任务定时轮：设置了timeout或alarm的任务按到期时刻挂在timer_wheel[expires % TIMER_WHEEL_SIZE]
+ * 上，时钟中断每个滴答只检查jiffies对应的一个槽，代替原来schedule()对所有任务的轮询。到期
+ * 时间超过一圈的任务每转一圈被多检查一次。调用者须关中断。
+ */
+#define TIMER_WHEEL_SIZE	256
+
+static struct task_struct * timer_wheel[TIMER_WHEEL_SIZE];
+
+static void task_timer_del(struct task_struct * p)
+{
+	if (!p->timer_pprev) {
+		return;
+	}
+	if ((*p->timer_pprev = p->timer_next)) {
+		p->timer_next->timer_pprev = p->timer_pprev;
+	}
+	p->timer_pprev = NULL;
+}
+
+/* 按timeout和alarm中较早到期的一个把任务重新挂入定时轮。timeout为0xffffffff表示不超时 */
+static void task_timer_update(struct task_struct * p)
+{
+	unsigned long expires = 0;
+	struct task_struct ** head;
+
+	task_timer_del(p);
+	/* timeout/alarm < jiffies 才算过期，所以到期时刻是它们加1 */
+	if (p->timeout && p->timeout != 0xffffffff) {
+		expires = p->timeout + 1;
+	}
+	if (p->alarm && (!expires || p->alarm + 1 < expires)) {
+		expires = p->alarm + 1;
+	}
+	if (!expires) {
+		return;
+	}
+	p->timer_expires = expires;
+	head = timer_wheel + (expires & (TIMER_WHEEL_SIZE - 1));
+	if ((p->timer_next = *head)) {
+		(*head)->timer_pprev = &p->timer_next;
+	}
+	*head = p;
+	p->timer_pprev = head;
+}
+
+/* 处理本滴答到期的任务定时器，在do_timer()中调用 */
+static void run_task_timers(void)
+{
+	struct task_struct ** pp = timer_wheel + (jiffies & (TIMER_WHEEL_SIZE - 1));
+	struct task_struct * p, * expired = NULL;
+
+	/* 先把到期的任务摘下来，处理时可能重新挂入同一个槽 */
+	while ((p = *pp)) {
+		if ((long) (jiffies - p->timer_expires) < 0) {
+			pp = &p->timer_next;
+			continue;
+		}
+		task_timer_del(p);
+		p->timer_next = expired;
+		expired = p;
+	}
+	while ((p = expired)) {
+		expired = p->timer_next;
+		/* 超时定时值timeout已经过期，则复位，并且如果任务处于可中断睡眠状态，将其置为就绪状态 */
+		if (p->timeout && p->timeout < jiffies) {
+			p->timeout = 0;
+			if (p->state == TASK_INTERRUPTIBLE) {
+				wake_up_process(p);
+			}
+		}
+		/* SIGALRM信号超时定时器值alarm已经过期，则向任务发送SIGALRM信号，然后清alarm */
+		if (p->alarm && p->alarm < jiffies) {
+			p->signal |= (1 << (SIGALRM - 1));
+			p->alarm = 0;
+		}
+		signal_wake_up(p);
+		task_timer_update(p);
+	}
+}
+
+/**
+ * 初始化新建任务的调度信息并让其就绪，在copy_process()的最后调用
+ * 任务结构是从父进程复制来的，其中的队列和定时器链接都属于父进程，必须清掉。
+ * @param[in]	p		新任务结构指针
+ * @param[in]	nr		新任务的任务号
+ * @retval		void
+ */
+void sched_fork(struct task_struct * p, int nr)
+{
+	p->nr = nr;
+	p->on_rq = 0;
+	p->rq_next = p->rq_prev = NULL;
+	p->timer_next = NULL;
+	p->timer_pprev = NULL;
+	p->epoch = sched_epoch;
+	wake_up_process(p);
+}
+
+/**
+ * 任务结构释放前，把它从运行队列和定时轮上摘下
+ * @param[in]	p		任务结构指针
+ * @retval		void
+ */
+void sched_release(struct task_struct * p)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (p->on_rq) {
+		dequeue_task(p);
+	}
+	task_timer_del(p);
+	restore_flags(flags);
+}
+
+/*
+ * 调度统计：schedule()的调用次数和真正切换任务的次数，以及两个TSC周期数：schedule()选出下一个
+ * 任务的耗时，和从switch_to()发起到被换入的任务在schedule()里恢复运行的上下文切换耗时。周期
+ * 数取滑动平均(新样本权重1/16)，不需要64位除法。CPU没有TSC(386/486)时只统计次数。
+ * 按Scroll Lock键由show_state()打印，例如在两个进程用管道互相收发时观察切换耗时。
+ */
+static int has_tsc = 0;
+static unsigned long nr_schedule = 0, nr_switch = 0;
+static unsigned long pick_cycles = 0, switch_cycles = 0;
+static unsigned long switch_start = 0;	/* 发起切换时的TSC，0表示没有待统计的切换 */
+
+/* TSC的低32位，只用来求短时间间隔 */
+#define rdtsc_low() ({ \
+unsigned long __lo, __hi; \
+__asm__ __volatile__ ("rdtsc":"=a" (__lo),"=d" (__hi)); \
+__lo; })
+
+#define SCHED_AVG(avg, x) ((avg) += ((long) (x) - (long) (avg)) / 16)
+
+/* 能翻转EFLAGS的ID位才有cpuid指令，再看cpuid(1)的EDX第4位 */
+static int cpu_has_tsc(void)
+{
+	unsigned long f1, f2, a, d;
+
+	__asm__("pushfl ; popl %0 ; movl %0,%1 ; xorl $0x200000,%0\n\t"
+		"pushl %0 ; popfl ; pushfl ; popl %0 ; pushl %1 ; popfl"
+		:"=&r" (f1),"=&r" (f2));
+	if (!((f1 ^ f2) & 0x200000)) {
+		return 0;
+	}
+	__asm__("cpuid":"=a" (a),"=d" (d):"0" (1):"bx","cx");
+	return (d >> 4) & 1;
+}
+
+static void show_sched_stats(void)
+{
+	printk("schedule: %u calls, %u switches", nr_schedule, nr_switch);
+	if (has_tsc) {
+		printk(", pick %u cycles, switch %u cycles", pick_cycles, switch_cycles);
+	}
+	printk("\n\r");
+}
+
 /*
  *  'schedule()' is the scheduler function. This is GOOD CODE! There
  * probably won't be any reason to change this, as it should work well
@@ -160,66 +468,79 @@ void math_state_restore()
  */
 void schedule(void)
 {
-	int i, next, c;
-	struct task_struct ** p;
+	struct task_struct * p;
+	unsigned long flags;
+	unsigned long start = 0;
+
+	save_flags(flags);
+	cli();
+	nr_schedule++;
+	/* 上一次切换没有换入到schedule()里(如新fork的任务从系统调用返回处开始运行)，作废 */
+	switch_start = 0;
+	if (has_tsc) {
+		start = rdtsc_low();
+	}
 
 /* check alarm, wake up any interruptible tasks that have got a signal */
-/* 检测alarm（进程的报警定时值），唤醒任何已得到信号的可中断任务 */
-
-	for(p = &LAST_TASK ; p > &FIRST_TASK ; --p)
-		if (*p) {
-			/* 如果设置过任务超时定时值timeout，并且已经超时，则复位超时定时值，并且如果任
-			 务处于可中断睡眠状态TASK_INTERRUPTIBLE下，将其置为就绪状态（TASK_RUNNING） */
-			if ((*p)->timeout && (*p)->timeout < jiffies) {
-				(*p)->timeout = 0;
-				if ((*p)->state == TASK_INTERRUPTIBLE) {
-					(*p)->state = TASK_RUNNING;
-				}
-			}
-			/* 如果设置过任务的SIGALRM信号超时定时器值alarm，并且已经过期(alarm<jiffies)，
-			 则在信号位图中置SIGALRM信号，即向任务发送SIGALRM信号。然后清alarm。该信号的默
-			 认操作是终止进程 */
-			if ((*p)->alarm && (*p)->alarm < jiffies) {
-				(*p)->signal |= (1 << (SIGALRM - 1));
-				(*p)->alarm = 0;
-			}
-			/* '~(_BLOCKABLE & (*p)->blocked)'用于忽略被阻塞的信号，除被阻塞的信号外还有其
-			 他信号，并且任务处于可中断状态，则置任务为就绪状态 */
-			if (((*p)->signal & ~(_BLOCKABLE & (*p)->blocked)) &&
-			(*p)->state == TASK_INTERRUPTIBLE) {
-				(*p)->state = TASK_RUNNING;
-			}
+/* 其他任务的timeout和alarm由时钟中断中的定时轮处理，这里只需检查即将睡眠的当前任务：如果它已
+ 有未屏蔽的信号或者timeout已经过期，则不再睡眠；否则按timeout把它挂入定时轮 */
+
+	if (current->state == TASK_INTERRUPTIBLE) {
+		if (current->timeout && current->timeout < jiffies) {
+			current->timeout = 0;
+			current->state = TASK_RUNNING;
+		} else if (current->signal & ~(_BLOCKABLE & current->blocked)) {
+			current->state = TASK_RUNNING;
+		} else if (current->timeout) {
+			task_timer_update(current);
 		}
+	}
 
 /* this is the scheduler proper: */
 /* 这里是调度程序的主要部分 */
 
+	/* 仍然就绪的当前任务按剩余的时间片重新入队，与其他就绪任务一起参与选择 */
+	if (current->state == TASK_RUNNING && current != &(init_task.task) &&
+		!current->on_rq) {
+		update_counter(current);
+		enqueue_task(current);
+	}
 	while (1) {
-		c = -1;
-		next = 0;
-		i = NR_TASKS;
-		p = &task[NR_TASKS];
-		/* 找到就绪状态下时间片最大的任务，用next指向该任务 */
-		while (--i) {
-			if (!*--p) {
-				continue;
-			}
-			if ((*p)->state == TASK_RUNNING && (*p)->counter > c) {
-				c = (*p)->counter, next = i;
-			}
+		/* 没有可以运行的任务，切去任务0 */
+		if (!runq_bitmap) {
+			p = &(init_task.task);
+			break;
+		}
+		/* 最高的非空队列的队首就是时间片最大的任务 */
+		p = runq[runq_first()].head;
+		dequeue_task(p);
+		/* 已经离开就绪状态的任务在这里才出队 */
+		if (p->state != TASK_RUNNING) {
+			continue;
 		}
-		/* c = -1，没有可以运行的任务（此时next=0，会切去任务0）；c > 0，找到了可以切换的任务 */
-		if (c) {
+		if (p->counter > 0) {
 			break;
 		}
-		/* 除任务0以外，存在处于就绪状态但时间片都为0的任务，则更新counter值，然后重新寻找 */
-		for(p = &LAST_TASK ; p > &FIRST_TASK ; --p) {
-			if (*p) {
-				(*p)->counter = ((*p)->counter >> 1) + (*p)->priority;
-			}
+		/* 存在处于就绪状态但时间片都为0的任务，则开始新一轮调度，然后重新寻找 */
+		enqueue_task(p);
+		new_epoch();
+	}
+	if (has_tsc) {
+		SCHED_AVG(pick_cycles, rdtsc_low() - start);
+	}
+	if (p != current) {
+		nr_switch++;
+		if (has_tsc) {
+			switch_start = rdtsc_low();
 		}
 	}
-	switch_to(next);
+	switch_to(p->nr);
+	/* 这里已经是被换入的任务 */
+	if (switch_start) {
+		SCHED_AVG(switch_cycles, rdtsc_low() - switch_start);
+		switch_start = 0;
+	}
+	restore_flags(flags);
 }
 
 /**
@@ -257,7 +578,7 @@ static inline void __sleep_on(struct task_struct **p, int state)
 	current->state = state;
 repeat:	schedule();
 	if (*p && *p != current) {
-		(**p).state = TASK_RUNNING;
+		wake_up_process(*p);
 		current->state = TASK_UNINTERRUPTIBLE;
 		goto repeat;
 	}
@@ -265,7 +586,7 @@ repeat:	schedule();
 		printk("Warning: *P = NULL\n\r");
 	}
 	if ((*p = tmp)) {
-		tmp->state = 0;
+		wake_up_process(tmp);
 	}
 }
 
@@ -293,7 +614,7 @@ void wake_up(struct task_struct **p)
 		if ((**p).state == TASK_ZOMBIE) {
 			printk("wake_up: TASK_ZOMBIE");
 		}
-		(**p).state = TASK_RUNNING;
+		wake_up_process(*p);
 	}
 }
 
@@ -467,6 +788,7 @@ void do_timer(long cpl)
 	if (current_DOR & 0xf0) {
 		do_floppy_timer();
 	}
+	run_task_timers();
 	if ((--current->counter)>0) {
 		return;
 	}
@@ -487,11 +809,16 @@ void do_timer(long cpl)
 int sys_alarm(long seconds)
 {
 	int old = current->alarm;
+	unsigned long flags;
 
 	if (old) {
 		old = (old - jiffies) / HZ;
 	}
 	current->alarm = (seconds > 0) ? (jiffies + HZ * seconds) : 0;
+	save_flags(flags);
+	cli();
+	task_timer_update(current);
+	restore_flags(flags);
 	return (old);
 }
 
@@ -576,4 +903,5 @@ void sched_init(void)
 
 	/* 设置系统调用的系统陷阱 */
 	set_system_gate(0x80,&system_call);
+	has_tsc = cpu_has_tsc();
 }
@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>//for inet_ntoa
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <unistd.h>//for close
+#include <string.h>
+#include <pthread.h>
+#include <atomic>
+
+/*
+ * TPACKET_V3ڴӳ价λץں˰Ѱ(block)дû̬Ļ
+ * û̬ԿΪλpollʹͷֱڻϽÿһrecvfrom
+ * ÷: ./rcver [] [߳] [-v]
+ * ߳ʱÿ߳һͨPACKET_FANOUTϣ̡̯߳
+ */
+
+typedef struct _IP_HEADER             //IPͷ壬20ֽ
+{
+    char m_cVersionAndHeaderLen;     //汾Ϣ(ǰ4λ)ͷ(4λ)
+    char m_cTypeOfService;         // 8λ
+    short m_sTotalLenOfPacket;    //ݰ
+    short m_sPacketID;      //ݰʶ
+    short m_sSliceinfo;     //Ƭʹ
+    char m_cTTL;       //ʱ
+    char m_cTypeOfProtocol;    //Э
+    short m_sCheckSum;      //У
+    unsigned int m_uiSourIp;     //ԴIPַ
+    unsigned int m_uiDestIp;    //ĿIPַ
+} IP_HEADER, *PIP_HEADER;
+
+typedef struct _UDP_HEADER         // UDPͷ壬8ֽ
+{
+    unsigned short m_usSourPort;    // Դ˿ں16bit
+    unsigned short m_usDestPort;     // ĿĶ˿ں16bit
+    unsigned short m_usLength;     // ݰ16bit
+    unsigned short m_usCheckSum;   // У16bit
+} UDP_HEADER, *PUDP_HEADER;
+
+#define BLOCK_SIZE (1 << 22)    //ÿ4MB
+#define BLOCK_NR 64             //64飬ÿ256MB
+#define FRAME_SIZE 2048
+#define BLOCK_TOV 60            //δдʱ60msû̬
+#define MAX_THREADS 64
+
+struct ring {
+    int fd;
+    uint8_t *map;
+    size_t maplen;
+    struct tpacket_req3 req;
+    pthread_t tid;
+    //ͳƣץ߳д̶߳
+    std::atomic<unsigned long long> pkts;
+    std::atomic<unsigned long long> bytes;
+    std::atomic<unsigned long long> udps;
+};
+
+static struct ring rings[MAX_THREADS];
+static int nthreads = 1;
+static int verbose = 0;
+static volatile sig_atomic_t running = 1;
+
+static void on_signal(int)
+{
+    running = 0;
+}
+
+//һTPACKET_V3󶨵fanoutΪ0ʱfanout
+static int ring_open(struct ring *r, int ifindex, int fanout)
+{
+    r->fd = socket(PF_PACKET, SOCK_RAW, htons(ETH_P_IP));
+    if (r->fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    int v = TPACKET_V3;
+    if (setsockopt(r->fd, SOL_PACKET, PACKET_VERSION, &v, sizeof(v)) < 0) {
+        perror("setsockopt PACKET_VERSION");
+        return -1;
+    }
+
+    memset(&r->req, 0, sizeof(r->req));
+    r->req.tp_block_size = BLOCK_SIZE;
+    r->req.tp_block_nr = BLOCK_NR;
+    r->req.tp_frame_size = FRAME_SIZE;
+    r->req.tp_frame_nr = (BLOCK_SIZE / FRAME_SIZE) * BLOCK_NR;
+    r->req.tp_retire_blk_tov = BLOCK_TOV;
+    r->req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    if (setsockopt(r->fd, SOL_PACKET, PACKET_RX_RING, &r->req, sizeof(r->req)) < 0) {
+        perror("setsockopt PACKET_RX_RING");
+        return -1;
+    }
+
+    r->maplen = (size_t)r->req.tp_block_size * r->req.tp_block_nr;
+    r->map = (uint8_t*)mmap(NULL, r->maplen, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_LOCKED | MAP_POPULATE, r->fd, 0);
+    if (r->map == MAP_FAILED) {
+        //ûڴȨʱȥMAP_LOCKED
+        r->map = (uint8_t*)mmap(NULL, r->maplen, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, r->fd, 0);
+        if (r->map == MAP_FAILED) {
+            perror("mmap");
+            return -1;
+        }
+    }
+
+    struct sockaddr_ll ll;
+    memset(&ll, 0, sizeof(ll));
+    ll.sll_family = PF_PACKET;
+    ll.sll_protocol = htons(ETH_P_IP);
+    ll.sll_ifindex = ifindex;
+    if (bind(r->fd, (struct sockaddr*)&ll, sizeof(ll)) < 0) {
+        perror("bind");
+        return -1;
+    }
+
+    //fanoutҪbind֮ãͬһsocketϣְ
+    if (fanout) {
+        int arg = (fanout & 0xffff) | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+        if (setsockopt(r->fd, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0) {
+            perror("setsockopt PACKET_FANOUT");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void ring_close(struct ring *r)
+{
+    if (r->map && r->map != MAP_FAILED)
+        munmap(r->map, r->maplen);
+    if (r->fd >= 0)
+        close(r->fd);
+}
+
+//ڻֱӽһ
+static void handle_packet(struct ring *r, struct tpacket3_hdr *ppd)
+{
+    struct sockaddr_ll *sll = (struct sockaddr_ll*)((uint8_t*)ppd + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+    //İҲύץsocketֻͳյİ
+    if (sll->sll_pkttype == PACKET_OUTGOING)
+        return;
+
+    r->pkts.fetch_add(1, std::memory_order_relaxed);
+    r->bytes.fetch_add(ppd->tp_len, std::memory_order_relaxed);
+
+    //SOCK_RAW̫ͷʼtp_mac֡ڵƫ
+    unsigned char *ethhead = (unsigned char*)ppd + ppd->tp_mac;
+    unsigned char *iphead = ethhead + 14; /* Skip Ethernet header */
+    if (ppd->tp_snaplen < 14 + 20 || (*iphead >> 4) != 4)
+        return;
+    PIP_HEADER iph = (PIP_HEADER)iphead;
+    int ihl = (*iphead & 0x0f) * 4;
+    if (iph->m_cTypeOfProtocol != IPPROTO_UDP || ppd->tp_snaplen < (unsigned)(14 + ihl + 8))
+        return;
+    PUDP_HEADER udph = (PUDP_HEADER)(iphead + ihl);
+    r->udps.fetch_add(1, std::memory_order_relaxed);
+
+    if (verbose) {
+        struct in_addr ias, iad;
+        ias.s_addr = iph->m_uiSourIp;
+        iad.s_addr = iph->m_uiDestIp;
+        char dip[INET_ADDRSTRLEN], sip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &ias, sip, sizeof(sip));
+        inet_ntop(AF_INET, &iad, dip, sizeof(dip));
+        printf("(sIp=%s,sPort=%d), (dIp=%s,dPort=%d) len=%d\n",
+               sip, ntohs(udph->m_usSourPort), dip, ntohs(udph->m_usDestPort),
+               ntohs(udph->m_usLength));
+    }
+}
+
+//ץ̣߳ȴ齻û̬󻹸ں
+static void *capture(void *arg)
+{
+    struct ring *r = (struct ring*)arg;
+    struct pollfd pfd;
+    pfd.fd = r->fd;
+    pfd.events = POLLIN | POLLERR;
+    pfd.revents = 0;
+    unsigned int cur = 0;
+
+    while (running) {
+        struct tpacket_block_desc *bd = (struct tpacket_block_desc*)(r->map + (size_t)cur * r->req.tp_block_size);
+        if ((__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+            poll(&pfd, 1, 200);
+            continue;
+        }
+
+        uint32_t num = bd->hdr.bh1.num_pkts;
+        struct tpacket3_hdr *ppd = (struct tpacket3_hdr*)((uint8_t*)bd + bd->hdr.bh1.offset_to_first_pkt);
+        for (uint32_t i = 0; i < num; i++) {
+            handle_packet(r, ppd);
+            ppd = (struct tpacket3_hdr*)((uint8_t*)ppd + ppd->tp_next_offset);
+        }
+
+        __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        cur = (cur + 1) % r->req.tp_block_nr;
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    const char *ifname = "lo";
+    for (int i = 1, pos = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0)
+            verbose = 1;
+        else if (pos++ == 0)
+            ifname = argv[i];
+        else
+            nthreads = atoi(argv[i]);
+    }
+    if (nthreads < 1 || nthreads > MAX_THREADS) {
+        printf("thread count must be 1..%d\n", MAX_THREADS);
+        return -1;
+    }
+
+    int ifindex = if_nametoindex(ifname);
+    if (ifindex == 0) {
+        perror("if_nametoindex");
+        return -1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    int fanout = nthreads > 1 ? (getpid() & 0xffff) : 0;
+    for (int i = 0; i < nthreads; i++) {
+        rings[i].fd = -1;
+        if (ring_open(&rings[i], ifindex, fanout) < 0)
+            return -1;
+    }
+    for (int i = 0; i < nthreads; i++)
+        pthread_create(&rings[i].tid, NULL, capture, &rings[i]);
+    printf("capture on %s, %d thread(s), ring %dMB each\n", ifname, nthreads, BLOCK_SIZE / (1 << 20) * BLOCK_NR);
+
+    //ÿһհʺͶPACKET_STATISTICSȡں˼
+    unsigned long long last_pkts = 0, last_bytes = 0, last_udps = 0, total_drops = 0;
+    while (running) {
+        sleep(1);
+        unsigned long long pkts = 0, bytes = 0, udps = 0, drops = 0, freezes = 0;
+        for (int i = 0; i < nthreads; i++) {
+            pkts += rings[i].pkts.load(std::memory_order_relaxed);
+            bytes += rings[i].bytes.load(std::memory_order_relaxed);
+            udps += rings[i].udps.load(std::memory_order_relaxed);
+            struct tpacket_stats_v3 st;
+            socklen_t len = sizeof(st);
+            if (getsockopt(rings[i].fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0) {
+                drops += st.tp_drops;
+                freezes += st.tp_freeze_q_cnt;
+            }
+        }
+        total_drops += drops;
+        printf("%llu pkts/s, %.1f Mbit/s, udp %llu/s, drops %llu (total %llu), queue freezes %llu\n",
+               pkts - last_pkts, (bytes - last_bytes) * 8 / 1e6, udps - last_udps, drops, total_drops, freezes);
+        fflush(stdout);
+        last_pkts = pkts;
+        last_bytes = bytes;
+        last_udps = udps;
+    }
+
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(rings[i].tid, NULL);
+    for (int i = 0; i < nthreads; i++)
+        ring_close(&rings[i]);
+    return 0;
+}
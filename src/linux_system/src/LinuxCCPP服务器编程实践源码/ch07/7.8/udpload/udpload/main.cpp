@@ -0,0 +1,235 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <atomic>
+
+/*
+ * udpserverѹÿ߳һ׽֣sendmmsgʹʱݱ
+ * recvmmsgջظʱӳ١ÿ߳windowδظİ
+ * ظʧʱʱ·ſڡ
+ * ÷: ./udpload [IP] [˿] [߳] [] [С] [window]
+ */
+
+#define BATCH 64
+#define MAX_THREADS 256
+#define MAX_SIZE 1472
+#define HIST_US 100000      //ӳֱͼ1usһ100ms
+
+struct stamp {
+    uint64_t ns;
+    uint64_t seq;
+};
+
+struct loader {
+    int id;
+    int fd;
+    pthread_t tid;
+    std::atomic<unsigned long long> sent;
+    std::atomic<unsigned long long> recvd;
+    unsigned long long *hist;   //ӳֱͼ߳̽
+};
+
+static struct loader loaders[MAX_THREADS];
+static struct sockaddr_in saddr;
+static int nthreads = 1;
+static int seconds = 10;
+static int psize = 64;
+static int window = 4096;
+static volatile int running = 1;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *load(void *arg)
+{
+    struct loader *l = (struct loader*)arg;
+    char sbufs[BATCH][MAX_SIZE], rbufs[BATCH][MAX_SIZE];
+    struct mmsghdr smsgs[BATCH], rmsgs[BATCH];
+    struct iovec siovs[BATCH], riovs[BATCH];
+    memset(sbufs, 'x', sizeof(sbufs));
+    memset(smsgs, 0, sizeof(smsgs));
+    memset(rmsgs, 0, sizeof(rmsgs));
+    for (int i = 0; i < BATCH; i++)
+    {
+        siovs[i].iov_base = sbufs[i];
+        siovs[i].iov_len = psize;
+        smsgs[i].msg_hdr.msg_iov = &siovs[i];
+        smsgs[i].msg_hdr.msg_iovlen = 1;
+        riovs[i].iov_base = rbufs[i];
+        riovs[i].iov_len = MAX_SIZE;
+        rmsgs[i].msg_hdr.msg_iov = &riovs[i];
+        rmsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    uint64_t seq = 0;
+    long outstanding = 0;
+    uint64_t last_reply = now_ns();
+    while (running)
+    {
+        //δʱһ
+        int n = window - outstanding;
+        if (n > BATCH)
+            n = BATCH;
+        if (n > 0)
+        {
+            uint64_t t = now_ns();
+            for (int i = 0; i < n; i++)
+            {
+                struct stamp *s = (struct stamp*)sbufs[i];
+                s->ns = t;
+                s->seq = seq++;
+            }
+            int re = sendmmsg(l->fd, smsgs, n, MSG_DONTWAIT);
+            if (re > 0)
+            {
+                outstanding += re;
+                l->sent.fetch_add(re, std::memory_order_relaxed);
+            }
+        }
+
+        //ջظʱȴ
+        int re = recvmmsg(l->fd, rmsgs, BATCH, outstanding >= window ? MSG_WAITFORONE : MSG_DONTWAIT, NULL);
+        uint64_t t = now_ns();
+        if (re > 0)
+        {
+            for (int i = 0; i < re; i++)
+            {
+                if (rmsgs[i].msg_len < sizeof(struct stamp))
+                    continue;
+                uint64_t us = (t - ((struct stamp*)rbufs[i])->ns) / 1000;
+                l->hist[us < HIST_US ? us : HIST_US]++;
+            }
+            outstanding -= re;
+            if (outstanding < 0)
+                outstanding = 0;
+            last_reply = t;
+            l->recvd.fetch_add(re, std::memory_order_relaxed);
+        }
+        else if (t - last_reply > 100000000ULL)
+        {
+            //100msûлظΪδظİѶʧ
+            outstanding = 0;
+            last_reply = t;
+        }
+    }
+    return NULL;
+}
+
+static unsigned long long percentile(unsigned long long *hist, unsigned long long total, double p)
+{
+    unsigned long long want = (unsigned long long)(total * p), sum = 0;
+    for (int i = 0; i <= HIST_US; i++)
+    {
+        sum += hist[i];
+        if (sum > want)
+            return i;
+    }
+    return HIST_US;
+}
+
+int main(int argc, char **argv)
+{
+    const char *ip = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : 8888;
+    if (argc > 3) nthreads = atoi(argv[3]);
+    if (argc > 4) seconds = atoi(argv[4]);
+    if (argc > 5) psize = atoi(argv[5]);
+    if (argc > 6) window = atoi(argv[6]);
+    if (nthreads < 1 || nthreads > MAX_THREADS || psize < (int)sizeof(struct stamp) || psize > MAX_SIZE || window < 1)
+    {
+        puts("usage: udpload [ip] [port] [threads 1..256] [seconds] [size 16..1472] [window]");
+        return -1;
+    }
+
+    memset(&saddr, 0, sizeof(saddr));
+    saddr.sin_family = AF_INET;
+    saddr.sin_port = htons(port);
+    saddr.sin_addr.s_addr = inet_addr(ip);
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        struct loader *l = &loaders[i];
+        l->id = i;
+        l->fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (l->fd < 0)
+        {
+            perror("socket failed");
+            return -1;
+        }
+        //ÿ߳һԴ˿ڣ˵SO_REUSEPORTݴ˷ֵͬ׽
+        if (connect(l->fd, (struct sockaddr*)&saddr, sizeof(saddr)) < 0)
+        {
+            perror("connect failed");
+            return -1;
+        }
+        int bufsize = 8 << 20;
+        setsockopt(l->fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+        setsockopt(l->fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+        struct timeval tv = {0, 100000};
+        setsockopt(l->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        l->hist = (unsigned long long*)calloc(HIST_US + 1, sizeof(unsigned long long));
+    }
+    for (int i = 0; i < nthreads; i++)
+        pthread_create(&loaders[i].tid, NULL, load, &loaders[i]);
+
+    unsigned long long last_sent = 0, last_recvd = 0;
+    for (int s = 0; s < seconds; s++)
+    {
+        sleep(1);
+        unsigned long long sent = 0, recvd = 0;
+        for (int i = 0; i < nthreads; i++)
+        {
+            sent += loaders[i].sent.load(std::memory_order_relaxed);
+            recvd += loaders[i].recvd.load(std::memory_order_relaxed);
+        }
+        printf("sent %llu pkts/s, recv %llu pkts/s\n", sent - last_sent, recvd - last_recvd);
+        fflush(stdout);
+        last_sent = sent;
+        last_recvd = recvd;
+    }
+    running = 0;
+
+    unsigned long long *hist = (unsigned long long*)calloc(HIST_US + 1, sizeof(unsigned long long));
+    unsigned long long total = 0, sent = 0;
+    for (int i = 0; i < nthreads; i++)
+    {
+        pthread_join(loaders[i].tid, NULL);
+        close(loaders[i].fd);
+        sent += loaders[i].sent;
+        for (int j = 0; j <= HIST_US; j++)
+        {
+            hist[j] += loaders[i].hist[j];
+            total += loaders[i].hist[j];
+        }
+        free(loaders[i].hist);
+    }
+    if (total == 0)
+    {
+        puts("no reply received");
+        return -1;
+    }
+    printf("total sent %llu, recv %llu, loss %.2f%%, avg %.0f pkts/s\n", sent, total,
+           sent ? 100.0 * (sent - total) / sent : 0.0, (double)total / seconds);
+    int maxus = HIST_US;
+    while (maxus > 0 && hist[maxus] == 0)
+        maxus--;
+    printf("latency us: p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %d%s\n",
+           percentile(hist, total, 0.5), percentile(hist, total, 0.9),
+           percentile(hist, total, 0.99), percentile(hist, total, 0.999),
+           maxus, maxus == HIST_US ? "+" : "");
+    free(hist);
+    return 0;
+}
@@ -0,0 +1,263 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+
+/*
+ * UDPǼܣÿCPUһ̣߳ÿ߳һSO_REUSEPORT׽֣
+ * ں˰Ԫݱֵ׽֡recvmmsg/sendmmsgÿշһ
+ * շʱһηáͬ7.1յݻظͻˡ
+ * ÷: ./udpserver [˿] [߳] [-gro]
+ * -groUDP GROһյͬһϲĶݱظʱUDP GSOںз֡
+ */
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+#define BATCH 64            //ÿrecvmmsg/sendmmsgϢ
+#define MSG_SIZE 2048       //GROʱÿϢĻ
+#define GRO_SIZE 65536      //GROʱϲ64K
+#define MAX_THREADS 256
+
+struct worker {
+    int id;
+    int fd;
+    pthread_t tid;
+    //ͳƣ߳д̶߳
+    std::atomic<unsigned long long> pkts;
+    std::atomic<unsigned long long> bytes;
+    std::atomic<unsigned long long> calls;
+};
+
+static struct worker workers[MAX_THREADS];
+static int port = 8888;
+static int nthreads = 0;
+static int gro = 0;
+static volatile sig_atomic_t running = 1;
+
+static void on_signal(int)
+{
+    running = 0;
+}
+
+static int open_socket(void)
+{
+    int on = 1;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        perror("socket failed");
+        return -1;
+    }
+    //̰߳ͬһ˿ڣں˰ϣַ
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0)
+    {
+        perror("SO_REUSEPORT failed");
+        close(fd);
+        return -1;
+    }
+    int bufsize = 8 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+    if (gro && setsockopt(fd, IPPROTO_UDP, UDP_GRO, &on, sizeof(on)) < 0)
+        perror("UDP_GRO not supported");
+    //ʱأܼ߳˳־
+    struct timeval tv = {0, 200000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    struct sockaddr_in saddr;
+    memset(&saddr, 0, sizeof(saddr));
+    saddr.sin_family = AF_INET;
+    saddr.sin_port = htons(port);
+    saddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (struct sockaddr*)&saddr, sizeof(saddr)) < 0)
+    {
+        perror("bind failed");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void *serve(void *arg)
+{
+    struct worker *w = (struct worker*)arg;
+
+    //󶨵ӦCPU׽ֵհʹͬһ
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(w->id % sysconf(_SC_NPROCESSORS_ONLN), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    //ԤȷһϢĻַͿϢѭвٷ
+    size_t size = gro ? GRO_SIZE : MSG_SIZE;
+    char *bufs = (char*)malloc(size * BATCH);
+    struct mmsghdr rmsgs[BATCH], smsgs[BATCH];
+    struct iovec iovs[BATCH], siovs[BATCH];
+    struct sockaddr_in addrs[BATCH];
+    char rctl[BATCH][CMSG_SPACE(sizeof(int))];
+    char sctl[BATCH][CMSG_SPACE(sizeof(uint16_t))];
+    memset(rmsgs, 0, sizeof(rmsgs));
+    memset(smsgs, 0, sizeof(smsgs));
+    for (int i = 0; i < BATCH; i++)
+    {
+        iovs[i].iov_base = bufs + i * size;
+        iovs[i].iov_len = size;
+        rmsgs[i].msg_hdr.msg_iov = &iovs[i];
+        rmsgs[i].msg_hdr.msg_iovlen = 1;
+        rmsgs[i].msg_hdr.msg_name = &addrs[i];
+        rmsgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        if (gro)
+        {
+            rmsgs[i].msg_hdr.msg_control = rctl[i];
+            rmsgs[i].msg_hdr.msg_controllen = sizeof(rctl[i]);
+        }
+        smsgs[i].msg_hdr.msg_iov = &siovs[i];
+        smsgs[i].msg_hdr.msg_iovlen = 1;
+        smsgs[i].msg_hdr.msg_name = &addrs[i];
+        smsgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+    }
+
+    while (running)
+    {
+        //ٵȵһݱ֮ѵľһ
+        int n = recvmmsg(w->fd, rmsgs, BATCH, MSG_WAITFORONE, NULL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EINTR)
+                continue;
+            perror("recvmmsg failed");
+            break;
+        }
+        unsigned long long pkts = 0, bytes = 0;
+        for (int i = 0; i < n; i++)
+        {
+            struct msghdr *h = &rmsgs[i].msg_hdr;
+            unsigned int len = rmsgs[i].msg_len;
+            //ظԭݣֱӸ
+            siovs[i].iov_base = iovs[i].iov_base;
+            siovs[i].iov_len = len;
+            smsgs[i].msg_hdr.msg_control = NULL;
+            smsgs[i].msg_hdr.msg_controllen = 0;
+            int segs = 1;
+            if (gro)
+            {
+                //GROϲݴgso_sizeظʱGSOͬСз
+                for (struct cmsghdr *c = CMSG_FIRSTHDR(h); c; c = CMSG_NXTHDR(h, c))
+                {
+                    if (c->cmsg_level == IPPROTO_UDP && c->cmsg_type == UDP_GRO)
+                    {
+                        int gso = *(int*)CMSG_DATA(c);
+                        if (gso > 0 && (unsigned)gso < len)
+                        {
+                            segs = (len + gso - 1) / gso;
+                            struct msghdr *sh = &smsgs[i].msg_hdr;
+                            sh->msg_control = sctl[i];
+                            sh->msg_controllen = sizeof(sctl[i]);
+                            struct cmsghdr *sc = CMSG_FIRSTHDR(sh);
+                            sc->cmsg_level = SOL_UDP;
+                            sc->cmsg_type = UDP_SEGMENT;
+                            sc->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                            *(uint16_t*)CMSG_DATA(sc) = gso;
+                        }
+                    }
+                }
+                h->msg_controllen = sizeof(rctl[i]);
+            }
+            h->msg_namelen = sizeof(addrs[i]);
+            pkts += segs;
+            bytes += len;
+        }
+        for (int sent = 0; sent < n;)
+        {
+            int re = sendmmsg(w->fd, smsgs + sent, n - sent, MSG_DONTWAIT);
+            if (re < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                //ͻ(EAGAIN)ʱʣظհ
+                break;
+            }
+            sent += re;
+        }
+        w->pkts.fetch_add(pkts, std::memory_order_relaxed);
+        w->bytes.fetch_add(bytes, std::memory_order_relaxed);
+        w->calls.fetch_add(1, std::memory_order_relaxed);
+    }
+    free(bufs);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1, pos = 0; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-gro") == 0)
+            gro = 1;
+        else if (pos++ == 0)
+            port = atoi(argv[i]);
+        else
+            nthreads = atoi(argv[i]);
+    }
+    if (nthreads <= 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > MAX_THREADS)
+        nthreads = MAX_THREADS;
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        workers[i].id = i;
+        workers[i].fd = open_socket();
+        if (workers[i].fd < 0)
+            return -1;
+    }
+    for (int i = 0; i < nthreads; i++)
+        pthread_create(&workers[i].tid, NULL, serve, &workers[i]);
+    printf("udp server on port %d, %d thread(s), batch %d%s\n", port, nthreads, BATCH, gro ? ", gro" : "");
+
+    //ÿһհʺƽÿϵͳյİ
+    unsigned long long last_pkts = 0, last_bytes = 0, last_calls = 0;
+    while (running)
+    {
+        sleep(1);
+        unsigned long long pkts = 0, bytes = 0, calls = 0;
+        for (int i = 0; i < nthreads; i++)
+        {
+            pkts += workers[i].pkts.load(std::memory_order_relaxed);
+            bytes += workers[i].bytes.load(std::memory_order_relaxed);
+            calls += workers[i].calls.load(std::memory_order_relaxed);
+        }
+        unsigned long long c = calls - last_calls;
+        printf("%llu pkts/s, %.1f Mbit/s, %.1f pkts/call\n", pkts - last_pkts,
+               (bytes - last_bytes) * 8 / 1e6, c ? (double)(pkts - last_pkts) / c : 0.0);
+        fflush(stdout);
+        last_pkts = pkts;
+        last_bytes = bytes;
+        last_calls = calls;
+    }
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        pthread_join(workers[i].tid, NULL);
+        close(workers[i].fd);
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+// RETR/STORԣģʽ(PORT)ftpSrvʹ
+//
+//   ./ftpBench ip port Զļ ļ []
+//
+// ÿRETRԶļ(ݶ)ٰѱļSTORΪ Զļ.up
+// ÿֵMB/sԱ㿽ͻ忽·
+//   ftpSrvĿ¼ make              sendfile/splice
+//   ftpSrvĿ¼ make MACRO=-DNOZEROCOPY  fread/bufferevent
+// ļüGB dd if=/dev/urandom of=big.bin bs=1M count=4096
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+using namespace std;
+
+#define BUFS (1024*1024)
+
+static char buf[BUFS];
+
+// ͨжȡӦ
+static int cmdSock = -1;
+static string cmdBuf;
+
+static double Now() {
+    timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// һӦ𣬷Ӧ룬ʧܷ-1
+static int ReadReply() {
+    for (;;) {
+        size_t pos = cmdBuf.find('\n');
+        if (pos != string::npos) {
+            string line = cmdBuf.substr(0, pos + 1);
+            cmdBuf.erase(0, pos + 1);
+            return atoi(line.c_str());
+        }
+        char tmp[4096];
+        int len = recv(cmdSock, tmp, sizeof(tmp), 0);
+        if (len <= 0) return -1;
+        cmdBuf.append(tmp, len);
+    }
+}
+
+// һȴӦ𡣷һζȡ͵һ
+static int Cmd(const string &cmd) {
+    string msg = cmd + "\r\n";
+    if (send(cmdSock, msg.c_str(), msg.size(), 0) != (ssize_t)msg.size())
+        return -1;
+    return ReadReply();
+}
+
+// ͨıصַϼһ˿ڣPORT֪
+static int OpenPORT() {
+    sockaddr_in sin;
+    socklen_t slen = sizeof(sin);
+    getsockname(cmdSock, (sockaddr*)&sin, &slen);
+    sin.sin_port = 0;
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 || bind(sock, (sockaddr*)&sin, sizeof(sin)) || listen(sock, 1)) {
+        cerr << "data listen failed: " << strerror(errno) << endl;
+        return -1;
+    }
+    slen = sizeof(sin);
+    getsockname(sock, (sockaddr*)&sin, &slen);
+
+    unsigned char *ip = (unsigned char*)&sin.sin_addr.s_addr;
+    int port = ntohs(sin.sin_port);
+    char cmd[64];
+    sprintf(cmd, "PORT %d,%d,%d,%d,%d,%d", ip[0], ip[1], ip[2], ip[3],
+            port / 256, port % 256);
+    if (Cmd(cmd) != 200) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// ȴͨ
+static int AcceptPORT(int lsock) {
+    int sock = accept(lsock, 0, 0);
+    close(lsock);
+    if (sock < 0)
+        cerr << "data accept failed: " << strerror(errno) << endl;
+    return sock;
+}
+
+// remoteֽʧܷ-1
+static long long Retr(const string &remote) {
+    int lsock = OpenPORT();
+    if (lsock < 0) return -1;
+    if (Cmd("RETR " + remote) != 150) {
+        close(lsock);
+        return -1;
+    }
+    int sock = AcceptPORT(lsock);
+    if (sock < 0) return -1;
+
+    long long total = 0;
+    for (;;) {
+        ssize_t len = recv(sock, buf, BUFS, 0);
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) break;
+        total += len;
+    }
+    close(sock);
+    if (ReadReply() != 226) return -1;
+    return total;
+}
+
+// sendfileϴlocalΪremoteͻ˱Ϊƿ
+static long long Stor(const string &local, const string &remote) {
+    int fd = open(local.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << local << ": " << strerror(errno) << endl;
+        return -1;
+    }
+    struct stat st;
+    fstat(fd, &st);
+
+    int lsock = OpenPORT();
+    if (lsock < 0 || Cmd("STOR " + remote) != 125) {
+        if (lsock >= 0) close(lsock);
+        close(fd);
+        return -1;
+    }
+    int sock = AcceptPORT(lsock);
+    if (sock < 0) {
+        close(fd);
+        return -1;
+    }
+
+    off_t off = 0;
+    while (off < st.st_size) {
+        ssize_t len = sendfile(sock, fd, &off, st.st_size - off);
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) break;
+    }
+    close(fd);
+    // رͨϴдļ226
+    close(sock);
+    if (off < st.st_size || ReadReply() != 226) return -1;
+    return off;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 5) {
+        cout << "usage: " << argv[0] << " ip port remote_file local_file [rounds]" << endl;
+        return -1;
+    }
+    string remote = argv[3];
+    string local = argv[4];
+    int rounds = argc > 5 ? atoi(argv[5]) : 3;
+
+    sockaddr_in sin;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons(atoi(argv[2]));
+    inet_pton(AF_INET, argv[1], &sin.sin_addr);
+    cmdSock = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(cmdSock, (sockaddr*)&sin, sizeof(sin))) {
+        cerr << "connect failed: " << strerror(errno) << endl;
+        return -1;
+    }
+    if (ReadReply() != 220 || Cmd("USER bench") != 230) {
+        cerr << "login failed" << endl;
+        return -1;
+    }
+
+    for (int i = 0; i < rounds; i++) {
+        double t = Now();
+        long long n = Retr(remote);
+        if (n < 0) {
+            cerr << "RETR " << remote << " failed" << endl;
+            return -1;
+        }
+        double dt = Now() - t;
+        printf("round %d RETR %lld bytes %.2fs %.1f MB/s\n", i, n, dt, n / dt / 1e6);
+
+        t = Now();
+        n = Stor(local, remote + ".up");
+        if (n < 0) {
+            cerr << "STOR " << remote << ".up failed" << endl;
+            return -1;
+        }
+        dt = Now() - t;
+        printf("round %d STOR %lld bytes %.2fs %.1f MB/s\n", i, n, dt, n / dt / 1e6);
+        fflush(stdout);
+    }
+    Cmd("QUIT");
+    close(cmdSock);
+    return 0;
+}
@@ -1,12 +1,41 @@
 #include "XFtpLIST.h"
+#include "event2/buffer.h"
 #include "event2/bufferevent.h"
 #include "event2/event.h"
 #include "testUtil.h"
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <grp.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 using namespace std;
 
+// Ŀ¼бĿ
+#define LIST_CACHE 256
+// Ŀ¼mtimeʱЧļԭظдĿ¼mtime
+#define LIST_TTL 5
 
+struct ListCache {
+    timespec mtime;
+    dev_t dev;
+    ino_t ino;
+    time_t built;
+    shared_ptr<const string> data;
+};
+static map<string, ListCache> list_cache;
+static mutex list_cache_mutex;
 
+// evbuffer_add_referenceͷʱ黹б
+static void ListUnref(const void *, size_t, void *arg) {
+    delete (shared_ptr<const string>*)arg;
+}
 
 void XFtpLIST::Write(bufferevent *bev) {
     testout("XFtpLIST::Write");
@@ -42,10 +71,15 @@ void XFtpLIST::Parse(std::string type, std::string msg) {
         //  "-rwxrwxrwx 1 root root      418 Mar 21 16:10 XFtpFactory.cpp";
         string path = cmdTask->rootDir + cmdTask->curDir;
         testout("listpath: " << path);
-        string listdata = GetListData(path);
+        shared_ptr<const string> listdata = GetListData(path);
         ConnectoPORT();
         ResCMD("150 Here coms the directory listing.");
-        Send(listdata);
+        // ֱûбͷ
+        if (bev && !listdata->empty()) {
+            evbuffer_add_reference(bufferevent_get_output(bev),
+                                   listdata->data(), listdata->size(),
+                                   ListUnref, new shared_ptr<const string>(listdata));
+        }
     }
     else if (type == "CWD") //лĿ¼
     {
@@ -95,22 +129,163 @@ void XFtpLIST::Parse(std::string type, std::string msg) {
     }
 }
 
-string XFtpLIST::GetListData(string path) {
+static string UserName(uid_t uid, map<uid_t, string> &names) {
+    auto i = names.find(uid);
+    if (i != names.end()) return i->second;
+    char buf[1024];
+    passwd pw, *res = 0;
+    string name = to_string(uid);
+    if (getpwuid_r(uid, &pw, buf, sizeof(buf), &res) == 0 && res)
+        name = res->pw_name;
+    names[uid] = name;
+    return name;
+}
+
+static string GroupName(gid_t gid, map<gid_t, string> &names) {
+    auto i = names.find(gid);
+    if (i != names.end()) return i->second;
+    char buf[1024];
+    group gr, *res = 0;
+    string name = to_string(gid);
+    if (getgrgid_r(gid, &gr, buf, sizeof(buf), &res) == 0 && res)
+        name = res->gr_name;
+    names[gid] = name;
+    return name;
+}
+
+// -rwxrwxrwx
+static void ModeString(mode_t m, char *out) {
+    out[0] = S_ISDIR(m) ? 'd' : S_ISLNK(m) ? 'l' : S_ISCHR(m) ? 'c' :
+             S_ISBLK(m) ? 'b' : S_ISFIFO(m) ? 'p' : S_ISSOCK(m) ? 's' : '-';
+    const char *rwx = "rwxrwxrwx";
+    for (int i = 0; i < 9; i++)
+        out[i + 1] = (m & (0400 >> i)) ? rwx[i] : '-';
+    if (m & S_ISUID) out[3] = (m & S_IXUSR) ? 's' : 'S';
+    if (m & S_ISGID) out[6] = (m & S_IXGRP) ? 's' : 'S';
+    if (m & S_ISVTX) out[9] = (m & S_IXOTH) ? 't' : 'T';
+    out[10] = '\0';
+}
+
+shared_ptr<const string> XFtpLIST::GetListData(string path) {
     // -rwxrwxrwx 1 root root 418 Mar 21 16:10 XFtpFactory.cpp
 
-    string data = "";
-    string cmd = "ls -l ";
-    cmd += path;
-    FILE *f = popen(cmd.c_str(), "r");
-    if (!f) return data;
-    char buf[1024] = {0};
-    while (1) {
-        int len = fread(buf, 1, sizeof(buf) - 1, f);
-        if (len <= 0)break;
-        buf[len] = '\0';
-        data += buf;
+    static const shared_ptr<const string> empty = make_shared<const string>();
+    int dfd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) return empty;
+    struct stat dst;
+    if (fstat(dfd, &dst) != 0) {
+        close(dfd);
+        return empty;
+    }
+
+    // Ŀ¼δ仯ֱʹû
+    time_t now = time(0);
+    {
+        lock_guard<mutex> lock(list_cache_mutex);
+        auto i = list_cache.find(path);
+        if (i != list_cache.end()
+                && i->second.dev == dst.st_dev && i->second.ino == dst.st_ino
+                && i->second.mtime.tv_sec == dst.st_mtim.tv_sec
+                && i->second.mtime.tv_nsec == dst.st_mtim.tv_nsec
+                && now - i->second.built < LIST_TTL) {
+            close(dfd);
+            testout("list cache hit: " << path);
+            return i->second.data;
+        }
+    }
+
+    DIR *dir = fdopendir(dfd);
+    if (!dir) {
+        close(dfd);
+        return empty;
+    }
+
+    struct Entry {
+        string name;
+        string link;
+        struct statx st;
+    };
+    vector<Entry> entries;
+    unsigned long long blocks = 0;
+    dirent *d;
+    while ((d = readdir(dir)) != 0) {
+        // ͬls -lгļ
+        if (d->d_name[0] == '.') continue;
+        Entry e;
+        e.name = d->d_name;
+        if (statx(dfd, d->d_name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+                  STATX_BASIC_STATS, &e.st) != 0)
+            continue;
+        if (S_ISLNK(e.st.stx_mode)) {
+            char buf[4096];
+            ssize_t len = readlinkat(dfd, d->d_name, buf, sizeof(buf));
+            if (len > 0) e.link.assign(buf, len);
+        }
+        blocks += e.st.stx_blocks;
+        entries.push_back(move(e));
+    }
+    closedir(dir);
+    sort(entries.begin(), entries.end(),
+         [](const Entry &a, const Entry &b) { return a.name < b.name; });
+
+    // lsķʽ
+    map<uid_t, string> users;
+    map<gid_t, string> groups;
+    vector<string> owners, grps;
+    size_t wlink = 1, wuser = 1, wgroup = 1, wsize = 1;
+    for (const Entry &e : entries) {
+        owners.push_back(UserName(e.st.stx_uid, users));
+        grps.push_back(GroupName(e.st.stx_gid, groups));
+        wlink = max(wlink, to_string(e.st.stx_nlink).size());
+        wuser = max(wuser, owners.back().size());
+        wgroup = max(wgroup, grps.back().size());
+        wsize = max(wsize, to_string(e.st.stx_size).size());
+    }
+
+    string *data = new string;
+    shared_ptr<const string> res(data);
+    data->reserve(entries.size() * 64 + 32);
+    *data += "total " + to_string(blocks / 2) + "\r\n";
+    char line[512];
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry &e = entries[i];
+        char mode[11];
+        ModeString(e.st.stx_mode, mode);
+        // ڵļʾʱ䣬ʾ
+        time_t mt = e.st.stx_mtime.tv_sec;
+        tm t;
+        localtime_r(&mt, &t);
+        char date[32];
+        if (mt > now - 15778476 && mt < now + 3600)
+            strftime(date, sizeof(date), "%b %e %H:%M", &t);
+        else
+            strftime(date, sizeof(date), "%b %e  %Y", &t);
+        snprintf(line, sizeof(line), "%s %*u %-*s %-*s %*llu %s ",
+                 mode, (int)wlink, e.st.stx_nlink,
+                 (int)wuser, owners[i].c_str(), (int)wgroup, grps[i].c_str(),
+                 (int)wsize, (unsigned long long)e.st.stx_size, date);
+        *data += line;
+        *data += e.name;
+        if (!e.link.empty()) {
+            *data += " -> ";
+            *data += e.link;
+        }
+        *data += "\r\n";
     }
-    pclose(f);
 
-    return data;
+    lock_guard<mutex> lock(list_cache_mutex);
+    if (list_cache.size() >= LIST_CACHE && list_cache.find(path) == list_cache.end()) {
+        // ̭ɵб
+        auto old = list_cache.begin();
+        for (auto i = list_cache.begin(); i != list_cache.end(); i++)
+            if (i->second.built < old->second.built) old = i;
+        list_cache.erase(old);
+    }
+    ListCache &c = list_cache[path];
+    c.mtime = dst.st_mtim;
+    c.dev = dst.st_dev;
+    c.ino = dst.st_ino;
+    c.built = now;
+    c.data = res;
+    return res;
 }
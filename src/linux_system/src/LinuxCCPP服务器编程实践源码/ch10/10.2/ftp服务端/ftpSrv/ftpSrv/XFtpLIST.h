@@ -1,5 +1,6 @@
 #pragma once
 #include "XFtpTask.h"
+#include <memory>
 #include <string>
 using namespace std;
 class XFtpLIST : public XFtpTask
@@ -10,6 +11,7 @@ public:
     virtual void Write(bufferevent *);
 
 private:
-    string GetListData(string path);
+    // Ŀ¼ls -lʽбĿ¼mtime棬̹߳
+    shared_ptr<const string> GetListData(string path);
 };
 
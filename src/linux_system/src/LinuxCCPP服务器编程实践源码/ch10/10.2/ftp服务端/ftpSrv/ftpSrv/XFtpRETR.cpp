@@ -1,11 +1,16 @@
 #include "XFtpRETR.h"
 #include "testUtil.h"
+#include <event2/buffer.h>
 #include <event2/bufferevent.h>
 #include <event2/event.h>
+#include <sys/stat.h>
 #include <iostream>
 #include <string>
 using namespace std;
 
+// ÿдصֽһռסļ
+#define SEGS (16*1024*1024)
+
 void XFtpRETR::Parse(string type, string msg) {
     testout("At XFtpRETR::Parse");
     int pos = msg.rfind(" ") + 1;
@@ -14,7 +19,19 @@ void XFtpRETR::Parse(string type, string msg) {
     testout("filepath:[" << path << "]");
     fp = fopen(path.c_str(), "rb");
     if (fp) {
+        struct stat st;
+        offset = 0;
+        filesize = 0;
+        if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode)) {
+            filesize = st.st_size;
+#ifndef NOZEROCOPY
+            // ļfpУEVBUF_FS_CLOSE_ON_FREE
+            if (filesize > 0)
+                seg = evbuffer_file_segment_new(fileno(fp), 0, filesize, 0);
+#endif
+        }
         ConnectoPORT();
+        BeginTransfer(filesize);
         ResCMD("150 File OK");
         bufferevent_trigger(bev, EV_WRITE, 0);
     }
@@ -26,14 +43,37 @@ void XFtpRETR::Parse(string type, string msg) {
 void XFtpRETR::Write(bufferevent *bev) {
     testout("At XFtpRETR::Write");
     if (!fp) return;
+    Transferred(queued);
+    queued = 0;
+
+    // 㿽ļμٴһдص
+    if (seg) {
+        if (offset >= filesize) {
+            ResCMD("226 Transfer complete");
+            ClosePORT();
+            return;
+        }
+        ev_off_t len = filesize - offset;
+        if (len > SEGS) len = SEGS;
+        if (evbuffer_add_file_segment(bufferevent_get_output(bev), seg, offset, len) == 0) {
+            offset += len;
+            queued = len;
+            return;
+        }
+        // ʧӵǰƫƸͨд
+        evbuffer_file_segment_free(seg);
+        seg = 0;
+        fseeko(fp, offset, SEEK_SET);
+    }
+
     int len = fread(buf, 1, sizeof(buf), fp);
     if (len <= 0) {
         ResCMD("226 Transfer complete");
         ClosePORT();
         return;
     }
-    cout << buf;
-    Send(buf, sizeof(buf));
+    Send(buf, len);
+    queued = len;
 }
 
 void XFtpRETR::Event(bufferevent *bev, short events) {
@@ -46,6 +86,18 @@ void XFtpRETR::Event(bufferevent *bev, short events) {
     }
 }
 
+void XFtpRETR::ClosePORT() {
+    // δ͵ĲֳļεãֻͷԼ
+    if (seg) {
+        evbuffer_file_segment_free(seg);
+        seg = 0;
+    }
+    offset = 0;
+    filesize = 0;
+    queued = 0;
+    XFtpTask::ClosePORT();
+}
 
-
-
+XFtpRETR::~XFtpRETR() {
+    ClosePORT();
+}
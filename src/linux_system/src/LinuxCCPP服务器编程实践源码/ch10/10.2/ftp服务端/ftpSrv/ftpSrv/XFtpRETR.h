@@ -1,18 +1,35 @@
 #pragma once
 #include "XFtpTask.h"
+
+#include <event2/util.h>
+
+struct evbuffer_file_segment;
+
 class XFtpRETR :
     public XFtpTask
 {
     void Parse(std::string type, std::string msg);
     virtual void Event(bufferevent *, short);
     virtual void Write(bufferevent *);
+    virtual void ClosePORT();
 
     bool Init() {
         return true;
     }
 
+public:
+    ~XFtpRETR();
 
 private:
+    // ļΣsocketʱlibeventsendfileֱӴļ
+    evbuffer_file_segment *seg = 0;
+    // ѼƫƺļܴС
+    ev_off_t offset = 0;
+    ev_off_t filesize = 0;
+    // ϴдصֽٴλصʱѷ
+    ev_off_t queued = 0;
+
+    // ޷ļʱ˻fread + ͵Ļ
     char buf[1024*1024] = {0};
 };
 
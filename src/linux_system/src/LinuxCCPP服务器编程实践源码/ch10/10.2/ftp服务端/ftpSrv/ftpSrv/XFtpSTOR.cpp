@@ -1,31 +1,47 @@
 #include "XFtpSTOR.h"
 #include "testUtil.h"
+#include <event2/buffer.h>
 #include <event2/bufferevent.h>
 #include <event2/event.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 #include <iostream>
 #include <string>
 using namespace std;
 
+// ܵ͵spliceֽ
+#define PIPES (1024*1024)
+// ÿοɶ¼ദһϴռס̵߳event_base
+#define SPLICE_LOOP 16
+
 void XFtpSTOR::Read(bufferevent *bev) {
     testout("At XFtpSTOR::Read");
     if (!fp) return;
-    while (1) {
-        int len = bufferevent_read(bev, buf, sizeof(buf));
+    // spliceʱ·ֱӴ뻺ڴдļʡȥbuf
+    evbuffer *in = bufferevent_get_input(bev);
+    while (evbuffer_get_length(in) > 0) {
+        int len = evbuffer_write(in, fileno(fp));
         if (len <= 0) {
+            cerr << "XFtpSTOR write file failed" << endl;
             return;
         }
-        fwrite(buf, 1, len, fp);
+        Transferred(len);
     }
 }
 
 void XFtpSTOR::Event(bufferevent *bev, short events) {
     testout("At XFtpSTOR::Event");
     if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR | BEV_EVENT_TIMEOUT)) {
-        ClosePORT();
-        ResCMD("226 Transfer complete");
+        Read(bev);
+        Finish();
     }
-    else if (events & BEV_EVENT_CONNECTED)
+    else if (events & BEV_EVENT_CONNECTED) {
         cout << "XFtpSTOR BEV_EVENT_CONNECTED" << endl;
+#ifndef NOZEROCOPY
+        StartSplice();
+#endif
+    }
 }
 
 void XFtpSTOR::Parse(std::string type, std::string msg) {
@@ -36,7 +52,9 @@ void XFtpSTOR::Parse(std::string type, std::string msg) {
     testout("filepath:[" << path << "]");
     fp = fopen(path.c_str(), "wb");
     if (fp) {
+        fileSplice = true;
         ConnectoPORT();
+        BeginTransfer(0);
         ResCMD("125 File OK");
         bufferevent_trigger(bev, EV_READ, 0);
     }
@@ -46,3 +64,119 @@ void XFtpSTOR::Parse(std::string type, std::string msg) {
 
 }
 
+bool XFtpSTOR::StartSplice() {
+    testout("At XFtpSTOR::StartSplice");
+    if (!fp || !bev || ev) return false;
+    if (pipe2(pfd, O_NONBLOCK | O_CLOEXEC)) {
+        pfd[0] = pfd[1] = -1;
+        return false;
+    }
+    fcntl(pfd[1], F_SETPIPE_SZ, PIPES);
+
+    evutil_socket_t sock = bufferevent_getfd(bev);
+    ev = event_new(cmdTask->base, sock, EV_READ | EV_PERSIST, SpliceCB, this);
+    if (!ev) {
+        close(pfd[0]);
+        close(pfd[1]);
+        pfd[0] = pfd[1] = -1;
+        return false;
+    }
+
+    // ֹͣbuffereventsocketдѾ
+    bufferevent_disable(bev, EV_READ);
+    Read(bev);
+
+    timeval t = {60, 0};
+    event_add(ev, &t);
+    return true;
+}
+
+void XFtpSTOR::SpliceCB(evutil_socket_t, short which, void *arg) {
+    XFtpSTOR *t = (XFtpSTOR*)arg;
+    t->Splice(which);
+}
+
+void XFtpSTOR::Splice(short which) {
+    if (which & EV_TIMEOUT) {
+        Finish();
+        return;
+    }
+    int sock = bufferevent_getfd(bev);
+    for (int i = 0; i < SPLICE_LOOP; i++) {
+        ssize_t len = splice(sock, 0, pfd[1], 0, PIPES, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (len == 0) {
+            // ͻ˹رӣϴ
+            Finish();
+            return;
+        }
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return;
+            cerr << "XFtpSTOR splice failed" << endl;
+            Finish();
+            return;
+        }
+        if (!DrainPipe(len)) {
+            cerr << "XFtpSTOR write file failed" << endl;
+            Finish();
+            return;
+        }
+        Transferred(len);
+    }
+}
+
+bool XFtpSTOR::DrainPipe(size_t len) {
+    int fd = fileno(fp);
+    while (len > 0) {
+        ssize_t re = -1;
+        if (fileSplice) {
+            re = splice(pfd[0], 0, fd, 0, len, SPLICE_F_MOVE);
+            if (re < 0 && errno == EINVAL) {
+                fileSplice = false;
+                continue;
+            }
+        }
+        else {
+            re = read(pfd[0], buf, len < sizeof(buf) ? len : sizeof(buf));
+            for (ssize_t w = 0; re > 0 && w < re;) {
+                ssize_t n = write(fd, buf + w, re - w);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                w += n;
+            }
+        }
+        if (re < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (re == 0) return false;
+        len -= re;
+    }
+    return true;
+}
+
+void XFtpSTOR::Finish() {
+    if (!fp) return;
+    ClosePORT();
+    ResCMD("226 Transfer complete");
+}
+
+void XFtpSTOR::ClosePORT() {
+    // ¼bevsocketҪbufferevent_freeͷ
+    if (ev) {
+        event_free(ev);
+        ev = 0;
+    }
+    if (pfd[0] >= 0) {
+        close(pfd[0]);
+        close(pfd[1]);
+        pfd[0] = pfd[1] = -1;
+    }
+    XFtpTask::ClosePORT();
+}
+
+XFtpSTOR::~XFtpSTOR() {
+    ClosePORT();
+}
@@ -1,5 +1,10 @@
 #pragma once
 #include "XFtpTask.h"
+
+#include <event2/util.h>
+
+struct event;
+
 class XFtpSTOR :
     public XFtpTask
 {
@@ -11,7 +16,26 @@ public:
 
     void Parse(std::string, std::string );
 
+    virtual void ClosePORT();
+
+    ~XFtpSTOR();
+
 private:
+    // ͨӺԼsocketܵspliceдļ
+    bool StartSplice();
+    static void SpliceCB(evutil_socket_t, short, void *);
+    void Splice(short);
+
+    // ѹܵеlenֽдļ֧spliceļϵͳ˻read/write
+    bool DrainPipe(size_t len);
+
+    // ϴ
+    void Finish();
+
+    event *ev = 0;
+    int pfd[2] = {-1, -1};
+    bool fileSplice = true;
+
     char buf[1024*1024] = {0};
 };
 
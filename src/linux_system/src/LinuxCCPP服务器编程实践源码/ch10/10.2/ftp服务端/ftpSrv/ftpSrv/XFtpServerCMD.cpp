@@ -7,6 +7,7 @@
 using namespace std;
 
 #include "XFtpServerCMD.h"
+#include "XThread.h"
 #include "testUtil.h"
 
 #define BUFS 4096
@@ -105,4 +106,6 @@ XFtpServerCMD::~XFtpServerCMD() {
     for (auto i : calls_del) {
         delete i.first;
     }
+    if (thread)
+        thread->conns--;
 }
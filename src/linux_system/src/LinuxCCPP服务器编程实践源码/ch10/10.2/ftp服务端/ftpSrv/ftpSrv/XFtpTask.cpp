@@ -1,4 +1,5 @@
 #include "XFtpTask.h"
+#include "XThread.h"
 #include "testUtil.h"
 
 #include <event2/bufferevent.h>
@@ -37,6 +38,7 @@ void XFtpTask::ConnectoPORT() {
 }
 
 void XFtpTask::ClosePORT() {
+    EndTransfer();
     if (bev) {
         bufferevent_free(bev);
         bev = 0;
@@ -47,6 +49,34 @@ void XFtpTask::ClosePORT() {
     }
 }
 
+void XFtpTask::BeginTransfer(long long size) {
+    EndTransfer();
+    XThread *th = cmdTask ? cmdTask->thread : 0;
+    if (!th) return;
+    transferring = true;
+    pendingBytes = size;
+    th->transfers++;
+    th->pending += size;
+}
+
+void XFtpTask::Transferred(long long len) {
+    XThread *th = cmdTask ? cmdTask->thread : 0;
+    if (!transferring || !th || len <= 0) return;
+    th->bytes += len;
+    long long p = len < pendingBytes ? len : pendingBytes;
+    pendingBytes -= p;
+    th->pending -= p;
+}
+
+void XFtpTask::EndTransfer() {
+    XThread *th = cmdTask ? cmdTask->thread : 0;
+    if (!transferring || !th) return;
+    th->transfers--;
+    th->pending -= pendingBytes;
+    pendingBytes = 0;
+    transferring = false;
+}
+
 void XFtpTask::Setcb(bufferevent *bev) {
     //ûص, صthisָʵ
     bufferevent_setcb(bev, ReadCB, WriteCB, EventCB, this);
@@ -57,11 +87,12 @@ void XFtpTask::Setcb(bufferevent *bev) {
 
 void XFtpTask::Send(const string &data) {
     testout("At XFtpTask::Send");
+    testout(data);
     Send(data.c_str(), data.size());
 }
 void XFtpTask::Send(const char *data, size_t datasize) {
-    testout("At XFtpTask::Send");
-    cout << data;
+    // dataǶļҲ'\0'βֱ
+    testout("At XFtpTask::Send " << datasize);
     if (datasize == 0) return;
     if (bev) {
         bufferevent_write(bev, data, datasize);
@@ -26,8 +26,8 @@ public:
 
     // ͨ
     void ConnectoPORT();
-    // ر
-    void ClosePORT();
+    // رӣ׷ͷԼĴԴ
+    virtual void ClosePORT();
 
     // ͨͨ
     void Send(const string& data);
@@ -42,9 +42,17 @@ public:
         return true;
     }
 
-    ~XFtpTask();
+    virtual ~XFtpTask();
 
 protected:
+    // ݴͳƣǵ̵ͨ߳ĸ
+    // ʼ䣬sizeΪԤƷ͵ֽδ֪ʱΪ0
+    void BeginTransfer(long long size);
+    // lenֽڵĴ
+    void Transferred(long long len);
+    // 䣬ClosePORTʱ
+    void EndTransfer();
+
     static void EventCB(bufferevent *, short, void *);
     static void ReadCB(bufferevent *, void *);
     static void WriteCB(bufferevent *, void *);
@@ -52,5 +60,9 @@ protected:
     // CMDͨLISTRETRͨ
     bufferevent *bev = 0;
     FILE *fp = 0;
+
+private:
+    bool transferring = false;
+    long long pendingBytes = 0;
 };
 
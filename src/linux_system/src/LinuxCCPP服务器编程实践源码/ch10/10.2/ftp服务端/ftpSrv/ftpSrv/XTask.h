@@ -1,10 +1,17 @@
 #pragma once
+class XThread;
 class XTask
 {
 public:
     // һͻһbase
     struct event_base *base = 0;
 
+    // ̣߳ͳƼ
+    XThread *thread = 0;
+
+    // ַеһXThreadʹ
+    XTask *next = 0;
+
     // ӵsock
     int sock = 0;
 
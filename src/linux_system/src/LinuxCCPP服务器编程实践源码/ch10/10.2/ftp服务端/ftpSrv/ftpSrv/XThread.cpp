@@ -1,5 +1,6 @@
 #include <thread>
 #include <iostream>
+#include <sstream>
 using namespace std;
 
 #include <unistd.h>
@@ -22,12 +23,30 @@ static void Notify_cb(evutil_socket_t fd, short which, void *arg) {
 
 void XThread::Notify(evutil_socket_t fd, short which) {
     testout(id << " thread At Notify()");
-    char buf[2] = { 0 };
+    char buf[64] = { 0 };
 
-    int re = read(fd, buf, 1);
+    // һ֪ͨܶӦ񣬰ѹܵе֪ͨȫ
+    int re = read(fd, buf, sizeof(buf) - 1);
     if (re < 0)
         return;
     cout << id << " thread recv" << buf << endl;
+
+    // ȡջǺȳת󰴷ַ˳ʼ
+    XTask *list = tasks.exchange(nullptr, memory_order_acquire);
+    XTask *t = NULL;
+    while (list) {
+        XTask *next = list->next;
+        list->next = t;
+        t = list;
+        list = next;
+    }
+    while (t) {
+        XTask *next = t->next;
+        t->next = NULL;
+        // ڱ̳߳ʼ¼עڱ̵߳event_base
+        t->Init();
+        t = next;
+    }
 }
 
 
@@ -96,17 +115,6 @@ void XThread::Activate() {
     if (re <= 0) {
         cerr << "XThread::Activate() fail" << endl;
     }
-    // ȡ񣬲ʼ
-    XTask *t = NULL;
-    tasks_mutex.lock();
-    if (tasks.empty()) {
-        tasks_mutex.unlock();
-        return;
-    }
-    t = tasks.front();
-    tasks.pop_front();
-    tasks_mutex.unlock();
-    t->Init();
 }
 
 /*
@@ -117,10 +125,34 @@ void XThread::AddTack(XTask *t) {
 
     // ̵̳߳libeventģע¼ʹ̴߳ӵ¼
     t->base = this->base;
+    t->thread = this;
+    conns++;
 
-    tasks_mutex.lock();
-    tasks.push_back(t);
-    tasks_mutex.unlock();
+    // ѹջ߳Notifyһȡȫ
+    t->next = tasks.load(memory_order_relaxed);
+    while (!tasks.compare_exchange_weak(t->next, t,
+                                        memory_order_release, memory_order_relaxed));
+}
+
+/*
+ *  عֵÿӼ1ÿ4ÿ64Mδݼ1
+ */
+long long XThread::Load() {
+    return conns + transfers * 4LL + (pending >> 26);
+}
+
+/*
+ *  ͳ
+ */
+string XThread::Stat() {
+    stringstream ss;
+    ss << "thread " << id
+       << " conns " << conns
+       << " transfers " << transfers
+       << " pending " << pending
+       << " bytes " << bytes
+       << " load " << Load() << "\n";
+    return ss.str();
 }
 
 XThread::XThread() {
@@ -1,7 +1,7 @@
 #pragma once
 #include <event2/util.h>
-#include <list>
-#include <mutex>
+#include <atomic>
+#include <string>
 class XTask;
 struct event_base;
 class XThread
@@ -16,7 +16,7 @@ public:
     // װ̣߳ʼevevnt_base͹ܵ¼ڼ
     bool Setup();
 
-    // յ̷߳ļϢַ̳߳
+    // յ̷߳ļϢַ̳߳ȡ񲢳ʼ
     void Notify(evutil_socket_t, short);
 
     // ̼߳
@@ -25,16 +25,32 @@ public:
     // , һ߳̿ͬʱ񣬹һevent_base
     void AddTack(XTask *);
 
+    // عֵ̳߳طַʱѡС߳
+    long long Load();
+
+    // ͳƵı˿
+    std::string Stat();
+
     XThread();
     ~XThread();
 
     // ̱߳
     int id = 0;
 
+    // ͳƣ߳ڸ£̶߳ȡ
+    // 
+    std::atomic<int> conns{0};
+    // ڽеݴ
+    std::atomic<int> transfers{0};
+    // ѿʼĴδ͵ֽ
+    std::atomic<long long> pending{0};
+    // ۼƴֽ
+    std::atomic<long long> bytes{0};
+
 private:
     int notify_send_fd = 0;
     event_base *base = 0;
-    std::list<XTask*> tasks;
-    std::mutex tasks_mutex;
+    // ʼջ߳ѹ룬߳ȡ
+    std::atomic<XTask*> tasks{nullptr};
 };
 
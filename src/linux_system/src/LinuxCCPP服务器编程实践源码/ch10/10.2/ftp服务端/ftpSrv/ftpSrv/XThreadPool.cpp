@@ -8,13 +8,22 @@ using namespace std;
 #include "testUtil.h"
 
 /*
- *  ̳߳
+ *  ̳߳أѡС̣߳ͬʱϴ֮ѯ
  */
 void XThreadPool::Dispatch(XTask *task) {
     testout("main thread At XThreadPoll::dispathch()");
 
     if (!task) return;
     int tid = (lastThread + 1) % threadCount;
+    long long load = threads[tid]->Load();
+    for (int i = 1; i < threadCount && load > 0; i++) {
+        int n = (lastThread + 1 + i) % threadCount;
+        long long l = threads[n]->Load();
+        if (l < load) {
+            load = l;
+            tid = n;
+        }
+    }
     lastThread = tid;
     XThread *t = threads[tid];
 
@@ -24,6 +33,16 @@ void XThreadPool::Dispatch(XTask *task) {
     t->Activate();
 }
 
+/*
+ *  ̳߳ظͳ
+ */
+string XThreadPool::Stat() {
+    string s;
+    for (XThread *t : threads)
+        s += t->Stat();
+    return s;
+}
+
 /*
  *  ʼ̳߳
  */
@@ -1,4 +1,5 @@
 #pragma once
+#include <string>
 #include <vector>
 
 class XThread;
@@ -16,6 +17,9 @@ public:
 
     // ַ߳
     void Dispatch(XTask*);
+
+    // ̵߳ĸͳ
+    std::string Stat();
 private:
     int threadCount;
     int lastThread = -1;
@@ -31,6 +31,7 @@ using std::string;
 
 
 #define SPORT 21
+#define APORT 8021
 #define BUFS 1024
 
 #define XThreadPoolGet XThreadPool::Get()
@@ -52,6 +53,18 @@ void listen_cb(struct evconnlistener *ev, evutil_socket_t s, struct sockaddr *ad
     XThreadPoolGet->Dispatch(task);
 }
 
+/*
+ *  管理端口，GET /stat 返回每个线程的负载统计
+ */
+void stat_cb(struct evhttp_request *req, void *arg) {
+    testout("main thread At stat_cb");
+    string s = XThreadPoolGet->Stat();
+    evbuffer *out = evhttp_request_get_output_buffer(req);
+    evbuffer_add(out, s.c_str(), s.size());
+    evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Type", "text/plain");
+    evhttp_send_reply(req, HTTP_OK, "OK", out);
+}
+
 int main() {
 
 
@@ -88,10 +101,21 @@ int main() {
                              (sockaddr*)&sin,								//绑定的地址和端口
                              sizeof(sin));
 
+    /*
+     *  管理端口只监听本机
+     */
+    evhttp *http = evhttp_new(base);
+    if (!http || evhttp_bind_socket(http, "127.0.0.1", APORT) != 0)
+        cerr << "admin port " << APORT << " bind failed" << endl;
+    else
+        evhttp_set_cb(http, "/stat", stat_cb, 0);
+
     if (base) {
         cout << "begin to listen..." << endl;
         event_base_dispatch(base);
     }
+    if (http)
+        evhttp_free(http);
     if (ev)
         evconnlistener_free(ev);
     if (base)
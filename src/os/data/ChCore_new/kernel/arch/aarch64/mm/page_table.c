@@ -190,6 +190,68 @@ static int get_next_ptp(ptp_t* cur_ptp, u32 level, vaddr_t va, ptp_t** next_ptp,
         }
 }
 
+extern void flush_tlb_all(void);
+
+/*
+ * Replace the 2M block mapping in `entry` with a L3 page table that maps
+ * the same 512 pages with the same attributes, so that part of the block
+ * can be remapped or unmapped.
+ */
+static ptp_t* split_l2_block(pte_t* entry)
+{
+        ptp_t* new_ptp;
+        u64 block_pte;
+        int i;
+
+        new_ptp = (ptp_t*)get_pages(0);
+        BUG_ON(new_ptp == NULL);
+
+        /* Bits [20:12] of a block descriptor are zero */
+        block_pte = entry->pte;
+        for (i = 0; i < PTP_ENTRIES; ++i) {
+                new_ptp->ent[i].pte = block_pte | AARCH64_MMU_PTE_TABLE_MASK
+                                      | ((u64)i << PAGE_SHIFT);
+        }
+
+        /* Break-before-make: the block must leave the TLBs first */
+        entry->pte = 0;
+        flush_tlb_all();
+
+        entry->table.is_valid = 1;
+        entry->table.is_table = 1;
+        entry->table.next_table_addr = virt_to_phys(new_ptp) >> PAGE_SHIFT;
+        PGTBL_LOG("Split 2MB block into ptp %llx", new_ptp);
+
+        return new_ptp;
+}
+
+/*
+ * Whether the 2M region at `va` has neither a block nor a L3 page table,
+ * i.e., map_range_in_pgtbl_huge can place a block there.
+ */
+bool is_l2_entry_free(void* pgtbl, vaddr_t va)
+{
+        ptp_t* cur_ptp = (ptp_t*)pgtbl;
+        ptp_t* next_ptp = NULL;
+        pte_t* entry = NULL;
+        u32 level;
+        int ret;
+
+        for (level = 0; level <= 2; level++) {
+                ret = get_next_ptp(cur_ptp, level, va, &next_ptp, &entry, false);
+                if (ret == -ENOMAPPING) {
+                        return true;
+                }
+                if (ret == BLOCK_PTP) {
+                        return false;
+                }
+                cur_ptp = next_ptp;
+        }
+
+        /* The L2 entry points to a L3 page table */
+        return false;
+}
+
 void free_page_table(void* pgtbl)
 {
         ptp_t *l0_ptp, *l1_ptp, *l2_ptp, *l3_ptp;
@@ -339,6 +401,11 @@ int map_range_in_pgtbl(void* pgtbl, vaddr_t va, paddr_t pa, size_t len,
                 while (level <= 2) {
                         retval = get_next_ptp(
                                 cur_ptp, level, cur_va, &next_ptp, &entry, true);
+                        if (retval == BLOCK_PTP && level == 2) {
+                                /* Remap a page inside a 2M block */
+                                next_ptp = split_l2_block(entry);
+                                retval = NORMAL_PTP;
+                        }
                         cur_ptp = next_ptp;
                         level++;
                 }
@@ -370,12 +437,12 @@ int unmap_range_in_pgtbl(void* pgtbl, vaddr_t va, size_t len)
         u64 cursor = 0;
         vaddr_t cur_va = va;
 
-        for (; cursor < len; cursor += PAGE_SIZE, cur_va += PAGE_SIZE) {
+        while (cursor < len) {
                 ptp_t* cur_ptp = (ptp_t*)pgtbl;
                 ptp_t* next_ptp = NULL;
                 pte_t* entry = NULL;
                 u32 level = 0;
-                int retval;
+                int retval = NORMAL_PTP;
 
                 while (level <= 2) {
                         retval = get_next_ptp(cur_ptp,
@@ -384,15 +451,40 @@ int unmap_range_in_pgtbl(void* pgtbl, vaddr_t va, size_t len)
                                               &next_ptp,
                                               &entry,
                                               false);
-                        BUG_ON(retval != NORMAL_PTP);
+                        if (retval != NORMAL_PTP) {
+                                break;
+                        }
                         cur_ptp = next_ptp;
                         level++;
                 }
 
+                if (retval == BLOCK_PTP && level == 2) {
+                        if (GET_VA_OFFSET_L2(cur_va) == 0
+                            && len - cursor >= PAGE_SIZE_2M) {
+                                /* Unmap the whole 2M block */
+                                entry->l2_block.is_valid = 0;
+                                PGTBL_LOG("Unmap 2MB page from va: %llx",
+                                          cur_va);
+                                cursor += PAGE_SIZE_2M;
+                                cur_va += PAGE_SIZE_2M;
+                                continue;
+                        }
+                        /* Unmap part of a 2M block */
+                        next_ptp = split_l2_block(entry);
+                } else if (retval != NORMAL_PTP) {
+                        /* Never faulted in, nothing to clear */
+                        BUG_ON(retval != -ENOMAPPING);
+                        cursor += PAGE_SIZE;
+                        cur_va += PAGE_SIZE;
+                        continue;
+                }
+
                 u32 index = GET_L3_INDEX(cur_va);
                 entry = &(next_ptp->ent[index]);
                 entry->l3_page.is_valid = 0;
                 PGTBL_LOG("Unmap 4KB page from va: %llx", cur_va);
+                cursor += PAGE_SIZE;
+                cur_va += PAGE_SIZE;
         }
 
         return 0;
@@ -668,6 +760,60 @@ void lab2_test_page_table(void)
                 free_page_table(pgtbl);
                 lab_check(ok, "Map & unmap with huge page support");
         }
+        {
+                bool ok = true;
+                void* pgtbl = get_pages(0);
+                memset(pgtbl, 0, PAGE_SIZE);
+                paddr_t pa;
+                pte_t* pte;
+                int ret;
+                vaddr_t blk = 0x200000;
+
+                lab_assert(is_l2_entry_free(pgtbl, blk));
+                ret = map_range_in_pgtbl_huge(
+                        pgtbl, blk, 0x40000000, PAGE_SIZE_2M, flags);
+                lab_assert(ret == 0);
+                lab_assert(!is_l2_entry_free(pgtbl, blk));
+
+                /* Punch a hole into the block, the rest stays mapped */
+                ret = unmap_range_in_pgtbl(pgtbl, blk + PAGE_SIZE, PAGE_SIZE);
+                lab_assert(ret == 0);
+                ret = query_in_pgtbl(pgtbl, blk + 0x50, &pa, &pte);
+                lab_assert(ret == 0 && pa == 0x40000050);
+                ret = query_in_pgtbl(pgtbl, blk + PAGE_SIZE, &pa, &pte);
+                lab_assert(ret == -ENOMAPPING);
+                ret = query_in_pgtbl(
+                        pgtbl, blk + PAGE_SIZE_2M - PAGE_SIZE, &pa, &pte);
+                lab_assert(ret == 0
+                           && pa == 0x40000000 + PAGE_SIZE_2M - PAGE_SIZE);
+
+                /* Remap a page inside another block */
+                ret = map_range_in_pgtbl_huge(pgtbl,
+                                              blk + PAGE_SIZE_2M,
+                                              0x40200000,
+                                              PAGE_SIZE_2M,
+                                              flags);
+                lab_assert(ret == 0);
+                ret = map_range_in_pgtbl(
+                        pgtbl, blk + PAGE_SIZE_2M, 0x50000000, PAGE_SIZE, flags);
+                lab_assert(ret == 0);
+                ret = query_in_pgtbl(pgtbl, blk + PAGE_SIZE_2M, &pa, &pte);
+                lab_assert(ret == 0 && pa == 0x50000000);
+                ret = query_in_pgtbl(
+                        pgtbl, blk + PAGE_SIZE_2M + PAGE_SIZE, &pa, &pte);
+                lab_assert(ret == 0 && pa == 0x40201000);
+
+                ret = unmap_range_in_pgtbl(pgtbl, blk, 2 * PAGE_SIZE_2M);
+                lab_assert(ret == 0);
+                for (vaddr_t va = blk; va < blk + 2 * PAGE_SIZE_2M;
+                     va += 5 * PAGE_SIZE + 0x100) {
+                        ret = query_in_pgtbl(pgtbl, va, &pa, &pte);
+                        lab_assert(ret == -ENOMAPPING);
+                }
+
+                free_page_table(pgtbl);
+                lab_check(ok, "Split 2M blocks on partial map & unmap");
+        }
         printk("[TEST] Page table tests finished\n");
 }
 #endif /* CHCORE_KERNEL_TEST */
@@ -15,6 +15,7 @@
 #include <mm/vmspace.h>
 #include <mm/mm.h>
 #include <arch/sync.h>
+#include <arch/machine/smp.h>
 
 /*
  * Invalidate TLB template:
@@ -22,33 +23,83 @@
  *  TLBI
  *  DSB: ensure TLB invalidation is finished
  *  ISB: ensure the instruction fetching is using new mappings
+ *
+ * Each flush either broadcasts to all the cores (the inner sharable "is"
+ * variants) or, when the vmspace has only ever run on the current core,
+ * stays local, which avoids the cross-core handshake.
  */
 
-/* Flush tlbs in all the cores by asid. */
-static void flush_tlb_by_asid(u64 asid)
+#define tlbi_begin(local)              \
+        do {                           \
+                if (local) {           \
+                        dsb(nshst);    \
+                } else {               \
+                        dsb(ishst);    \
+                }                      \
+        } while (0)
+
+#define tlbi_end(local)                \
+        do {                           \
+                if (local) {           \
+                        dsb(nsh);      \
+                } else {               \
+                        dsb(ish);      \
+                }                      \
+                isb();                 \
+        } while (0)
+
+#define tlbi(op, local, arg)                                               \
+        do {                                                               \
+                if (local) {                                               \
+                        asm volatile("tlbi " #op ", %0\n" : : "r"(arg) :);  \
+                } else {                                                   \
+                        asm volatile("tlbi " #op "is, %0\n" : : "r"(arg) :); \
+                }                                                          \
+        } while (0)
+
+/*
+ * TLBI RVAE1(IS) from ARMv8.4-TLBI, written as SYS so that older
+ * assemblers accept it.
+ */
+#define tlbi_range(local, arg)                                          \
+        do {                                                            \
+                if (local) {                                            \
+                        asm volatile("sys #0, c8, c6, #1, %0\n"         \
+                                     :                                  \
+                                     : "r"(arg)                         \
+                                     :);                                \
+                } else {                                                \
+                        asm volatile("sys #0, c8, c2, #1, %0\n"         \
+                                     :                                  \
+                                     : "r"(arg)                         \
+                                     :);                                \
+                }                                                       \
+        } while (0)
+
+/* Set by tlb_setup if the cores implement range TLBI */
+static bool tlbi_range_supported = false;
+
+/* Flush tlbs by asid. */
+static void flush_tlb_by_asid(u64 asid, bool local)
 {
-        /* inner sharable barrier */
-        dsb(ish);
-        asm volatile("tlbi aside1is, %0\n" : : "r"(asid << 48) :);
-        dsb(ish);
-        isb();
+        tlbi_begin(local);
+        tlbi(aside1, local, asid << 48);
+        tlbi_end(local);
 }
 
 /* Flush tlbs of designated VAs. The asid info is encoded in @addr_arg. */
-static void flush_tlb_addr_asid(u64 addr_arg, u64 page_cnt)
+static void flush_tlb_addr_asid(u64 addr_arg, u64 page_cnt, bool local)
 {
         u64 i;
 
-        /* inner sharable barrier */
-        dsb(ish);
+        tlbi_begin(local);
 
         for (i = 0; i < page_cnt; ++i) {
-                asm volatile("tlbi vae1is, %0\n" : : "r"(addr_arg) :);
+                tlbi(vae1, local, addr_arg);
                 addr_arg++;
         }
 
-        dsb(ish);
-        isb();
+        tlbi_end(local);
 }
 
 /*
@@ -65,25 +116,111 @@ static u64 get_tlbi_va_arg(vaddr_t addr, u64 asid)
         return arg;
 }
 
+/*
+ * The arg for 'tlbi rvae1is':
+ * | ASID | TG | SCALE | NUM | TTL | BaseADDR (virtual frame number) |.
+ * It covers (NUM + 1) << (5 * SCALE + 1) pages from BaseADDR.
+ */
+#define TLBI_RANGE_TG_4K       (1UL << 46)
+#define TLBI_RANGE_SCALE_SHIFT 44
+#define TLBI_RANGE_NUM_SHIFT   39
+#define TLBI_RANGE_NUM_MAX     31
+#define TLBI_RANGE_SCALE_MAX   3
+#define TLBI_RANGE_PAGES(num, scale) \
+        ((u64)((num) + 1) << (5 * (scale) + 1))
+#define TLBI_RANGE_MAX_PAGES \
+        TLBI_RANGE_PAGES(TLBI_RANGE_NUM_MAX, TLBI_RANGE_SCALE_MAX)
+
+/*
+ * Flush [start_va, start_va + page_cnt pages) with as few TLBIs as possible:
+ * an odd page is flushed alone, then each scale takes the pages its NUM
+ * field can express, from the smallest scale up.
+ */
+static void flush_tlb_range_asid(vaddr_t start_va, u64 page_cnt, u64 asid,
+                                 bool local)
+{
+        u64 scale = 0;
+        u64 num, arg, pages;
+
+        tlbi_begin(local);
+
+        while (page_cnt > 0) {
+                if (page_cnt % 2 == 1) {
+                        tlbi(vae1, local, get_tlbi_va_arg(start_va, asid));
+                        start_va += PAGE_SIZE;
+                        page_cnt--;
+                        continue;
+                }
+
+                BUG_ON(scale > TLBI_RANGE_SCALE_MAX);
+                num = (page_cnt >> (5 * scale + 1)) & TLBI_RANGE_NUM_MAX;
+                if (num) {
+                        /* NUM encodes (number of units - 1) */
+                        pages = TLBI_RANGE_PAGES(num - 1, scale);
+                        arg = (start_va >> 12) & ((1UL << 37) - 1);
+                        arg |= (num - 1) << TLBI_RANGE_NUM_SHIFT;
+                        arg |= scale << TLBI_RANGE_SCALE_SHIFT;
+                        arg |= TLBI_RANGE_TG_4K;
+                        arg |= asid << 48;
+                        tlbi_range(local, arg);
+                        start_va += pages * PAGE_SIZE;
+                        page_cnt -= pages;
+                }
+                scale++;
+        }
+
+        tlbi_end(local);
+}
+
 #define TLB_SHOOTDOWN_THRESHOLD 2
 
-static void do_flush_tlb_opt(vaddr_t start_va, u64 page_cnt, u64 asid)
+static void do_flush_tlb_opt(vaddr_t start_va, u64 page_cnt, u64 asid,
+                             bool local)
 {
-        /* flush tlbs in all the cpus */
-        if (page_cnt > TLB_SHOOTDOWN_THRESHOLD) {
-                /* Flush all the TLBs of the ASID in all the cpus */
-                flush_tlb_by_asid(asid);
+        if (page_cnt <= TLB_SHOOTDOWN_THRESHOLD) {
+                /* Flush each TLB entry one-by-one */
+                flush_tlb_addr_asid(
+                        get_tlbi_va_arg(start_va, asid), page_cnt, local);
+        } else if (tlbi_range_supported && page_cnt < TLBI_RANGE_MAX_PAGES) {
+                /* Flush the range with a few range TLBIs */
+                flush_tlb_range_asid(start_va, page_cnt, asid, local);
         } else {
-                /* Flush each TLB entry one-by-one in all the cpus */
-                flush_tlb_addr_asid(get_tlbi_va_arg(start_va, asid), page_cnt);
+                /* Flush all the TLBs of the ASID */
+                flush_tlb_by_asid(asid, local);
+        }
+}
+
+/*
+ * Decide where the TLBs of @vmspace may live. Returns false if no core has
+ * ever run it, in which case nothing needs flushing.
+ */
+static bool tlb_flush_scope(struct vmspace* vmspace, bool* local)
+{
+        u64 cpus = vmspace->tlb_cpus;
+
+        if (cpus == 0) {
+                return false;
         }
+
+        *local = (cpus == (1UL << smp_get_cpu_id()));
+        return true;
 }
 
 /* Exposed functions */
+void tlb_setup(void)
+{
+        u64 isar0;
+
+        /* ID_AA64ISAR0_EL1.TLB == 0b0010: range TLBI is implemented */
+        asm volatile("mrs %0, id_aa64isar0_el1" : "=r"(isar0));
+        tlbi_range_supported = (((isar0 >> 56) & 0xf) == 2);
+}
+
 void flush_tlb_opt(struct vmspace* vmspace, vaddr_t start_va, size_t len)
 {
         u64 page_cnt;
         u64 asid;
+        bool local;
 
         if (unlikely(len < PAGE_SIZE)) {
                 kwarn("func: %s. len (%p) < PAGE_SIZE\n", __func__, len);
@@ -93,13 +230,17 @@ void flush_tlb_opt(struct vmspace* vmspace, vaddr_t start_va, size_t len)
                 return;
         }
 
+        if (!tlb_flush_scope(vmspace, &local)) {
+                return;
+        }
+
         start_va = ROUND_DOWN(start_va, PAGE_SIZE);
         len = ROUND_UP(len, PAGE_SIZE);
         page_cnt = len / PAGE_SIZE;
 
         asid = vmspace->pcid;
 
-        do_flush_tlb_opt(start_va, page_cnt, asid);
+        do_flush_tlb_opt(start_va, page_cnt, asid, local);
 }
 
 void flush_tlbs(struct vmspace* vmspace, vaddr_t start_va, size_t len)
@@ -107,6 +248,50 @@ void flush_tlbs(struct vmspace* vmspace, vaddr_t start_va, size_t len)
         flush_tlb_opt(vmspace, start_va, len);
 }
 
+/*
+ * Record an unmapped range whose TLB flush can wait until
+ * tlb_gather_flush. Ranges are merged into the one covering them all.
+ */
+void tlb_gather_range(struct vmspace* vmspace, vaddr_t start_va, size_t len)
+{
+        struct tlb_gather* tlb = &vmspace->tlb_gather;
+        vaddr_t end_va;
+
+        if (len == 0) {
+                return;
+        }
+
+        start_va = ROUND_DOWN(start_va, PAGE_SIZE);
+        end_va = ROUND_UP(start_va + len, PAGE_SIZE);
+
+        if (tlb->end == 0) {
+                tlb->start = start_va;
+                tlb->end = end_va;
+                return;
+        }
+
+        tlb->start = MIN(tlb->start, start_va);
+        tlb->end = MAX(tlb->end, end_va);
+}
+
+/* Flush the range gathered so far, must be done before returning to user */
+void tlb_gather_flush(struct vmspace* vmspace)
+{
+        struct tlb_gather* tlb = &vmspace->tlb_gather;
+        vaddr_t start_va, end_va;
+
+        if (tlb->end == 0) {
+                return;
+        }
+
+        start_va = tlb->start;
+        end_va = tlb->end;
+        tlb->start = 0;
+        tlb->end = 0;
+
+        flush_tlb_opt(vmspace, start_va, end_va - start_va);
+}
+
 void flush_tlb_all(void)
 {
         /* full system barrier */
@@ -118,5 +303,11 @@ void flush_tlb_all(void)
 
 void flush_tlb_of_vmspace(struct vmspace* vmspace)
 {
-        flush_tlb_by_asid(vmspace->pcid);
+        bool local;
+
+        if (!tlb_flush_scope(vmspace, &local)) {
+                return;
+        }
+
+        flush_tlb_by_asid(vmspace->pcid, local);
 }
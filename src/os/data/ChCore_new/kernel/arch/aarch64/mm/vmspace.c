@@ -14,13 +14,18 @@
 #include <mm/vmspace.h>
 #include <mm/kmalloc.h>
 #include <mm/mm.h>
+#include <machine.h>
+#include <arch/machine/smp.h>
 
 /* In cache.c */
 void cache_setup(void);
+/* In tlb.c */
+void tlb_setup(void);
 
 void arch_mm_init(void)
 {
         cache_setup();
+        tlb_setup();
 }
 
 /*
@@ -50,13 +55,27 @@ struct vmspace* create_idle_vmspace(void)
         return vmspace;
 }
 
+/*
+ * TTBR0_EL1 value last written on each CPU. Switching between threads of the
+ * same vmspace (e.g., an IPC server thread in the caller's process, or
+ * returning to the thread that ran before idle) then needs no TTBR write
+ * and no isb.
+ */
+static paddr_t cpu_ttbr0[PLAT_CPU_NUM];
+
 /* Change vmspace to the target one */
 void switch_vmspace_to(struct vmspace* vmspace)
 {
         paddr_t pa;
+        u32 cpuid = smp_get_cpu_id();
 
         pa = virt_to_phys(vmspace->pgtbl);
         /* The upper 16 bits of TTBR0_EL1 represent ASID */
         pa |= (u64)(vmspace->pcid) << ASID_SHIFT;
+        vmspace->tlb_cpus |= 1UL << cpuid;
+        if (cpu_ttbr0[cpuid] == pa) {
+                return;
+        }
+        cpu_ttbr0[cpuid] = pa;
         set_page_table(pa);
 }
@@ -96,6 +96,13 @@ void arch_set_thread_arg1(struct thread* thread, u64 pid)
         thread->thread_ctx->ec.reg[X1] = pid;
 }
 
+/* The n-th argument in Xn (n < 8) */
+void arch_set_thread_arg(struct thread* thread, u32 n, u64 arg)
+{
+        BUG_ON(n >= 8);
+        thread->thread_ctx->ec.reg[X0 + n] = arg;
+}
+
 /* set arch-specific thread state */
 void set_thread_arch_spec_state(struct thread* thread)
 {
@@ -34,6 +34,7 @@ int unmap_range_in_pgtbl(void* pgtbl, vaddr_t va, size_t len);
 int map_range_in_pgtbl_huge(void* pgtbl, vaddr_t va, paddr_t pa, size_t len,
                             vmr_prop_t flags);
 int unmap_range_in_pgtbl_huge(void* pgtbl, vaddr_t va, size_t len);
+bool is_l2_entry_free(void* pgtbl, vaddr_t va);
 
 #define phys_to_virt(x) ((vaddr_t)((paddr_t)(x) + KBASE))
 #define virt_to_phys(x) ((paddr_t)((vaddr_t)(x) - KBASE))
@@ -21,3 +21,20 @@ static inline u64 get_cycles(void)
         asm volatile("mrs %0, pmccntr_el0" : "=r"(tsc));
         return tsc;
 }
+
+/* Generic timer counter, ticks at get_timer_freq() Hz */
+static inline u64 get_timer_cnt(void)
+{
+        u64 cnt;
+
+        asm volatile("mrs %0, cntpct_el0" : "=r"(cnt));
+        return cnt;
+}
+
+static inline u64 get_timer_freq(void)
+{
+        u64 frq;
+
+        asm volatile("mrs %0, cntfrq_el0" : "=r"(frq));
+        return frq;
+}
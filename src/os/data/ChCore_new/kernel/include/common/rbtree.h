@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan
+ * PSL v1. You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ * KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE. See the
+ * Mulan PSL v1 for more details.
+ */
+
+#pragma once
+
+#include <common/types.h>
+#include <common/macro.h>
+
+/*
+ * An intrusive red-black tree.
+ * Users embed a struct rb_node in their objects, walk down from
+ * root->node to find the insertion point, then call rb_link_node and
+ * rb_insert_color (the same protocol as in Linux).
+ */
+
+#define RB_RED   (0)
+#define RB_BLACK (1)
+
+struct rb_node {
+        struct rb_node* parent;
+        struct rb_node* left;
+        struct rb_node* right;
+        int color;
+};
+
+struct rb_root {
+        struct rb_node* node;
+};
+
+#define rb_entry(ptr, type, field) container_of(ptr, type, field)
+
+/* A node that is not in any tree points to itself */
+#define RB_CLEAR_NODE(n) ((n)->parent = (n))
+#define RB_EMPTY_NODE(n) ((n)->parent == (n))
+
+static inline void init_rb_root(struct rb_root* root)
+{
+        root->node = NULL;
+}
+
+static inline void rb_link_node(struct rb_node* node, struct rb_node* parent,
+                                struct rb_node** link)
+{
+        node->parent = parent;
+        node->left = NULL;
+        node->right = NULL;
+        node->color = RB_RED;
+        *link = node;
+}
+
+void rb_insert_color(struct rb_node* node, struct rb_root* root);
+void rb_erase(struct rb_node* node, struct rb_root* root);
+
+struct rb_node* rb_first(struct rb_root* root);
+struct rb_node* rb_last(struct rb_root* root);
+struct rb_node* rb_next(struct rb_node* node);
+struct rb_node* rb_prev(struct rb_node* node);
@@ -16,6 +16,13 @@
 
 #define IPC_MAX_CONN_PER_SERVER 32
 #define MAX_CAP_TRANSFER        8
+/* Words carried in registers by sys_ipc_call_reg */
+#define IPC_REG_MSG_WORDS 4
+/*
+ * The server's ipc_msg argument for sys_ipc_call_reg, never a valid buffer
+ * address. A NULL ipc_msg stays a plain call without data.
+ */
+#define IPC_REG_MSG_ARG ((u64)-1)
 
 /*
  * Used in both server and client register.
@@ -75,3 +82,4 @@ u64 sys_register_server(u64 callback, u64 max_client, u64 vm_config_ptr);
 u32 sys_register_client(u32 server_cap, u64 vm_config_ptr);
 u64 sys_ipc_call(u32 conn_cap, struct ipc_msg* ipc_msg, u64 cap_num);
 void sys_ipc_return(u64 ret, u64 cap_num);
+u64 sys_ipc_call_reg(u32 conn_cap, u64 w0, u64 w1, u64 w2, u64 w3);
@@ -14,6 +14,8 @@
 
 #include <common/types.h>
 #include <common/list.h>
+#include <common/lock.h>
+#include <machine.h>
 
 /*
  * Supported Order: [0, BUDDY_MAX_ORDER).
@@ -45,6 +47,25 @@ struct free_list {
         u64 nr_free;
 };
 
+/*
+ * Per-CPU cache of order-0 pages in front of the buddy free lists.
+ * Pages move between the cache and the buddy system PCP_BATCH at a time,
+ * so the pool lock is taken once per batch instead of once per page.
+ * A cache holding more than PCP_HIGH pages gives a batch back.
+ */
+#define PCP_BATCH (16)
+#define PCP_HIGH  (64)
+
+struct pcp_cache {
+        /* Only contended when another CPU drains this cache on OOM */
+        struct lock lock;
+        /* Cached pages stay marked as allocated order-0 pages */
+        struct list_head pages;
+        u64 count;
+        char pad[pad_to_cache_line(sizeof(struct lock)
+                                   + sizeof(struct list_head) + sizeof(u64))];
+};
+
 /* Disjoint physical memory can be represented by several phys_mem_pool. */
 struct phys_mem_pool {
         /*
@@ -68,6 +89,12 @@ struct phys_mem_pool {
 
         /* The free list of different free-memory-chunk orders. */
         struct free_list free_lists[BUDDY_MAX_ORDER];
+
+        /* Protects free_lists */
+        struct lock buddy_lock;
+
+        /* Hot order-0 pages of each CPU */
+        struct pcp_cache pcp[PLAT_CPU_NUM];
 };
 
 extern struct phys_mem_pool global_mem[];
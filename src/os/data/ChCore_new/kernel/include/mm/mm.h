@@ -25,6 +25,8 @@ void arch_mm_init(void);
 void mm_init(void);
 void set_page_table(paddr_t pgtbl);
 void flush_tlbs(struct vmspace *, u64, u64);
+void tlb_gather_range(struct vmspace *, vaddr_t, size_t);
+void tlb_gather_flush(struct vmspace *);
 
 static inline bool is_user_addr(vaddr_t vaddr)
 {
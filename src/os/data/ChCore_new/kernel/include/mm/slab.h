@@ -13,6 +13,7 @@
 #pragma once
 
 #include <common/types.h>
+#include <common/lock.h>
 
 #define SLAB_INIT_SIZE (2 * 1024 * 1024) // 2M
 
@@ -20,11 +21,51 @@
 #define SLAB_MIN_ORDER (5)
 #define SLAB_MAX_ORDER (11)
 
+/*
+ * Object sizes are the powers of two in the order range plus the midpoints
+ * between them: 32, 48, 64, 96, ..., 1536, 2048.
+ */
+#define SLAB_CLASS_NUM (2 * (SLAB_MAX_ORDER - SLAB_MIN_ORDER) + 1)
+
+/*
+ * Each CPU keeps a magazine of free objects per size class.
+ * Objects move between a magazine and the slabs SLAB_MAG_BATCH at a time.
+ */
+#define SLAB_MAG_SIZE  (32)
+#define SLAB_MAG_BATCH (SLAB_MAG_SIZE / 2)
+
 typedef struct slab_header slab_header_t;
 struct slab_header {
         void* free_list_head;
         slab_header_t* next_slab;
-        int order;
+        /* Index of the size class this slab belongs to */
+        int size_class;
+};
+
+struct slab_class {
+        /* Protects the slab chain and the counters below */
+        struct lock lock;
+        slab_header_t* slabs;
+        u64 obj_size;
+        u64 nr_slabs;
+        /* Free objects in the slabs, excluding those in magazines */
+        u64 nr_free;
+};
+
+struct slab_magazine {
+        u64 count;
+        void* objs[SLAB_MAG_SIZE];
+};
+
+struct slab_class_stats {
+        u64 obj_size;
+        u64 nr_slabs;
+        /* Objects handed out by kmalloc */
+        u64 nr_used;
+        /* Free objects in the slabs */
+        u64 nr_free;
+        /* Free objects cached in the per-CPU magazines */
+        u64 nr_cached;
 };
 
 typedef struct slab_slot_list slab_slot_list_t;
@@ -38,3 +79,4 @@ void* alloc_in_slab(u64);
 void free_in_slab(void* addr);
 
 u64 get_free_mem_size_from_slab(void);
+int get_slab_class_stats(int size_class, struct slab_class_stats* stats);
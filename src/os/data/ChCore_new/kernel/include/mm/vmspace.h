@@ -14,24 +14,54 @@
 
 #include <common/list.h>
 #include <common/radix.h>
+#include <common/rbtree.h>
 #include <arch/mmu.h>
 #include <machine.h>
 
 struct vmregion {
         struct list_head node; /* vmr_list */
+        struct rb_node tree_node; /* vmr_tree */
         vaddr_t start;
         size_t size;
         vmr_prop_t perm;
         struct pmobject* pmo;
+        /* Fault-around state: next expected fault index and window size */
+        u64 fault_next_index;
+        u32 fault_window;
+};
+
+/* Upper bound of pages mapped by one (non-huge) page fault */
+#define FAULT_AROUND_MAX_PAGES 16
+
+/* A range unmapped from a vmspace whose TLB flush is deferred */
+struct tlb_gather {
+        vaddr_t start;
+        /* 0 when nothing is pending */
+        vaddr_t end;
 };
 
 struct vmspace {
         /* List head of vmregion (vmr_list) */
         struct list_head vmr_list;
+        /*
+         * The same vmregions ordered by start address (vmr_tree).
+         * vmregions never overlap, so the region containing a va is the
+         * one with the greatest start not above it.
+         */
+        struct rb_root vmr_tree;
+        /* The vmregion found by the last find_vmr_for_va */
+        struct vmregion* cached_vmr;
         /* Root page table */
         void* pgtbl;
 
         u64 pcid;
+        /*
+         * Cores that may hold TLB entries of this vmspace, one bit per cpu
+         * id. Set on switching to it and never cleared, since the entries
+         * are tagged with pcid and survive switches.
+         */
+        u64 tlb_cpus;
+        struct tlb_gather tlb_gather;
 
         /* Heap-related: only used for user processes */
         struct vmregion* heap_vmr;
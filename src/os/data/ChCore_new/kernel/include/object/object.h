@@ -43,6 +43,12 @@ enum object_type {
         TYPE_NR,
 };
 
+/*
+ * Rights of a cap slot. A set bit takes a right away, so the default 0 is
+ * full access. Copies of a cap inherit its rights.
+ */
+#define CAP_RIGHT_NO_WRITE (1 << 0)
+
 struct cap_group;
 
 typedef void (*obj_deinit_func)(void*);
@@ -61,6 +67,7 @@ int cap_move(struct cap_group* src_cap_group, struct cap_group* dest_cap_group,
              int src_slot_id);
 
 int cap_free_all(struct cap_group* cap_group, int slot_id);
+u64 cap_get_rights(struct cap_group* cap_group, int slot_id);
 
 /* Syscalls */
 int sys_cap_copy_to(u64 dest_cap_group_cap, u64 src_slot_id);
@@ -68,4 +75,6 @@ int sys_cap_copy_from(u64 src_cap_group_cap, u64 src_slot_id);
 int sys_transfer_caps(u64 dest_group_cap, u64 src_caps_buf, int nr_caps,
                       u64 dst_caps_buf);
 int sys_cap_move(u64 dest_cap_group_cap, u64 src_slot_id);
+int sys_cap_free(u64 slot_id);
+int sys_cap_restrict(u64 slot_id, u64 rights);
 int sys_get_all_caps(u64 cap_group_cap);
@@ -27,6 +27,7 @@ u64 arch_get_thread_next_ip(struct thread* thread);
 void arch_set_thread_info_page(struct thread* thread, u64 info_page_addr);
 void arch_set_thread_arg0(struct thread* thread, u64 arg);
 void arch_set_thread_arg1(struct thread* thread, u64 pid);
+void arch_set_thread_arg(struct thread* thread, u32 n, u64 arg);
 void set_thread_arch_spec_state(struct thread* thread);
 
 void arch_enable_interrupt(struct thread* thread);
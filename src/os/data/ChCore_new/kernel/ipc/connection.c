@@ -644,3 +644,34 @@ out_obj_put:
 out_fail:
         return r;
 }
+
+/*
+ * Fast path for short requests: up to IPC_REG_MSG_WORDS words are passed in
+ * the server's x2-x5 and the shared buffer is not touched at all.
+ * The server handler gets IPC_REG_MSG_ARG as ipc_msg and replies with
+ * ipc_return().
+ */
+u64 sys_ipc_call_reg(u32 conn_cap, u64 w0, u64 w1, u64 w2, u64 w3)
+{
+        struct ipc_connection* conn = NULL;
+        struct thread* target;
+
+        conn = obj_get(current_thread->cap_group, conn_cap, TYPE_CONNECTION);
+
+        if (!conn) {
+                return -ECAPBILITY;
+        }
+
+        conn->ipc_msg = NULL;
+
+        target = conn->target;
+        arch_set_thread_arg(target, 2, w0);
+        arch_set_thread_arg(target, 3, w1);
+        arch_set_thread_arg(target, 4, w2);
+        arch_set_thread_arg(target, 5, w3);
+
+        thread_migrate_to_server(conn, IPC_REG_MSG_ARG);
+
+        BUG("This function should never\n");
+        return 0;
+}
@@ -15,6 +15,32 @@
 #include <common/macro.h>
 #include <common/radix.h>
 #include <common/errno.h>
+#include <arch/sync.h>
+
+/*
+ * Lookups do not take radix_lock. Writers (radix_add/radix_del) still
+ * serialize on it, and publish a slot with a release store only after
+ * everything it points to is initialized, so a reader that loads the slot
+ * with acquire sees a complete node (zeroed by kzalloc) or value.
+ *
+ * Nodes are never freed while the tree is in use: deleting a key only
+ * clears its slot, and radix_free runs when the owner (e.g., a pmo) is
+ * destroyed, i.e., after its last reference, and so after the last
+ * reader. That plays the role of the grace period, and no reader can
+ * reach a freed node.
+ */
+static inline void* radix_load(void** slot)
+{
+        void* value;
+
+        ldar_64(slot, value);
+        return value;
+}
+
+static inline void radix_publish(void** slot, void* value)
+{
+        stlr_64(slot, value);
+}
 
 struct radix* new_radix(void)
 {
@@ -73,7 +99,7 @@ int radix_add(struct radix* radix, u64 key, void* value)
                         goto fail_out;
                 }
 
-                radix->root = new;
+                radix_publish((void**)&radix->root, new);
         }
 
         node = radix->root;
@@ -96,7 +122,7 @@ int radix_add(struct radix* radix, u64 key, void* value)
                                 goto fail_out;
                         }
 
-                        node->children[k] = new;
+                        radix_publish((void**)&node->children[k], new);
                 }
 
                 node = node->children[k];
@@ -110,7 +136,7 @@ int radix_add(struct radix* radix, u64 key, void* value)
                 BUG_ON(1);
         }
 
-        node->values[k] = value;
+        radix_publish(&node->values[k], value);
 
         unlock(&radix->radix_lock);
         return 0;
@@ -120,23 +146,20 @@ fail_out:
         return ret;
 }
 
+/* Lock-free, may run concurrently with radix_add/radix_del */
 void* radix_get(struct radix* radix, u64 key)
 {
-        void* ret;
         struct radix_node* node;
         u16 index[RADIX_LEVELS];
         int i;
         int k;
 
-        lock(&radix->radix_lock);
+        node = radix_load((void**)&radix->root);
 
-        if (!radix->root) {
-                ret = NULL;
-                goto out;
+        if (!node) {
+                return NULL;
         }
 
-        node = radix->root;
-
         /* calculate index for each level */
         for (i = 0; i < RADIX_LEVELS; ++i) {
                 index[i] = key & RADIX_NODE_MASK;
@@ -146,22 +169,16 @@ void* radix_get(struct radix* radix, u64 key)
         /* the intermediate levels */
         for (i = RADIX_LEVELS - 1; i > 0; --i) {
                 k = index[i];
+                node = radix_load((void**)&node->children[k]);
 
-                if (!node->children[k]) {
-                        ret = NULL;
-                        goto out;
+                if (!node) {
+                        return NULL;
                 }
-
-                node = node->children[k];
         }
 
         /* the leaf level */
         k = index[0];
-        ret = node->values[k];
-
-out:
-        unlock(&radix->radix_lock);
-        return ret;
+        return radix_load(&node->values[k]);
 }
 
 int radix_del(struct radix* radix, u64 key)
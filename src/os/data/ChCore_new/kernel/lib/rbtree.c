@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan
+ * PSL v1. You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ * KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE. See the
+ * Mulan PSL v1 for more details.
+ */
+
+#include <common/rbtree.h>
+
+static inline int is_black(struct rb_node* node)
+{
+        /* NULL leaves are black */
+        return node == NULL || node->color == RB_BLACK;
+}
+
+static inline void change_child(struct rb_root* root, struct rb_node* parent,
+                                struct rb_node* old, struct rb_node* new)
+{
+        if (parent == NULL) {
+                root->node = new;
+        } else if (parent->left == old) {
+                parent->left = new;
+        } else {
+                parent->right = new;
+        }
+}
+
+static void rotate_left(struct rb_root* root, struct rb_node* x)
+{
+        struct rb_node* y = x->right;
+
+        x->right = y->left;
+        if (y->left) {
+                y->left->parent = x;
+        }
+        y->parent = x->parent;
+        change_child(root, x->parent, x, y);
+        y->left = x;
+        x->parent = y;
+}
+
+static void rotate_right(struct rb_root* root, struct rb_node* x)
+{
+        struct rb_node* y = x->left;
+
+        x->left = y->right;
+        if (y->right) {
+                y->right->parent = x;
+        }
+        y->parent = x->parent;
+        change_child(root, x->parent, x, y);
+        y->right = x;
+        x->parent = y;
+}
+
+void rb_insert_color(struct rb_node* node, struct rb_root* root)
+{
+        struct rb_node *parent, *gparent, *uncle;
+
+        while ((parent = node->parent) && parent->color == RB_RED) {
+                /* A red parent is never the root, so gparent exists */
+                gparent = parent->parent;
+
+                if (parent == gparent->left) {
+                        uncle = gparent->right;
+                        if (!is_black(uncle)) {
+                                /* Recolor and continue from gparent */
+                                parent->color = RB_BLACK;
+                                uncle->color = RB_BLACK;
+                                gparent->color = RB_RED;
+                                node = gparent;
+                                continue;
+                        }
+                        if (node == parent->right) {
+                                rotate_left(root, parent);
+                                node = parent;
+                                parent = node->parent;
+                        }
+                        parent->color = RB_BLACK;
+                        gparent->color = RB_RED;
+                        rotate_right(root, gparent);
+                } else {
+                        uncle = gparent->left;
+                        if (!is_black(uncle)) {
+                                parent->color = RB_BLACK;
+                                uncle->color = RB_BLACK;
+                                gparent->color = RB_RED;
+                                node = gparent;
+                                continue;
+                        }
+                        if (node == parent->left) {
+                                rotate_right(root, parent);
+                                node = parent;
+                                parent = node->parent;
+                        }
+                        parent->color = RB_BLACK;
+                        gparent->color = RB_RED;
+                        rotate_left(root, gparent);
+                }
+        }
+
+        root->node->color = RB_BLACK;
+}
+
+/* @node took the place of a removed black node and lacks one black */
+static void erase_fixup(struct rb_root* root, struct rb_node* node,
+                        struct rb_node* parent)
+{
+        struct rb_node* sibling;
+
+        while (node != root->node && is_black(node)) {
+                if (node == parent->left) {
+                        sibling = parent->right;
+                        if (!is_black(sibling)) {
+                                sibling->color = RB_BLACK;
+                                parent->color = RB_RED;
+                                rotate_left(root, parent);
+                                sibling = parent->right;
+                        }
+                        if (is_black(sibling->left)
+                            && is_black(sibling->right)) {
+                                sibling->color = RB_RED;
+                                node = parent;
+                                parent = node->parent;
+                                continue;
+                        }
+                        if (is_black(sibling->right)) {
+                                sibling->left->color = RB_BLACK;
+                                sibling->color = RB_RED;
+                                rotate_right(root, sibling);
+                                sibling = parent->right;
+                        }
+                        sibling->color = parent->color;
+                        parent->color = RB_BLACK;
+                        sibling->right->color = RB_BLACK;
+                        rotate_left(root, parent);
+                } else {
+                        sibling = parent->left;
+                        if (!is_black(sibling)) {
+                                sibling->color = RB_BLACK;
+                                parent->color = RB_RED;
+                                rotate_right(root, parent);
+                                sibling = parent->left;
+                        }
+                        if (is_black(sibling->left)
+                            && is_black(sibling->right)) {
+                                sibling->color = RB_RED;
+                                node = parent;
+                                parent = node->parent;
+                                continue;
+                        }
+                        if (is_black(sibling->left)) {
+                                sibling->right->color = RB_BLACK;
+                                sibling->color = RB_RED;
+                                rotate_left(root, sibling);
+                                sibling = parent->left;
+                        }
+                        sibling->color = parent->color;
+                        parent->color = RB_BLACK;
+                        sibling->left->color = RB_BLACK;
+                        rotate_right(root, parent);
+                }
+                node = root->node;
+                break;
+        }
+
+        if (node) {
+                node->color = RB_BLACK;
+        }
+}
+
+void rb_erase(struct rb_node* node, struct rb_root* root)
+{
+        struct rb_node *child, *parent, *succ;
+        int color;
+
+        if (node->left && node->right) {
+                /* Replace the node with its in-order successor */
+                succ = node->right;
+                while (succ->left) {
+                        succ = succ->left;
+                }
+
+                child = succ->right;
+                parent = succ->parent;
+                color = succ->color;
+
+                if (parent == node) {
+                        /* child stays the right child of succ */
+                        parent = succ;
+                } else {
+                        parent->left = child;
+                        if (child) {
+                                child->parent = parent;
+                        }
+                        succ->right = node->right;
+                        node->right->parent = succ;
+                }
+
+                succ->left = node->left;
+                node->left->parent = succ;
+                succ->color = node->color;
+                succ->parent = node->parent;
+                change_child(root, node->parent, node, succ);
+        } else {
+                child = node->left ? node->left : node->right;
+                parent = node->parent;
+                color = node->color;
+
+                if (child) {
+                        child->parent = parent;
+                }
+                change_child(root, parent, node, child);
+        }
+
+        if (color == RB_BLACK) {
+                erase_fixup(root, child, parent);
+        }
+
+        RB_CLEAR_NODE(node);
+}
+
+struct rb_node* rb_first(struct rb_root* root)
+{
+        struct rb_node* node = root->node;
+
+        if (node == NULL) {
+                return NULL;
+        }
+        while (node->left) {
+                node = node->left;
+        }
+        return node;
+}
+
+struct rb_node* rb_last(struct rb_root* root)
+{
+        struct rb_node* node = root->node;
+
+        if (node == NULL) {
+                return NULL;
+        }
+        while (node->right) {
+                node = node->right;
+        }
+        return node;
+}
+
+struct rb_node* rb_next(struct rb_node* node)
+{
+        struct rb_node* parent;
+
+        if (node->right) {
+                node = node->right;
+                while (node->left) {
+                        node = node->left;
+                }
+                return node;
+        }
+
+        while ((parent = node->parent) && node == parent->right) {
+                node = parent;
+        }
+        return parent;
+}
+
+struct rb_node* rb_prev(struct rb_node* node)
+{
+        struct rb_node* parent;
+
+        if (node->left) {
+                node = node->left;
+                while (node->right) {
+                        node = node->right;
+                }
+                return node;
+        }
+
+        while ((parent = node->parent) && node == parent->left) {
+                node = parent;
+        }
+        return parent;
+}
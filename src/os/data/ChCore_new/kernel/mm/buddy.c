@@ -14,6 +14,7 @@
 #include <common/macro.h>
 #include <common/kprint.h>
 #include <mm/buddy.h>
+#include <arch/machine/smp.h>
 
 #define BUDDYx
 
@@ -31,6 +32,8 @@
         } while (0);
 #endif
 
+static void __buddy_free_pages(struct phys_mem_pool* pool, struct page* page);
+
 /*
  * The layout of a phys_mem_pool:
  * | page_metadata are (an array of struct page) | alignment pad | usable memory
@@ -43,6 +46,7 @@ void init_buddy(struct phys_mem_pool* pool, struct page* start_page,
 {
         int order;
         int page_idx;
+        int cpuid;
         struct page* page;
 
         /* Init the physical memory pool. */
@@ -58,6 +62,14 @@ void init_buddy(struct phys_mem_pool* pool, struct page* start_page,
                 init_list_head(&(pool->free_lists[order].free_list));
         }
 
+        /* Init the lock and the per-CPU page caches */
+        lock_init(&pool->buddy_lock);
+        for (cpuid = 0; cpuid < PLAT_CPU_NUM; ++cpuid) {
+                lock_init(&pool->pcp[cpuid].lock);
+                init_list_head(&pool->pcp[cpuid].pages);
+                pool->pcp[cpuid].count = 0;
+        }
+
         /* Clear the page_metadata area. */
         memset((char*)start_page, 0, page_num * sizeof(struct page));
 
@@ -72,7 +84,7 @@ void init_buddy(struct phys_mem_pool* pool, struct page* start_page,
         /* Put each physical memory page into the free lists. */
         for (page_idx = 0; page_idx < page_num; ++page_idx) {
                 page = start_page + page_idx;
-                buddy_free_pages(pool, page);
+                __buddy_free_pages(pool, page);
                 // printk("%d\n", page_idx);
         }
 }
@@ -143,7 +155,8 @@ static struct page* split_page(struct phys_mem_pool* pool, u64 order,
         /* LAB 2 TODO 2 END */
 }
 
-struct page* buddy_get_pages(struct phys_mem_pool* pool, u64 order)
+/* Caller must hold pool->buddy_lock */
+static struct page* __buddy_get_pages(struct phys_mem_pool* pool, u64 order)
 {
         /* LAB 2 TODO 2 BEGIN */
         /*
@@ -152,7 +165,7 @@ struct page* buddy_get_pages(struct phys_mem_pool* pool, u64 order)
          */
         u64 match_order = order;
 
-        while (match_order <= BUDDY_MAX_ORDER) {
+        while (match_order < BUDDY_MAX_ORDER) {
                 if (pool->free_lists[match_order].nr_free > 0) {
                         struct page* target_page = split_page(
                                 pool,
@@ -206,7 +219,8 @@ static struct page* merge_page(struct phys_mem_pool* pool, struct page* page)
         /* LAB 2 TODO 2 END */
 }
 
-void buddy_free_pages(struct phys_mem_pool* pool, struct page* page)
+/* Caller must hold pool->buddy_lock */
+static void __buddy_free_pages(struct phys_mem_pool* pool, struct page* page)
 {
         /* LAB 2 TODO 2 BEGIN */
         /*
@@ -231,6 +245,137 @@ void buddy_free_pages(struct phys_mem_pool* pool, struct page* page)
         /* LAB 2 TODO 2 END */
 }
 
+/*
+ * Take one page from the cache of the current CPU.
+ * An empty cache is refilled with up to PCP_BATCH pages first.
+ */
+static struct page* pcp_get_page(struct phys_mem_pool* pool)
+{
+        struct pcp_cache* pcp = &pool->pcp[smp_get_cpu_id()];
+        struct page* page = NULL;
+        int i;
+
+        lock(&pcp->lock);
+        if (pcp->count == 0) {
+                lock(&pool->buddy_lock);
+                for (i = 0; i < PCP_BATCH; ++i) {
+                        page = __buddy_get_pages(pool, 0);
+                        if (page == NULL) {
+                                break;
+                        }
+                        list_add(&page->node, &pcp->pages);
+                        pcp->count++;
+                }
+                unlock(&pool->buddy_lock);
+        }
+
+        page = NULL;
+        if (pcp->count > 0) {
+                /* The most recently freed page is the most likely cached */
+                page = list_entry(pcp->pages.next, struct page, node);
+                list_del(&page->node);
+                pcp->count--;
+        }
+        unlock(&pcp->lock);
+
+        return page;
+}
+
+/* Caller must hold pcp->lock */
+static u64 pcp_drain(struct phys_mem_pool* pool, struct pcp_cache* pcp,
+                     u64 nr)
+{
+        struct page* page;
+        u64 drained = 0;
+
+        lock(&pool->buddy_lock);
+        while (drained < nr && pcp->count > 0) {
+                /* Give back the coldest pages */
+                page = list_entry(pcp->pages.prev, struct page, node);
+                list_del(&page->node);
+                pcp->count--;
+                __buddy_free_pages(pool, page);
+                drained++;
+        }
+        unlock(&pool->buddy_lock);
+
+        return drained;
+}
+
+static void pcp_put_page(struct phys_mem_pool* pool, struct page* page)
+{
+        struct pcp_cache* pcp = &pool->pcp[smp_get_cpu_id()];
+
+        lock(&pcp->lock);
+        list_add(&page->node, &pcp->pages);
+        pcp->count++;
+        if (pcp->count > PCP_HIGH) {
+                pcp_drain(pool, pcp, PCP_BATCH);
+        }
+        unlock(&pcp->lock);
+}
+
+/*
+ * Return the pages cached by all CPUs to the buddy system so that they can
+ * be merged again. Used when an allocation cannot be satisfied.
+ */
+static u64 pcp_drain_all(struct phys_mem_pool* pool)
+{
+        struct pcp_cache* pcp;
+        u64 drained = 0;
+        int cpuid;
+
+        for (cpuid = 0; cpuid < PLAT_CPU_NUM; ++cpuid) {
+                pcp = &pool->pcp[cpuid];
+                lock(&pcp->lock);
+                drained += pcp_drain(pool, pcp, pcp->count);
+                unlock(&pcp->lock);
+        }
+
+        return drained;
+}
+
+struct page* buddy_get_pages(struct phys_mem_pool* pool, u64 order)
+{
+        struct page* page;
+
+        if (order >= BUDDY_MAX_ORDER) {
+                return NULL;
+        }
+
+        if (order == 0) {
+                page = pcp_get_page(pool);
+                if (page) {
+                        return page;
+                }
+        }
+
+        lock(&pool->buddy_lock);
+        page = __buddy_get_pages(pool, order);
+        unlock(&pool->buddy_lock);
+
+        /* Free pages may be stranded in the caches of other CPUs */
+        if (page == NULL && pcp_drain_all(pool) > 0) {
+                lock(&pool->buddy_lock);
+                page = __buddy_get_pages(pool, order);
+                unlock(&pool->buddy_lock);
+        }
+
+        return page;
+}
+
+void buddy_free_pages(struct phys_mem_pool* pool, struct page* page)
+{
+        if (page->order == 0) {
+                pcp_put_page(pool, page);
+                return;
+        }
+
+        lock(&pool->buddy_lock);
+        __buddy_free_pages(pool, page);
+        unlock(&pool->buddy_lock);
+}
+
 void show_page(struct page* page)
 {
         BUDDY_LOG("Page: order->%d, allocated->%d, next:->%llx, prev->%llx",
@@ -310,6 +455,7 @@ u64 get_free_mem_size_from_buddy(struct phys_mem_pool* pool)
         struct free_list* list;
         u64 current_order_size;
         u64 total_size = 0;
+        int cpuid;
 
         for (order = 0; order < BUDDY_MAX_ORDER; order++) {
                 /* 2^order * 4K */
@@ -324,6 +470,11 @@ u64 get_free_mem_size_from_buddy(struct phys_mem_pool* pool)
                        list->nr_free);
         }
 
+        /* Pages in the per-CPU caches are free as well */
+        for (cpuid = 0; cpuid < PLAT_CPU_NUM; cpuid++) {
+                total_size += pool->pcp[cpuid].count * BUDDY_PAGE_SIZE;
+        }
+
         return total_size;
 }
 
@@ -20,12 +20,105 @@
 #include <mm/vmspace.h>
 #include <mm/kmalloc.h>
 #include <mm/mm.h>
+#include <mm/buddy.h>
 #include <mm/vmspace.h>
 #include <arch/mmu.h>
 #include <object/thread.h>
 #include <object/cap_group.h>
 #include <sched/context.h>
 
+/* Order of a 2M block in 4K pages */
+#define HUGE_PAGE_ORDER 9
+#define HUGE_PAGE_PAGES (1UL << HUGE_PAGE_ORDER)
+
+/*
+ * Back the whole 2M block around `fault_addr` with one physically contiguous
+ * chunk and map it with a single L2 block entry. This is only done when the
+ * block lies inside the vmr and the pmo, none of its pages has been
+ * committed yet and nothing is mapped there.
+ * Returns the number of pages mapped, or 0 if the caller should fall back
+ * to 4K pages.
+ */
+static u64 map_huge_block(struct vmspace* vmspace, struct vmregion* vmr,
+                          vaddr_t fault_addr)
+{
+        struct pmobject* pmo = vmr->pmo;
+        vaddr_t blk_va;
+        void* blk;
+        paddr_t pa;
+        u64 index;
+        u64 i;
+
+        blk_va = ROUND_DOWN(fault_addr, PAGE_SIZE_2M);
+        if (blk_va < vmr->start || blk_va + PAGE_SIZE_2M > vmr->start + vmr->size)
+                return 0;
+
+        index = (blk_va - vmr->start) / PAGE_SIZE;
+        if ((index + HUGE_PAGE_PAGES) * PAGE_SIZE > pmo->size)
+                return 0;
+
+        for (i = 0; i < HUGE_PAGE_PAGES; ++i) {
+                if (get_page_from_pmo(pmo, index + i) != 0)
+                        return 0;
+        }
+
+        if (!is_l2_entry_free(vmspace->pgtbl, blk_va))
+                return 0;
+
+        blk = get_pages(HUGE_PAGE_ORDER);
+        if (blk == NULL)
+                return 0;
+
+        pa = virt_to_phys(blk);
+        if (pa & (PAGE_SIZE_2M - 1)) {
+                /* The memory pool does not start at a 2M boundary */
+                free_pages(blk);
+                return 0;
+        }
+
+        memset(blk, 0, PAGE_SIZE_2M);
+        /*
+         * The pmo frees its pages one by one (see __free_pmo_page), so hand
+         * out the chunk as 512 independent order-0 pages.
+         */
+        for (i = 0; i < HUGE_PAGE_PAGES; ++i) {
+                set_alloc_page(virt_to_page(blk + i * PAGE_SIZE), 0);
+                commit_page_to_pmo(pmo, index + i, pa + i * PAGE_SIZE);
+        }
+
+        map_range_in_pgtbl_huge(
+                vmspace->pgtbl, blk_va, pa, PAGE_SIZE_2M, vmr->perm);
+
+        vmr->fault_next_index = index + HUGE_PAGE_PAGES;
+        vmr->fault_window = 0;
+        return HUGE_PAGE_PAGES;
+}
+
+/*
+ * Number of pages to map for a fault on page `index` of `vmr`.
+ * Faults that continue where the previous one stopped double the window
+ * (up to FAULT_AROUND_MAX_PAGES), any other fault resets it to one page.
+ */
+static u64 fault_around_pages(struct vmregion* vmr, u64 index)
+{
+        u64 nr_pages;
+        u64 vmr_pages;
+        u64 pmo_pages;
+
+        if (vmr->fault_window != 0 && index == vmr->fault_next_index)
+                vmr->fault_window =
+                        MIN(vmr->fault_window * 2, FAULT_AROUND_MAX_PAGES);
+        else
+                vmr->fault_window = 1;
+
+        vmr_pages = vmr->size / PAGE_SIZE;
+        pmo_pages = ROUND_UP(vmr->pmo->size, PAGE_SIZE) / PAGE_SIZE;
+        nr_pages = MIN(vmr->fault_window, MIN(vmr_pages, pmo_pages) - index);
+
+        vmr->fault_next_index = index + nr_pages;
+        return nr_pages;
+}
+
 int handle_trans_fault(struct vmspace* vmspace, vaddr_t fault_addr)
 {
         struct vmregion* vmr;
@@ -33,6 +126,8 @@ int handle_trans_fault(struct vmspace* vmspace, vaddr_t fault_addr)
         paddr_t pa;
         u64 offset;
         u64 index;
+        u64 nr_pages;
+        u64 i;
         int ret = 0;
 
         vmr = find_vmr_for_va(vmspace, fault_addr);
@@ -75,55 +170,70 @@ int handle_trans_fault(struct vmspace* vmspace, vaddr_t fault_addr)
                 if (pa == 0) {
                         /* Not committed before. Then, allocate the physical
                          * page. */
-                        /* LAB 3 TODO BEGIN */
-                        vaddr_t va = get_pages(0);
-                        BUG_ON(va == 0);
-                        memset(va, 0, PAGE_SIZE);
-                        pa = virt_to_phys(va);
-                        commit_page_to_pmo(pmo, index, pa);
-                        map_range_in_pgtbl(vmspace->pgtbl,
-                                           fault_addr,
-                                           pa,
-                                           PAGE_SIZE,
-                                           perm);
-/* LAB 3 TODO END */
 #ifdef CHCORE_LAB3_TEST
                         printk("Test: Test: Successfully map for pa 0\n");
 #endif
-                } else {
-                        /*
-                         * pa != 0: the faulting address has be committed a
-                         * physical page.
-                         *
-                         * For concurrent page faults:
-                         *
-                         * When type is PMO_ANONYM, the later faulting threads
-                         * of the process do not need to modify the page
-                         * table because a previous faulting thread will do
-                         * that. (This is always true for the same process)
-                         * However, if one process map an anonymous pmo for
-                         * another process (e.g., main stack pmo), the faulting
-                         * thread (e.g, in the new process) needs to update its
-                         * page table.
-                         * So, for simplicity, we just update the page table.
-                         * Note that adding the same mapping is harmless.
-                         *
-                         * When type is PMO_SHM, the later faulting threads
-                         * needs to add the mapping in the page table.
-                         * Repeated mapping operations are harmless.
-                         */
                         /* LAB 3 TODO BEGIN */
+                        nr_pages = map_huge_block(vmspace, vmr, fault_addr);
+                        if (nr_pages != 0) {
+                                fault_addr = ROUND_DOWN(fault_addr,
+                                                        PAGE_SIZE_2M);
+                                goto flush;
+                        }
+                        /* LAB 3 TODO END */
+                } else {
+#ifdef CHCORE_LAB3_TEST
+                        printk("Test: Test: Successfully map for pa not 0\n");
+#endif
+                }
+
+                /*
+                 * Map the faulting page and, for sequential access, the
+                 * following ones so that they do not fault again. Pages that
+                 * are not committed yet are allocated here.
+                 *
+                 * For pages that have been committed before:
+                 *
+                 * When type is PMO_ANONYM, the later faulting threads
+                 * of the process do not need to modify the page
+                 * table because a previous faulting thread will do
+                 * that. (This is always true for the same process)
+                 * However, if one process map an anonymous pmo for
+                 * another process (e.g., main stack pmo), the faulting
+                 * thread (e.g, in the new process) needs to update its
+                 * page table.
+                 * So, for simplicity, we just update the page table.
+                 * Note that adding the same mapping is harmless.
+                 *
+                 * When type is PMO_SHM, the later faulting threads
+                 * needs to add the mapping in the page table.
+                 * Repeated mapping operations are harmless.
+                 */
+                nr_pages = fault_around_pages(vmr, index);
+                for (i = 0; i < nr_pages; ++i) {
+                        if (i != 0)
+                                pa = get_page_from_pmo(pmo, index + i);
+                        if (pa == 0) {
+                                void* va = get_pages(0);
+                                if (va == NULL) {
+                                        /* Only the faulting page is a must */
+                                        BUG_ON(i == 0);
+                                        nr_pages = i;
+                                        vmr->fault_next_index = index + i;
+                                        break;
+                                }
+                                memset(va, 0, PAGE_SIZE);
+                                pa = virt_to_phys(va);
+                                commit_page_to_pmo(pmo, index + i, pa);
+                        }
                         map_range_in_pgtbl(vmspace->pgtbl,
-                                           fault_addr,
+                                           fault_addr + i * PAGE_SIZE,
                                            pa,
                                            PAGE_SIZE,
                                            perm);
-/* LAB 3 TODO END */
-#ifdef CHCORE_LAB3_TEST
-                        printk("Test: Test: Successfully map for pa not 0\n");
-#endif
                 }
 
+flush:
 /* Cortex A53 has VIPT I-cache which is inconsistent with
  * dcache. */
 #ifdef CHCORE_ARCH_AARCH64
@@ -136,7 +246,8 @@ int handle_trans_fault(struct vmspace* vmspace, vaddr_t fault_addr)
                          */
                         BUG_ON(current_thread->vmspace != vmspace);
                         /* 4 means flush idcache. */
-                        arch_flush_cache(fault_addr, PAGE_SIZE, 4);
+                        arch_flush_cache(
+                                fault_addr, nr_pages * PAGE_SIZE, 4);
                 }
 
 #endif
@@ -13,12 +13,27 @@
 #include <common/macro.h>
 #include <common/types.h>
 #include <common/kprint.h>
+#include <common/errno.h>
 #include <mm/kmalloc.h>
 #include <mm/buddy.h>
 #include <mm/slab.h>
+#include <arch/machine/smp.h>
+#include <machine.h>
 
 /* local variables */
-slab_header_t* slabs[SLAB_MAX_ORDER + 1] = {NULL};
+struct slab_class slab_classes[SLAB_CLASS_NUM];
+
+/* Per-CPU magazines, only accessed by their owner CPU */
+struct slab_cpu_cache {
+        struct slab_magazine mags[SLAB_CLASS_NUM];
+} __attribute__((aligned(CACHELINE_SZ)));
+
+struct slab_cpu_cache slab_cpu_caches[PLAT_CPU_NUM];
+
+/* Size class of each allocation size, indexed by (size + 15) / 16 */
+#define SLAB_SIZE_SHIFT     (4)
+#define SLAB_SIZE_TABLE_LEN ((1 << (SLAB_MAX_ORDER - SLAB_SIZE_SHIFT)) + 1)
+static u8 size_to_class_table[SLAB_SIZE_TABLE_LEN];
 
 /* local functions */
 static inline u64 size_to_order(u64 size)
@@ -43,6 +58,24 @@ static inline u64 order_to_size(u64 order)
         return 1UL << order;
 }
 
+/* Class 2k is 2^(MIN_ORDER + k), class 2k + 1 lies halfway to the next one */
+static inline u64 class_to_size(int size_class)
+{
+        u64 size = order_to_size(SLAB_MIN_ORDER + size_class / 2);
+
+        if (size_class & 1) {
+                size += size / 2;
+        }
+
+        return size;
+}
+
+static inline u64 objs_per_slab(struct slab_class* sc)
+{
+        /* the first slot is used as metadata */
+        return SLAB_INIT_SIZE / sc->obj_size - 1;
+}
+
 static void* alloc_slab_memory(u64 size)
 {
         struct page *p_page, *page;
@@ -72,7 +105,7 @@ static void* alloc_slab_memory(u64 size)
         return addr;
 }
 
-static slab_header_t* init_slab_cache(int order, int size)
+static slab_header_t* init_slab_cache(int size_class, int size)
 {
         void* addr;
         slab_slot_list_t* slot;
@@ -83,14 +116,14 @@ static slab_header_t* init_slab_cache(int order, int size)
         addr = alloc_slab_memory(size);
         slab = (slab_header_t*)addr;
 
-        obj_size = order_to_size(order);
+        obj_size = class_to_size(size_class);
         /* the first slot is used as metadata */
         cnt = size / obj_size - 1;
 
         slot = (slab_slot_list_t*)(addr + obj_size);
         slab->free_list_head = (void*)slot;
         slab->next_slab = NULL;
-        slab->order = order;
+        slab->size_class = size_class;
 
         /* the last slot has no next one */
         for (i = 0; i < cnt - 1; i++) {
@@ -103,49 +136,91 @@ static slab_header_t* init_slab_cache(int order, int size)
         return slab;
 }
 
-static void* _alloc_in_slab_nolock(slab_header_t* slab_header, int order)
+/* Caller must hold sc->lock */
+static void* _alloc_in_slab_nolock(struct slab_class* sc, int size_class)
 {
         slab_slot_list_t* first_slot;
-        void* next_slot;
-        slab_header_t* next_slab;
+        slab_header_t* slab;
         slab_header_t* new_slab;
 
-        first_slot = (slab_slot_list_t*)(slab_header->free_list_head);
+        for (slab = sc->slabs; slab != NULL; slab = slab->next_slab) {
+                first_slot = (slab_slot_list_t*)(slab->free_list_head);
 
-        if (likely(first_slot != NULL)) {
-                next_slot = first_slot->next_free;
-                slab_header->free_list_head = next_slot;
-                return first_slot;
+                if (likely(first_slot != NULL)) {
+                        slab->free_list_head = first_slot->next_free;
+                        sc->nr_free--;
+                        return first_slot;
+                }
         }
 
-        next_slab = slab_header->next_slab;
+        /* Allocate a new slab */
+        new_slab = init_slab_cache(size_class, SLAB_INIT_SIZE);
+        new_slab->next_slab = sc->slabs;
+        sc->slabs = new_slab;
+        sc->nr_slabs++;
+        sc->nr_free += objs_per_slab(sc);
+
+        return _alloc_in_slab_nolock(sc, size_class);
+}
 
-        while (next_slab != NULL) {
-                first_slot = (slab_slot_list_t*)(next_slab->free_list_head);
+/* Caller must hold the lock of the size class of `addr` */
+static void _free_in_slab_nolock(void* addr)
+{
+        struct page* page;
+        slab_header_t* slab;
+        slab_slot_list_t* slot;
 
-                if (likely(first_slot != NULL)) {
-                        next_slot = first_slot->next_free;
-                        next_slab->free_list_head = next_slot;
-                        return first_slot;
-                }
+        slot = (slab_slot_list_t*)addr;
+        page = virt_to_page(addr);
+        BUG_ON(page == NULL || page->slab == NULL);
 
-                next_slab = next_slab->next_slab;
+        slab = page->slab;
+        slot->next_free = slab->free_list_head;
+        slab->free_list_head = slot;
+        slab_classes[slab->size_class].nr_free++;
+}
+
+/* Fill an empty magazine with a batch of objects from the slabs */
+static void magazine_refill(struct slab_magazine* mag, int size_class)
+{
+        struct slab_class* sc = &slab_classes[size_class];
+
+        lock(&sc->lock);
+        while (mag->count < SLAB_MAG_BATCH) {
+                mag->objs[mag->count++] = _alloc_in_slab_nolock(sc, size_class);
         }
+        unlock(&sc->lock);
+}
 
-        /* Allocate a new slab */
-        new_slab = init_slab_cache(order, SLAB_INIT_SIZE);
-        new_slab->next_slab = slab_header;
-        slabs[order] = new_slab;
+/* Return the oldest batch of a full magazine to the slabs */
+static void magazine_flush(struct slab_magazine* mag, int size_class)
+{
+        struct slab_class* sc = &slab_classes[size_class];
+        int i;
 
-        return _alloc_in_slab_nolock(new_slab, order);
+        lock(&sc->lock);
+        for (i = 0; i < SLAB_MAG_BATCH; i++) {
+                _free_in_slab_nolock(mag->objs[i]);
+        }
+        unlock(&sc->lock);
+
+        for (i = SLAB_MAG_BATCH; i < mag->count; i++) {
+                mag->objs[i - SLAB_MAG_BATCH] = mag->objs[i];
+        }
+        mag->count -= SLAB_MAG_BATCH;
 }
 
-static void* _alloc_in_slab(slab_header_t* slab_header, int order)
+static void* _alloc_in_slab(int size_class)
 {
-        void* free_slot;
+        struct slab_magazine* mag;
 
-        free_slot = _alloc_in_slab_nolock(slab_header, order);
-        return free_slot;
+        mag = &slab_cpu_caches[smp_get_cpu_id()].mags[size_class];
+
+        if (unlikely(mag->count == 0)) {
+                magazine_refill(mag, size_class);
+        }
+
+        return mag->objs[--mag->count];
 }
 
 /*
@@ -154,11 +229,29 @@ static void* _alloc_in_slab(slab_header_t* slab_header, int order)
 
 void init_slab()
 {
-        int order;
+        int size_class;
+        int i;
+        u64 size;
+
+        /* slab obj size: 32, 48, 64, 96, 128, ..., 1024, 1536, 2048 */
+        for (size_class = 0; size_class < SLAB_CLASS_NUM; size_class++) {
+                lock_init(&slab_classes[size_class].lock);
+                slab_classes[size_class].obj_size = class_to_size(size_class);
+                slab_classes[size_class].slabs =
+                        init_slab_cache(size_class, SLAB_INIT_SIZE);
+                slab_classes[size_class].nr_slabs = 1;
+                slab_classes[size_class].nr_free =
+                        objs_per_slab(&slab_classes[size_class]);
+        }
 
-        /* slab obj size: 32, 64, 128, 256, 512, 1024, 2048 */
-        for (order = SLAB_MIN_ORDER; order <= SLAB_MAX_ORDER; order++) {
-                slabs[order] = init_slab_cache(order, SLAB_INIT_SIZE);
+        /* Map each size to the smallest class that holds it */
+        size_class = 0;
+        for (i = 0; i < SLAB_SIZE_TABLE_LEN; i++) {
+                size = (u64)i << SLAB_SIZE_SHIFT;
+                while (class_to_size(size_class) < size) {
+                        size_class++;
+                }
+                size_to_class_table[i] = size_class;
         }
 
         kdebug("mm: finish initing slab allocators\n");
@@ -166,66 +259,81 @@ void init_slab()
 
 void* alloc_in_slab(u64 size)
 {
-        int order;
-
         BUG_ON(size > order_to_size(SLAB_MAX_ORDER));
 
-        order = (int)size_to_order(size);
-
-        if (order < SLAB_MIN_ORDER) {
-                order = SLAB_MIN_ORDER;
-        }
-
-        return _alloc_in_slab(slabs[order], order);
+        return _alloc_in_slab(
+                size_to_class_table[(size + (1 << SLAB_SIZE_SHIFT) - 1)
+                                    >> SLAB_SIZE_SHIFT]);
 }
 
 void free_in_slab(void* addr)
 {
         struct page* page;
         slab_header_t* slab;
-        slab_slot_list_t* slot;
+        struct slab_magazine* mag;
 
-        slot = (slab_slot_list_t*)addr;
         page = virt_to_page(addr);
         BUG_ON(page == NULL);
 
         slab = page->slab;
-        slot->next_free = slab->free_list_head;
-        slab->free_list_head = slot;
+        mag = &slab_cpu_caches[smp_get_cpu_id()].mags[slab->size_class];
+
+        if (unlikely(mag->count == SLAB_MAG_SIZE)) {
+                magazine_flush(mag, slab->size_class);
+        }
+
+        mag->objs[mag->count++] = addr;
 }
 
-/* Get the size of free memory in slab */
-u64 get_free_mem_size_from_slab(void)
+int get_slab_class_stats(int size_class, struct slab_class_stats* stats)
 {
-        int order;
-        slab_header_t* current_slab;
-        slab_slot_list_t* slot;
-        u64 current_slot_size;
-        u64 total_size = 0;
-        u64 current_slot_num; /* used for debug */
+        struct slab_class* sc;
+        int cpuid;
+
+        if (size_class < 0 || size_class >= SLAB_CLASS_NUM || stats == NULL) {
+                return -EINVAL;
+        }
 
-        for (order = SLAB_MIN_ORDER; order <= SLAB_MAX_ORDER; order++) {
-                current_slab = slabs[order];
-                current_slot_size = order_to_size(order);
-                current_slot_num = 0;
+        sc = &slab_classes[size_class];
+        stats->nr_cached = 0;
 
-                /* walk throught all the slabs of a certain order */
-                while (current_slab != NULL) {
-                        slot = current_slab->free_list_head;
+        /* Magazines of other CPUs are read racily, good enough for stats */
+        for (cpuid = 0; cpuid < PLAT_CPU_NUM; cpuid++) {
+                stats->nr_cached +=
+                        slab_cpu_caches[cpuid].mags[size_class].count;
+        }
 
-                        /* walk through all the slots of a certain slab */
-                        while (slot != NULL) {
-                                total_size += current_slot_size;
-                                current_slot_num++;
-                                slot = slot->next_free;
-                        }
+        lock(&sc->lock);
+        stats->obj_size = sc->obj_size;
+        stats->nr_slabs = sc->nr_slabs;
+        stats->nr_free = sc->nr_free;
+        unlock(&sc->lock);
 
-                        current_slab = current_slab->next_slab;
-                }
+        stats->nr_used = stats->nr_slabs * objs_per_slab(sc) - stats->nr_free
+                         - stats->nr_cached;
+
+        return 0;
+}
+
+/* Get the size of free memory in slab */
+u64 get_free_mem_size_from_slab(void)
+{
+        int size_class;
+        struct slab_class_stats stats;
+        u64 total_size = 0;
 
-                kdebug("slab memory chunk size : 0x%lx, num : %d\n",
-                       current_slot_size,
-                       current_slot_num);
+        for (size_class = 0; size_class < SLAB_CLASS_NUM; size_class++) {
+                BUG_ON(get_slab_class_stats(size_class, &stats));
+                total_size += (stats.nr_free + stats.nr_cached)
+                              * stats.obj_size;
+
+                kdebug("slab chunk size: 0x%lx, slabs: %lu, used: %lu, "
+                       "free: %lu, cached: %lu\n",
+                       stats.obj_size,
+                       stats.nr_slabs,
+                       stats.nr_used,
+                       stats.nr_free,
+                       stats.nr_cached);
         }
 
         return total_size;
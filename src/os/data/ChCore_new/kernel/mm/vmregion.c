@@ -27,6 +27,11 @@ static struct vmregion* alloc_vmregion(void)
         struct vmregion* vmr;
 
         vmr = kmalloc(sizeof(*vmr));
+        if (vmr) {
+                RB_CLEAR_NODE(&vmr->tree_node);
+                vmr->fault_next_index = 0;
+                vmr->fault_window = 0;
+        }
         return vmr;
 }
 
@@ -35,6 +40,31 @@ static void free_vmregion(struct vmregion* vmr)
         kfree((void*)vmr);
 }
 
+static inline int vmr_contains(struct vmregion* vmr, vaddr_t addr)
+{
+        return addr >= vmr->start && addr < vmr->start + vmr->size;
+}
+
+/* Returns the vmregion with the greatest start <= addr, or NULL */
+static struct vmregion* find_vmr_floor(struct vmspace* vmspace, vaddr_t addr)
+{
+        struct rb_node* node = vmspace->vmr_tree.node;
+        struct vmregion* vmr;
+        struct vmregion* floor = NULL;
+
+        while (node) {
+                vmr = rb_entry(node, struct vmregion, tree_node);
+                if (addr < vmr->start) {
+                        node = node->left;
+                } else {
+                        floor = vmr;
+                        node = node->right;
+                }
+        }
+
+        return floor;
+}
+
 /*
  * Returns 0 when no intersection detected.
  */
@@ -42,6 +72,7 @@ static int check_vmr_intersect(struct vmspace* vmspace,
                                struct vmregion* vmr_to_add)
 {
         struct vmregion* vmr;
+        struct rb_node* node;
         vaddr_t new_start, start;
         vaddr_t new_end, end;
 
@@ -52,10 +83,22 @@ static int check_vmr_intersect(struct vmspace* vmspace,
         new_start = vmr_to_add->start;
         new_end = new_start + vmr_to_add->size - 1;
 
-        for_each_in_list (vmr, struct vmregion, node, &(vmspace->vmr_list)) {
+        /*
+         * Regions before the floor of new_start end before it, so only the
+         * floor and its successors starting up to new_end are candidates.
+         */
+        vmr = find_vmr_floor(vmspace, new_start);
+        node = vmr ? &vmr->tree_node : rb_first(&vmspace->vmr_tree);
+
+        for (; node != NULL; node = rb_next(node)) {
+                vmr = rb_entry(node, struct vmregion, tree_node);
                 start = vmr->start;
                 end = start + vmr->size;
 
+                if (start > new_end) {
+                        break;
+                }
+
                 if (!((new_start >= end) || (new_end <= start))) {
                         kwarn("new_start: %p, new_ned: %p, start: %p, end: %p\n",
                               new_start,
@@ -69,36 +112,45 @@ static int check_vmr_intersect(struct vmspace* vmspace,
         return 0;
 }
 
-static int is_vmr_in_vmspace(struct vmspace* vmspace, struct vmregion* vmr)
-{
-        struct vmregion* iter;
-
-        for_each_in_list (iter, struct vmregion, node, &(vmspace->vmr_list)) {
-                if (iter == vmr) {
-                        return 1;
-                }
-        }
-        return 0;
-}
-
 static int add_vmr_to_vmspace(struct vmspace* vmspace, struct vmregion* vmr)
 {
+        struct rb_node** link = &vmspace->vmr_tree.node;
+        struct rb_node* parent = NULL;
+
         if (check_vmr_intersect(vmspace, vmr) != 0) {
                 kwarn("Detecting: vmr overlap\n");
                 BUG_ON(1);
                 return -EINVAL;
         }
 
+        while (*link) {
+                parent = *link;
+                if (vmr->start
+                    < rb_entry(parent, struct vmregion, tree_node)->start) {
+                        link = &parent->left;
+                } else {
+                        link = &parent->right;
+                }
+        }
+        rb_link_node(&vmr->tree_node, parent, link);
+        rb_insert_color(&vmr->tree_node, &vmspace->vmr_tree);
+
         list_add(&(vmr->node), &(vmspace->vmr_list));
         return 0;
 }
 
 static void del_vmr_from_vmspace(struct vmspace* vmspace, struct vmregion* vmr)
 {
-        if (is_vmr_in_vmspace(vmspace, vmr)) {
+        /* Regions not added to a vmspace have an empty tree_node */
+        if (!RB_EMPTY_NODE(&vmr->tree_node)) {
+                rb_erase(&vmr->tree_node, &vmspace->vmr_tree);
                 list_del(&(vmr->node));
         }
 
+        if (vmspace->cached_vmr == vmr) {
+                vmspace->cached_vmr = NULL;
+        }
+
         free_vmregion(vmr);
 }
 
@@ -122,6 +174,7 @@ static int unmap_vmrs(struct vmspace* vmspace, vaddr_t va, size_t len)
 {
         struct vmregion* vmr;
         struct pmobject* pmo;
+        size_t size;
 
         if (len == 0) {
                 return 0;
@@ -157,22 +210,24 @@ static int unmap_vmrs(struct vmspace* vmspace, vaddr_t va, size_t len)
 
                 unmap_range_in_pgtbl(vmspace->pgtbl, va, len);
 
-                /* Flush TLBs */
-                flush_tlbs(vmspace, va, len);
+                /* Flushed by the caller of unmap_vmrs */
+                tlb_gather_range(vmspace, va, len);
 
                 return 0;
         }
 
+        size = vmr->size;
+
         /* delete the vmr from the vmspace */
         del_vmr_from_vmspace(vmspace, vmr);
 
         /* Umap a whole vmr */
         unmap_range_in_pgtbl(vmspace->pgtbl, va, len);
 
-        flush_tlbs(vmspace, va, len);
+        tlb_gather_range(vmspace, va, len);
 
-        va += vmr->size;
-        len -= vmr->size;
+        va += size;
+        len -= size;
         return unmap_vmrs(vmspace, va, len);
 }
 
@@ -200,17 +255,20 @@ void kprint_vmr(struct vmspace* vmspace)
 struct vmregion* find_vmr_for_va(struct vmspace* vmspace, vaddr_t addr)
 {
         struct vmregion* vmr;
-        vaddr_t start, end;
 
-        for_each_in_list (vmr, struct vmregion, node, &(vmspace->vmr_list)) {
-                start = vmr->start;
-                end = start + vmr->size;
+        /* Consecutive faults usually hit the same region */
+        vmr = vmspace->cached_vmr;
+        if (vmr && vmr_contains(vmr, addr)) {
+                return vmr;
+        }
 
-                if (addr >= start && addr < end) {
-                        return vmr;
-                }
+        vmr = find_vmr_floor(vmspace, addr);
+        if (vmr == NULL || !vmr_contains(vmr, addr)) {
+                return NULL;
         }
-        return NULL;
+
+        vmspace->cached_vmr = vmr;
+        return vmr;
 }
 
 int vmspace_map_range(struct vmspace* vmspace, vaddr_t va, size_t len,
@@ -313,10 +371,10 @@ int vmspace_unmap_range(struct vmspace* vmspace, vaddr_t va, size_t len)
                 BUG_ON(1);
         }
 
-        del_vmr_from_vmspace(vmspace, vmr);
-
         pmo = vmr->pmo;
 
+        del_vmr_from_vmspace(vmspace, vmr);
+
         /* No pmo is mapped */
         if (pmo == NULL) {
                 ret = 0;
@@ -334,7 +392,8 @@ int vmspace_unmap_range(struct vmspace* vmspace, vaddr_t va, size_t len)
         if (likely(len != 0)) {
                 unmap_range_in_pgtbl(vmspace->pgtbl, va, len);
 
-                flush_tlbs(vmspace, va, len);
+                tlb_gather_range(vmspace, va, len);
+                tlb_gather_flush(vmspace);
         }
 
         /*
@@ -352,6 +411,9 @@ out:
  * If a process wants to map pmos to another process`s vmspace and
  * free these pmo_caps in its own cap group. It may use this function to
  * remove the mappings in its own vmspace
+ *
+ * The TLB flush is only gathered: the caller calls tlb_gather_flush once
+ * after removing all the pmos it wants to.
  */
 int unmap_pmo_in_vmspace(struct vmspace* vmspace, struct pmobject* pmo)
 {
@@ -384,7 +446,7 @@ int unmap_pmo_in_vmspace(struct vmspace* vmspace, struct pmobject* pmo)
         /* Remove the mapping in page table */
         unmap_range_in_pgtbl(vmspace->pgtbl, flush_va_start, flush_len);
 
-        flush_tlbs(vmspace, flush_va_start, flush_len);
+        tlb_gather_range(vmspace, flush_va_start, flush_len);
 
         return 0;
 out:
@@ -500,7 +562,13 @@ out_fail:
 
 int vmspace_munmap_with_addr(struct vmspace* vmspace, vaddr_t va, size_t len)
 {
-        return unmap_vmrs(vmspace, va, len);
+        int ret;
+
+        /* One flush for all the vmrs in the range */
+        ret = unmap_vmrs(vmspace, va, len);
+        tlb_gather_flush(vmspace);
+
+        return ret;
 }
 
 int vmspace_unmap_shm_vmr(struct vmspace* vmspace, vaddr_t va)
@@ -540,7 +608,8 @@ int vmspace_unmap_shm_vmr(struct vmspace* vmspace, vaddr_t va)
         del_vmr_from_vmspace(vmspace, vmr);
 
         /* Flush TLBs without holding locks */
-        flush_tlbs(vmspace, flush_va_start, flush_len);
+        tlb_gather_range(vmspace, flush_va_start, flush_len);
+        tlb_gather_flush(vmspace);
 
         return 0;
 
@@ -553,6 +622,11 @@ extern void arch_vmspace_init(struct vmspace*);
 int vmspace_init(struct vmspace* vmspace)
 {
         init_list_head(&vmspace->vmr_list);
+        init_rb_root(&vmspace->vmr_tree);
+        vmspace->cached_vmr = NULL;
+        vmspace->tlb_cpus = 0;
+        vmspace->tlb_gather.start = 0;
+        vmspace->tlb_gather.end = 0;
         /* Allocate the root page table page */
         vmspace->pgtbl = get_pages(0);
         BUG_ON(vmspace->pgtbl == NULL);
@@ -14,6 +14,9 @@
 #include <object/object.h>
 #include <object/cap_group.h>
 #include <object/thread.h>
+#include <object/memory.h>
+#include <mm/vmspace.h>
+#include <mm/mm.h>
 #include <mm/kmalloc.h>
 #include <mm/uaccess.h>
 #include <lib/printk.h>
@@ -219,6 +222,7 @@ int cap_copy(struct cap_group* src_cap_group, struct cap_group* dest_cap_group,
         dest_slot->slot_id = dest_slot_id;
         dest_slot->cap_group = dest_cap_group;
         dest_slot->isvalid = true;
+        dest_slot->rights = src_slot->rights;
         dest_slot->object = src_slot->object;
 
         list_add(&dest_slot->copies, &src_slot->copies);
@@ -291,6 +295,20 @@ out_fail:
         return r;
 }
 
+/* Returns 0 (full access) for an invalid slot, obj_get rejects it anyway */
+u64 cap_get_rights(struct cap_group* cap_group, int slot_id)
+{
+        struct object_slot* slot;
+
+        slot = get_slot(cap_group, slot_id);
+
+        if (!slot || slot->isvalid == false) {
+                return 0;
+        }
+
+        return slot->rights;
+}
+
 int sys_cap_copy_to(u64 dest_cap_group_cap, u64 src_slot_id)
 {
         struct cap_group* dest_cap_group;
@@ -380,6 +398,39 @@ int sys_cap_move(u64 dest_cap_group_cap, u64 src_slot_id)
         return r;
 }
 
+/*
+ * Drop one cap of the current cap_group. Mappings are left alone: a mapping
+ * does not record which cap it came from, and other caps of the same PMO may
+ * still be mapped. Callers unmap their own range before dropping the cap.
+ */
+int sys_cap_free(u64 slot_id)
+{
+        /* The cap_group and vmspace caps are never given up */
+        if (slot_id == CAP_GROUP_OBJ_ID || slot_id == VMSPACE_OBJ_ID) {
+                return -EINVAL;
+        }
+
+        return cap_free(current_cap_group, slot_id);
+}
+
+/*
+ * Take rights away from a cap of the current cap_group, e.g., before handing
+ * out copies of it. Rights can only be dropped, never regained.
+ */
+int sys_cap_restrict(u64 slot_id, u64 rights)
+{
+        struct object_slot* slot;
+
+        slot = get_slot(current_cap_group, slot_id);
+
+        if (!slot || slot->isvalid == false) {
+                return -ECAPBILITY;
+        }
+
+        slot->rights |= rights;
+        return 0;
+}
+
 // for debug
 int sys_get_all_caps(u64 cap_group_cap)
 {
@@ -177,6 +177,13 @@ static int read_write_pmo(u64 pmo_cap, u64 offset, u64 user_buf, u64 size,
                 goto out_obj_put;
         }
 
+        if (op_type == WRITE
+            && (cap_get_rights(current_cap_group, pmo_cap)
+                & CAP_RIGHT_NO_WRITE)) {
+                r = -EPERM;
+                goto out_obj_put;
+        }
+
         /* Range check */
         if (offset + size < offset || offset + size > pmo->size) {
                 r = -EINVAL;
@@ -351,6 +358,14 @@ int sys_map_pmo(u64 target_cap_group_cap, u64 pmo_cap, u64 addr, u64 perm,
                 goto out_fail;
         }
 
+        /* A read-only cap cannot be mapped writable, here or in others */
+        if ((perm & VMR_WRITE)
+            && (cap_get_rights(current_cap_group, pmo_cap)
+                & CAP_RIGHT_NO_WRITE)) {
+                r = -EPERM;
+                goto out_obj_put_pmo;
+        }
+
         /* translate default length (-1) to pmo_size */
         if (likely(len == -1)) {
                 len = pmo->size;
@@ -455,6 +470,7 @@ int sys_map_pmos(u64 target_cap_group_cap, u64 user_buf, u64 cnt)
         struct pmobject* pmo;
         int i;
         int map_ret, ret = 0;
+        bool unmapped = false;
 
         /* in case of integer overflow */
         if (cnt > MAX_CNT) {
@@ -505,7 +521,9 @@ int sys_map_pmos(u64 target_cap_group_cap, u64 user_buf, u64 cnt)
                          * vmregion in current vmspace, we need
                          * to remove the mapping.
                          */
-                        unmap_pmo_in_vmspace(vmspace, pmo);
+                        if (unmap_pmo_in_vmspace(vmspace, pmo) == 0) {
+                                unmapped = true;
+                        }
 
                         cap_free(current_cap_group, requests[i].pmo_cap);
                         obj_put(vmspace);
@@ -513,6 +531,15 @@ int sys_map_pmos(u64 target_cap_group_cap, u64 user_buf, u64 cnt)
                 }
         }
 
+        /* One TLB flush for all the pmos removed above */
+        if (unmapped) {
+                vmspace = obj_get(
+                        current_cap_group, VMSPACE_OBJ_ID, TYPE_VMSPACE);
+                BUG_ON(vmspace == NULL);
+                tlb_gather_flush(vmspace);
+                obj_put(vmspace);
+        }
+
         copy_to_user((char*)user_buf, (char*)requests, size);
 
         kfree(requests);
@@ -25,6 +25,7 @@
 #include <object/thread.h>
 #include <irq/irq.h>
 #include <sched/context.h>
+#include <common/lock.h>
 
 #define RRx
 
@@ -46,11 +47,27 @@
 /* in arch/sched/idle.S */
 void idle_thread_routine(void);
 
+/*
+ * Load balancing
+ * An idle CPU steals one thread from the busiest ready queue before falling
+ * back to its idle thread. Besides, every RR_BALANCE_PERIOD scheduling
+ * decisions a CPU pulls threads from the busiest queue if that queue is
+ * longer than its own by at least RR_BALANCE_THRESHOLD.
+ * Only NO_AFF threads are migrated, pinned threads never leave their CPU.
+ */
+#define RR_BALANCE_PERIOD    4
+#define RR_BALANCE_THRESHOLD 2
+
 /* Metadata for ready queue */
 struct queue_meta {
         struct list_head queue_head;
+        /* Protects queue_head and queue_len against remote stealers */
+        struct lock queue_lock;
         u32 queue_len;
-        char pad[pad_to_cache_line(sizeof(u32) + sizeof(struct list_head))];
+        /* Only touched by the owner CPU */
+        u32 balance_tick;
+        char pad[pad_to_cache_line(sizeof(struct list_head)
+                                   + sizeof(struct lock) + 2 * sizeof(u32))];
 };
 
 /*
@@ -107,11 +124,13 @@ int rr_sched_enqueue(struct thread* thread)
         s32 cpuid = (aff == NO_AFF) ? smp_get_cpu_id() : aff;
 
         /* Set thread state to TS_READY & Add to ready queue */
+        lock(&rr_ready_queue_meta[cpuid].queue_lock);
         thread->thread_ctx->state = TS_READY;
         thread->thread_ctx->cpuid = cpuid;
         list_append(&thread->ready_queue_node,
                     &rr_ready_queue_meta[cpuid].queue_head);
         rr_ready_queue_meta[cpuid].queue_len++;
+        unlock(&rr_ready_queue_meta[cpuid].queue_lock);
         // printk("queue_len: %d", rr_ready_queue_meta[cpuid].queue_len);
         // RR_LOG("queue_len: %d", rr_ready_queue_meta[cpuid].queue_len);
         /* LAB 4 TODO END */
@@ -151,18 +170,114 @@ int rr_sched_dequeue(struct thread* thread)
                 return -EINVAL;
         }
 
-        /* Delete the thread from ready queue & set thread state and cpuid */
-        s32 cpuid = smp_get_cpu_id();
+        /*
+         * Delete the thread from the ready queue it resides in, which is not
+         * necessarily the local one, & set thread state and cpuid
+         */
+        s32 qid = thread->thread_ctx->cpuid;
+        lock(&rr_ready_queue_meta[qid].queue_lock);
+        if (thread->thread_ctx->state != TS_READY) {
+                /* Stolen by another CPU before we got the lock */
+                unlock(&rr_ready_queue_meta[qid].queue_lock);
+                return -EINVAL;
+        }
         list_del(&thread->ready_queue_node);
         thread->thread_ctx->state = TS_INTER;
-        thread->thread_ctx->cpuid = cpuid;
-        rr_ready_queue_meta[cpuid].queue_len--;
+        thread->thread_ctx->cpuid = smp_get_cpu_id();
+        rr_ready_queue_meta[qid].queue_len--;
+        unlock(&rr_ready_queue_meta[qid].queue_lock);
         // printk("queue_len: %d", rr_ready_queue_meta[cpuid].queue_len);
         // RR_LOG("queue_len: %d", rr_ready_queue_meta[cpuid].queue_len);
         /* LAB 4 TODO END */
         return 0;
 }
 
+/* Return the CPU with the longest ready queue other than `self`, or -1 */
+static int rr_busiest_cpu(u32 self)
+{
+        int i, busiest = -1;
+        u32 max_len = 0;
+
+        for (i = 0; i < PLAT_CPU_NUM; i++) {
+                /* Racy read, only used as a hint */
+                u32 len = rr_ready_queue_meta[i].queue_len;
+
+                if (i != self && len > max_len) {
+                        max_len = len;
+                        busiest = i;
+                }
+        }
+        return busiest;
+}
+
+/*
+ * Dequeue the first migratable thread from the ready queue of `victim`.
+ * Threads with a fixed affinity are skipped.
+ * Only one queue lock is held at a time, so stealers never deadlock.
+ */
+static struct thread* rr_steal_from(u32 victim)
+{
+        struct thread* thread = NULL;
+        struct thread* iter;
+        struct queue_meta* meta = &rr_ready_queue_meta[victim];
+
+        if (try_lock(&meta->queue_lock) != 0) {
+                /* The owner or another stealer is busy, try next time */
+                return NULL;
+        }
+        for_each_in_list (
+                iter, struct thread, ready_queue_node, &meta->queue_head) {
+                if (iter->thread_ctx->affinity == NO_AFF) {
+                        thread = iter;
+                        break;
+                }
+        }
+        if (thread) {
+                list_del(&thread->ready_queue_node);
+                meta->queue_len--;
+                thread->thread_ctx->state = TS_INTER;
+                thread->thread_ctx->cpuid = smp_get_cpu_id();
+        }
+        unlock(&meta->queue_lock);
+        return thread;
+}
+
+/*
+ * Periodic balancing: pull threads from the busiest queue until both queues
+ * are roughly equal.
+ */
+static void rr_balance(u32 cpuid)
+{
+        struct thread* thread;
+        u32 local_len, remote_len, nr_pull;
+        int busiest;
+
+        if (++rr_ready_queue_meta[cpuid].balance_tick < RR_BALANCE_PERIOD) {
+                return;
+        }
+        rr_ready_queue_meta[cpuid].balance_tick = 0;
+
+        busiest = rr_busiest_cpu(cpuid);
+        if (busiest < 0) {
+                return;
+        }
+        local_len = rr_ready_queue_meta[cpuid].queue_len;
+        remote_len = rr_ready_queue_meta[busiest].queue_len;
+        if (remote_len < local_len + RR_BALANCE_THRESHOLD) {
+                return;
+        }
+
+        for (nr_pull = (remote_len - local_len) / 2; nr_pull > 0; nr_pull--) {
+                thread = rr_steal_from(busiest);
+                if (thread == NULL) {
+                        break;
+                }
+                RR_LOG("pull thread from CPU %d", busiest);
+                /* NO_AFF threads are enqueued on the current CPU */
+                BUG_ON(rr_sched_enqueue(thread));
+        }
+}
+
 /*
  * Lab4
  * Choose an appropriate thread and dequeue from ready queue
@@ -173,20 +288,41 @@ int rr_sched_dequeue(struct thread* thread)
 struct thread* rr_sched_choose_thread(void)
 {
         struct thread* thread = NULL;
+        u32 cpuid = smp_get_cpu_id();
+        struct queue_meta* meta = &rr_ready_queue_meta[cpuid];
+        int busiest;
 
         /* LAB 4 TODO BEGIN */
-        /* if queue len is 0, return IDLE thread */
-        if (rr_ready_queue_meta[smp_get_cpu_id()].queue_len == 0) {
-                thread = &idle_threads[smp_get_cpu_id()];
-                RR_LOG("return IDLE thread");
+        rr_balance(cpuid);
+
+        /* Take the first thread in the local ready queue */
+        lock(&meta->queue_lock);
+        if (meta->queue_len != 0) {
+                thread = list_entry(meta->queue_head.next,
+                                    struct thread,
+                                    ready_queue_node);
+                list_del(&thread->ready_queue_node);
+                meta->queue_len--;
+                thread->thread_ctx->state = TS_INTER;
+                thread->thread_ctx->cpuid = cpuid;
         }
-        /* else dequeue the first thread in ready queue */
-        else {
-                struct list_head* choose_thread_node =
-                        rr_ready_queue_meta[smp_get_cpu_id()].queue_head.next;
-                thread = list_entry(
-                        choose_thread_node, struct thread, ready_queue_node);
-                BUG_ON(rr_sched_dequeue(thread));
+        unlock(&meta->queue_lock);
+
+        /* Local queue is empty, try to steal from the busiest CPU */
+        if (thread == NULL) {
+                busiest = rr_busiest_cpu(cpuid);
+                if (busiest >= 0) {
+                        thread = rr_steal_from(busiest);
+                        if (thread) {
+                                RR_LOG("steal thread from CPU %d", busiest);
+                        }
+                }
+        }
+
+        /* if there is still nothing to run, return IDLE thread */
+        if (thread == NULL) {
+                thread = &idle_threads[cpuid];
+                RR_LOG("return IDLE thread");
         }
 
         /* LAB 4 TODO END */
@@ -269,7 +405,9 @@ int rr_sched_init(void)
         for (i = 0; i < PLAT_CPU_NUM; i++) {
                 current_threads[i] = NULL;
                 init_list_head(&(rr_ready_queue_meta[i].queue_head));
+                lock_init(&(rr_ready_queue_meta[i].queue_lock));
                 rr_ready_queue_meta[i].queue_len = 0;
+                rr_ready_queue_meta[i].balance_tick = 0;
         }
 
         /* Create a fake idle cap group to store the name */
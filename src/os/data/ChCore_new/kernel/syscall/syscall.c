@@ -114,6 +114,8 @@ const void* syscall_table[NR_SYSCALL] = {
         [SYS_cap_copy_to] = sys_cap_copy_to,
         [SYS_cap_copy_from] = sys_cap_copy_from,
         [SYS_transfer_caps] = sys_transfer_caps,
+        [SYS_cap_free] = sys_cap_free,
+        [SYS_cap_restrict] = sys_cap_restrict,
 
         /* Multitask */
         /* - create & exit */
@@ -132,6 +134,7 @@ const void* syscall_table[NR_SYSCALL] = {
         [SYS_register_client] = sys_register_client,
         [SYS_ipc_call] = sys_ipc_call,
         [SYS_ipc_return] = sys_ipc_return,
+        [SYS_ipc_call_reg] = sys_ipc_call_reg,
 
         /* Hardware Access (Privileged Instruction) */
         /* - cache */
@@ -37,6 +37,8 @@
 #define SYS_cap_copy_to   60
 #define SYS_cap_copy_from 61
 #define SYS_transfer_caps 62
+#define SYS_cap_free      63
+#define SYS_cap_restrict  64
 
 /* Multitask */
 /* - create & exit */
@@ -55,6 +57,7 @@
 #define SYS_register_client 121
 #define SYS_ipc_call        122
 #define SYS_ipc_return      123
+#define SYS_ipc_call_reg    124
 
 /* Hardware Access (Privileged Instruction) */
 /* - cache */
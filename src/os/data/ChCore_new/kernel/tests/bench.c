@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan
+ * PSL v1. You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ * KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE. See the
+ * Mulan PSL v1 for more details.
+ */
+
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <arch/machine/smp.h>
+#include <arch/time.h>
+
+#include "bench.h"
+#include "barrier.h"
+
+static u64 bench_start_ticks[PLAT_CPU_NUM];
+static u64 bench_ticks[PLAT_CPU_NUM];
+static u64 baseline_start_ticks;
+static u64 baseline_ticks;
+
+/* All cores start their clocks together */
+void bench_begin(void)
+{
+        global_barrier();
+        bench_start_ticks[smp_get_cpu_id()] = get_timer_cnt();
+}
+
+/* Stop this core's clock and wait for the others */
+void bench_end(void)
+{
+        u32 cpuid = smp_get_cpu_id();
+
+        bench_ticks[cpuid] = get_timer_cnt() - bench_start_ticks[cpuid];
+        global_barrier();
+}
+
+/* Only on core 0, before bench_begin() */
+void bench_baseline_begin(void)
+{
+        baseline_start_ticks = get_timer_cnt();
+}
+
+void bench_baseline_end(void)
+{
+        baseline_ticks = get_timer_cnt() - baseline_start_ticks;
+}
+
+/*
+ * Print the rate of all cores together, `ops` being what each core did.
+ * The phase lasts until the slowest core is done.
+ */
+void bench_report(const char* what, u64 ops)
+{
+        u64 max_ticks = 0;
+        u64 rate, base;
+        int i;
+
+        for (i = 0; i < PLAT_CPU_NUM; i++) {
+                max_ticks = MAX(max_ticks, bench_ticks[i]);
+        }
+
+        rate = max_ticks ? (u64)PLAT_CPU_NUM * ops * get_timer_freq() / max_ticks
+                         : 0;
+        base = baseline_ticks ? ops * get_timer_freq() / baseline_ticks : 0;
+        baseline_ticks = 0;
+
+        if (!base) {
+                kinfo("[TEST] %d cores, %lu %s/s\n", PLAT_CPU_NUM, rate, what);
+                return;
+        }
+
+        /* Speedup over one core, in hundredths */
+        kinfo("[TEST] %d cores, %lu %s/s (1 core: %lu/s, %lu.%02lux)\n",
+              PLAT_CPU_NUM,
+              rate,
+              what,
+              base,
+              rate * 100 / base / 100,
+              rate * 100 / base % 100);
+}
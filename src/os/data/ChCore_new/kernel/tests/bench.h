@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan
+ * PSL v1. You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ * KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE. See the
+ * Mulan PSL v1 for more details.
+ */
+
+#pragma once
+
+#include <common/types.h>
+
+/*
+ * Timing of a phase that all cores run at the same time:
+ *
+ *      bench_begin();
+ *      ... ops operations on every core ...
+ *      bench_end();
+ *      if (smp_get_cpu_id() == 0)
+ *              bench_report("things", ops);
+ *
+ * For a single-core baseline, core 0 first runs the same ops alone between
+ * bench_baseline_begin() and bench_baseline_end() (the other cores wait in
+ * bench_begin()), and bench_report() prints its rate next to the total.
+ */
+void bench_begin(void);
+void bench_end(void);
+void bench_baseline_begin(void);
+void bench_baseline_end(void);
+void bench_report(const char* what, u64 ops);
@@ -37,4 +37,9 @@ void run_test(void)
         tst_sched_preemptive();
         tst_sched_affinity();
         tst_sched();
+        tst_sched_balance();
+        tst_malloc_pages();
+        tst_malloc_slab();
+        tst_vmregion();
+        tst_radix();
 }
@@ -19,5 +19,10 @@ void tst_sched_cooperative(void);
 void tst_sched_preemptive(void);
 void tst_sched_affinity(void);
 void tst_sched(void);
+void tst_sched_balance(void);
 void tst_malloc(void);
+void tst_malloc_pages(void);
+void tst_malloc_slab(void);
+void tst_vmregion(void);
+void tst_radix(void);
 void tst_sched(void);
@@ -15,12 +15,21 @@
 #include <arch/machine/smp.h>
 #include <common/macro.h>
 #include <mm/kmalloc.h>
+#include <mm/slab.h>
 
 #include "tests.h"
+#include "barrier.h"
+#include "bench.h"
 
 #define MALLOC_TEST_NUM   256
 #define MALLOC_TEST_ROUND 10
 
+#define PAGE_TEST_NUM   256
+#define PAGE_TEST_ROUND 64
+
+#define SLAB_TEST_NUM   256
+#define SLAB_TEST_ROUND 128
+
 volatile int malloc_start_flag = 0;
 volatile int malloc_finish_flag = 0;
 
@@ -73,3 +82,108 @@ void tst_malloc(void)
                 kinfo("[TEST] malloc succ!\n");
         }
 }
+
+/*
+ * All cores allocate and free order-0 pages at the same time.
+ * Each page is tagged with its owner, so a page handed out twice is caught.
+ */
+void tst_malloc_pages(void)
+{
+        void* pages[PAGE_TEST_NUM];
+        u32 cpuid = smp_get_cpu_id();
+        u64 tag;
+        int round, i;
+
+        bench_begin();
+        for (round = 0; round < PAGE_TEST_ROUND; round++) {
+                for (i = 0; i < PAGE_TEST_NUM; i++) {
+                        pages[i] = get_pages(0);
+                        BUG_ON(!pages[i]);
+                        *(u64*)pages[i] = ((u64)cpuid << 32) | i;
+                }
+
+                for (i = 0; i < PAGE_TEST_NUM; i++) {
+                        tag = ((u64)cpuid << 32) | i;
+                        BUG_ON(*(u64*)pages[i] != tag);
+                        free_pages(pages[i]);
+                }
+        }
+        bench_end();
+
+        if (cpuid == 0) {
+                /* One get_pages/free_pages pair per page */
+                bench_report("pages", PAGE_TEST_ROUND * PAGE_TEST_NUM);
+                kinfo("[TEST] malloc pages succ!\n");
+        }
+
+        global_barrier();
+}
+
+static u64 slab_used_objs(void)
+{
+        struct slab_class_stats stats;
+        u64 used = 0;
+        int i;
+
+        for (i = 0; i < SLAB_CLASS_NUM; i++) {
+                BUG_ON(get_slab_class_stats(i, &stats));
+                used += stats.nr_used;
+        }
+        return used;
+}
+
+static void slab_rounds(u32 cpuid)
+{
+        char* objs[SLAB_TEST_NUM];
+        int round, i, size;
+
+        for (round = 0; round < SLAB_TEST_ROUND; round++) {
+                for (i = 0; i < SLAB_TEST_NUM; i++) {
+                        /* Sizes cycle through 16..2048 bytes */
+                        size = 16 + (i * 131 + round) % (2048 - 16 + 1);
+                        objs[i] = kmalloc(size);
+                        BUG_ON(!objs[i]);
+                        objs[i][0] = (char)(cpuid + i);
+                        objs[i][size - 1] = (char)(cpuid + i);
+                }
+
+                for (i = 0; i < SLAB_TEST_NUM; i++) {
+                        size = 16 + (i * 131 + round) % (2048 - 16 + 1);
+                        BUG_ON(objs[i][0] != (char)(cpuid + i));
+                        BUG_ON(objs[i][size - 1] != (char)(cpuid + i));
+                        kfree(objs[i]);
+                }
+        }
+}
+
+/*
+ * Core 0 kmallocs and kfrees small objects of every size class alone, then
+ * all cores do it at the same time, and no object may be leaked. The
+ * single-core rate is printed next to the all-core one.
+ */
+void tst_malloc_slab(void)
+{
+        u32 cpuid = smp_get_cpu_id();
+        u64 used = 0;
+
+        if (cpuid == 0) {
+                used = slab_used_objs();
+                bench_baseline_begin();
+                slab_rounds(cpuid);
+                bench_baseline_end();
+        }
+
+        bench_begin();
+        slab_rounds(cpuid);
+        bench_end();
+
+        if (cpuid == 0) {
+                BUG_ON(slab_used_objs() != used);
+                /* One kmalloc/kfree pair per object */
+                bench_report("kmalloc/kfree pairs",
+                             SLAB_TEST_ROUND * SLAB_TEST_NUM);
+                kinfo("[TEST] malloc slab succ!\n");
+        }
+
+        global_barrier();
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan
+ * PSL v1. You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ * KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE. See the
+ * Mulan PSL v1 for more details.
+ */
+
+#include <common/lock.h>
+#include <common/kprint.h>
+#include <common/radix.h>
+#include <arch/machine/smp.h>
+#include <common/macro.h>
+#include <mm/kmalloc.h>
+
+#include "tests.h"
+#include "barrier.h"
+#include "bench.h"
+
+/* Keys laid out like the page indexes of a 16M pmo */
+#define RADIX_TEST_KEYS  4096
+#define RADIX_TEST_ROUND 64
+
+static struct radix* test_radix;
+
+static inline void* radix_test_value(u64 key)
+{
+        return (void*)((key << 12) | 0x1);
+}
+
+/*
+ * All cores look up the same tree at the same time, while core 0 keeps
+ * adding the upper half of the keys. A lookup must see either nothing or
+ * the right value, never a half-built node.
+ */
+void tst_radix(void)
+{
+        u32 cpuid = smp_get_cpu_id();
+        u64 key;
+        void* value;
+        int round, i;
+
+        if (cpuid == 0) {
+                test_radix = new_radix();
+                init_radix(test_radix);
+                for (key = 0; key < RADIX_TEST_KEYS / 2; key++) {
+                        BUG_ON(radix_add(
+                                test_radix, key, radix_test_value(key)));
+                }
+        }
+
+        bench_begin();
+        for (round = 0; round < RADIX_TEST_ROUND; round++) {
+                if (cpuid == 0 && round == 0) {
+                        for (key = RADIX_TEST_KEYS / 2; key < RADIX_TEST_KEYS;
+                             key++) {
+                                BUG_ON(radix_add(test_radix,
+                                                 key,
+                                                 radix_test_value(key)));
+                        }
+                }
+
+                for (i = 0; i < RADIX_TEST_KEYS; i++) {
+                        key = (i + cpuid * 17) % RADIX_TEST_KEYS;
+                        value = radix_get(test_radix, key);
+                        BUG_ON(value != NULL
+                               && value != radix_test_value(key));
+                        BUG_ON(key < RADIX_TEST_KEYS / 2 && value == NULL);
+                }
+        }
+        bench_end();
+
+        if (cpuid == 0) {
+                for (key = 0; key < RADIX_TEST_KEYS; key++) {
+                        BUG_ON(radix_get(test_radix, key)
+                               != radix_test_value(key));
+                }
+                radix_free(test_radix);
+                bench_report("radix lookups",
+                             RADIX_TEST_ROUND * RADIX_TEST_KEYS);
+                kinfo("[TEST] radix succ!\n");
+        }
+
+        global_barrier();
+}
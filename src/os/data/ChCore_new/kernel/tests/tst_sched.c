@@ -19,14 +19,19 @@
 #include <sched/context.h>
 #include <sched/sched.h>
 #include <machine.h>
+#include <arch/sync.h>
+#include <arch/time.h>
 #include "barrier.h"
 
 /* Only for test use */
 /* Metadata for ready queue */
 struct queue_meta {
         struct list_head queue_head;
+        struct lock queue_lock;
         u32 queue_len;
-        char pad[pad_to_cache_line(sizeof(u32) + sizeof(struct list_head))];
+        u32 balance_tick;
+        char pad[pad_to_cache_line(sizeof(struct list_head)
+                                   + sizeof(struct lock) + 2 * sizeof(u32))];
 };
 
 extern struct thread* rr_sched_choose_thread(void);
@@ -35,6 +40,10 @@ extern struct queue_meta rr_ready_queue_meta[PLAT_CPU_NUM];
 #define TEST_NUM   1
 #define THREAD_NUM 8
 
+/* Threads and per-thread spin iterations of tst_sched_balance */
+#define BALANCE_THREAD_NUM (THREAD_NUM * PLAT_CPU_NUM)
+#define BALANCE_WORK       100000
+
 struct lock test_lock;
 
 volatile int sched_start_flag = 0;
@@ -589,3 +598,83 @@ void tst_sched()
                 kinfo("Pass tst_sched!\n");
         }
 }
+
+volatile u32 balance_done = 0;
+u32 balance_ran[PLAT_CPU_NUM];
+u64 balance_cycles[PLAT_CPU_NUM];
+
+static void spin_work(void)
+{
+        volatile int i;
+
+        for (i = 0; i < BALANCE_WORK; i++) {
+        }
+}
+
+/*
+ * All NO_AFF threads start in the ready queue of CPU 0.
+ * The other CPUs only get work by stealing, so the makespan
+ * (the time until the last CPU finishes) shows how well the load spreads.
+ */
+void tst_sched_balance(void)
+{
+        int i = 0;
+        u32 cpuid = smp_get_cpu_id();
+        u32 max_ran = 0;
+        u64 start, max_cycles = 0, sum_cycles = 0;
+
+        balance_ran[cpuid] = 0;
+        global_barrier();
+
+        if (cpuid == 0) {
+                for (i = 0; i < BALANCE_THREAD_NUM; i++) {
+                        BUG_ON(atomic_sched_enqueue(
+                                create_test_thread(i % MAX_PRIO, NO_AFF)));
+                }
+        }
+
+        global_barrier();
+
+        start = get_cycles();
+        while (balance_done < BALANCE_THREAD_NUM) {
+                atomic_sched();
+                current_thread->thread_ctx->sc->budget = 0;
+                if (current_thread->thread_ctx->type == TYPE_IDLE) {
+                        continue;
+                }
+
+                BUG_ON(current_thread->thread_ctx->affinity != NO_AFF);
+                BUG_ON(current_thread->thread_ctx->cpuid != cpuid);
+                spin_work();
+                balance_ran[cpuid]++;
+                balance_cycles[cpuid] = get_cycles() - start;
+                free_test_thread(current_thread);
+                current_thread = NULL;
+                atomic_fetch_add_32(&balance_done, 1);
+        }
+        current_thread = NULL;
+
+        global_barrier();
+
+        if (cpuid == 0) {
+                for (i = 0; i < PLAT_CPU_NUM; i++) {
+                        kinfo("CPU %d ran %u threads in %lu cycles\n",
+                              i,
+                              balance_ran[i],
+                              balance_cycles[i]);
+                        max_ran = MAX(max_ran, balance_ran[i]);
+                        max_cycles = MAX(max_cycles, balance_cycles[i]);
+                        sum_cycles += balance_cycles[i];
+                }
+                /* Without stealing CPU 0 would run every thread */
+                BUG_ON(PLAT_CPU_NUM > 1 && max_ran == BALANCE_THREAD_NUM);
+                kinfo("makespan %lu cycles, imbalance %lu%% over the mean\n",
+                      max_cycles,
+                      sum_cycles ? (max_cycles * PLAT_CPU_NUM * 100 / sum_cycles
+                                    - 100) :
+                                   0);
+                kinfo("Pass tst_sched_balance!\n");
+        }
+
+        global_barrier();
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan
+ * PSL v1. You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ * KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE. See the
+ * Mulan PSL v1 for more details.
+ */
+
+#include <common/kprint.h>
+#include <common/macro.h>
+#include <arch/machine/smp.h>
+#include <arch/time.h>
+#include <mm/kmalloc.h>
+#include <mm/vmspace.h>
+#include <mm/mm.h>
+
+#include "tests.h"
+#include "barrier.h"
+
+/* Only for test use */
+extern int handle_trans_fault(struct vmspace* vmspace, vaddr_t fault_addr);
+extern void vmspace_deinit(void* ptr);
+extern int pmo_init(struct pmobject* pmo, pmo_type_t type, size_t len,
+                    paddr_t paddr);
+extern void pmo_deinit(void* pmo_ptr);
+
+/* VMR_TEST_NUM must be a power of two for vmr_test_perm */
+#define VMR_TEST_NUM   4096
+#define VMR_TEST_ROUND 16
+#define VMR_TEST_BASE  (0x100000000000UL)
+
+/* One-page regions separated by one-page gaps */
+static inline vaddr_t vmr_test_va(int i)
+{
+        return VMR_TEST_BASE + (vaddr_t)i * 2 * PAGE_SIZE;
+}
+
+/* Multiplying by an odd number permutes [0, VMR_TEST_NUM) */
+static inline int vmr_test_perm(int i)
+{
+        return (i * 1237) & (VMR_TEST_NUM - 1);
+}
+
+/*
+ * Map thousands of regions into one vmspace, check lookups at region
+ * boundaries and in the gaps, and measure page fault throughput when
+ * every fault lands in a different region than the previous one.
+ */
+void tst_vmregion(void)
+{
+        struct vmspace* vmspace;
+        struct pmobject* pmo;
+        struct vmregion* vmr;
+        vaddr_t va;
+        u64 start, ticks;
+        int i, round;
+
+        global_barrier();
+
+        if (smp_get_cpu_id() == 0) {
+                vmspace = kzalloc(sizeof(*vmspace));
+                BUG_ON(!vmspace);
+                BUG_ON(vmspace_init(vmspace));
+
+                /* All regions share a single anonymous page */
+                pmo = kzalloc(sizeof(*pmo));
+                BUG_ON(!pmo);
+                BUG_ON(pmo_init(pmo, PMO_ANONYM, PAGE_SIZE, 0));
+
+                for (i = 0; i < VMR_TEST_NUM; i++) {
+                        BUG_ON(vmspace_map_range(vmspace,
+                                                 vmr_test_va(vmr_test_perm(i)),
+                                                 PAGE_SIZE,
+                                                 VMR_READ | VMR_WRITE,
+                                                 pmo));
+                }
+
+                BUG_ON(find_vmr_for_va(vmspace, VMR_TEST_BASE - 1) != NULL);
+                for (i = 0; i < VMR_TEST_NUM; i++) {
+                        va = vmr_test_va(i);
+                        vmr = find_vmr_for_va(vmspace, va);
+                        BUG_ON(vmr == NULL || vmr->start != va);
+                        BUG_ON(find_vmr_for_va(vmspace, va + PAGE_SIZE - 1)
+                               != vmr);
+                        BUG_ON(find_vmr_for_va(vmspace, va + PAGE_SIZE)
+                               != NULL);
+                }
+
+                start = get_timer_cnt();
+                for (round = 0; round < VMR_TEST_ROUND; round++) {
+                        for (i = 0; i < VMR_TEST_NUM; i++) {
+                                va = vmr_test_va(vmr_test_perm(i));
+                                BUG_ON(handle_trans_fault(vmspace,
+                                                          va + round * 8));
+                        }
+                }
+                ticks = get_timer_cnt() - start;
+                kinfo("[TEST] %d vmregions, %lu faults/s\n",
+                      VMR_TEST_NUM,
+                      ticks ? (u64)VMR_TEST_ROUND * VMR_TEST_NUM
+                                      * get_timer_freq() / ticks :
+                              0);
+
+                /* Unmap every other region, the rest must still resolve */
+                for (i = 0; i < VMR_TEST_NUM; i += 2) {
+                        BUG_ON(vmspace_unmap_range(
+                                vmspace, vmr_test_va(i), PAGE_SIZE));
+                }
+                for (i = 0; i < VMR_TEST_NUM; i++) {
+                        vmr = find_vmr_for_va(vmspace, vmr_test_va(i));
+                        BUG_ON((vmr == NULL) != (i % 2 == 0));
+                }
+
+                vmspace_deinit(vmspace);
+                pmo_deinit(pmo);
+                kfree(pmo);
+                kfree(vmspace);
+
+                kinfo("[TEST] vmregion succ!\n");
+        }
+
+        global_barrier();
+}
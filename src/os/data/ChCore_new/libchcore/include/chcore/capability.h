@@ -17,6 +17,9 @@
 /* Capability of current cap_group */
 #define SELF_CAP 0
 
+/* Rights to take away with chcore_cap_restrict, copies of the cap inherit it */
+#define CAP_RIGHT_NO_WRITE (1 << 0)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -27,6 +30,9 @@ int chcore_cap_copy_from(u64 src_cap_group_cap, u64 src_cap);
 int chcore_cap_transfer_multi(u64 dest_group_cap, int* src_caps, int nr_caps,
                               int* dest_caps);
 
+int chcore_cap_free(u64 cap);
+int chcore_cap_restrict(u64 cap, u64 rights);
+
 #ifdef __cplusplus
 }
 #endif
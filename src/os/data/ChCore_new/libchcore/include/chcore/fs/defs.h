@@ -57,6 +57,9 @@ struct dentry {
         struct inode* inode;
         struct hlist_node node;
         int refcnt;
+        /* Link in the parent's dentry_list and its readdir cookie there */
+        struct list_head order;
+        u64 seq;
 };
 
 struct inode {
@@ -66,7 +69,16 @@ struct inode {
         size_t size;
         unsigned int mode;
         union {
-                struct htable dentries;
+                struct {
+                        struct htable dentries;
+                        /*
+                         * Dentries in creation order. Readdir walks this
+                         * list, so its position survives a table resize.
+                         */
+                        struct list_head dentry_list;
+                        /* seq of the next dentry created here */
+                        u64 next_seq;
+                };
                 struct radix data;
         };
 
@@ -78,6 +90,9 @@ struct inode {
                 size_t size; /* Total capacity. */
                 int translated_pmo_cap; /* PMO cap of translated array. */
         } aarray;
+
+        /* Read-only PMO copy of a regular file, for mapped reads (or -1). */
+        int pmo_cap;
 };
 
 struct super_block {
@@ -42,7 +42,9 @@ enum fs_req_type {
         FS_REQ_GETDENTS64,
         FS_REQ_MOUNT,
         FS_REQ_UMOUNT,
-        FS_REQ_GET_FS_CAP
+        FS_REQ_GET_FS_CAP,
+        FS_REQ_GET_PMO,
+        FS_REQ_BATCH
 };
 
 #define FS_READ_BUF_SIZE \
@@ -111,9 +113,35 @@ struct fs_request {
                 struct {
                         char pathname[FS_REQ_PATH_BUF_LEN];
                 } getsize;
+                struct {
+                        int fd;
+                } getpmo;
         };
 };
 
+/*
+ * FS_REQ_BATCH carries several requests in one message: a fs_batch_head
+ * followed by nr_entries slots. The server runs them in order, writes each
+ * result back into its slot, and stops at the first failing one, since later
+ * requests usually depend on it (e.g., read after open). nr_done tells how
+ * many slots were run.
+ */
+#define FS_BATCH_INLINE_DATA (128)
+
+struct fs_batch_entry {
+        long ret;
+        struct fs_request req;
+        /* Write data goes here, read data overwrites req and spills here */
+        char data[FS_BATCH_INLINE_DATA];
+};
+
+struct fs_batch_head {
+        enum fs_req_type req;
+        unsigned int nr_entries;
+        unsigned int nr_done;
+        struct fs_batch_entry entries[];
+};
+
 typedef unsigned long int ino_t;
 typedef long int off_t;
 typedef unsigned int mode_t;
@@ -22,44 +22,154 @@
 extern "C" {
 #endif
 
+/*
+ * A chained hash table of hlist nodes. The caller hashes, the table only
+ * sees a u32 key per node.
+ *
+ * Tables made by init_htable_resizable() grow when the load factor goes above
+ * HTABLE_MAX_LOAD and shrink (not below the initial size) when it drops under
+ * HTABLE_MIN_LOAD_DIV. Resizing is incremental: the old buckets are kept and
+ * each add/del moves HTABLE_MIGRATE_STEP of them to the new table, so no
+ * single operation rehashes everything. Old buckets below migrate_pos are
+ * already moved, hence every key still lives in exactly one bucket (see
+ * htable_get_bucket).
+ *
+ * Nodes must not be added or deleted while iterating the table.
+ */
+#define HTABLE_MAX_LOAD     2
+#define HTABLE_MIN_LOAD_DIV 8
+#define HTABLE_MIGRATE_STEP 4
+
+typedef u32 (*htable_key_fn)(struct hlist_node* node);
+
 struct htable {
         struct hlist_head* buckets;
         int size;
+        /* Number of nodes */
+        int count;
+
+        /* Only for resizable tables */
+        htable_key_fn key_of;
+        int min_size;
+        /* Buckets being moved into `buckets`, NULL if not resizing */
+        struct hlist_head* old_buckets;
+        int old_size;
+        int migrate_pos;
 };
 
 static inline void init_htable(struct htable* ht, int size)
 {
         ht->size = size;
+        ht->count = 0;
         ht->buckets =
                 (struct hlist_head*)calloc(1, sizeof(*ht->buckets) * size);
+        ht->key_of = NULL;
+        ht->min_size = size;
+        ht->old_buckets = NULL;
+        ht->old_size = 0;
+        ht->migrate_pos = 0;
 }
 
-static inline void htable_add(struct htable* ht, u32 key,
-                              struct hlist_node* node)
-{
-        hlist_add(node, &ht->buckets[key % ht->size]);
-}
-
-static inline void htable_del(struct hlist_node* node)
+/* @key_of recomputes the key of a node when it is moved */
+static inline void init_htable_resizable(struct htable* ht, int size,
+                                         htable_key_fn key_of)
 {
-        hlist_del(node);
+        init_htable(ht, size);
+        ht->key_of = key_of;
 }
 
 static inline struct hlist_head* htable_get_bucket(struct htable* ht, u32 key)
 {
+        if (ht->old_buckets && (int)(key % ht->old_size) >= ht->migrate_pos) {
+                return &ht->old_buckets[key % ht->old_size];
+        }
+
         return &ht->buckets[key % ht->size];
 }
 
-static inline bool htable_empty(struct htable* ht)
+/* Move up to @nr_buckets old buckets into the new table */
+static inline void htable_migrate(struct htable* ht, int nr_buckets)
 {
-        int i;
+        struct hlist_head* old;
+        struct hlist_node* node;
+
+        while (ht->old_buckets && nr_buckets-- > 0) {
+                old = &ht->old_buckets[ht->migrate_pos];
 
-        for (i = 0; i < ht->size; ++i)
-                if (!hlist_empty(&ht->buckets[i])) {
-                        return false;
+                while (!hlist_empty(old)) {
+                        node = old->next;
+                        hlist_del(node);
+                        hlist_add(node,
+                                  &ht->buckets[ht->key_of(node) % ht->size]);
                 }
 
-        return true;
+                if (++ht->migrate_pos == ht->old_size) {
+                        free(ht->old_buckets);
+                        ht->old_buckets = NULL;
+                        ht->old_size = 0;
+                        ht->migrate_pos = 0;
+                }
+        }
+}
+
+static inline void htable_resize(struct htable* ht, int new_size)
+{
+        struct hlist_head* buckets;
+
+        /* Finish the ongoing resize first */
+        htable_migrate(ht, ht->old_size);
+
+        buckets = (struct hlist_head*)calloc(1, sizeof(*buckets) * new_size);
+
+        /* Keep the current size if memory is short */
+        if (!buckets) {
+                return;
+        }
+
+        ht->old_buckets = ht->buckets;
+        ht->old_size = ht->size;
+        ht->migrate_pos = 0;
+        ht->buckets = buckets;
+        ht->size = new_size;
+}
+
+static inline void htable_rebalance(struct htable* ht)
+{
+        if (!ht->key_of) {
+                return;
+        }
+
+        if (ht->old_buckets) {
+                htable_migrate(ht, HTABLE_MIGRATE_STEP);
+                return;
+        }
+
+        if (ht->count > ht->size * HTABLE_MAX_LOAD) {
+                htable_resize(ht, ht->size * 2);
+        } else if (ht->size > ht->min_size
+                   && ht->count < ht->size / HTABLE_MIN_LOAD_DIV) {
+                htable_resize(ht, ht->size / 2);
+        }
+}
+
+static inline void htable_add(struct htable* ht, u32 key,
+                              struct hlist_node* node)
+{
+        htable_rebalance(ht);
+        hlist_add(node, htable_get_bucket(ht, key));
+        ht->count++;
+}
+
+static inline void htable_del(struct htable* ht, struct hlist_node* node)
+{
+        hlist_del(node);
+        ht->count--;
+        htable_rebalance(ht);
+}
+
+static inline bool htable_empty(struct htable* ht)
+{
+        return ht->count == 0;
 }
 
 static inline int htable_free(struct htable* ht)
@@ -73,17 +183,43 @@ static inline int htable_free(struct htable* ht)
         // a not allocated by htable_xxx or hlist_xxx
 
         free(ht->buckets);
+        if (ht->old_buckets) {
+                free(ht->old_buckets);
+        }
 
         return 0;
 }
 
-#define for_each_in_htable(elem, b, field, ht)                        \
-        for (b = 0, elem = NULL; elem == NULL && b < (ht)->size; ++b) \
-                for_each_in_hlist (elem, field, &(ht)->buckets[b])
+/* Buckets of the old table (while resizing) come first */
+static inline int htable_nr_buckets(struct htable* ht)
+{
+        return ht->size + (ht->old_buckets ? ht->old_size : 0);
+}
+
+static inline struct hlist_head* htable_bucket_at(struct htable* ht, int b)
+{
+        if (ht->old_buckets) {
+                if (b < ht->old_size) {
+                        return &ht->old_buckets[b];
+                }
+                b -= ht->old_size;
+        }
+
+        return &ht->buckets[b];
+}
 
-#define for_each_in_htable_safe(elem, tmp, b, field, ht)              \
-        for (b = 0, elem = NULL; elem == NULL && b < (ht)->size; ++b) \
-                for_each_in_hlist_safe (elem, tmp, field, &(ht)->buckets[b])
+#define for_each_in_htable(elem, b, field, ht)                   \
+        for (b = 0, elem = NULL;                                 \
+             elem == NULL && b < htable_nr_buckets(ht);          \
+             ++b)                                                \
+                for_each_in_hlist (elem, field, htable_bucket_at(ht, b))
+
+#define for_each_in_htable_safe(elem, tmp, b, field, ht)          \
+        for (b = 0, elem = NULL;                                  \
+             elem == NULL && b < htable_nr_buckets(ht);           \
+             ++b)                                                 \
+                for_each_in_hlist_safe (                          \
+                        elem, tmp, field, htable_bucket_at(ht, b))
 
 #ifdef __cplusplus
 }
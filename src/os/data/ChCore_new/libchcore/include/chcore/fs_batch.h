@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan
+ * PSL v1. You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ * KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE. See the
+ * Mulan PSL v1 for more details.
+ */
+
+#pragma once
+
+#include <chcore/ipc.h>
+#include <chcore/fs/defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Queue fs_requests in the shared buffer of a connection to a fs server
+ * (tmpfs, fakefs) and submit them with a single IPC call.
+ *
+ * The batch keeps the connection's message for its whole life, so the
+ * connection must not be used for anything else in between.
+ */
+struct fs_batch {
+        struct ipc_struct* icb;
+        struct ipc_msg* ipc_msg;
+        struct fs_batch_head* head;
+        unsigned int capacity;
+        bool submitted;
+};
+
+int fs_batch_init(struct fs_batch* batch, struct ipc_struct* icb);
+void fs_batch_destroy(struct fs_batch* batch);
+
+/**
+ * Get a zeroed slot for the next request. Returns NULL when the batch is
+ * full. Results of the previous submission are dropped.
+ * Write data is put in fs_batch_data() of the slot, at most
+ * FS_BATCH_INLINE_DATA bytes.
+ */
+struct fs_request* fs_batch_get_req(struct fs_batch* batch);
+
+/**
+ * Run all queued requests. Returns how many of them were run, which is
+ * less than queued if one failed, or a negative error.
+ */
+int fs_batch_submit(struct fs_batch* batch);
+
+/* Result of the idx-th request of the last submission */
+long fs_batch_result(struct fs_batch* batch, unsigned int idx);
+
+/* Write payload of the idx-th slot */
+void* fs_batch_data(struct fs_batch* batch, unsigned int idx);
+
+/*
+ * Data returned by the idx-th request, a FS_REQ_READ of at most
+ * sizeof(struct fs_request) + FS_BATCH_INLINE_DATA bytes
+ */
+void* fs_batch_read_data(struct fs_batch* batch, unsigned int idx);
+
+#ifdef __cplusplus
+}
+#endif
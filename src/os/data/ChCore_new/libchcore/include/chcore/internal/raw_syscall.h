@@ -137,6 +137,16 @@ static inline int __chcore_sys_transfer_caps(u64 dest_group_cap,
                                  dst_caps_buf);
 }
 
+static inline int __chcore_sys_cap_free(u64 slot_id)
+{
+        return __chcore_syscall1(__CHCORE_SYS_cap_free, slot_id);
+}
+
+static inline int __chcore_sys_cap_restrict(u64 slot_id, u64 rights)
+{
+        return __chcore_syscall2(__CHCORE_SYS_cap_restrict, slot_id, rights);
+}
+
 /* Multitask */
 
 /* - create & exit */
@@ -219,6 +229,13 @@ static inline void __chcore_sys_ipc_return(u64 ret, u64 cap_num)
         __chcore_syscall2(__CHCORE_SYS_ipc_return, ret, cap_num);
 }
 
+static inline u64 __chcore_sys_ipc_call_reg(u32 conn_cap, u64 w0, u64 w1,
+                                            u64 w2, u64 w3)
+{
+        return __chcore_syscall5(
+                __CHCORE_SYS_ipc_call_reg, conn_cap, w0, w1, w2, w3);
+}
+
 /* Hardware Access (Privileged Instruction) */
 
 /* - cache */
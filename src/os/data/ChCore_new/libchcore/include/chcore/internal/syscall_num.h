@@ -35,6 +35,8 @@
 #define __CHCORE_SYS_cap_copy_to   60
 #define __CHCORE_SYS_cap_copy_from 61
 #define __CHCORE_SYS_transfer_caps 62
+#define __CHCORE_SYS_cap_free      63
+#define __CHCORE_SYS_cap_restrict  64
 
 /* Multitask */
 /* - create & exit */
@@ -53,6 +55,7 @@
 #define __CHCORE_SYS_register_client 121
 #define __CHCORE_SYS_ipc_call        122
 #define __CHCORE_SYS_ipc_return      123
+#define __CHCORE_SYS_ipc_call_reg    124
 
 /* Hardware Access (Privileged Instruction) */
 /* - cache */
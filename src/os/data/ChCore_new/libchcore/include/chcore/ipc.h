@@ -48,9 +48,17 @@ struct ipc_vm_config {
 #define MAX_CLIENT        32
 #define RETRY_UPPER_BOUND 100
 
+/* Words carried in registers by ipc_call_reg */
+#define IPC_REG_MSG_WORDS 4
+/* ipc_msg seen by the server for requests sent by ipc_call_reg */
+#define IPC_REG_MSG ((struct ipc_msg*)-1)
+
 /*
  * server_handler is an IPC routine (can have two arguments):
  * first is ipc_msg and second is client_pid.
+ * For requests sent by ipc_call_reg, ipc_msg is IPC_REG_MSG and the words
+ * follow as the third to sixth arguments. Reply with ipc_return(NULL, ret).
+ * A NULL ipc_msg is an ipc_call without a message, and x2-x5 are undefined.
  */
 typedef void (*server_handler)();
 
@@ -71,3 +79,4 @@ int ipc_destroy_msg(struct ipc_struct* icb, struct ipc_msg* ipc_msg);
 s64 ipc_call(struct ipc_struct* icb, struct ipc_msg* ipc_msg);
 void ipc_return(struct ipc_msg* ipc_msg, int ret);
 void ipc_return_with_cap(struct ipc_msg* ipc_msg, int ret);
+s64 ipc_call_reg(struct ipc_struct* icb, u64 w0, u64 w1, u64 w2, u64 w3);
@@ -12,6 +12,9 @@
 
 #pragma once
 
+#include <chcore/types.h>
+#include <sys/types.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -43,6 +46,29 @@ struct tmpfs_ipc_data {
  */
 int chcore_tmpfs_test(int arg1, int arg2);
 
+/* A file of tmpfs mapped read-only into the caller */
+struct tfs_mapped_file {
+        void* addr;
+        size_t size;
+        int pmo_cap;
+};
+
+/**
+ * Read the whole file into `buf`, which must hold get_file_size_from_tfs()
+ * bytes. Returns the number of bytes read.
+ */
+int read_file_from_tfs(const char* path, char* buf);
+int get_file_size_from_tfs(const char* path);
+
+/**
+ * Map the whole file read-only without copying it through IPC.
+ * Returns the file size, or a negative error (e.g., for empty files), in
+ * which case the caller should fall back to read_file_from_tfs().
+ */
+int map_file_from_tfs(const char* path, struct tfs_mapped_file* file);
+/* Unmap the file and give up the PMO cap received for it */
+void unmap_file_from_tfs(struct tfs_mapped_file* file);
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,3 +29,13 @@ int chcore_cap_transfer_multi(u64 dest_group_cap, int* src_caps, int nr_caps,
         return __chcore_sys_transfer_caps(
                 dest_group_cap, (u64)src_caps, nr_caps, (u64)dest_caps);
 }
+
+int chcore_cap_free(u64 cap)
+{
+        return __chcore_sys_cap_free(cap);
+}
+
+int chcore_cap_restrict(u64 cap, u64 rights)
+{
+        return __chcore_sys_cap_restrict(cap, rights);
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan
+ * PSL v1. You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ * KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE. See the
+ * Mulan PSL v1 for more details.
+ */
+
+#include <chcore/fs_batch.h>
+#include <chcore/assert.h>
+#include <string.h>
+
+int fs_batch_init(struct fs_batch* batch, struct ipc_struct* icb)
+{
+        u64 data_len;
+
+        /* Slots are laid out right in the shared buffer, use all of it */
+        data_len = icb->shared_buf_len - sizeof(struct ipc_msg);
+        if (data_len < sizeof(struct fs_batch_head)
+                               + sizeof(struct fs_batch_entry)) {
+                return -EINVAL;
+        }
+
+        batch->ipc_msg = ipc_create_msg(icb, data_len, 0);
+        if (!batch->ipc_msg) {
+                return -ENOMEM;
+        }
+
+        batch->icb = icb;
+        batch->head = (struct fs_batch_head*)ipc_get_msg_data(batch->ipc_msg);
+        batch->capacity = (data_len - sizeof(struct fs_batch_head))
+                          / sizeof(struct fs_batch_entry);
+        batch->head->req = FS_REQ_BATCH;
+        batch->head->nr_entries = 0;
+        batch->head->nr_done = 0;
+        batch->submitted = false;
+
+        return 0;
+}
+
+void fs_batch_destroy(struct fs_batch* batch)
+{
+        ipc_destroy_msg(batch->icb, batch->ipc_msg);
+        batch->ipc_msg = NULL;
+        batch->head = NULL;
+}
+
+struct fs_request* fs_batch_get_req(struct fs_batch* batch)
+{
+        struct fs_batch_entry* entry;
+
+        if (batch->submitted) {
+                batch->head->nr_entries = 0;
+                batch->head->nr_done = 0;
+                batch->submitted = false;
+        }
+
+        if (batch->head->nr_entries == batch->capacity) {
+                return NULL;
+        }
+
+        entry = &batch->head->entries[batch->head->nr_entries++];
+        memset(entry, 0, sizeof(*entry));
+        return &entry->req;
+}
+
+int fs_batch_submit(struct fs_batch* batch)
+{
+        int ret;
+
+        if (batch->submitted || batch->head->nr_entries == 0) {
+                return 0;
+        }
+
+        batch->head->req = FS_REQ_BATCH;
+        ret = ipc_call(batch->icb, batch->ipc_msg);
+        batch->submitted = true;
+
+        return ret;
+}
+
+long fs_batch_result(struct fs_batch* batch, unsigned int idx)
+{
+        chcore_assert(idx < batch->head->nr_entries);
+
+        if (idx >= batch->head->nr_done) {
+                return -ECANCELED;
+        }
+
+        return batch->head->entries[idx].ret;
+}
+
+void* fs_batch_data(struct fs_batch* batch, unsigned int idx)
+{
+        chcore_assert(idx < batch->head->nr_entries);
+        return batch->head->entries[idx].data;
+}
+
+void* fs_batch_read_data(struct fs_batch* batch, unsigned int idx)
+{
+        chcore_assert(idx < batch->head->nr_entries);
+
+        /* The server returns read data in place of the request */
+        return &batch->head->entries[idx].req;
+}
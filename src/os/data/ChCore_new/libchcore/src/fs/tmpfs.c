@@ -14,6 +14,9 @@
 #include <chcore/ipc.h>
 #include <chcore/assert.h>
 #include <chcore/internal/server_caps.h>
+#include <chcore/internal/utils.h>
+#include <chcore/memory.h>
+#include <chcore/capability.h>
 #include <chcore/fs/defs.h>
 #include <string.h>
 
@@ -27,79 +30,143 @@ void connect_tmpfs_server(void)
         chcore_assert(tmpfs_ipc_struct);
 }
 
+/* Open `path` with the caller's message, which must be reused for the fd */
+static int tfs_open_with_msg(struct ipc_msg* ipc_msg, const char* path,
+                             int file_fd)
+{
+        struct fs_request* fr = (struct fs_request*)ipc_get_msg_data(ipc_msg);
+
+        memset(fr, 0, sizeof(*fr));
+        fr->req = FS_REQ_OPEN;
+        strcpy(fr->open.pathname, path);
+        fr->open.flags = O_RDONLY;
+        fr->open.new_fd = file_fd;
+        return ipc_call(tmpfs_ipc_struct, ipc_msg);
+}
+
+/* Close needs no message, call it after the message is destroyed */
+static int tfs_close(int file_fd)
+{
+        return ipc_call_reg(
+                tmpfs_ipc_struct, FS_REQ_CLOSE, (u64)file_fd, 0, 0);
+}
+
 int read_file_from_tfs(const char* path, char* buf)
 {
+        struct ipc_msg* ipc_msg;
+        struct fs_request* fr;
+        u64 data_len;
+        int file_fd = 1;
         int p = 0;
+        int ret;
 
         if (!tmpfs_ipc_struct) {
                 connect_tmpfs_server();
         }
 
-        int file_fd = 1;
+        /*
+         * One message covering the whole shared buffer serves open and all
+         * the reads. The server returns file data in place of the
+         * request, so each read moves as much as the buffer holds.
+         */
+        data_len = tmpfs_ipc_struct->shared_buf_len - sizeof(struct ipc_msg);
+        chcore_assert(data_len >= sizeof(struct fs_request));
+        ipc_msg = ipc_create_msg(tmpfs_ipc_struct, data_len, 0);
+        chcore_assert(ipc_msg);
+        fr = (struct fs_request*)ipc_get_msg_data(ipc_msg);
 
-        {
-                //  Open test
-                struct ipc_msg* ipc_msg = ipc_create_msg(
-                        tmpfs_ipc_struct, sizeof(struct fs_request), 0);
-                chcore_assert(ipc_msg);
-                struct fs_request* fr =
-                        (struct fs_request*)ipc_get_msg_data(ipc_msg);
-                fr->req = FS_REQ_OPEN;
-                strcpy(fr->open.pathname, path);
-                fr->open.flags = O_RDONLY;
-                fr->open.new_fd = file_fd;
-                int ret = ipc_call(tmpfs_ipc_struct, ipc_msg);
+        ret = tfs_open_with_msg(ipc_msg, path, file_fd);
+        if (ret < 0) {
                 ipc_destroy_msg(tmpfs_ipc_struct, ipc_msg);
+                return ret;
+        }
 
-                if (ret < 0) {
-                        return ret;
+        do {
+                fr->req = FS_REQ_READ;
+                fr->read.fd = file_fd;
+                fr->read.count = data_len;
+                ret = ipc_call(tmpfs_ipc_struct, ipc_msg);
+
+                if (ret > 0) {
+                        memcpy(buf + p, fr, ret);
+                        p += ret;
                 }
+        } while (ret > 0);
+
+        ipc_destroy_msg(tmpfs_ipc_struct, ipc_msg);
+
+        if (ret < 0) {
+                tfs_close(file_fd);
+                return ret;
         }
 
-        {
-                int cnt = 256;
-                int ret = 0;
-
-                do {
-                        struct ipc_msg* ipc_msg = ipc_create_msg(
-                                tmpfs_ipc_struct,
-                                sizeof(struct fs_request) + cnt + 2,
-                                0);
-                        chcore_assert(ipc_msg);
-                        struct fs_request* fr =
-                                (struct fs_request*)ipc_get_msg_data(ipc_msg);
-                        fr->req = FS_REQ_READ;
-                        fr->read.fd = file_fd;
-                        fr->read.count = cnt;
-                        ret = ipc_call(tmpfs_ipc_struct, ipc_msg);
-
-                        if (ret > 0) {
-                                memcpy(buf + p, ipc_get_msg_data(ipc_msg), ret);
-                                p += ret;
-                        }
-
-                        ipc_destroy_msg(tmpfs_ipc_struct, ipc_msg);
-                } while (ret > 0);
-
-                // printf("read_file_from_tfs read %d bytes \n", ret);
+        ret = tfs_close(file_fd);
+        return ret < 0 ? ret : p;
+}
+
+int map_file_from_tfs(const char* path, struct tfs_mapped_file* file)
+{
+        struct ipc_msg* ipc_msg;
+        struct fs_request* fr;
+        int file_fd = 1;
+        int pmo_cap = -1;
+        int size;
+        int ret;
+
+        if (!tmpfs_ipc_struct) {
+                connect_tmpfs_server();
         }
 
-        {
-                struct ipc_msg* ipc_msg = ipc_create_msg(
-                        tmpfs_ipc_struct, sizeof(struct fs_request), 0);
-                chcore_assert(ipc_msg);
-                struct fs_request* fr =
-                        (struct fs_request*)ipc_get_msg_data(ipc_msg);
-                fr->req = FS_REQ_CLOSE;
-                fr->close.fd = file_fd;
-                int ret = ipc_call(tmpfs_ipc_struct, ipc_msg);
+        /* The server appends the PMO cap right after the request */
+        ipc_msg = ipc_create_msg(
+                tmpfs_ipc_struct, sizeof(struct fs_request), 0);
+        chcore_assert(ipc_msg);
+        fr = (struct fs_request*)ipc_get_msg_data(ipc_msg);
+
+        ret = tfs_open_with_msg(ipc_msg, path, file_fd);
+        if (ret < 0) {
                 ipc_destroy_msg(tmpfs_ipc_struct, ipc_msg);
+                return ret;
+        }
 
-                if (ret < 0) {
-                        return ret;
+        fr->req = FS_REQ_GET_PMO;
+        fr->getpmo.fd = file_fd;
+        size = ipc_call(tmpfs_ipc_struct, ipc_msg);
+        if (size > 0) {
+                pmo_cap = ipc_get_msg_cap(ipc_msg, 0);
+        }
+        /* Do not send the cap back with a later message */
+        ipc_msg->cap_slot_number = 0;
+        ipc_destroy_msg(tmpfs_ipc_struct, ipc_msg);
+
+        ret = tfs_close(file_fd);
+        if (ret < 0 || size <= 0 || pmo_cap < 0) {
+                if (pmo_cap >= 0) {
+                        chcore_cap_free(pmo_cap);
                 }
+                return ret < 0 ? ret : (size < 0 ? size : -EINVAL);
+        }
+
+        file->addr = chcore_pmo_auto_map(
+                pmo_cap, ROUND_UP(size, PAGE_SIZE), VM_READ);
+        if (!file->addr) {
+                chcore_cap_free(pmo_cap);
+                return -ENOMEM;
         }
-        return p;
+        file->size = size;
+        file->pmo_cap = pmo_cap;
+
+        return size;
+}
+
+void unmap_file_from_tfs(struct tfs_mapped_file* file)
+{
+        chcore_pmo_auto_unmap(
+                file->pmo_cap, (u64)file->addr, ROUND_UP(file->size, PAGE_SIZE));
+        /* Only our copy goes, the server keeps the PMO while it is cached */
+        chcore_cap_free(file->pmo_cap);
+        file->addr = NULL;
+        file->pmo_cap = -1;
 }
 
 int get_file_size_from_tfs(const char* path)
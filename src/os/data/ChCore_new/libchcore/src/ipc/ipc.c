@@ -195,3 +195,24 @@ void ipc_return_with_cap(struct ipc_msg* ipc_msg, int ret)
 {
         __chcore_sys_ipc_return((u64)ret, ipc_msg->cap_slot_number);
 }
+
+/*
+ * Client uses **ipc_call_reg** for short requests which fit in
+ * IPC_REG_MSG_WORDS words: they are passed in registers and the shared
+ * buffer is left untouched. The server replies with a single return value.
+ */
+s64 ipc_call_reg(struct ipc_struct* icb, u64 w0, u64 w1, u64 w2, u64 w3)
+{
+        s64 ret;
+
+        if (icb->conn_cap == 0) {
+                return -EINVAL;
+        }
+
+        /* One call in flight per connection, as with ipc_create_msg */
+        spinlock_lock(&icb->ipc_lock);
+        ret = __chcore_sys_ipc_call_reg(icb->conn_cap, w0, w1, w2, w3);
+        spinlock_unlock(&icb->ipc_lock);
+
+        return ret;
+}
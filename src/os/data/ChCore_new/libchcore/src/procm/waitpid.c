@@ -19,17 +19,9 @@
 
 int chcore_procm_waitpid(int pid)
 {
-        int ret;
         struct ipc_struct* procm_ipc_struct = get_procm_server();
-        struct ipc_msg* ipc_msg = ipc_create_msg(
-                procm_ipc_struct, sizeof(struct procm_ipc_data), 0);
-        chcore_assert(ipc_msg);
 
-        struct procm_ipc_data* procm_ipc_data =
-                (struct procm_ipc_data*)ipc_get_msg_data(ipc_msg);
-        procm_ipc_data->request = PROCM_IPC_REQ_WAITPID;
-        procm_ipc_data->waitpid.pid = pid;
-        ret = ipc_call(procm_ipc_struct, ipc_msg);
-        ipc_destroy_msg(procm_ipc_struct, ipc_msg);
-        return ret;
+        /* Fits in registers, no message needed */
+        return ipc_call_reg(
+                procm_ipc_struct, PROCM_IPC_REQ_WAITPID, (u64)pid, 0, 0);
 }
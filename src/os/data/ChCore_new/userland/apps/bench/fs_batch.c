@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan
+ * PSL v1. You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ * KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE. See the
+ * Mulan PSL v1 for more details.
+ */
+
+/*
+ * Small-file workload on tmpfs: create, write, and read back many files,
+ * once with one ipc_call per request and once with FS_REQ_BATCH. Reports
+ * the IPC calls (traps) and PMU cycles (PMCCNTR_EL0) of each run.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chcore/ipc.h>
+#include <chcore/assert.h>
+#include <chcore/fs_batch.h>
+#include <chcore/internal/server_caps.h>
+
+#define NR_FILES  1024
+#define FILE_SIZE 64
+/* Requests per file: creat, open, write, close, open, read, close */
+#define REQS_PER_FILE 7
+
+#define SYNC_FD  10
+#define BATCH_FD 11
+
+struct bench_result {
+        u64 cycles;
+        u64 nr_calls;
+};
+
+static inline u64 read_cycles(void)
+{
+        u64 cycles;
+
+        asm volatile("isb; mrs %0, pmccntr_el0" : "=r"(cycles));
+        return cycles;
+}
+
+/* The libc has no snprintf, append the decimal index by hand */
+static void make_path(char* path, const char* prefix, int idx)
+{
+        char digits[16];
+        int n = 0;
+        int len;
+
+        do {
+                digits[n++] = '0' + idx % 10;
+                idx /= 10;
+        } while (idx);
+
+        strcpy(path, prefix);
+        len = strlen(path);
+        while (n) {
+                path[len++] = digits[--n];
+        }
+        path[len] = '\0';
+}
+
+static void fill_request(struct fs_request* fr, int step, const char* path,
+                         int fd)
+{
+        switch (step) {
+        case 0:
+                fr->req = FS_REQ_CREAT;
+                strcpy(fr->creat.pathname, path);
+                break;
+        case 1:
+        case 4:
+                fr->req = FS_REQ_OPEN;
+                strcpy(fr->open.pathname, path);
+                fr->open.flags = step == 1 ? O_RDWR : O_RDONLY;
+                fr->open.new_fd = fd;
+                break;
+        case 2:
+                fr->req = FS_REQ_WRITE;
+                fr->write.fd = fd;
+                fr->write.count = FILE_SIZE;
+                break;
+        case 5:
+                fr->req = FS_REQ_READ;
+                fr->read.fd = fd;
+                fr->read.count = FILE_SIZE;
+                break;
+        default:
+                fr->req = FS_REQ_CLOSE;
+                fr->close.fd = fd;
+                break;
+        }
+}
+
+static void bench_sync(struct ipc_struct* icb, struct bench_result* res)
+{
+        struct ipc_msg* ipc_msg;
+        struct fs_request* fr;
+        char path[FS_REQ_PATH_BUF_LEN];
+        u64 start;
+        int i, step, ret;
+
+        ipc_msg = ipc_create_msg(icb, sizeof(struct fs_request) + FILE_SIZE, 0);
+        chcore_assert(ipc_msg);
+        fr = (struct fs_request*)ipc_get_msg_data(ipc_msg);
+        res->nr_calls = 0;
+
+        start = read_cycles();
+        for (i = 0; i < NR_FILES; i++) {
+                make_path(path, "/fs_sync_", i);
+                for (step = 0; step < REQS_PER_FILE; step++) {
+                        memset(fr, 0, sizeof(*fr));
+                        fill_request(fr, step, path, SYNC_FD);
+                        if (step == 2) {
+                                memset((char*)fr + sizeof(*fr), 'a' + i % 26,
+                                       FILE_SIZE);
+                        }
+                        ret = ipc_call(icb, ipc_msg);
+                        chcore_assert(ret >= 0);
+                        res->nr_calls++;
+                }
+                chcore_assert(ret == 0);
+        }
+        res->cycles = read_cycles() - start;
+
+        ipc_destroy_msg(icb, ipc_msg);
+}
+
+static void submit_batch(struct fs_batch* batch, struct bench_result* res)
+{
+        unsigned int i;
+        int ret;
+
+        ret = fs_batch_submit(batch);
+        chcore_assert(ret == batch->head->nr_entries);
+        for (i = 0; i < batch->head->nr_entries; i++) {
+                chcore_assert(fs_batch_result(batch, i) >= 0);
+        }
+        res->nr_calls++;
+}
+
+static void bench_batch(struct ipc_struct* icb, struct bench_result* res)
+{
+        struct fs_batch batch;
+        struct fs_request* fr;
+        char path[FS_REQ_PATH_BUF_LEN];
+        u64 start;
+        int i, step, ret;
+
+        ret = fs_batch_init(&batch, icb);
+        chcore_assert(ret == 0);
+        res->nr_calls = 0;
+
+        start = read_cycles();
+        for (i = 0; i < NR_FILES; i++) {
+                make_path(path, "/fs_batch_", i);
+                for (step = 0; step < REQS_PER_FILE; step++) {
+                        fr = fs_batch_get_req(&batch);
+                        if (!fr) {
+                                submit_batch(&batch, res);
+                                fr = fs_batch_get_req(&batch);
+                        }
+                        fill_request(fr, step, path, BATCH_FD);
+                        if (step == 2) {
+                                memset(fs_batch_data(&batch,
+                                                     batch.head->nr_entries - 1),
+                                       'a' + i % 26,
+                                       FILE_SIZE);
+                        }
+                }
+        }
+        submit_batch(&batch, res);
+        res->cycles = read_cycles() - start;
+
+        fs_batch_destroy(&batch);
+}
+
+int main(int argc, char* argv[])
+{
+        struct ipc_struct* sync_icb;
+        struct ipc_struct* batch_icb;
+        struct fs_batch probe;
+        struct bench_result sync_res, batch_res;
+        int tmpfs_cap;
+
+        tmpfs_cap = __chcore_get_tmpfs_cap();
+        chcore_assert(tmpfs_cap >= 0);
+        sync_icb = ipc_register_client(tmpfs_cap);
+        batch_icb = ipc_register_client(tmpfs_cap);
+        chcore_assert(sync_icb && batch_icb);
+
+        chcore_assert(fs_batch_init(&probe, batch_icb) == 0);
+        printf("fs batch: %d files of %d bytes, %d requests each, %u per "
+               "batch\n",
+               NR_FILES,
+               FILE_SIZE,
+               REQS_PER_FILE,
+               probe.capacity);
+        fs_batch_destroy(&probe);
+
+        bench_sync(sync_icb, &sync_res);
+        bench_batch(batch_icb, &batch_res);
+
+        printf("  one call per request: %llu calls, %llu cycles\n",
+               sync_res.nr_calls,
+               sync_res.cycles);
+        printf("  batched             : %llu calls, %llu cycles\n",
+               batch_res.nr_calls,
+               batch_res.cycles);
+        return 0;
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan
+ * PSL v1. You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ * KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE. See the
+ * Mulan PSL v1 for more details.
+ */
+
+/*
+ * IPC round-trip latency: a server thread answers ping requests from the
+ * main thread, once through the shared buffer and once with the register
+ * fast path. The same two paths are then timed against tmpfs and procm,
+ * which run in other processes. Cycles are read from the PMU cycle counter
+ * (PMCCNTR_EL0), which the kernel makes readable from EL0.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <chcore/ipc.h>
+#include <chcore/assert.h>
+#include <chcore/thread.h>
+#include <chcore/procm.h>
+#include <chcore/fs/defs.h>
+#include <chcore/internal/raw_syscall.h>
+#include <chcore/internal/server_caps.h>
+
+#define PINGPONG_WARMUP 1000
+#define PINGPONG_ROUND  10000
+
+/* Never opened here, so tmpfs answers -ENOENT without touching any file */
+#define PINGPONG_BAD_FD 1000
+/* Above procm's PID_MAX, so waitpid returns -EINVAL without blocking */
+#define PINGPONG_BAD_PID (1 << 20)
+
+static volatile int server_ready = 0;
+
+static inline u64 read_cycles(void)
+{
+        u64 cycles;
+
+        asm volatile("isb; mrs %0, pmccntr_el0" : "=r"(cycles));
+        return cycles;
+}
+
+static void pingpong_dispatch(struct ipc_msg* ipc_msg, u64 client_badge,
+                              u64 w0, u64 w1, u64 w2, u64 w3)
+{
+        u64* words;
+
+        if (ipc_msg == IPC_REG_MSG) {
+                ipc_return(NULL, w0 + w1 + w2 + w3);
+        }
+
+        words = (u64*)ipc_get_msg_data(ipc_msg);
+        ipc_return(ipc_msg, words[0] + words[1] + words[2] + words[3]);
+}
+
+static void* pingpong_server(void* arg)
+{
+        ipc_register_server(pingpong_dispatch);
+        server_ready = 1;
+
+        /* Server does not exit */
+        while (1) {
+                __chcore_sys_yield();
+        }
+
+        return NULL;
+}
+
+static u64 bench_msg(struct ipc_struct* icb)
+{
+        struct ipc_msg* ipc_msg;
+        u64 words[IPC_REG_MSG_WORDS] = {1, 2, 3, 4};
+        u64 start, end;
+        s64 ret;
+        int i;
+
+        ipc_msg = ipc_create_msg(icb, sizeof(words), 0);
+        chcore_assert(ipc_msg);
+
+        for (i = 0; i < PINGPONG_WARMUP + PINGPONG_ROUND; i++) {
+                if (i == PINGPONG_WARMUP) {
+                        start = read_cycles();
+                }
+                ipc_set_msg_data(ipc_msg, words, 0, sizeof(words));
+                ret = ipc_call(icb, ipc_msg);
+                chcore_assert(ret == 10);
+        }
+        end = read_cycles();
+
+        ipc_destroy_msg(icb, ipc_msg);
+        return (end - start) / PINGPONG_ROUND;
+}
+
+static u64 bench_reg(struct ipc_struct* icb)
+{
+        u64 start, end;
+        s64 ret;
+        int i;
+
+        for (i = 0; i < PINGPONG_WARMUP + PINGPONG_ROUND; i++) {
+                if (i == PINGPONG_WARMUP) {
+                        start = read_cycles();
+                }
+                ret = ipc_call_reg(icb, 1, 2, 3, 4);
+                chcore_assert(ret == 10);
+        }
+        end = read_cycles();
+
+        return (end - start) / PINGPONG_ROUND;
+}
+
+/* FS_REQ_CLOSE to tmpfs, as tfs_close sent it before ipc_call_reg */
+static u64 bench_tmpfs_msg(struct ipc_struct* icb)
+{
+        struct ipc_msg* ipc_msg;
+        struct fs_request* fr;
+        u64 start, end;
+        s64 ret;
+        int i;
+
+        ipc_msg = ipc_create_msg(icb, sizeof(struct fs_request), 0);
+        chcore_assert(ipc_msg);
+        fr = (struct fs_request*)ipc_get_msg_data(ipc_msg);
+
+        for (i = 0; i < PINGPONG_WARMUP + PINGPONG_ROUND; i++) {
+                if (i == PINGPONG_WARMUP) {
+                        start = read_cycles();
+                }
+                fr->req = FS_REQ_CLOSE;
+                fr->close.fd = PINGPONG_BAD_FD;
+                ret = ipc_call(icb, ipc_msg);
+                chcore_assert(ret == -ENOENT);
+        }
+        end = read_cycles();
+
+        ipc_destroy_msg(icb, ipc_msg);
+        return (end - start) / PINGPONG_ROUND;
+}
+
+static u64 bench_tmpfs_reg(struct ipc_struct* icb)
+{
+        u64 start, end;
+        s64 ret;
+        int i;
+
+        for (i = 0; i < PINGPONG_WARMUP + PINGPONG_ROUND; i++) {
+                if (i == PINGPONG_WARMUP) {
+                        start = read_cycles();
+                }
+                ret = ipc_call_reg(icb, FS_REQ_CLOSE, PINGPONG_BAD_FD, 0, 0);
+                chcore_assert(ret == -ENOENT);
+        }
+        end = read_cycles();
+
+        return (end - start) / PINGPONG_ROUND;
+}
+
+/* PROCM_IPC_REQ_WAITPID, as chcore_procm_waitpid sent it before */
+static u64 bench_procm_msg(struct ipc_struct* icb)
+{
+        struct ipc_msg* ipc_msg;
+        struct procm_ipc_data* data;
+        u64 start, end;
+        s64 ret;
+        int i;
+
+        ipc_msg = ipc_create_msg(icb, sizeof(struct procm_ipc_data), 0);
+        chcore_assert(ipc_msg);
+        data = (struct procm_ipc_data*)ipc_get_msg_data(ipc_msg);
+
+        for (i = 0; i < PINGPONG_WARMUP + PINGPONG_ROUND; i++) {
+                if (i == PINGPONG_WARMUP) {
+                        start = read_cycles();
+                }
+                data->request = PROCM_IPC_REQ_WAITPID;
+                data->waitpid.pid = PINGPONG_BAD_PID;
+                ret = ipc_call(icb, ipc_msg);
+                chcore_assert(ret == -EINVAL);
+        }
+        end = read_cycles();
+
+        ipc_destroy_msg(icb, ipc_msg);
+        return (end - start) / PINGPONG_ROUND;
+}
+
+static u64 bench_procm_reg(struct ipc_struct* icb)
+{
+        u64 start, end;
+        s64 ret;
+        int i;
+
+        for (i = 0; i < PINGPONG_WARMUP + PINGPONG_ROUND; i++) {
+                if (i == PINGPONG_WARMUP) {
+                        start = read_cycles();
+                }
+                ret = ipc_call_reg(
+                        icb, PROCM_IPC_REQ_WAITPID, PINGPONG_BAD_PID, 0, 0);
+                chcore_assert(ret == -EINVAL);
+        }
+        end = read_cycles();
+
+        return (end - start) / PINGPONG_ROUND;
+}
+
+int main(int argc, char* argv[])
+{
+        struct ipc_struct* icb;
+        int server_cap;
+
+        server_cap = chcore_thread_create(pingpong_server, 0, 0, TYPE_USER);
+        chcore_assert(server_cap >= 0);
+
+        while (!server_ready) {
+                __chcore_sys_yield();
+        }
+
+        icb = ipc_register_client(server_cap);
+        chcore_assert(icb);
+
+        printf("IPC ping-pong, %d rounds:\n", PINGPONG_ROUND);
+        printf("  shared buffer (%d words): %llu cycles\n",
+               IPC_REG_MSG_WORDS,
+               bench_msg(icb));
+        printf("  registers     (%d words): %llu cycles\n",
+               IPC_REG_MSG_WORDS,
+               bench_reg(icb));
+
+        icb = ipc_register_client(__chcore_get_tmpfs_cap());
+        chcore_assert(icb);
+        printf("tmpfs close (other process):\n");
+        printf("  shared buffer: %llu cycles\n", bench_tmpfs_msg(icb));
+        printf("  registers    : %llu cycles\n", bench_tmpfs_reg(icb));
+
+        icb = ipc_register_client(__chcore_get_procm_cap());
+        chcore_assert(icb);
+        printf("procm waitpid (other process):\n");
+        printf("  shared buffer: %llu cycles\n", bench_procm_msg(icb));
+        printf("  registers    : %llu cycles\n", bench_procm_reg(icb));
+        return 0;
+}
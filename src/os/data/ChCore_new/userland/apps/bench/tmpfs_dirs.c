@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan
+ * PSL v1. You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ * KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE. See the
+ * Mulan PSL v1 for more details.
+ */
+
+/*
+ * tmpfs directory scaling: create 100k files across nested directories
+ * (/tmpfs_dirs/aI/bJ/fK), then look every file up, and probe as many
+ * times a few missing names per directory, which the negative dentry
+ * cache answers without walking the bucket.
+ * Creation and hits are sent with FS_REQ_BATCH, misses one call each, since
+ * a failing request ends a batch. Cycles are read from PMCCNTR_EL0.
+ * Last, directories of growing size report the bytes of their dentry table
+ * (tmpfs answers FS_REQ_GET_SIZE on a directory with it), next to the fixed
+ * 1024-bucket table every directory used to get.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chcore/ipc.h>
+#include <chcore/assert.h>
+#include <chcore/fs_batch.h>
+#include <chcore/internal/server_caps.h>
+
+#define NR_TOP_DIRS   10
+#define NR_SUB_DIRS   10
+#define FILES_PER_DIR 1000
+#define NR_FILES      (NR_TOP_DIRS * NR_SUB_DIRS * FILES_PER_DIR)
+
+#define ROOT_DIR "/tmpfs_dirs"
+
+/* Buckets of the fixed dentry table before tables could grow */
+#define OLD_DENTRY_BUCKETS 1024
+#define NR_SIZED_DIRS      6
+static const int sized_dir_files[NR_SIZED_DIRS] = {0, 1, 16, 128, 1024, 8192};
+
+static inline u64 read_cycles(void)
+{
+        u64 cycles;
+
+        asm volatile("isb; mrs %0, pmccntr_el0" : "=r"(cycles));
+        return cycles;
+}
+
+/* The libc has no snprintf, append "<prefix><decimal idx>" by hand */
+static char* append_name(char* path, const char* prefix, int idx)
+{
+        char digits[16];
+        int n = 0;
+
+        do {
+                digits[n++] = '0' + idx % 10;
+                idx /= 10;
+        } while (idx);
+
+        strcpy(path, prefix);
+        path += strlen(path);
+        while (n) {
+                *path++ = digits[--n];
+        }
+        *path = '\0';
+
+        return path;
+}
+
+/* "/tmpfs_dirs/aI", "/tmpfs_dirs/aI/bJ", or "/tmpfs_dirs/aI/bJ/<leaf>K" */
+static void make_path(char* path, int top, int sub, const char* leaf, int k)
+{
+        char* p;
+
+        p = append_name(path, ROOT_DIR "/a", top);
+        if (sub < 0) {
+                return;
+        }
+        p = append_name(p, "/b", sub);
+        if (!leaf) {
+                return;
+        }
+        append_name(p, leaf, k);
+}
+
+static void batch_submit(struct fs_batch* batch)
+{
+        unsigned int i;
+        int ret;
+
+        ret = fs_batch_submit(batch);
+        chcore_assert(ret == batch->head->nr_entries);
+        for (i = 0; i < batch->head->nr_entries; i++) {
+                chcore_assert(fs_batch_result(batch, i) >= 0);
+        }
+}
+
+static struct fs_request* batch_next(struct fs_batch* batch)
+{
+        struct fs_request* fr;
+
+        fr = fs_batch_get_req(batch);
+        if (!fr) {
+                batch_submit(batch);
+                fr = fs_batch_get_req(batch);
+        }
+
+        return fr;
+}
+
+static void batch_mkdir(struct fs_batch* batch, const char* path)
+{
+        struct fs_request* fr = batch_next(batch);
+
+        fr->req = FS_REQ_MKDIR;
+        strcpy(fr->mkdir.pathname, path);
+}
+
+static u64 create_tree(struct fs_batch* batch)
+{
+        char path[FS_REQ_PATH_BUF_LEN];
+        struct fs_request* fr;
+        u64 start;
+        int top, sub, k;
+
+        start = read_cycles();
+        batch_mkdir(batch, ROOT_DIR);
+        for (top = 0; top < NR_TOP_DIRS; top++) {
+                make_path(path, top, -1, NULL, 0);
+                batch_mkdir(batch, path);
+                for (sub = 0; sub < NR_SUB_DIRS; sub++) {
+                        make_path(path, top, sub, NULL, 0);
+                        batch_mkdir(batch, path);
+                        for (k = 0; k < FILES_PER_DIR; k++) {
+                                fr = batch_next(batch);
+                                fr->req = FS_REQ_CREAT;
+                                make_path(fr->creat.pathname,
+                                          top,
+                                          sub,
+                                          "f",
+                                          k);
+                        }
+                }
+        }
+        batch_submit(batch);
+
+        return read_cycles() - start;
+}
+
+static u64 lookup_hits(struct fs_batch* batch)
+{
+        struct fs_request* fr;
+        u64 start;
+        int top, sub, k;
+
+        start = read_cycles();
+        for (top = 0; top < NR_TOP_DIRS; top++) {
+                for (sub = 0; sub < NR_SUB_DIRS; sub++) {
+                        for (k = 0; k < FILES_PER_DIR; k++) {
+                                fr = batch_next(batch);
+                                fr->req = FS_REQ_GET_SIZE;
+                                make_path(fr->getsize.pathname,
+                                          top,
+                                          sub,
+                                          "f",
+                                          k);
+                        }
+                }
+        }
+        batch_submit(batch);
+
+        return read_cycles() - start;
+}
+
+static u64 lookup_misses(struct ipc_struct* icb)
+{
+        struct ipc_msg* ipc_msg;
+        struct fs_request* fr;
+        u64 start;
+        int top, sub, k;
+        int ret;
+
+        ipc_msg = ipc_create_msg(icb, sizeof(struct fs_request), 0);
+        chcore_assert(ipc_msg);
+        fr = (struct fs_request*)ipc_get_msg_data(ipc_msg);
+
+        start = read_cycles();
+        for (top = 0; top < NR_TOP_DIRS; top++) {
+                for (sub = 0; sub < NR_SUB_DIRS; sub++) {
+                        for (k = 0; k < FILES_PER_DIR; k++) {
+                                fr->req = FS_REQ_GET_SIZE;
+                                make_path(fr->getsize.pathname,
+                                          top,
+                                          sub,
+                                          "missing",
+                                          k % 16);
+                                ret = ipc_call(icb, ipc_msg);
+                                chcore_assert(ret < 0);
+                        }
+                }
+        }
+        start = read_cycles() - start;
+
+        ipc_destroy_msg(icb, ipc_msg);
+        return start;
+}
+
+/* "/tmpfs_dirs/nI" with sized_dir_files[I] files, then its table bytes */
+static void table_bytes(struct fs_batch* batch, struct ipc_struct* icb)
+{
+        char path[FS_REQ_PATH_BUF_LEN];
+        struct ipc_msg* ipc_msg;
+        struct fs_request* fr;
+        char* p;
+        int i, k;
+        int ret;
+
+        for (i = 0; i < NR_SIZED_DIRS; i++) {
+                p = append_name(path, ROOT_DIR "/n", i);
+                batch_mkdir(batch, path);
+                for (k = 0; k < sized_dir_files[i]; k++) {
+                        fr = batch_next(batch);
+                        fr->req = FS_REQ_CREAT;
+                        strcpy(fr->creat.pathname, path);
+                        append_name(fr->creat.pathname + (p - path), "/f", k);
+                }
+        }
+        batch_submit(batch);
+
+        ipc_msg = ipc_create_msg(icb, sizeof(struct fs_request), 0);
+        chcore_assert(ipc_msg);
+        fr = (struct fs_request*)ipc_get_msg_data(ipc_msg);
+
+        printf("  dentry table bytes (fixed %d buckets -> resizable):\n",
+               OLD_DENTRY_BUCKETS);
+        for (i = 0; i < NR_SIZED_DIRS; i++) {
+                fr->req = FS_REQ_GET_SIZE;
+                append_name(fr->getsize.pathname, ROOT_DIR "/n", i);
+                ret = ipc_call(icb, ipc_msg);
+                chcore_assert(ret > 0);
+                printf("    %5d entries: %lu -> %d\n",
+                       sized_dir_files[i],
+                       OLD_DENTRY_BUCKETS * sizeof(struct hlist_head),
+                       ret);
+        }
+
+        ipc_destroy_msg(icb, ipc_msg);
+}
+
+int main(int argc, char* argv[])
+{
+        struct ipc_struct* batch_icb;
+        struct ipc_struct* sync_icb;
+        struct fs_batch batch;
+        int tmpfs_cap;
+        u64 cycles;
+
+        tmpfs_cap = __chcore_get_tmpfs_cap();
+        chcore_assert(tmpfs_cap >= 0);
+        batch_icb = ipc_register_client(tmpfs_cap);
+        sync_icb = ipc_register_client(tmpfs_cap);
+        chcore_assert(batch_icb && sync_icb);
+        chcore_assert(fs_batch_init(&batch, batch_icb) == 0);
+
+        printf("tmpfs dirs: %d files in %d directories\n",
+               NR_FILES,
+               NR_TOP_DIRS * NR_SUB_DIRS);
+
+        cycles = create_tree(&batch);
+        printf("  create      : %llu cycles/file\n", cycles / NR_FILES);
+        cycles = lookup_hits(&batch);
+        printf("  lookup hit  : %llu cycles/file\n", cycles / NR_FILES);
+        cycles = lookup_misses(sync_icb);
+        printf("  lookup miss : %llu cycles/name\n", cycles / NR_FILES);
+        table_bytes(&batch, sync_icb);
+
+        fs_batch_destroy(&batch);
+        return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2022 Institute of Parallel And Distributed Systems (IPADS)
+ * ChCore-Lab is licensed under the Mulan PSL v1.
+ * You can use this software according to the terms and conditions of the Mulan
+ * PSL v1. You may obtain a copy of Mulan PSL v1 at:
+ *     http://license.coscl.org.cn/MulanPSL
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY
+ * KIND, EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE. See the
+ * Mulan PSL v1 for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <chcore/tmpfs.h>
+#include <chcore/assert.h>
+
+/*
+ * tmpfs hands out the same cached PMO for every mapping of a file.
+ * Unmapping (and freeing the cap of) one mapping must leave the other
+ * one readable.
+ */
+int main(int argc, char* argv[])
+{
+        struct tfs_mapped_file first, second;
+        char buf[64];
+        int size, ret;
+
+        size = get_file_size_from_tfs("/test.txt");
+        chcore_assert(size > 0 && size <= sizeof(buf));
+        ret = read_file_from_tfs("/test.txt", buf);
+        chcore_assert(ret == size);
+
+        chcore_assert(map_file_from_tfs("/test.txt", &first) == size);
+        chcore_assert(map_file_from_tfs("/test.txt", &second) == size);
+        chcore_assert(first.pmo_cap != second.pmo_cap);
+        chcore_assert(memcmp(first.addr, buf, size) == 0);
+
+        unmap_file_from_tfs(&first);
+        chcore_assert(memcmp(second.addr, buf, size) == 0);
+
+        unmap_file_from_tfs(&second);
+        printf("map twice passed!\n");
+        return 0;
+}
@@ -403,4 +403,5 @@ struct fs_server_ops server_ops = {
         .rmdir = fakefs_rmdir,
         .getdents64 = fakefs_getdents,
         .getsize = fakefs_getsize,
+        .get_pmo = default_server_get_pmo,
 };
\ No newline at end of file
@@ -166,41 +166,45 @@ void translate_fd_to_fid(u64 client_badge, struct fs_request* fr)
                         client_badge, fr->getdents64.fd);
                 break;
 
+        case FS_REQ_GET_PMO:
+                fr->getpmo.fd =
+                        fs_wrapper_get_server_entry(client_badge, fr->getpmo.fd);
+                break;
+
         default:
                 break;
         }
 }
 
-void fs_server_dispatch(struct ipc_msg* ipc_msg, u64 client_badge)
+/*
+ * Requests sent with ipc_call_reg carry the request type in w0 and its
+ * only argument in w1. Only FS_REQ_CLOSE is short enough for now.
+ */
+static int fs_server_dispatch_reg(u64 client_badge, u64 w0, u64 w1)
 {
-        struct fs_request* fr;
-        int ret;
-        bool ret_with_cap = false;
+        struct fs_request fr;
 
-        fr = (struct fs_request*)ipc_get_msg_data(ipc_msg);
+        if (!mounted) {
+                return -EINVAL;
+        }
 
-        spinlock_lock(&fs_wrapper_meta_lock);
+        switch (w0) {
+        case FS_REQ_CLOSE:
+                fr.req = FS_REQ_CLOSE;
+                fr.close.fd = (int)w1;
+                translate_fd_to_fid(client_badge, &fr);
+                return fs_wrapper_close(NULL, &fr);
 
-        /*
-         * Some FS Servers need to complete the initialization process when
-         * mounting eg. Connect with corresponding block device, Save partition
-         * offset, etc So, when the mounted flag is off, requests will be
-         * rejected except FS_REQ_MOUNT
-         */
-        if (!mounted && (fr->req != FS_REQ_MOUNT)) {
-                printf("[fs server] Not fully initialized, send FS_REQ_MOUNT first\n");
-                ret = -EINVAL;
-                goto out;
+        default:
+                return -EINVAL;
         }
+}
 
-        /*
-         * Now fr->fd stores the `Client Side FD Index',
-         * We need to translate fr->fd to fid here, except FS_REQ_OPEN
-         * FS_REQ_OPEN's fr->fd stores the newly generated `Client Side FD
-         * Index' and we should build mapping between fr->fd to fid when handle
-         * open request
-         */
-        translate_fd_to_fid(client_badge, fr);
+/* Run one request whose fd has already been translated */
+static int fs_server_handle(u64 client_badge, struct ipc_msg* ipc_msg,
+                            struct fs_request* fr)
+{
+        int ret;
 
         /*
          * FS Server Requests Handlers
@@ -250,6 +254,10 @@ void fs_server_dispatch(struct ipc_msg* ipc_msg, u64 client_badge)
                 ret = fs_wrapper_lseek(ipc_msg, fr);
                 break;
 
+        case FS_REQ_GET_PMO:
+                ret = fs_wrapper_get_pmo(ipc_msg, fr);
+                break;
+
         default:
                 printf("[Error] Strange FS Server request number %d\n",
                        fr->req);
@@ -257,8 +265,136 @@ void fs_server_dispatch(struct ipc_msg* ipc_msg, u64 client_badge)
                 break;
         }
 
+        return ret;
+}
+
+/*
+ * Drain the slots of a FS_REQ_BATCH message. Requests that use the message
+ * beyond their own slot (getdents64, get_pmo, mount) are refused, and read
+ * and write are limited to what fits in a slot.
+ */
+static int fs_server_dispatch_batch(u64 client_badge, struct ipc_msg* ipc_msg,
+                                    struct fs_batch_head* head)
+{
+        struct fs_batch_entry* entry;
+        u64 max_entries;
+        unsigned int i;
+
+        if (ipc_msg->data_len < sizeof(*head)) {
+                return -EINVAL;
+        }
+
+        max_entries = (ipc_msg->data_len - sizeof(*head))
+                      / sizeof(struct fs_batch_entry);
+        if (head->nr_entries > max_entries) {
+                return -EINVAL;
+        }
+
+        head->nr_done = 0;
+        for (i = 0; i < head->nr_entries; i++) {
+                entry = &head->entries[i];
+                /* A failing slot is still counted, so its error can be read */
+                head->nr_done = i + 1;
+
+                switch (entry->req.req) {
+                case FS_REQ_READ:
+                        if (entry->req.read.count
+                            > sizeof(entry->req) + FS_BATCH_INLINE_DATA) {
+                                entry->req.read.count = sizeof(entry->req)
+                                                        + FS_BATCH_INLINE_DATA;
+                        }
+                        break;
+
+                case FS_REQ_WRITE:
+                        if (entry->req.write.count > FS_BATCH_INLINE_DATA) {
+                                entry->req.write.count = FS_BATCH_INLINE_DATA;
+                        }
+                        break;
+
+                case FS_REQ_OPEN:
+                case FS_REQ_CLOSE:
+                case FS_REQ_CREAT:
+                case FS_REQ_MKDIR:
+                case FS_REQ_RMDIR:
+                case FS_REQ_UNLINK:
+                case FS_REQ_GET_SIZE:
+                case FS_REQ_LSEEK:
+                        break;
+
+                default:
+                        entry->ret = -EINVAL;
+                        return head->nr_done;
+                }
+
+                /* Translate per slot, an earlier slot may have opened the fd */
+                translate_fd_to_fid(client_badge, &entry->req);
+                entry->ret = fs_server_handle(client_badge, ipc_msg, &entry->req);
+                if (entry->ret < 0) {
+                        break;
+                }
+        }
+
+        return head->nr_done;
+}
+
+void fs_server_dispatch(struct ipc_msg* ipc_msg, u64 client_badge, u64 w0,
+                        u64 w1, u64 w2, u64 w3)
+{
+        struct fs_request* fr;
+        int ret;
+        bool ret_with_cap = false;
+
+        if (ipc_msg == IPC_REG_MSG) {
+                spinlock_lock(&fs_wrapper_meta_lock);
+                ret = fs_server_dispatch_reg(client_badge, w0, w1);
+                spinlock_unlock(&fs_wrapper_meta_lock);
+                ipc_return(NULL, ret);
+        }
+
+        if (!ipc_msg) {
+                ipc_return(NULL, -EINVAL);
+        }
+
+        fr = (struct fs_request*)ipc_get_msg_data(ipc_msg);
+
+        spinlock_lock(&fs_wrapper_meta_lock);
+
+        /*
+         * Some FS Servers need to complete the initialization process when
+         * mounting eg. Connect with corresponding block device, Save partition
+         * offset, etc So, when the mounted flag is off, requests will be
+         * rejected except FS_REQ_MOUNT
+         */
+        if (!mounted && (fr->req != FS_REQ_MOUNT)) {
+                printf("[fs server] Not fully initialized, send FS_REQ_MOUNT first\n");
+                ret = -EINVAL;
+                goto out;
+        }
+
+        if (fr->req == FS_REQ_BATCH) {
+                ret = fs_server_dispatch_batch(
+                        client_badge, ipc_msg, (struct fs_batch_head*)fr);
+                goto out;
+        }
+
+        /*
+         * Now fr->fd stores the `Client Side FD Index',
+         * We need to translate fr->fd to fid here, except FS_REQ_OPEN
+         * FS_REQ_OPEN's fr->fd stores the newly generated `Client Side FD
+         * Index' and we should build mapping between fr->fd to fid when handle
+         * open request
+         */
+        translate_fd_to_fid(client_badge, fr);
+
+        ret = fs_server_handle(client_badge, ipc_msg, fr);
+        ret_with_cap = (fr->req == FS_REQ_GET_PMO && ret >= 0);
+
 out:
         spinlock_unlock(&fs_wrapper_meta_lock);
 
-        ipc_return(ipc_msg, ret);
+        if (ret_with_cap) {
+                ipc_return_with_cap(ipc_msg, ret);
+        } else {
+                ipc_return(ipc_msg, ret);
+        }
 }
@@ -65,10 +65,16 @@ struct fs_server_ops {
 
         int (*getdents64)(struct ipc_msg* ipc_msg, struct fs_request* fr);
         int (*getsize)(char*);
+        /*
+         * Return a PMO holding the whole file content, for mapped reads.
+         * The server keeps the cap, which is made read-only.
+         */
+        int (*get_pmo)(void* operator, int* pmo_cap);
 };
 
 int default_server_operation(struct ipc_msg* ipc_msg, struct fs_request* fr);
 #define default_fmap_get_page_addr NULL
+#define default_server_get_pmo     NULL
 int fs_wrapper_open(u64 client_badge, struct ipc_msg* ipc_msg,
                     struct fs_request* fr);
 int fs_wrapper_close(struct ipc_msg* ipc_msg, struct fs_request* fr);
@@ -81,5 +87,7 @@ int fs_wrapper_mkdir(struct ipc_msg* ipc_msg, struct fs_request* fr);
 int fs_wrapper_creat(struct ipc_msg* ipc_msg, struct fs_request* fr);
 int fs_wrapper_getdents64(struct ipc_msg* ipc_msg, struct fs_request* fr);
 int fs_wrapper_get_size(struct ipc_msg* ipc_msg, struct fs_request* fr);
+int fs_wrapper_get_pmo(struct ipc_msg* ipc_msg, struct fs_request* fr);
 
-void fs_server_dispatch(struct ipc_msg* ipc_msg, u64 client_badge);
+void fs_server_dispatch(struct ipc_msg* ipc_msg, u64 client_badge, u64 w0,
+                        u64 w1, u64 w2, u64 w3);
@@ -12,6 +12,7 @@
 
 #include <errno.h>
 #include <chcore/types.h>
+#include <chcore/capability.h>
 #include "fs_wrapper_defs.h"
 #include "fs_vnode.h"
 #include <chcore/fs/defs.h>
@@ -362,3 +363,45 @@ int fs_wrapper_get_size(struct ipc_msg* ipc_msg, struct fs_request* fr)
 {
         return server_ops.getsize(fr->getsize.pathname);
 }
+
+/*
+ * Hand out a read-only PMO of the whole file in the reply's cap slot, so that
+ * the client can map the file instead of copying it through IPC.
+ * Servers may share one PMO among all callers, so the cap loses its write
+ * right first and no client can change what others (e.g., procm) map.
+ * Returns the file size.
+ */
+int fs_wrapper_get_pmo(struct ipc_msg* ipc_msg, struct fs_request* fr)
+{
+        int fd;
+        int pmo_cap;
+        int ret;
+        int err;
+
+        fd = fr->getpmo.fd;
+
+        if (fd_type_invalid(fd, true)) {
+                return -ENOENT;
+        }
+
+        if (!server_ops.get_pmo) {
+                return -EINVAL;
+        }
+
+        ret = server_ops.get_pmo(server_entrys[fd]->vnode->private, &pmo_cap);
+
+        if (ret < 0) {
+                return ret;
+        }
+
+        err = chcore_cap_restrict(pmo_cap, CAP_RIGHT_NO_WRITE);
+
+        if (err < 0) {
+                return err;
+        }
+
+        ipc_msg->cap_slot_number = 1;
+        ipc_set_msg_cap(ipc_msg, 0, pmo_cap);
+
+        return ret;
+}
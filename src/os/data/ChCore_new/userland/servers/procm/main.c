@@ -27,7 +27,20 @@
 #include "spawn.h"
 #include "proc.h"
 
-static void ipc_dispatch(struct ipc_msg* ipc_msg, u64 client_pid)
+/* Requests sent with ipc_call_reg: w0 is the request type */
+static int ipc_dispatch_reg(u64 client_pid, u64 w0, u64 w1)
+{
+        switch (w0) {
+        case PROCM_IPC_REQ_WAITPID:
+                return internal_waitpid((int)w1);
+
+        default:
+                return -1;
+        }
+}
+
+static void ipc_dispatch(struct ipc_msg* ipc_msg, u64 client_pid, u64 w0,
+                         u64 w1, u64 w2, u64 w3)
 {
         int ret = 0;
         int mt_cap, pcid, pid;
@@ -35,6 +48,11 @@ static void ipc_dispatch(struct ipc_msg* ipc_msg, u64 client_pid)
         struct procm_ipc_data* ipc_data;
         static int __sd_server_cap = -1;
 
+        if (ipc_msg == IPC_REG_MSG) {
+                ret = ipc_dispatch_reg(client_pid, w0, w1);
+                ipc_return(0, ret);
+        }
+
         if (!ipc_msg) {
                 ipc_return(0, ret);
         }
@@ -15,6 +15,7 @@
 #include <chcore/internal/utils.h>
 #include <chcore/internal/server_caps.h>
 #include <chcore/internal/idman.h>
+#include <chcore/tmpfs.h>
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
@@ -187,17 +188,25 @@ int readelf_from_incbin(enum incbin_elf_id elf_id, struct user_elf* user_elf)
         return ret;
 }
 
-int read_file_from_tfs(const char* path, char* buf);
-int get_file_size_from_tfs(const char* path);
-
 int readelf_from_fs(const char* filename, struct user_elf* user_elf)
 {
+        struct tfs_mapped_file file;
+        int ret;
+
+        /* Parse the binary in place, segments are copied into their PMOs */
+        if (map_file_from_tfs(filename, &file) > 0) {
+                ret = parse_elf_from_binary(file.addr, user_elf);
+                unmap_file_from_tfs(&file);
+                return ret;
+        }
+
         int file_size = get_file_size_from_tfs(filename);
         char* buf = (char*)malloc(file_size);
 
         read_file_from_tfs(filename, buf);
         // read_file_from_fsm (filename, buf);
-        int ret = parse_elf_from_binary(buf, user_elf);
+        ret = parse_elf_from_binary(buf, user_elf);
+        free(buf);
         return ret;
 }
 
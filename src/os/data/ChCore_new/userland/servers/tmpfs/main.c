@@ -26,7 +26,8 @@ int tfs_load_image(const char* start);
 extern const char __binary_ramdisk_cpio_start;
 extern u64 __binary_ramdisk_cpio_size;
 
-void fs_server_dispatch(struct ipc_msg* ipc_msg, u64 client_badge);
+void fs_server_dispatch(struct ipc_msg* ipc_msg, u64 client_badge, u64 w0,
+                        u64 w1, u64 w2, u64 w3);
 
 #ifdef TMPFS_TEST
 void tfs_test();
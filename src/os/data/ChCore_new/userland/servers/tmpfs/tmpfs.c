@@ -14,6 +14,7 @@
 #include <chcore/fs/defs.h>
 #include <chcore/ipc.h>
 #include <chcore/memory.h>
+#include <chcore/capability.h>
 #include <chcore/assert.h>
 #include <stdio.h>
 
@@ -33,27 +34,38 @@ bool mounted;
 /*
  * Helper functions to calucate hash value of string
  */
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325UL
+#define FNV_PRIME        0x100000001b3UL
+
+/*
+ * FNV-1a, then the murmur3 finalizer, so that the low bits, which pick the
+ * bucket, depend on every input byte.
+ */
 static inline u64 hash_chars(const char* str, ssize_t len)
 {
-        u64 seed = 131; /* 31 131 1313 13131 131313 etc.. */
-        u64 hash = 0;
+        u64 hash = FNV_OFFSET_BASIS;
         int i;
 
         if (len < 0) {
                 while (*str) {
-                        hash = (hash * seed) + *str;
+                        hash = (hash ^ (unsigned char)*str) * FNV_PRIME;
                         str++;
                 }
         } else {
                 for (i = 0; i < len; ++i) {
-                        hash = (hash * seed) + str[i];
+                        hash = (hash ^ (unsigned char)str[i]) * FNV_PRIME;
                 }
         }
 
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdUL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53UL;
+        hash ^= hash >> 33;
+
         return hash;
 }
 
-/* BKDR hash */
 static inline u64 hash_string(struct string* s)
 {
         return (s->hash = hash_chars(s->str, s->len));
@@ -81,6 +93,77 @@ static inline int init_string(struct string* s, const char* name, size_t len)
         return 0;
 }
 
+/*
+ * Negative dentry cache: names recently looked up in a directory and not
+ * found, so that repeated misses skip the bucket walk. It is direct mapped
+ * on (dir, hash), so a name can only sit in one slot, which tfs_mknod clears
+ * when the name is created. Longer names are not cached.
+ */
+#define NEG_DENTRY_CACHE_SIZE 256
+#define NEG_DENTRY_NAME_LEN   32
+
+struct neg_dentry {
+        struct inode* dir;
+        u64 hash;
+        size_t len;
+        char name[NEG_DENTRY_NAME_LEN];
+};
+
+static struct neg_dentry neg_dentry_cache[NEG_DENTRY_CACHE_SIZE];
+
+static inline struct neg_dentry* neg_dentry_slot(struct inode* dir, u64 hash)
+{
+        return &neg_dentry_cache[(hash ^ ((u64)dir >> 4))
+                                 % NEG_DENTRY_CACHE_SIZE];
+}
+
+static bool neg_dentry_hit(struct inode* dir, const char* name, size_t len,
+                           u64 hash)
+{
+        struct neg_dentry* neg = neg_dentry_slot(dir, hash);
+
+        return neg->dir == dir && neg->hash == hash && neg->len == len
+               && memcmp(neg->name, name, len) == 0;
+}
+
+static void neg_dentry_add(struct inode* dir, const char* name, size_t len,
+                           u64 hash)
+{
+        struct neg_dentry* neg;
+
+        if (len >= NEG_DENTRY_NAME_LEN) {
+                return;
+        }
+
+        neg = neg_dentry_slot(dir, hash);
+        neg->dir = dir;
+        neg->hash = hash;
+        neg->len = len;
+        memcpy(neg->name, name, len);
+}
+
+/* The name is being created in dir */
+static void neg_dentry_forget(struct inode* dir, u64 hash)
+{
+        struct neg_dentry* neg = neg_dentry_slot(dir, hash);
+
+        if (neg->dir == dir && neg->hash == hash) {
+                neg->dir = NULL;
+        }
+}
+
+/* dir is being freed, and its address may be reused by a new directory */
+static void neg_dentry_forget_dir(struct inode* dir)
+{
+        int i;
+
+        for (i = 0; i < NEG_DENTRY_CACHE_SIZE; i++) {
+                if (neg_dentry_cache[i].dir == dir) {
+                        neg_dentry_cache[i].dir = NULL;
+                }
+        }
+}
+
 /*
  *  Helper functions to create instances of key structures
  */
@@ -94,10 +177,28 @@ static inline struct inode* new_inode(void)
 
         inode->type = 0;
         inode->size = 0;
+        inode->pmo_cap = -1;
 
         return inode;
 }
 
+/* The file changed or is gone: drop the PMO copy made for mapped reads */
+static void drop_file_pmo(struct inode* inode)
+{
+        if (inode->pmo_cap >= 0) {
+                chcore_cap_free(inode->pmo_cap);
+                inode->pmo_cap = -1;
+        }
+}
+
+/* Directories start with a small dentry table, which grows with them */
+#define DENTRY_HTABLE_INIT_SIZE 8
+
+static u32 dentry_key(struct hlist_node* node)
+{
+        return (u32)container_of(node, struct dentry, node)->name.hash;
+}
+
 struct inode* new_dir(void)
 {
         struct inode* inode;
@@ -109,7 +210,10 @@ struct inode* new_dir(void)
         }
 
         inode->type = FS_DIR;
-        init_htable(&inode->dentries, 1024);
+        init_htable_resizable(
+                &inode->dentries, DENTRY_HTABLE_INIT_SIZE, dentry_key);
+        init_list_head(&inode->dentry_list);
+        inode->next_seq = 0;
 
         return inode;
 }
@@ -149,6 +253,8 @@ struct dentry* new_dent(struct inode* inode, const char* name, size_t len)
         }
 
         dent->inode = inode;
+        init_list_head(&dent->order);
+        dent->seq = 0;
 
         return dent;
 }
@@ -182,7 +288,10 @@ static int tfs_mknod(struct inode* dir, const char* name, size_t len, int mkdir)
 
         /* Create dentry */
         dent = new_dent(inode, name, strlen(name));
+        neg_dentry_forget(dir, dent->name.hash);
         htable_add(&dir->dentries, dent->name.hash, &dent->node);
+        dent->seq = dir->next_seq++;
+        list_append(&dent->order, &dir->dentry_list);
         /* LAB 5 TODO END */
 
         return 0;
@@ -206,6 +315,10 @@ struct dentry* tfs_lookup(struct inode* dir, const char* name, size_t len)
         struct dentry* dent;
         struct hlist_head* head;
 
+        if (neg_dentry_hit(dir, name, len, hash)) {
+                return NULL;
+        }
+
         head = htable_get_bucket(&dir->dentries, (u32)hash);
 
         for_each_in_hlist (dent, node, head) {
@@ -214,6 +327,8 @@ struct dentry* tfs_lookup(struct inode* dir, const char* name, size_t len)
                         return dent;
                 }
         }
+
+        neg_dentry_add(dir, name, len, hash);
         return NULL;
 }
 
@@ -324,12 +439,14 @@ int tfs_remove(struct inode* dir, const char* name, size_t len)
 
         // remove only when file is closed by all processes
         if (target->inode->type == FS_REG) {
+                drop_file_pmo(target->inode);
                 // free radix tree
                 radix_free(&target->inode->data);
                 // free inode
                 free(target->inode);
                 // remove dentry from parent
-                htable_del(&target->node);
+                htable_del(&dir->dentries, &target->node);
+                list_del(&target->order);
                 // free dentry
                 free(target);
         } else if (target->inode->type == FS_DIR) {
@@ -339,10 +456,12 @@ int tfs_remove(struct inode* dir, const char* name, size_t len)
 
                 // free htable
                 htable_free(&target->inode->dentries);
+                neg_dentry_forget_dir(target->inode);
                 // free inode
                 free(target->inode);
                 // remove dentry from parent
-                htable_del(&target->node);
+                htable_del(&dir->dentries, &target->node);
+                list_del(&target->order);
                 // free dentry
                 free(target);
         } else {
@@ -366,6 +485,9 @@ ssize_t tfs_file_write(struct inode* inode, off_t offset, const char* data,
         size_t to_write;
         void* page;
 
+        /* Clients that mapped it keep the old version until they unmap */
+        drop_file_pmo(inode);
+
         /* LAB 5 TODO BEGIN */
         while (size > 0) {
                 page_no = cur_off / PAGE_SIZE;
@@ -535,6 +657,7 @@ struct inode* tfs_open_path(const char* path)
 int del_inode(struct inode* inode)
 {
         if (inode->type == FS_REG) {
+                drop_file_pmo(inode);
                 // free radix tree
                 radix_free(&inode->data);
                 // free inode
@@ -546,6 +669,7 @@ int del_inode(struct inode* inode)
 
                 // free htable
                 htable_free(&inode->dentries);
+                neg_dentry_forget_dir(inode);
                 // free inode
                 free(inode);
         } else {
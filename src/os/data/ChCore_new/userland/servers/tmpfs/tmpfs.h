@@ -49,7 +49,7 @@ ssize_t tfs_file_read(struct inode* inode, off_t offset, char* buff,
 ssize_t tfs_file_write(struct inode* inode, off_t offset, const char* data,
                        size_t size);
 
-int tfs_scan(struct inode* dir, unsigned int start, void* buf, void* end,
+u64 tfs_scan(struct inode* dir, u64 start, void* buf, void* end,
              int* readbytes);
 struct inode* tfs_open_path(const char* path);
 
@@ -14,7 +14,9 @@
 #include <chcore/fs/defs.h>
 #include <chcore/ipc.h>
 #include <chcore/memory.h>
+#include <chcore/capability.h>
 #include <chcore/assert.h>
+#include <chcore/internal/utils.h>
 #include <stdio.h>
 #include <string.h>
 #include "../fs_base/fs_wrapper_defs.h"
@@ -186,41 +188,44 @@ static int __dirent_filler(void** dirpp, void* end, char* name,
         return len;
 }
 
-int tfs_scan(struct inode* dir, unsigned int start, void* buf, void* end,
+/*
+ * Fill `buf` with the dentries of `dir` whose seq is at least `start`, in
+ * creation order, and return the cookie to continue from. Cookies are
+ * dentry seqs rather than positions in the hash table, which moves entries
+ * around when it resizes: entries created meanwhile come last and entries
+ * removed meanwhile are simply not seen, none is returned twice.
+ */
+u64 tfs_scan(struct inode* dir, u64 start, void* buf, void* end,
              int* read_bytes)
 {
-        s64 cnt = 0;
-        int b;
         int ret;
         unsigned long ino;
         void* p = buf;
         unsigned char type;
         struct dentry* iter;
 
-        for_each_in_htable (iter, b, node, &dir->dentries) {
-                if (cnt >= start) {
-                        type = iter->inode->type;
-                        ino = iter->inode->size;
-                        ret = __dirent_filler(
-                                &p, end, iter->name.str, cnt, type, ino);
+        for_each_in_list (iter, struct dentry, order, &dir->dentry_list) {
+                if (iter->seq < start) {
+                        continue;
+                }
 
-                        if (ret <= 0) {
-                                if (read_bytes) {
-                                        *read_bytes = (int)(p - buf);
-                                }
+                type = iter->inode->type;
+                ino = iter->inode->size;
+                ret = __dirent_filler(
+                        &p, end, iter->name.str, iter->seq + 1, type, ino);
 
-                                return cnt - start;
-                        }
+                if (ret <= 0) {
+                        break;
                 }
 
-                cnt++;
+                start = iter->seq + 1;
         }
 
         if (read_bytes) {
                 *read_bytes = (int)(p - buf);
         }
 
-        return cnt - start;
+        return start;
 }
 
 int tmpfs_getdents(struct ipc_msg* ipc_msg, struct fs_request* fr)
@@ -232,12 +237,13 @@ int tmpfs_getdents(struct ipc_msg* ipc_msg, struct fs_request* fr)
 
         if (inode) {
                 if (inode->type == FS_DIR) {
-                        ret = tfs_scan(inode,
-                                       server_entrys[fd]->offset,
-                                       ipc_get_msg_data(ipc_msg),
-                                       ipc_get_msg_data(ipc_msg) + count,
-                                       &read_bytes);
-                        server_entrys[fd]->offset += ret;
+                        /* The offset of a directory fd is a tfs_scan cookie */
+                        server_entrys[fd]->offset =
+                                tfs_scan(inode,
+                                         server_entrys[fd]->offset,
+                                         ipc_get_msg_data(ipc_msg),
+                                         ipc_get_msg_data(ipc_msg) + count,
+                                         &read_bytes);
                         ret = read_bytes;
                 } else {
                         ret = -ENOTDIR;
@@ -262,6 +268,52 @@ vaddr_t tmpfs_get_page_addr(void* operator, size_t offset)
         return (vaddr_t)page;
 }
 
+/*
+ * Copy the file into a PMO once and keep it in the inode, so that later
+ * mapped reads (e.g., procm loading the same binary again) copy nothing.
+ * fs_wrapper_get_pmo makes the cap read-only before any copy of it leaves
+ * the server. Writing or removing the file drops the cached PMO.
+ */
+int tmpfs_get_pmo(void* operator, int* pmo_cap)
+{
+        struct inode* inode = (struct inode*)operator;
+        size_t pmo_size;
+        u64 page_no;
+        void* page;
+        int cap;
+        int ret;
+
+        if (!inode || inode->type != FS_REG || inode->size == 0) {
+                return -EINVAL;
+        }
+
+        if (inode->pmo_cap < 0) {
+                pmo_size = ROUND_UP(inode->size, PAGE_SIZE);
+                cap = chcore_pmo_create(pmo_size, PMO_DATA);
+                if (cap < 0) {
+                        return cap;
+                }
+
+                /* File pages are calloc-ed, so the tail is already zero */
+                for (page_no = 0; page_no < pmo_size / PAGE_SIZE; page_no++) {
+                        page = radix_get(&inode->data, page_no);
+                        BUG_ON(!page);
+                        ret = chcore_pmo_write(
+                                cap, page_no * PAGE_SIZE, page, PAGE_SIZE);
+                        if (ret < 0) {
+                                chcore_cap_free(cap);
+                                return ret;
+                        }
+                }
+
+                inode->pmo_cap = cap;
+        }
+
+        *pmo_cap = inode->pmo_cap;
+        return inode->size;
+}
+
+/* For a directory, the size is the bytes of its dentry table */
 int tmpfs_get_size(char* path)
 {
         struct inode* inode;
@@ -272,6 +324,11 @@ int tmpfs_get_size(char* path)
 
         inode = tfs_open_path((const char*)path);
 
+        if (inode && inode->type == FS_DIR) {
+                return htable_nr_buckets(&inode->dentries)
+                       * sizeof(struct hlist_head);
+        }
+
         if (inode) {
                 return inode->size;
         }
@@ -290,4 +347,5 @@ struct fs_server_ops server_ops = {
         .rmdir = tmpfs_rmdir,
         .getdents64 = tmpfs_getdents,
         .getsize = tmpfs_get_size,
+        .get_pmo = tmpfs_get_pmo,
 };
\ No newline at end of file
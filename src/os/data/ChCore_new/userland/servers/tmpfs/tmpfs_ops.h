@@ -40,9 +40,11 @@ int tmpfs_rmdir(const char* path, int flags);
 
 int tmpfs_mkdir(const char* path, mode_t mode);
 
-int tfs_scan(struct inode* dir, unsigned int start, void* buf, void* end,
+u64 tfs_scan(struct inode* dir, u64 start, void* buf, void* end,
              int* read_bytes);
 
 int tmpfs_getdents(struct ipc_msg* ipc_msg, struct fs_request* fr);
 
 int tmpfs_get_size(char* path);
+
+int tmpfs_get_pmo(void* foperator, int* pmo_cap);
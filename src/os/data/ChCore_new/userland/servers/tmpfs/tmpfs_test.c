@@ -160,6 +160,81 @@ int test_tfs_load_image()
         return 0;
 }
 
+#define SCAN_TEST_FILES 64
+
+/* "/scan_dir/<prefix>xy" for i < 64 */
+static void scan_test_path(char path[], char prefix, int i)
+{
+        strcpy(path, "/scan_dir/");
+        path[10] = prefix;
+        path[11] = 'a' + i / 8;
+        path[12] = 'a' + i % 8;
+        path[13] = '\0';
+}
+
+/*
+ * Read a directory one entry per tfs_scan while files are created and then
+ * removed in it, which grows and shrinks its dentry table. Files that exist
+ * during the whole scan must be returned exactly once.
+ */
+int test_scan_resize()
+{
+        char path[16];
+        char seen[SCAN_TEST_FILES] = {0};
+        char buf[64];
+        struct inode* dir;
+        struct dirent* p = (struct dirent*)buf;
+        int readbytes, step, i;
+        u64 pos = 0;
+
+        tmpfs_mkdir("/scan_dir", 0);
+        for (i = 0; i < SCAN_TEST_FILES; i++) {
+                scan_test_path(path, 'f', i);
+                fs_creat(path);
+        }
+        dir = tfs_open_path("/scan_dir");
+
+        if (!dir) {
+                return -1;
+        }
+
+        for (step = 0;; step++) {
+                /* Room for one entry with a 3-char name only */
+                pos = tfs_scan(dir, pos, buf, buf + 24, &readbytes);
+                if (readbytes == 0) {
+                        break;
+                }
+                if (p->d_name[0] == 'f') {
+                        i = (p->d_name[1] - 'a') * 8 + p->d_name[2] - 'a';
+                        if (seen[i]++) {
+                                return -1;
+                        }
+                }
+
+                if (step < SCAN_TEST_FILES) {
+                        scan_test_path(path, 'g', step);
+                        fs_creat(path);
+                } else if (step < 2 * SCAN_TEST_FILES) {
+                        scan_test_path(path, 'g', step - SCAN_TEST_FILES);
+                        tmpfs_unlink(path, 0);
+                }
+        }
+
+        for (i = 0; i < SCAN_TEST_FILES; i++) {
+                if (!seen[i]) {
+                        return -1;
+                }
+                scan_test_path(path, 'f', i);
+                tmpfs_unlink(path, 0);
+        }
+        for (i = 0; i < SCAN_TEST_FILES; i++) {
+                scan_test_path(path, 'g', i);
+                tmpfs_unlink(path, 0);
+        }
+
+        return tmpfs_rmdir("/scan_dir", 0);
+}
+
 void tfs_test()
 {
         TEST_FUNC(test_tfs_load_image);
@@ -167,4 +242,5 @@ void tfs_test()
         TEST_FUNC(test_create);
         TEST_FUNC(test_read_write);
         TEST_FUNC(test_unlink);
+        TEST_FUNC(test_scan_resize);
 }
@@ -0,0 +1,209 @@
+# Compares per-call overhead and bulk throughput of the same kernels in
+# pure Python, Cython, pybind11 and Rust (ctypes). Build first with make.
+#
+#   python bench.py [--quick] [--markdown]
+#
+# Backends that are not built are skipped. Results are the best of
+# several repeats, per call, and the speedup over pure Python.
+import argparse
+import array
+import ctypes
+import os
+import random
+import sys
+import time
+
+import kernels_py
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+RUST_LIB = os.path.join(HERE, "..", "python_call_rust", "lib.so")
+
+
+def load(name):
+    try:
+        return __import__(name)
+    except ImportError as e:
+        print("skip %s: %s" % (name, e), file=sys.stderr)
+        return None
+
+
+def load_rust():
+    if not os.path.exists(RUST_LIB):
+        print("skip rust: %s not built" % RUST_LIB, file=sys.stderr)
+        return None
+    lib = ctypes.CDLL(RUST_LIB)
+    lib.noop.argtypes = []
+    lib.noop.restype = None
+    lib.fib.argtypes = [ctypes.c_int]
+    lib.fib.restype = ctypes.c_int64
+    lib.sum_f64.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+    lib.sum_f64.restype = ctypes.c_double
+    lib.encode_recs.argtypes = [ctypes.c_void_p] * 4 + [ctypes.c_size_t, ctypes.c_void_p, ctypes.c_size_t]
+    lib.encode_recs.restype = ctypes.c_size_t
+    lib.decode_recs.argtypes = [ctypes.c_char_p, ctypes.c_size_t] + [ctypes.c_void_p] * 4 + [ctypes.c_size_t]
+    lib.decode_recs.restype = ctypes.c_size_t
+    return lib
+
+
+def addr(arr):
+    return arr.buffer_info()[0]
+
+
+# Python side of the Rust record kernels: the marshaling into flat
+# arrays is part of what the FFI path costs.
+def rust_encode(lib, recs):
+    ids = array.array("q", [r[0] for r in recs])
+    vals = array.array("d", [r[1] for r in recs])
+    names = [r[2].encode() for r in recs]
+    offs = array.array("Q", [0])
+    for n in names:
+        offs.append(offs[-1] + len(n))
+    blob = b"".join(names)
+    cap = 20 * len(recs) + len(blob)
+    out = ctypes.create_string_buffer(cap)
+    n = lib.encode_recs(addr(ids), addr(vals), blob, addr(offs), len(recs), out, cap)
+    return out.raw[:n]
+
+
+def rust_decode(lib, buf):
+    # one spare slot, so that a short tail after the last full record is seen
+    max_recs = len(buf) // 20 + 1
+    ids = array.array("q", bytes(8 * max_recs))
+    vals = array.array("d", bytes(8 * max_recs))
+    pos = array.array("Q", bytes(8 * max_recs))
+    lens = array.array("I", bytes(4 * max_recs))
+    n = lib.decode_recs(buf, len(buf), addr(ids), addr(vals), addr(pos), addr(lens), max_recs)
+    if n == ctypes.c_size_t(-1).value:
+        raise ValueError("truncated record")
+    return [(ids[i], vals[i], buf[pos[i]:pos[i] + lens[i]].decode()) for i in range(n)]
+
+
+def timeit(fn, min_time):
+    # calls per repeat grow until one repeat takes min_time
+    calls = 1
+    while True:
+        t = time.perf_counter()
+        for _ in range(calls):
+            fn()
+        dt = time.perf_counter() - t
+        if dt >= min_time:
+            break
+        calls *= 2 if dt == 0 else max(2, min(10, int(min_time / dt) + 1))
+    best = dt / calls
+    for _ in range(4):
+        t = time.perf_counter()
+        for _ in range(calls):
+            fn()
+        best = min(best, (time.perf_counter() - t) / calls)
+    return best
+
+
+def fmt_time(sec):
+    if sec < 1e-6:
+        return "%.0f ns" % (sec * 1e9)
+    if sec < 1e-3:
+        return "%.2f us" % (sec * 1e6)
+    return "%.2f ms" % (sec * 1e3)
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--quick", action="store_true", help="smaller inputs and shorter runs")
+    ap.add_argument("--markdown", action="store_true", help="print a markdown table")
+    args = ap.parse_args()
+    min_time = 0.05 if args.quick else 0.3
+    fib_n = 20 if args.quick else 25
+    array_n = 100000 if args.quick else 1000000
+    rec_n = 2000 if args.quick else 20000
+
+    cy = load("kernels_cy")
+    pb = load("kernels_pb")
+    rust = load_rust()
+    try:
+        import numpy
+    except ImportError:
+        numpy = None
+        print("skip numpy kernels: numpy not installed", file=sys.stderr)
+
+    random.seed(1)
+    values = [random.random() for _ in range(array_n)]
+    darr = array.array("d", values)
+    nparr = numpy.array(values) if numpy else None
+    recs = [(random.randrange(-2**62, 2**62), random.random(), "name%d" % i) for i in range(rec_n)]
+    packed = kernels_py.encode_recs(recs)
+
+    # (kernel, backend, variant, fn, expected result or None)
+    cases = [
+        ("call", "python", "def", kernels_py.noop, None),
+        ("fib(%d)" % fib_n, "python", "def", lambda: kernels_py.fib(fib_n), kernels_py.fib(fib_n)),
+        ("sum %d" % array_n, "python", "list loop", lambda: kernels_py.sum_list(values), None),
+        ("sum %d" % array_n, "python", "builtin sum", lambda: sum(values), None),
+        ("encode %d" % rec_n, "python", "struct", lambda: kernels_py.encode_recs(recs), packed),
+        ("decode %d" % rec_n, "python", "struct", lambda: kernels_py.decode_recs(packed), recs),
+    ]
+    fib_expect = kernels_py.fib(fib_n)
+    if cy:
+        cases += [
+            ("call", "cython", "def", cy.noop, None),
+            ("call", "cython", "cpdef", cy.noop_cpdef, None),
+            ("fib(%d)" % fib_n, "cython", "untyped def", lambda: cy.fib_def(fib_n), fib_expect),
+            ("fib(%d)" % fib_n, "cython", "cdef nogil", lambda: cy.fib_cdef(fib_n), fib_expect),
+            ("sum %d" % array_n, "cython", "list", lambda: cy.sum_list(values), None),
+            ("sum %d" % array_n, "cython", "memoryview nogil", lambda: cy.sum_view(darr), None),
+            ("sum %d" % array_n, "cython", "prange", lambda: cy.sum_prange(darr), None),
+            ("encode %d" % rec_n, "cython", "typed", lambda: cy.encode_recs(recs), packed),
+            ("decode %d" % rec_n, "cython", "typed", lambda: cy.decode_recs(packed), recs),
+        ]
+    if pb:
+        cases += [
+            ("call", "pybind11", "def", pb.noop, None),
+            ("fib(%d)" % fib_n, "pybind11", "gil held", lambda: pb.fib(fib_n), fib_expect),
+            ("fib(%d)" % fib_n, "pybind11", "gil released", lambda: pb.fib_nogil(fib_n), fib_expect),
+            ("sum %d" % array_n, "pybind11", "py::list", lambda: pb.sum_list(values), None),
+            ("encode %d" % rec_n, "pybind11", "C API", lambda: pb.encode_recs(recs), packed),
+            ("decode %d" % rec_n, "pybind11", "C API", lambda: pb.decode_recs(packed), recs),
+        ]
+        if numpy is not None:
+            cases += [
+                ("sum %d" % array_n, "pybind11", "array_t", lambda: pb.sum_array(nparr), None),
+                ("sum %d" % array_n, "pybind11", "array_t nogil", lambda: pb.sum_array_nogil(nparr), None),
+            ]
+    if rust:
+        cases += [
+            ("call", "rust", "ctypes", rust.noop, None),
+            ("fib(%d)" % fib_n, "rust", "ctypes", lambda: rust.fib(fib_n), fib_expect),
+            ("sum %d" % array_n, "rust", "ctypes buffer", lambda: rust.sum_f64(addr(darr), len(darr)), None),
+            ("encode %d" % rec_n, "rust", "ctypes arrays", lambda: rust_encode(rust, recs), packed),
+            ("decode %d" % rec_n, "rust", "ctypes arrays", lambda: rust_decode(rust, packed), recs),
+        ]
+    if numpy is not None:
+        cases.append(("sum %d" % array_n, "numpy", "ndarray.sum", nparr.sum, None))
+
+    expect_sum = sum(values)
+    baseline = {}
+    rows = []
+    for kernel, backend, variant, fn, expect in cases:
+        result = fn()
+        if expect is not None and result != expect:
+            raise SystemExit("%s %s %s: wrong result" % (kernel, backend, variant))
+        if kernel.startswith("sum") and abs(result - expect_sum) > 1e-6 * array_n:
+            raise SystemExit("%s %s %s: wrong sum %r" % (kernel, backend, variant, result))
+        sec = timeit(fn, min_time)
+        baseline.setdefault(kernel, sec)
+        rows.append((kernel, backend, variant, sec))
+
+    header = ("kernel", "backend", "variant", "per call", "vs python")
+    table = [(k, b, v, fmt_time(s), "%.1fx" % (baseline[k] / s)) for k, b, v, s in rows]
+    if args.markdown:
+        print("| " + " | ".join(header) + " |")
+        print("|" + "---|" * len(header))
+        for r in table:
+            print("| " + " | ".join(r) + " |")
+    else:
+        widths = [max(len(str(r[i])) for r in table + [header]) for i in range(len(header))]
+        for r in [header] + table:
+            print("  ".join(str(c).ljust(w) for c, w in zip(r, widths)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,103 @@
+# cython: language_level=3, boundscheck=False, wraparound=False
+# Cython versions of the kernels: fib_def is the untyped code of
+# cython/fibo.pyx, the rest use typed cdef functions, nogil and prange.
+from cython.parallel import prange
+from libc.string cimport memcpy
+from libc.stdint cimport int64_t, uint32_t
+
+
+def noop():
+    pass
+
+
+cpdef void noop_cpdef():
+    pass
+
+
+def fib_def(n):
+    if n < 2:
+        return n
+    return fib_def(n - 1) + fib_def(n - 2)
+
+
+cdef long _fib(int n) nogil:
+    if n < 2:
+        return n
+    return _fib(n - 1) + _fib(n - 2)
+
+
+def fib_cdef(int n):
+    cdef long r
+    with nogil:
+        r = _fib(n)
+    return r
+
+
+def sum_list(list values):
+    cdef double total = 0
+    for v in values:
+        total += <double>v
+    return total
+
+
+def sum_view(const double[::1] values):
+    cdef double total = 0
+    cdef Py_ssize_t i
+    with nogil:
+        for i in range(values.shape[0]):
+            total += values[i]
+    return total
+
+
+def sum_prange(const double[::1] values):
+    cdef double total = 0
+    cdef Py_ssize_t i
+    for i in prange(values.shape[0], nogil=True, schedule="static"):
+        total += values[i]
+    return total
+
+
+def encode_recs(list recs):
+    cdef Py_ssize_t size = 0, pos = 0
+    cdef bytes name
+    cdef int64_t rid
+    cdef double val
+    cdef uint32_t n
+    names = []
+    for rec in recs:
+        name = (<str>rec[2]).encode()
+        names.append(name)
+        size += 20 + len(name)
+    out = bytearray(size)
+    cdef char *p = out
+    for i in range(len(recs)):
+        rec = recs[i]
+        rid = rec[0]
+        val = rec[1]
+        name = names[i]
+        n = len(name)
+        memcpy(p + pos, &rid, 8)
+        memcpy(p + pos + 8, &val, 8)
+        memcpy(p + pos + 16, &n, 4)
+        memcpy(p + pos + 20, <char *>name, n)
+        pos += 20 + n
+    return bytes(out)
+
+
+def decode_recs(const unsigned char[::1] buf):
+    cdef Py_ssize_t pos = 0, size = buf.shape[0]
+    cdef int64_t rid
+    cdef double val
+    cdef uint32_t n
+    recs = []
+    while pos < size:
+        if size - pos < 20:
+            raise ValueError("truncated record")
+        memcpy(&rid, &buf[pos], 8)
+        memcpy(&val, &buf[pos + 8], 8)
+        memcpy(&n, &buf[pos + 16], 4)
+        if n > size - pos - 20:
+            raise ValueError("truncated record")
+        recs.append((rid, val, (<const char *>&buf[pos + 20])[:n].decode()))
+        pos += 20 + n
+    return recs
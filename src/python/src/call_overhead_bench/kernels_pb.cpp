@@ -0,0 +1,90 @@
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+namespace py = pybind11;
+
+// pybind11 versions of the kernels. The sum kernels show the cost of
+// converting a list element by element against reading a numpy array
+// in place, with and without releasing the GIL.
+
+static long fib(int n) {
+    return n < 2 ? n : fib(n - 1) + fib(n - 2);
+}
+
+static double sum_ptr(const double *p, ssize_t n) {
+    double total = 0;
+    for (ssize_t i = 0; i < n; i++)
+        total += p[i];
+    return total;
+}
+
+PYBIND11_MODULE(kernels_pb, m) {
+    m.def("noop", []() {});
+    m.def("fib", &fib);
+    m.def("fib_nogil", &fib, py::call_guard<py::gil_scoped_release>());
+    m.def("sum_list", [](py::list values) {
+        double total = 0;
+        for (auto v : values) {
+            double d = PyFloat_AsDouble(v.ptr());
+            if (d == -1.0 && PyErr_Occurred())
+                throw py::error_already_set();
+            total += d;
+        }
+        return total;
+    });
+    m.def("sum_array", [](py::array_t<double, py::array::c_style | py::array::forcecast> values) {
+        return sum_ptr(values.data(), values.size());
+    });
+    m.def("sum_array_nogil", [](py::array_t<double, py::array::c_style | py::array::forcecast> values) {
+        const double *p = values.data();
+        ssize_t n = values.size();
+        py::gil_scoped_release nogil;
+        return sum_ptr(p, n);
+    });
+    m.def("encode_recs", [](py::list recs) {
+        std::string out;
+        for (auto rec : recs) {
+            py::tuple t = py::reinterpret_borrow<py::tuple>(rec);
+            int64_t rid = PyLong_AsLongLong(t[0].ptr());
+            if (rid == -1 && PyErr_Occurred())
+                throw py::error_already_set();
+            double val = PyFloat_AsDouble(t[1].ptr());
+            if (val == -1.0 && PyErr_Occurred())
+                throw py::error_already_set();
+            Py_ssize_t len;
+            const char *name = PyUnicode_AsUTF8AndSize(t[2].ptr(), &len);
+            if (!name)
+                throw py::error_already_set();
+            uint32_t n = len;
+            out.append((const char *) &rid, 8);
+            out.append((const char *) &val, 8);
+            out.append((const char *) &n, 4);
+            out.append(name, n);
+        }
+        return py::bytes(out);
+    });
+    m.def("decode_recs", [](py::bytes buf) {
+        char *p;
+        Py_ssize_t size;
+        PyBytes_AsStringAndSize(buf.ptr(), &p, &size);
+        py::list recs;
+        for (Py_ssize_t pos = 0; pos < size;) {
+            int64_t rid;
+            double val;
+            uint32_t n;
+            if (size - pos < 20)
+                throw py::value_error("truncated record");
+            memcpy(&rid, p + pos, 8);
+            memcpy(&val, p + pos + 8, 8);
+            memcpy(&n, p + pos + 16, 4);
+            if (n > size - pos - 20)
+                throw py::value_error("truncated record");
+            recs.append(py::make_tuple(rid, val, py::str(p + pos + 20, n)));
+            pos += 20 + n;
+        }
+        return recs;
+    });
+}
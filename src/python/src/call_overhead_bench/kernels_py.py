@@ -0,0 +1,47 @@
+# Pure Python versions of the benchmark kernels, the baseline for bench.py.
+import struct
+
+REC = struct.Struct("<qdI")
+
+
+def noop():
+    pass
+
+
+def fib(n):
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+
+
+def sum_list(values):
+    total = 0.0
+    for v in values:
+        total += v
+    return total
+
+
+# Records are (int id, float value, str name), packed as int64, float64,
+# uint32 name length and the UTF-8 name, all little endian.
+def encode_recs(recs):
+    out = bytearray()
+    for rid, val, name in recs:
+        data = name.encode()
+        out += REC.pack(rid, val, len(data))
+        out += data
+    return bytes(out)
+
+
+def decode_recs(buf):
+    recs = []
+    pos = 0
+    while pos < len(buf):
+        if len(buf) - pos < REC.size:
+            raise ValueError("truncated record")
+        rid, val, n = REC.unpack_from(buf, pos)
+        pos += REC.size
+        if n > len(buf) - pos:
+            raise ValueError("truncated record")
+        recs.append((rid, val, buf[pos:pos + n].decode()))
+        pos += n
+    return recs
@@ -0,0 +1,18 @@
+from setuptools import Extension, setup
+from Cython.Build import cythonize
+
+# pybind11 headers come from the copy vendored with sqlite_blaster_python
+PYBIND11_INCLUDE = "../sqlite_blaster_python/pybind11/include"
+
+setup(
+    ext_modules=cythonize(
+        Extension("kernels_cy", ["kernels_cy.pyx"],
+                  extra_compile_args=["-O3", "-fopenmp"],
+                  extra_link_args=["-fopenmp"]),
+        language_level="3") + [
+        Extension("kernels_pb", ["kernels_pb.cpp"],
+                  include_dirs=[PYBIND11_INCLUDE],
+                  extra_compile_args=["-O3", "-std=c++14", "-fvisibility=hidden"],
+                  language="c++"),
+    ],
+)
@@ -0,0 +1,80 @@
+// Kernels called from Python through ctypes (see
+// ../call_overhead_bench/bench.py). Build with make -> lib.so.
+
+use std::convert::TryInto;
+use std::slice;
+
+#[no_mangle]
+pub extern "C" fn noop() {}
+
+#[no_mangle]
+pub extern "C" fn fib(n: i32) -> i64 {
+    if n < 2 {
+        n as i64
+    } else {
+        fib(n - 1) + fib(n - 2)
+    }
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn sum_f64(values: *const f64, n: usize) -> f64 {
+    slice::from_raw_parts(values, n).iter().sum()
+}
+
+// Records are (i64 id, f64 value, name), packed as id, value, u32 name
+// length and the name bytes, little endian. names holds all names back
+// to back, name_offs[i]..name_offs[i + 1] is name i. Returns the bytes
+// written to out, or 0 if out is too small.
+#[no_mangle]
+pub unsafe extern "C" fn encode_recs(ids: *const i64, vals: *const f64, names: *const u8,
+                                     name_offs: *const usize, n: usize, out: *mut u8, cap: usize) -> usize {
+    let ids = slice::from_raw_parts(ids, n);
+    let vals = slice::from_raw_parts(vals, n);
+    let offs = slice::from_raw_parts(name_offs, n + 1);
+    let names = slice::from_raw_parts(names, offs[n]);
+    let out = slice::from_raw_parts_mut(out, cap);
+    let mut pos = 0;
+    for i in 0..n {
+        let name = &names[offs[i]..offs[i + 1]];
+        if pos + 20 + name.len() > cap {
+            return 0;
+        }
+        out[pos..pos + 8].copy_from_slice(&ids[i].to_le_bytes());
+        out[pos + 8..pos + 16].copy_from_slice(&vals[i].to_le_bytes());
+        out[pos + 16..pos + 20].copy_from_slice(&(name.len() as u32).to_le_bytes());
+        out[pos + 20..pos + 20 + name.len()].copy_from_slice(name);
+        pos += 20 + name.len();
+    }
+    pos
+}
+
+// Decodes up to max records into ids, vals and the name position and
+// length within buf. Returns the number of records, or usize::MAX if a
+// record runs past the end of buf.
+#[no_mangle]
+pub unsafe extern "C" fn decode_recs(buf: *const u8, len: usize, ids: *mut i64, vals: *mut f64,
+                                     name_pos: *mut usize, name_lens: *mut u32, max: usize) -> usize {
+    let buf = slice::from_raw_parts(buf, len);
+    let ids = slice::from_raw_parts_mut(ids, max);
+    let vals = slice::from_raw_parts_mut(vals, max);
+    let name_pos = slice::from_raw_parts_mut(name_pos, max);
+    let name_lens = slice::from_raw_parts_mut(name_lens, max);
+    let mut pos = 0;
+    let mut count = 0;
+    while pos < len && count < max {
+        if len - pos < 20 {
+            return usize::MAX;
+        }
+        ids[count] = i64::from_le_bytes(buf[pos..pos + 8].try_into().unwrap());
+        vals[count] = f64::from_le_bytes(buf[pos + 8..pos + 16].try_into().unwrap());
+        let n = u32::from_le_bytes(buf[pos + 16..pos + 20].try_into().unwrap());
+        if n as usize > len - pos - 20 {
+            return usize::MAX;
+        }
+        name_pos[count] = pos + 20;
+        name_lens[count] = n;
+        pos += 20 + n as usize;
+        count += 1;
+    }
+    count
+}
@@ -1,7 +1,15 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
 #include "sqlite_blaster/src/util.h"
 #include "sqlite_blaster/src/sqlite_index_blaster.h"
+#include "sqlite_btree.h"
+#include "sqlite_bulk_load.h"
 
 #define STRINGIFY(x) #x
 #define MACRO_STRINGIFY(x) STRINGIFY(x)
@@ -12,109 +20,592 @@ namespace py = pybind11;
 #define SQIB_MALFORMED_REC 2;
 
 static const uint8_t int_type_from_len[] = {0, 1, 2, 3, 4, 0, 5, 0, 6};
-int fill_col_arr(py::list py_args, void **col_arr, size_t *col_lens, uint8_t *col_types) {
-    int col_idx = 0;
-    int est_len = 0;
-    for (auto item : py_args) {
-        if (py::isinstance<py::str>(item)) {
-            std::string s = py::cast<std::string>(item);
-            col_arr[col_idx] = (void *) malloc(s.length() + 1);
-            memcpy(col_arr[col_idx], s.c_str(), s.length());
-            col_lens[col_idx] = s.length();
-            col_types[col_idx] = 13;
-            //col_arr[col_idx][s.length()] = '\0';
-            est_len += s.length();
-        } else if (py::isinstance<py::int_>(item)) {
-            int i = py::cast<int>(item);
-            col_arr[col_idx] = (void *) malloc(sizeof(int));
-            memcpy(col_arr[col_idx], &i, sizeof(int));
-            col_lens[col_idx] = sizeof(int);
-            col_types[col_idx] = int_type_from_len[sizeof(int)];
-            est_len += sizeof(int);
-        } else if (py::isinstance<py::float_>(item)) {
-            double d = py::cast<double>(item);
-            col_arr[col_idx] = (void *) malloc(sizeof(double));
-            memcpy(col_arr[col_idx], &d, sizeof(double));
-            col_lens[col_idx] = sizeof(double);
-            col_types[col_idx] = 7;
-            est_len += sizeof(double);
+
+// Index plus the lock that serializes tree access, since batch calls
+// run without the GIL and other Python threads may use the same index.
+class sqlite_index_blaster_py : public sqlite_index_blaster {
+    public:
+        using sqlite_index_blaster::sqlite_index_blaster;
+        std::mutex lock;
+};
+
+// Records of a batch built back to back in one buffer. Python values
+// are staged while the GIL is held (text is copied, so the rows need
+// not outlive add); encode then builds the records with make_new_rec
+// under the index lock, without the GIL. Kept per thread and reused
+// across calls.
+struct rec_arena {
+    std::vector<uint8_t> bytes;
+    std::vector<size_t> offsets {0};
+    // staged columns of all rows, row r is [row_cols[r], row_cols[r + 1])
+    union col_num {
+        int32_t i32;
+        int64_t i64;
+        double dbl;
+    };
+    std::vector<size_t> row_cols {0};
+    std::vector<col_num> nums;
+    std::vector<size_t> col_lens;
+    std::vector<uint8_t> col_types;
+    std::string text;
+    std::vector<const void *> col_arr;
+    void clear() {
+        bytes.clear();
+        offsets.resize(1);
+        row_cols.resize(1);
+        nums.clear();
+        col_lens.clear();
+        col_types.clear();
+        text.clear();
+    }
+    size_t count() {
+        return offsets.size() - 1;
+    }
+    uint8_t *rec(size_t i) {
+        return bytes.data() + offsets[i];
+    }
+    int rec_len(size_t i) {
+        return offsets[i + 1] - offsets[i];
+    }
+    void add(py::handle py_args) {
+        py::object seq = py::reinterpret_steal<py::object>(
+                PySequence_Fast(py_args.ptr(), "record must be a sequence"));
+        if (!seq)
+            throw py::error_already_set();
+        int col_count = PySequence_Fast_GET_SIZE(seq.ptr());
+        PyObject **items = PySequence_Fast_ITEMS(seq.ptr());
+        for (int col_idx = 0; col_idx < col_count; col_idx++) {
+            py::handle item(items[col_idx]);
+            col_num num;
+            if (py::isinstance<py::str>(item)) {
+                // offset into text, made a pointer by encode
+                Py_ssize_t len;
+                const char *s = PyUnicode_AsUTF8AndSize(item.ptr(), &len);
+                if (!s)
+                    throw py::error_already_set();
+                num.i64 = text.size();
+                text.append(s, len);
+                col_lens.push_back(len);
+                col_types.push_back(13);
+            } else if (py::isinstance<py::int_>(item)) {
+                // 4 bytes when the value fits, else the full 64 bit type
+                int64_t val = py::cast<int64_t>(item);
+                if (val >= INT32_MIN && val <= INT32_MAX) {
+                    num.i32 = (int32_t) val;
+                    col_lens.push_back(sizeof(int32_t));
+                } else {
+                    num.i64 = val;
+                    col_lens.push_back(sizeof(int64_t));
+                }
+                col_types.push_back(int_type_from_len[col_lens.back()]);
+            } else if (py::isinstance<py::float_>(item)) {
+                num.dbl = py::cast<double>(item);
+                col_lens.push_back(sizeof(double));
+                col_types.push_back(7);
+            } else
+                throw SQIB_UNHANDLED_TYPE_PASSED;
+            nums.push_back(num);
         }
-        col_idx++;
+        row_cols.push_back(nums.size());
     }
-    if (col_idx != py_args.size())
-        throw SQIB_UNHANDLED_TYPE_PASSED;
-    return est_len;
+    // Builds the records of the rows added since clear. Needs no GIL;
+    // call with the lock of the index held.
+    void encode(sqlite_index_blaster& self) {
+        for (size_t r = count(); r + 1 < row_cols.size(); r++) {
+            size_t first = row_cols[r];
+            int col_count = row_cols[r + 1] - first;
+            size_t est_len = 0;
+            col_arr.resize(col_count);
+            for (int col_idx = 0; col_idx < col_count; col_idx++) {
+                size_t c = first + col_idx;
+                if (col_types[c] == 13)
+                    col_arr[col_idx] = text.data() + nums[c].i64;
+                else
+                    col_arr[col_idx] = &nums[c];
+                est_len += col_lens[c];
+            }
+            size_t pos = bytes.size();
+            bytes.resize(pos + est_len + col_count * 9 + 9);
+            int rec_len = self.make_new_rec(bytes.data() + pos, col_count,
+                            col_arr.data(), col_lens.data() + first, col_types.data() + first);
+            bytes.resize(pos + rec_len);
+            offsets.push_back(pos + rec_len);
+        }
+    }
+};
+
+// Values looked up by a batch, back to back; length -1 if not found.
+struct val_arena {
+    std::vector<uint8_t> bytes;
+    std::vector<size_t> offsets;
+    std::vector<int> lens;
+    void clear() {
+        bytes.clear();
+        offsets.clear();
+        lens.clear();
+    }
+};
+
+static thread_local rec_arena tl_recs;
+static thread_local val_arena tl_vals;
+
+static py::object col_value(rec_reader& col) {
+    switch (col.col_type) {
+        case SQLT_TYPE_NULL:
+        case SQLT_TYPE_BLOB:
+        case SQLT_TYPE_TEXT:
+            return py::str((const char *) col.data_ptr, col.col_len);
+        case SQLT_TYPE_REAL:
+            return py::float_(col.real_val());
+    }
+    return py::int_(col.int_val());
 }
 
-py::list get_values(sqlite_index_blaster& self, uint8_t *rec, int rec_len) {
+// Column values of a record; cols selects and orders the columns to
+// convert (missing ones become None), empty means all.
+py::list get_values(const uint8_t *rec, int rec_len, const std::vector<int>& cols = std::vector<int>()) {
     py::list result;
-    int8_t vlen;
-    int col_type_or_len, col_len, col_type;
-    int hdr_len = util::read_vint32(rec, &vlen);
-    int hdr_pos = vlen;
-    uint8_t *data_ptr = rec + hdr_len;
-    col_len = vlen = 0;
-    do {
-        data_ptr += col_len;
-        hdr_pos += vlen;
-        if (data_ptr - rec > rec_len)
-            break;
-        if (hdr_pos >= hdr_len)
-            break;
-        col_type_or_len = util::read_vint32(rec + hdr_pos, &vlen);
-        col_len = self.derive_data_len(col_type_or_len);
-        col_type = self.derive_col_type(col_type_or_len);
-        switch (col_type) {
-            case SQLT_TYPE_NULL:
-            case SQLT_TYPE_BLOB:
-            case SQLT_TYPE_TEXT: {
-                    std::string str_val((const char *) data_ptr, col_len);
-                    result.append(py::str(str_val));
-                }
-                break;
-            case SQLT_TYPE_INT0:
-                result.append(py::int_(0));
-                break;
-            case SQLT_TYPE_INT1:
-                result.append(py::int_(1));
-                break;
-            case SQLT_TYPE_INT8:
-                result.append(py::int_(*data_ptr));
-                break;
-            case SQLT_TYPE_INT16: {
-                    int int_val = util::read_uint16(data_ptr);
-                    result.append(py::int_(int_val));
-                }
-                break;
-            case SQLT_TYPE_INT24: {
-                    int32_t int_val = util::read_uint24(data_ptr);
-                    result.append(py::int_(int_val));
-                }
-                break;
-            case SQLT_TYPE_INT32: {
-                    int32_t int_val = util::read_uint32(data_ptr);
-                    result.append(py::int_(int_val));
+    rec_reader col(rec, rec_len);
+    if (cols.empty()) {
+        while (col.next())
+            result.append(col_value(col));
+        return result;
+    }
+    int max_col = *std::max_element(cols.begin(), cols.end());
+    if (*std::min_element(cols.begin(), cols.end()) < 0)
+        throw std::out_of_range("column index must not be negative");
+    std::vector<py::object> vals(max_col + 1);
+    for (int c = 0; c <= max_col && col.next(); c++) {
+        if (std::find(cols.begin(), cols.end(), c) != cols.end())
+            vals[c] = col_value(col);
+    }
+    for (int c : cols)
+        result.append(vals[c] ? vals[c] : py::none());
+    return result;
+}
+
+// Flat typed array handed to Python through the buffer protocol, so
+// numpy.asarray() / memoryview() use it without copying.
+struct typed_buffer {
+    char format;    // 'q' int64, 'd' float64, 'B' uint8
+    std::vector<int64_t> i64;
+    std::vector<double> f64;
+    std::vector<uint8_t> u8;
+    typed_buffer(char format) : format (format) {}
+    py::buffer_info info() {
+        void *ptr = format == 'q' ? (void *) i64.data() : format == 'd' ? (void *) f64.data() : (void *) u8.data();
+        size_t count = format == 'q' ? i64.size() : format == 'd' ? f64.size() : u8.size();
+        size_t item_size = format == 'B' ? 1 : 8;
+        return py::buffer_info(ptr, item_size, std::string(1, format), 1,
+                    {(py::ssize_t) count}, {(py::ssize_t) item_size}, true);
+    }
+};
+typedef std::shared_ptr<typed_buffer> typed_buffer_ptr;
+
+enum {COL_NULL = 0, COL_INT, COL_REAL, COL_TEXT};
+static const char *col_kind_names[] = {"null", "int", "real", "text"};
+
+// Many records decoded column by column. int columns are int64, real
+// columns float64 (ints in a real column are converted), text/blob
+// columns a bytes buffer plus int64 offsets (n + 1 entries; numbers in a
+// text column are stored as their decimal text). valid is 0 for rows
+// where the column is NULL or missing.
+struct column_batch {
+    size_t rows = 0;
+    std::vector<int> kinds;
+    std::vector<typed_buffer_ptr> values;
+    std::vector<typed_buffer_ptr> offsets;
+    std::vector<typed_buffer_ptr> valid;
+    typed_buffer_ptr found;
+
+    // Decodes recs into columns. cols selects and orders the columns
+    // to keep; empty means all. Does not touch Python objects, so it
+    // can run without the GIL.
+    void decode(val_arena& recs, const std::vector<int>& cols) {
+        rows = recs.lens.size();
+        size_t col_count = cols.size();
+        if (col_count == 0) {
+            for (size_t r = 0; r < rows; r++) {
+                if (recs.lens[r] < 0)
+                    continue;
+                rec_reader col(recs.bytes.data() + recs.offsets[r], recs.lens[r]);
+                size_t n = 0;
+                while (col.next())
+                    n++;
+                col_count = std::max(col_count, n);
+            }
+        }
+        // positions in the output for each record column, none if skipped
+        // and several if cols repeats it
+        std::vector<std::vector<int> > out_pos;
+        if (cols.empty()) {
+            for (size_t c = 0; c < col_count; c++)
+                out_pos.push_back(std::vector<int>(1, c));
+        } else {
+            for (size_t c = 0; c < cols.size(); c++) {
+                if (cols[c] < 0)
+                    throw std::out_of_range("column index must not be negative");
+                if ((size_t) cols[c] >= out_pos.size())
+                    out_pos.resize(cols[c] + 1);
+                out_pos[cols[c]].push_back(c);
+            }
+        }
+        // first pass: column kinds
+        kinds.assign(col_count, COL_NULL);
+        for (size_t r = 0; r < rows; r++) {
+            if (recs.lens[r] < 0)
+                continue;
+            rec_reader col(recs.bytes.data() + recs.offsets[r], recs.lens[r]);
+            for (size_t c = 0; c < out_pos.size() && col.next(); c++) {
+                for (int out : out_pos[c]) {
+                    int& kind = kinds[out];
+                    if (col.col_type == SQLT_TYPE_TEXT || col.col_type == SQLT_TYPE_BLOB)
+                        kind = COL_TEXT;
+                    else if (col.col_type == SQLT_TYPE_REAL)
+                        kind = kind == COL_TEXT ? COL_TEXT : COL_REAL;
+                    else if (col.is_int() && kind == COL_NULL)
+                        kind = COL_INT;
                 }
-                break;
-            case SQLT_TYPE_INT48: {
-                    int int_val = util::read_int48(data_ptr);
-                    result.append(py::int_(int_val));
+            }
+        }
+        // second pass: values
+        values.clear();
+        offsets.clear();
+        valid.clear();
+        for (size_t c = 0; c < col_count; c++) {
+            int kind = kinds[c];
+            typed_buffer_ptr v = std::make_shared<typed_buffer>(kind == COL_REAL ? 'd' : kind == COL_TEXT ? 'B' : 'q');
+            if (kind == COL_REAL)
+                v->f64.assign(rows, 0);
+            else if (kind != COL_TEXT)
+                v->i64.assign(rows, 0);
+            values.push_back(v);
+            typed_buffer_ptr o;
+            if (kind == COL_TEXT) {
+                o = std::make_shared<typed_buffer>('q');
+                o->i64.assign(rows + 1, 0);
+            }
+            offsets.push_back(o);
+            typed_buffer_ptr m = std::make_shared<typed_buffer>('B');
+            m->u8.assign(rows, 0);
+            valid.push_back(m);
+        }
+        found = std::make_shared<typed_buffer>('B');
+        found->u8.assign(rows, 0);
+        char num_str[32];
+        for (size_t r = 0; r < rows; r++) {
+            for (size_t c = 0; c < col_count; c++) {
+                if (kinds[c] == COL_TEXT)
+                    offsets[c]->i64[r] = values[c]->u8.size();
+            }
+            if (recs.lens[r] >= 0) {
+                found->u8[r] = 1;
+                rec_reader col(recs.bytes.data() + recs.offsets[r], recs.lens[r]);
+                for (size_t c = 0; c < out_pos.size() && col.next(); c++) {
+                    if (col.col_type == SQLT_TYPE_NULL)
+                        continue;
+                    for (int out : out_pos[c]) {
+                        typed_buffer& v = *values[out];
+                        switch (kinds[out]) {
+                            case COL_INT:
+                                v.i64[r] = col.int_val();
+                                break;
+                            case COL_REAL:
+                                v.f64[r] = col.col_type == SQLT_TYPE_REAL ? col.real_val() : (double) col.int_val();
+                                break;
+                            case COL_TEXT:
+                                if (col.col_type == SQLT_TYPE_TEXT || col.col_type == SQLT_TYPE_BLOB)
+                                    v.u8.insert(v.u8.end(), col.data_ptr, col.data_ptr + col.col_len);
+                                else {
+                                    int len = col.col_type == SQLT_TYPE_REAL
+                                            ? snprintf(num_str, sizeof(num_str), "%.17g", col.real_val())
+                                            : snprintf(num_str, sizeof(num_str), "%lld", (long long) col.int_val());
+                                    v.u8.insert(v.u8.end(), num_str, num_str + len);
+                                }
+                                break;
+                        }
+                        valid[out]->u8[r] = 1;
+                    }
                 }
+            }
+        }
+        for (size_t c = 0; c < col_count; c++) {
+            if (kinds[c] == COL_TEXT)
+                offsets[c]->i64[rows] = values[c]->u8.size();
+        }
+    }
+    void check_col(size_t c) {
+        if (c >= kinds.size())
+            throw py::index_error("column index out of range");
+    }
+};
+typedef std::shared_ptr<column_batch> column_batch_ptr;
+
+static std::vector<int> to_col_list(py::object cols) {
+    std::vector<int> col_list;
+    if (!cols.is_none()) {
+        for (auto c : cols)
+            col_list.push_back(py::cast<int>(c));
+    }
+    return col_list;
+}
+
+// Search key from a Python sequence (or a single value); None gives an
+// empty key, meaning no bound.
+static std::vector<key_val> to_key(py::object py_key) {
+    std::vector<key_val> key;
+    if (py_key.is_none())
+        return key;
+    py::list items;
+    if (py::isinstance<py::str>(py_key) || py::isinstance<py::bytes>(py_key) || !py::isinstance<py::sequence>(py_key))
+        items.append(py_key);
+    else
+        items = py::list(py_key);
+    for (auto item : items) {
+        key_val kv;
+        kv.i = 0;
+        kv.d = 0;
+        if (item.is_none())
+            kv.col_type = SQLT_TYPE_NULL;
+        else if (py::isinstance<py::str>(item)) {
+            kv.col_type = SQLT_TYPE_TEXT;
+            kv.s = py::cast<std::string>(item);
+        } else if (py::isinstance<py::bytes>(item)) {
+            kv.col_type = SQLT_TYPE_BLOB;
+            kv.s = py::cast<std::string>(item);
+        } else if (py::isinstance<py::int_>(item)) {
+            kv.col_type = SQLT_TYPE_INT64;
+            kv.i = py::cast<int64_t>(item);
+        } else if (py::isinstance<py::float_>(item)) {
+            kv.col_type = SQLT_TYPE_REAL;
+            kv.d = py::cast<double>(item);
+        } else
+            throw SQIB_UNHANDLED_TYPE_PASSED;
+        key.push_back(kv);
+    }
+    return key;
+}
+
+// Ordered scan over a key range of an index file, returned in batches.
+// Records of a batch are read from the leaf pages into an arena without
+// the GIL; only the requested columns are converted.
+struct range_scan {
+    sqlite_btree_cursor cur;
+    std::vector<key_val> start, end, prefix;
+    bool reverse;
+    std::vector<int> cols;
+    size_t batch_size;
+    bool columnar;
+    bool started = false;
+    std::mutex lock;
+
+    range_scan(const std::string& filename, const std::string& tbl_name)
+            : cur (filename.c_str(), tbl_name) {
+    }
+    // Positions at the first entry in scan order: start (inclusive)
+    // going forward, end (exclusive) going backward, narrowed to prefix.
+    void position() {
+        const uint8_t *rec;
+        int rec_len;
+        if (!reverse) {
+            if (!start.empty())
+                cur.seek_ge(start, false);
+            else if (!prefix.empty())
+                cur.seek_ge(prefix, true);
+            else
+                cur.first();
+            if (!prefix.empty() && !start.empty() && cur.valid()) {
+                cur.current(&rec, &rec_len);
+                if (compare_key(rec, rec_len, prefix, true) < 0)
+                    cur.seek_ge(prefix, true);
+            }
+        } else {
+            if (!end.empty())
+                cur.seek_lt(end, false, false);
+            else if (!prefix.empty())
+                cur.seek_lt(prefix, true, true);
+            else
+                cur.last();
+            if (!prefix.empty() && !end.empty() && cur.valid()) {
+                cur.current(&rec, &rec_len);
+                if (compare_key(rec, rec_len, prefix, true) > 0)
+                    cur.seek_lt(prefix, true, true);
+            }
+        }
+    }
+    // Copies up to batch_size records in range to vals.
+    void fill(val_arena& vals) {
+        vals.clear();
+        if (!started) {
+            position();
+            started = true;
+        }
+        while (cur.valid() && vals.lens.size() < batch_size) {
+            const uint8_t *rec;
+            int rec_len;
+            cur.current(&rec, &rec_len);
+            bool in_range = reverse
+                    ? start.empty() || compare_key(rec, rec_len, start, false) >= 0
+                    : end.empty() || compare_key(rec, rec_len, end, false) < 0;
+            if (in_range && !prefix.empty())
+                in_range = compare_key(rec, rec_len, prefix, true) == 0;
+            if (!in_range) {
+                cur.invalidate();
                 break;
-            case SQLT_TYPE_INT64: {
-                    int64_t int_val = util::read_uint64(data_ptr);
-                    result.append(py::int_(int_val));
+            }
+            vals.offsets.push_back(vals.bytes.size());
+            vals.lens.push_back(rec_len);
+            vals.bytes.insert(vals.bytes.end(), rec, rec + rec_len);
+            if (reverse)
+                cur.prev();
+            else
+                cur.next();
+        }
+    }
+};
+typedef std::shared_ptr<range_scan> range_scan_ptr;
+
+// Appends one Python value to a record being built for bulk_load.
+static void add_py_value(rec_builder& rec, py::handle val) {
+    PyObject *obj = val.ptr();
+    if (obj == Py_None)
+        rec.add_null();
+    else if (PyUnicode_Check(obj)) {
+        Py_ssize_t len;
+        const char *s = PyUnicode_AsUTF8AndSize(obj, &len);
+        if (!s)
+            throw py::error_already_set();
+        rec.add_text(s, len);
+    } else if (PyBytes_Check(obj))
+        rec.add_text(PyBytes_AS_STRING(obj), PyBytes_GET_SIZE(obj), true);
+    else if (PyFloat_Check(obj))
+        rec.add_real(PyFloat_AS_DOUBLE(obj));
+    else if (PyIndex_Check(obj)) {
+        // OverflowError beyond 64 bits, as sqlite3 raises
+        py::object i = py::reinterpret_steal<py::object>(PyNumber_Index(obj));
+        if (!i)
+            throw py::error_already_set();
+        long long v = PyLong_AsLongLong(i.ptr());
+        if (v == -1 && PyErr_Occurred())
+            throw py::error_already_set();
+        rec.add_int(v);
+    }
+    else if (PyNumber_Check(obj))
+        rec.add_real(py::cast<double>(val));
+    else
+        throw SQIB_UNHANDLED_TYPE_PASSED;
+}
+
+// One input column for bulk_load: a 1-d numeric buffer read directly,
+// or any sequence converted to a list.
+struct bulk_column {
+    py::buffer_info buf;
+    char kind = 0;      // 'i' signed, 'u' unsigned, 'f' float, 0 for list
+    py::list items;
+    size_t size;
+    bulk_column(py::handle col) {
+        if (PyObject_CheckBuffer(col.ptr())) {
+            buf = py::reinterpret_borrow<py::buffer>(col).request();
+            std::string fmt = buf.format;
+            char f = fmt.empty() ? 0 : fmt.back();
+            if (buf.ndim == 1 && fmt.size() <= 2 && strchr("bhilqBHILQ?fd", f)) {
+                kind = f == 'f' || f == 'd' ? 'f' : (f >= 'a' ? 'i' : 'u');
+                if (f == '?')
+                    kind = 'u';
+                size = buf.shape[0];
+                return;
+            }
+        }
+        items = py::list(py::reinterpret_borrow<py::object>(col));
+        size = items.size();
+    }
+    void add(rec_builder& rec, size_t row) {
+        if (!kind) {
+            add_py_value(rec, items[row]);
+            return;
+        }
+        const uint8_t *p = (const uint8_t *) buf.ptr + row * buf.strides[0];
+        if (kind == 'f') {
+            double d = buf.itemsize == 4 ? *(const float *) p : *(const double *) p;
+            if (d != d)
+                rec.add_null();     // NaN, as pandas/Arrow use for missing values
+            else
+                rec.add_real(d);
+            return;
+        }
+        int64_t v = 0;
+        switch (buf.itemsize) {
+            case 1: v = kind == 'i' ? *(const int8_t *) p : *(const uint8_t *) p; break;
+            case 2: v = kind == 'i' ? *(const int16_t *) p : *(const uint16_t *) p; break;
+            case 4: v = kind == 'i' ? *(const int32_t *) p : *(const uint32_t *) p; break;
+            default:
+                v = *(const int64_t *) p;
+                // same limit as for Python ints
+                if (kind == 'u' && v < 0) {
+                    PyErr_SetString(PyExc_OverflowError, "unsigned value does not fit in a 64-bit integer");
+                    throw py::error_already_set();
                 }
                 break;
-            case SQLT_TYPE_REAL: {
-                    double dbl_val = util::read_double(data_ptr);
-                    result.append(PyFloat_FromDouble(dbl_val));
+        }
+        rec.add_int(v);
+    }
+};
+
+// Feeds records converted under the GIL to sorters, sorting and spilling
+// each full chunk on a background thread while conversion goes on.
+class bulk_feeder {
+    private:
+        sqlite_bulk_loader& loader;
+        size_t chunk_bytes;
+        run_sorter *cur;
+        std::vector<std::thread> pool;
+        std::deque<std::exception_ptr> errors;
+
+        void join_all() {
+            for (auto& th : pool)
+                th.join();
+            pool.clear();
+        }
+    public:
+        bulk_feeder(sqlite_bulk_loader& loader, size_t mem_limit)
+                : loader (loader), chunk_bytes (mem_limit / (loader.threads() + 1)) {
+            cur = loader.new_sorter();
+        }
+        ~bulk_feeder() {
+            join_all();
+        }
+        void add(rec_builder& rec) {
+            cur->add(rec);
+            if (cur->mem_bytes() < chunk_bytes)
+                return;
+            if ((int) pool.size() >= loader.threads()) {
+                py::gil_scoped_release nogil;
+                join_all();
+            }
+            errors.emplace_back();
+            std::exception_ptr *err = &errors.back();
+            run_sorter *full = cur;
+            pool.emplace_back([full, err]() {
+                try {
+                    full->spill();
+                } catch (...) {
+                    *err = std::current_exception();
                 }
-                break;
+            });
+            cur = loader.new_sorter();
         }
-    } while (hdr_pos < hdr_len);
-    return result;
-}
+        void finish() {
+            {
+                py::gil_scoped_release nogil;
+                join_all();
+                cur->finish();
+            }
+            for (auto& e : errors) {
+                if (e)
+                    std::rethrow_exception(e);
+            }
+        }
+};
 
 PYBIND11_MODULE(sqlite_blaster_python, m) {
     m.doc() = R"pbdoc(
@@ -128,42 +619,394 @@ PYBIND11_MODULE(sqlite_blaster_python, m) {
 
            get
            put
+           put_recs
+           get_recs
+           get_cols
+           scan
+           bulk_load
     )pbdoc";
-    py::class_<sqlite_index_blaster>(m, "sqlite_index_blaster")
+    py::class_<sqlite_index_blaster_py>(m, "sqlite_index_blaster")
         .def(py::init<int, int, 
                 std::string, std::string,
                 int, int,
                 const char *>())
-        .def("close", &sqlite_index_blaster::close)
-        .def("put_string", &sqlite_index_blaster::put_string)
-        .def("get_string", &sqlite_index_blaster::get_string)
-        .def("put_rec", [](sqlite_index_blaster& self, py::list py_args) {
-            int col_count = py_args.size();
-            void *col_arr[col_count];
-            size_t col_lens[col_count];
-            uint8_t col_types[col_count];
-            int est_len = fill_col_arr(py_args, col_arr, col_lens, col_types);
-            uint8_t rec[est_len + col_count * 3 + 3];
-            int rec_len = self.make_new_rec(rec, col_count, (const void **) col_arr, col_lens, col_types);
-            return self.put(rec, -rec_len, NULL, 0);
+        .def("close", [](sqlite_index_blaster_py& self) {
+            py::gil_scoped_release nogil;
+            std::lock_guard<std::mutex> guard(self.lock);
+            self.close();
+        })
+        .def("put_string", [](sqlite_index_blaster_py& self, std::string key, std::string val) {
+            py::gil_scoped_release nogil;
+            std::lock_guard<std::mutex> guard(self.lock);
+            return self.put_string(key, val);
+        })
+        .def("get_string", [](sqlite_index_blaster_py& self, std::string key, std::string not_found_val) {
+            py::gil_scoped_release nogil;
+            std::lock_guard<std::mutex> guard(self.lock);
+            return self.get_string(key, not_found_val);
+        })
+        .def("put_rec", [](sqlite_index_blaster_py& self, py::list py_args) {
+            rec_arena& recs = tl_recs;
+            recs.clear();
+            recs.add(py_args);
+            py::gil_scoped_release nogil;
+            std::lock_guard<std::mutex> guard(self.lock);
+            recs.encode(self);
+            return self.put(recs.rec(0), -recs.rec_len(0), NULL, 0);
         })
-        .def("get_rec", [](sqlite_index_blaster& self, py::list py_args) {
-            int col_count = py_args.size();
-            void *col_arr[col_count];
-            size_t col_lens[col_count];
-            uint8_t col_types[col_count];
-            int est_len = fill_col_arr(py_args, col_arr, col_lens, col_types);
-            uint8_t rec[est_len + col_count * 3 + 3];
-            int rec_len = self.make_new_rec(rec, col_count, (const void **) col_arr, col_lens, col_types);
+        .def("get_rec", [](sqlite_index_blaster_py& self, py::list py_args) {
+            rec_arena& recs = tl_recs;
+            recs.clear();
+            recs.add(py_args);
+            val_arena& vals = tl_vals;
+            vals.clear();
             int out_len;
             py::list result;
-            if (self.get(rec, -rec_len, &out_len)) {
-                uint8_t *val = (uint8_t *) malloc(out_len);
-                self.copy_value(val, &out_len);
-                result = get_values(self, val, out_len);
-                free(val);
+            {
+                py::gil_scoped_release nogil;
+                std::lock_guard<std::mutex> guard(self.lock);
+                recs.encode(self);
+                if (self.get(recs.rec(0), -recs.rec_len(0), &out_len)) {
+                    vals.bytes.resize(out_len);
+                    self.copy_value(vals.bytes.data(), &out_len);
+                } else
+                    out_len = -1;
             }
+            if (out_len >= 0)
+                result = get_values(vals.bytes.data(), out_len);
             return result;
+        })
+        .def("put_recs", [](sqlite_index_blaster_py& self, py::iterable rows) {
+            rec_arena& recs = tl_recs;
+            recs.clear();
+            for (auto row : rows)
+                recs.add(row);
+            size_t inserted = 0;
+            {
+                py::gil_scoped_release nogil;
+                std::lock_guard<std::mutex> guard(self.lock);
+                recs.encode(self);
+                for (size_t i = 0; i < recs.count(); i++) {
+                    if (self.put(recs.rec(i), -recs.rec_len(i), NULL, 0))
+                        inserted++;
+                }
+            }
+            return inserted;
+        }, R"pbdoc(
+            Puts a batch of records. Each row is converted up front and the
+            index is updated without holding the GIL. Returns the number of
+            rows for which put returned true.
+        )pbdoc")
+        .def("get_recs", [](sqlite_index_blaster_py& self, py::iterable keys) {
+            rec_arena& recs = tl_recs;
+            recs.clear();
+            for (auto key : keys)
+                recs.add(key);
+            val_arena& vals = tl_vals;
+            vals.clear();
+            {
+                py::gil_scoped_release nogil;
+                std::lock_guard<std::mutex> guard(self.lock);
+                recs.encode(self);
+                for (size_t i = 0; i < recs.count(); i++) {
+                    int out_len;
+                    size_t pos = vals.bytes.size();
+                    if (self.get(recs.rec(i), -recs.rec_len(i), &out_len)) {
+                        vals.bytes.resize(pos + out_len);
+                        self.copy_value(vals.bytes.data() + pos, &out_len);
+                        vals.bytes.resize(pos + out_len);
+                    } else
+                        out_len = -1;
+                    vals.offsets.push_back(pos);
+                    vals.lens.push_back(out_len);
+                }
+            }
+            py::list result;
+            for (size_t i = 0; i < vals.lens.size(); i++) {
+                if (vals.lens[i] < 0)
+                    result.append(py::list());
+                else
+                    result.append(get_values(vals.bytes.data() + vals.offsets[i], vals.lens[i]));
+            }
+            return result;
+        }, R"pbdoc(
+            Looks up a batch of keys without holding the GIL during the index
+            walk. Returns one list of column values per key, empty if not found.
+        )pbdoc")
+        .def("get_cols", [](sqlite_index_blaster_py& self, py::iterable keys, py::object cols) {
+            rec_arena& recs = tl_recs;
+            recs.clear();
+            for (auto key : keys)
+                recs.add(key);
+            std::vector<int> col_list = to_col_list(cols);
+            val_arena& vals = tl_vals;
+            vals.clear();
+            column_batch_ptr batch = std::make_shared<column_batch>();
+            {
+                py::gil_scoped_release nogil;
+                {
+                    std::lock_guard<std::mutex> guard(self.lock);
+                    recs.encode(self);
+                    for (size_t i = 0; i < recs.count(); i++) {
+                        int out_len;
+                        size_t pos = vals.bytes.size();
+                        if (self.get(recs.rec(i), -recs.rec_len(i), &out_len)) {
+                            vals.bytes.resize(pos + out_len);
+                            self.copy_value(vals.bytes.data() + pos, &out_len);
+                            vals.bytes.resize(pos + out_len);
+                        } else
+                            out_len = -1;
+                        vals.offsets.push_back(pos);
+                        vals.lens.push_back(out_len);
+                    }
+                }
+                batch->decode(vals, col_list);
+            }
+            return batch;
+        }, py::arg("keys"), py::arg("cols") = py::none(), R"pbdoc(
+            Like get_recs, but returns a column_batch with one typed array per
+            column instead of Python objects per value. cols optionally selects
+            and orders the columns to decode.
+        )pbdoc");
+
+    m.def("scan", [](std::string filename, py::object start, py::object end, py::object prefix,
+                bool reverse, py::object cols, size_t batch_size, bool columnar, std::string tbl_name) {
+            if (batch_size == 0)
+                throw std::invalid_argument("batch_size must be positive");
+            range_scan_ptr scan = std::make_shared<range_scan>(filename, tbl_name);
+            scan->start = to_key(start);
+            scan->end = to_key(end);
+            scan->prefix = to_key(prefix);
+            scan->reverse = reverse;
+            scan->cols = to_col_list(cols);
+            scan->batch_size = batch_size;
+            scan->columnar = columnar;
+            return scan;
+        }, py::arg("filename"), py::arg("start") = py::none(), py::arg("end") = py::none(),
+           py::arg("prefix") = py::none(), py::arg("reverse") = false, py::arg("cols") = py::none(),
+           py::arg("batch_size") = 1024, py::arg("columnar") = false, py::arg("tbl_name") = "", R"pbdoc(
+            Iterates records of an index file in key order, from start
+            (inclusive) to end (exclusive), or only those whose leading key
+            columns equal prefix (a str last column matches as a string
+            prefix). Yields lists of up to batch_size records, or a
+            column_batch per batch with columnar=True; cols selects the
+            columns to decode. Reads the file, so close the index (or use a
+            finished one) before scanning. tbl_name defaults to the first table.
+        )pbdoc");
+
+    m.def("bulk_load", [](std::string filename, py::object source, py::object key_cols, py::object col_names,
+                std::string tbl_name, int page_size, double fill_factor, int threads, size_t mem_limit,
+                char delimiter, bool header, std::string tmp_dir) {
+            bulk_load_opts opts;
+            opts.tbl_name = tbl_name;
+            opts.page_size = page_size;
+            opts.fill_factor = fill_factor;
+            opts.threads = threads;
+            opts.mem_limit = mem_limit;
+            opts.delimiter = delimiter;
+            opts.header = header;
+            opts.tmp_dir = tmp_dir;
+            if (opts.tmp_dir.empty()) {
+                size_t slash = filename.rfind('/');
+                opts.tmp_dir = slash == std::string::npos ? "." : slash == 0 ? "/" : filename.substr(0, slash);
+            }
+            sqlite_bulk_loader loader(opts);
+            std::vector<std::string> names;
+            if (!col_names.is_none()) {
+                for (auto n : col_names)
+                    names.push_back(py::cast<std::string>(n));
+            }
+            py::list keys;
+            if (py::isinstance<py::str>(key_cols) || py::isinstance<py::int_>(key_cols))
+                keys.append(key_cols);
+            else
+                keys = py::list(key_cols);
+            auto key_index = [&keys](const std::vector<std::string>& names) {
+                std::vector<int> idx;
+                for (auto k : keys) {
+                    if (py::isinstance<py::int_>(k))
+                        idx.push_back(py::cast<int>(k));
+                    else {
+                        std::string name = py::cast<std::string>(k);
+                        auto it = std::find(names.begin(), names.end(), name);
+                        if (it == names.end())
+                            throw std::invalid_argument("unknown key column: " + name);
+                        idx.push_back(it - names.begin());
+                    }
+                }
+                return idx;
+            };
+            bulk_load_result result;
+            if (py::isinstance<py::str>(source) || py::hasattr(source, "__fspath__")) {
+                std::string path = py::str(py::module_::import("os").attr("fspath")(source));
+                // names (or count) come from the first line
+                if (names.empty())
+                    names = loader.csv_columns(path);
+                loader.set_columns(names, key_index(names));
+                py::gil_scoped_release nogil;
+                loader.parse_csv(path);
+                result = loader.write(filename);
+            } else {
+                std::vector<bulk_column> columns;
+                bool by_column = py::isinstance<py::dict>(source) || py::hasattr(source, "column_names");
+                if (by_column) {
+                    // mapping of name -> column, or an Arrow table / record batch
+                    std::vector<std::string> src_names;
+                    if (py::isinstance<py::dict>(source)) {
+                        for (auto item : py::reinterpret_borrow<py::dict>(source)) {
+                            src_names.push_back(py::str(item.first));
+                            py::object col = py::reinterpret_borrow<py::object>(item.second);
+                            if (py::hasattr(col, "to_numpy"))
+                                col = col.attr("to_numpy")();
+                            columns.emplace_back(col);
+                        }
+                    } else {
+                        for (auto n : source.attr("column_names"))
+                            src_names.push_back(py::cast<std::string>(n));
+                        for (size_t c = 0; c < src_names.size(); c++)
+                            columns.emplace_back(source.attr("column")(c).attr("to_numpy")());
+                    }
+                    if (names.empty())
+                        names = src_names;
+                    for (auto& col : columns) {
+                        if (col.size != columns[0].size)
+                            throw std::invalid_argument("columns differ in length");
+                    }
+                }
+                py::iterator rows;
+                py::object first;
+                if (!by_column) {
+                    rows = py::iter(source);
+                    if (rows != py::iterator::sentinel())
+                        first = py::reinterpret_borrow<py::object>(*rows);
+                    if (names.empty() && first) {
+                        for (size_t c = 0; c < py::len(first); c++)
+                            names.push_back("c" + std::to_string(c + 1));
+                    }
+                }
+                if (by_column && names.size() != columns.size())
+                    throw std::invalid_argument("col_names does not match the number of columns");
+                loader.set_columns(names, key_index(names));
+                const std::vector<int>& order = loader.record_order();
+                bulk_feeder feeder(loader, mem_limit);
+                rec_builder rec;
+                if (by_column) {
+                    size_t row_count = columns.empty() ? 0 : columns[0].size;
+                    for (size_t r = 0; r < row_count; r++) {
+                        rec.clear();
+                        for (int c : order)
+                            columns[c].add(rec, r);
+                        feeder.add(rec);
+                    }
+                } else {
+                    for (; rows != py::iterator::sentinel(); ++rows) {
+                        py::object row = py::reinterpret_borrow<py::object>(*rows);
+                        py::object seq = py::reinterpret_steal<py::object>(
+                                PySequence_Fast(row.ptr(), "row must be a sequence"));
+                        if (!seq)
+                            throw py::error_already_set();
+                        size_t n = PySequence_Fast_GET_SIZE(seq.ptr());
+                        PyObject **items = PySequence_Fast_ITEMS(seq.ptr());
+                        rec.clear();
+                        for (int c : order) {
+                            if ((size_t) c < n)
+                                add_py_value(rec, items[c]);
+                            else
+                                rec.add_null();
+                        }
+                        feeder.add(rec);
+                    }
+                }
+                feeder.finish();
+                py::gil_scoped_release nogil;
+                result = loader.write(filename);
+            }
+            py::dict info;
+            info["rows"] = result.rows;
+            info["duplicates"] = result.duplicates;
+            info["pages"] = result.pages;
+            info["runs"] = result.runs;
+            return info;
+        }, py::arg("filename"), py::arg("source"), py::arg("key_cols"), py::arg("col_names") = py::none(),
+           py::arg("tbl_name") = "kv", py::arg("page_size") = 4096, py::arg("fill_factor") = 0.9,
+           py::arg("threads") = 0, py::arg("mem_limit") = (size_t) 1 << 30, py::arg("delimiter") = ',',
+           py::arg("header") = true, py::arg("tmp_dir") = "", R"pbdoc(
+            Builds a new index file (a WITHOUT ROWID table) from source in
+            one pass instead of row by row puts. source is a CSV path,
+            parsed on all threads (quoted fields must not span lines), a
+            dict of columns / Arrow table (numeric buffers are read
+            directly), or an iterable of rows. Rows are sorted by key_cols
+            (names or indexes) in runs of mem_limit / threads bytes, spilled
+            to tmp_dir, merged, and written bottom up with pages filled to
+            fill_factor. Later rows with a key already seen are skipped.
+            Returns a dict with rows, duplicates, pages and runs.
+        )pbdoc");
+
+    py::class_<range_scan, range_scan_ptr>(m, "range_scan")
+        .def("__iter__", [](range_scan_ptr self) {
+            return self;
+        })
+        .def("__next__", [](range_scan& self) -> py::object {
+            val_arena& vals = tl_vals;
+            column_batch_ptr batch;
+            {
+                py::gil_scoped_release nogil;
+                {
+                    std::lock_guard<std::mutex> guard(self.lock);
+                    self.fill(vals);
+                }
+                if (self.columnar && !vals.lens.empty()) {
+                    batch = std::make_shared<column_batch>();
+                    batch->decode(vals, self.cols);
+                }
+            }
+            if (vals.lens.empty())
+                throw py::stop_iteration();
+            if (batch)
+                return py::cast(batch);
+            py::list result;
+            for (size_t i = 0; i < vals.lens.size(); i++)
+                result.append(get_values(vals.bytes.data() + vals.offsets[i], vals.lens[i], self.cols));
+            return result;
+        });
+
+    py::class_<typed_buffer, typed_buffer_ptr>(m, "typed_buffer", py::buffer_protocol())
+        .def_buffer([](typed_buffer& self) {
+            return self.info();
+        })
+        .def("__len__", [](typed_buffer& self) {
+            return self.info().shape[0];
+        });
+
+    py::class_<column_batch, column_batch_ptr>(m, "column_batch", R"pbdoc(
+            Records decoded into columns. values(i) is an int64, float64 or
+            (for text) uint8 buffer; text rows are values(i)[offsets(i)[r]:offsets(i)[r + 1]].
+            All buffers support the buffer protocol, e.g. numpy.asarray(batch.values(0)).
+        )pbdoc")
+        .def("__len__", [](column_batch& self) {
+            return self.rows;
+        })
+        .def_property_readonly("num_cols", [](column_batch& self) {
+            return self.kinds.size();
+        })
+        .def_property_readonly("found", [](column_batch& self) {
+            return self.found;
+        })
+        .def("kind", [](column_batch& self, size_t c) {
+            self.check_col(c);
+            return col_kind_names[self.kinds[c]];
+        })
+        .def("values", [](column_batch& self, size_t c) {
+            self.check_col(c);
+            return self.values[c];
+        })
+        .def("offsets", [](column_batch& self, size_t c) {
+            self.check_col(c);
+            return self.offsets[c];
+        })
+        .def("valid", [](column_batch& self, size_t c) {
+            self.check_col(c);
+            return self.valid[c];
         });
 
 #ifdef VERSION_INFO
@@ -0,0 +1,441 @@
+#ifndef SQLITE_BTREE_H
+#define SQLITE_BTREE_H
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "sqlite_blaster/src/util.h"
+#include "sqlite_blaster/src/sqlite_index_blaster.h"
+
+// Serial type of a record column -> SQLT_TYPE_* and data length,
+// as in the SQLite file format.
+static int serial_col_type(uint32_t serial) {
+    static const int types[] = {SQLT_TYPE_NULL, SQLT_TYPE_INT8, SQLT_TYPE_INT16,
+        SQLT_TYPE_INT24, SQLT_TYPE_INT32, SQLT_TYPE_INT48, SQLT_TYPE_INT64,
+        SQLT_TYPE_REAL, SQLT_TYPE_INT0, SQLT_TYPE_INT1, SQLT_TYPE_NULL, SQLT_TYPE_NULL};
+    if (serial >= 12)
+        return serial & 1 ? SQLT_TYPE_TEXT : SQLT_TYPE_BLOB;
+    return types[serial];
+}
+
+static int serial_data_len(uint32_t serial) {
+    static const int lens[] = {0, 1, 2, 3, 4, 6, 8, 8, 0, 0, 0, 0};
+    if (serial >= 12)
+        return (serial - 12) / 2;
+    return lens[serial];
+}
+
+// Walks the columns of a record in SQLite record format.
+struct rec_reader {
+    const uint8_t *rec;
+    int rec_len;
+    int hdr_len;
+    int hdr_pos;
+    const uint8_t *data_ptr;
+    int8_t vlen;
+    int col_len;
+    int col_type;
+    rec_reader(const uint8_t *rec, int rec_len)
+            : rec (rec), rec_len (rec_len) {
+        hdr_len = util::read_vint32(rec, &vlen);
+        hdr_pos = vlen;
+        data_ptr = rec + hdr_len;
+        col_len = vlen = 0;
+    }
+    bool next() {
+        data_ptr += col_len;
+        hdr_pos += vlen;
+        if (hdr_pos >= hdr_len)
+            return false;
+        uint32_t serial = util::read_vint32(rec + hdr_pos, &vlen);
+        col_len = serial_data_len(serial);
+        col_type = serial_col_type(serial);
+        return data_ptr + col_len <= rec + rec_len;
+    }
+    bool is_int() {
+        return col_type != SQLT_TYPE_NULL && col_type != SQLT_TYPE_REAL
+                 && col_type != SQLT_TYPE_BLOB && col_type != SQLT_TYPE_TEXT;
+    }
+    // big endian two's complement of the stored width
+    int64_t int_val() {
+        switch (col_type) {
+            case SQLT_TYPE_INT0:
+                return 0;
+            case SQLT_TYPE_INT1:
+                return 1;
+            case SQLT_TYPE_INT8:
+                return (int8_t) *data_ptr;
+            case SQLT_TYPE_INT16:
+                return (int16_t) util::read_uint16(data_ptr);
+            case SQLT_TYPE_INT24: {
+                    int32_t int_val = util::read_uint24(data_ptr) & 0xFFFFFF;
+                    return int_val & 0x800000 ? int_val - 0x1000000 : int_val;
+                }
+            case SQLT_TYPE_INT32:
+                return (int32_t) util::read_uint32(data_ptr);
+            case SQLT_TYPE_INT48: {
+                    int64_t int_val = util::read_int48(data_ptr) & 0xFFFFFFFFFFFFLL;
+                    return int_val & 0x800000000000LL ? int_val - 0x1000000000000LL : int_val;
+                }
+            case SQLT_TYPE_INT64:
+                return (int64_t) util::read_uint64(data_ptr);
+        }
+        return 0;
+    }
+    double real_val() {
+        return util::read_double(data_ptr);
+    }
+};
+
+// One column of a search key.
+struct key_val {
+    int col_type;   // SQLT_TYPE_NULL, SQLT_TYPE_INT64, SQLT_TYPE_REAL, SQLT_TYPE_TEXT or SQLT_TYPE_BLOB
+    int64_t i;
+    double d;
+    std::string s;
+};
+
+// SQLite sort class: NULL < numbers < text < blob
+static int sort_class(int col_type) {
+    if (col_type == SQLT_TYPE_NULL)
+        return 0;
+    if (col_type == SQLT_TYPE_TEXT)
+        return 2;
+    if (col_type == SQLT_TYPE_BLOB)
+        return 3;
+    return 1;
+}
+
+// Compares the current column of a with a value of type b_type using
+// BINARY collation. With prefix set, a text/blob value matches any
+// column value that starts with it.
+static int compare_col(rec_reader& a, int b_type, int64_t b_i, double b_d,
+                const uint8_t *b_s, size_t b_len, bool prefix) {
+    int cls = sort_class(a.col_type);
+    int b_cls = sort_class(b_type);
+    if (cls != b_cls)
+        return cls < b_cls ? -1 : 1;
+    int cmp = 0;
+    if (cls == 1) {
+        if (a.col_type != SQLT_TYPE_REAL && b_type != SQLT_TYPE_REAL) {
+            int64_t v = a.int_val();
+            cmp = v < b_i ? -1 : v > b_i ? 1 : 0;
+        } else {
+            double v = a.col_type == SQLT_TYPE_REAL ? a.real_val() : (double) a.int_val();
+            double bd = b_type == SQLT_TYPE_REAL ? b_d : (double) b_i;
+            cmp = v < bd ? -1 : v > bd ? 1 : 0;
+        }
+    } else if (cls > 1) {
+        size_t len = (size_t) a.col_len < b_len ? a.col_len : b_len;
+        cmp = memcmp(a.data_ptr, b_s, len);
+        if (cmp == 0) {
+            if (prefix)
+                return 0;
+            cmp = (size_t) a.col_len < b_len ? -1 : (size_t) a.col_len > b_len ? 1 : 0;
+        }
+    }
+    return cmp < 0 ? -1 : cmp > 0 ? 1 : 0;
+}
+
+// Compares the leading columns of a record with key. With prefix set,
+// a text/blob last key column matches as a string prefix.
+static int compare_key(const uint8_t *rec, int rec_len, const std::vector<key_val>& key, bool prefix) {
+    rec_reader col(rec, rec_len);
+    for (size_t k = 0; k < key.size(); k++) {
+        if (!col.next())
+            return -1;
+        const key_val& kv = key[k];
+        int cmp = compare_col(col, kv.col_type, kv.i, kv.d, (const uint8_t *) kv.s.data(), kv.s.size(),
+                        prefix && k == key.size() - 1);
+        if (cmp)
+            return cmp;
+    }
+    return 0;
+}
+
+// Compares the first key_count columns of two records.
+static int compare_recs(const uint8_t *a, int a_len, const uint8_t *b, int b_len, int key_count) {
+    rec_reader a_col(a, a_len);
+    rec_reader b_col(b, b_len);
+    for (int k = 0; k < key_count; k++) {
+        bool a_more = a_col.next();
+        bool b_more = b_col.next();
+        if (!a_more || !b_more)
+            return a_more == b_more ? 0 : a_more ? 1 : -1;
+        int cmp = compare_col(a_col, b_col.col_type, b_col.is_int() ? b_col.int_val() : 0,
+                        b_col.col_type == SQLT_TYPE_REAL ? b_col.real_val() : 0, b_col.data_ptr, b_col.col_len, false);
+        if (cmp)
+            return cmp;
+    }
+    return 0;
+}
+
+// Read only cursor over one b-tree of a SQLite database file, walking
+// pages in key order in either direction. Index b-trees (WITHOUT ROWID
+// tables, as written by sqlite_index_blaster) and table b-trees are
+// both understood; for table b-trees the entry is the row record.
+class sqlite_btree_cursor {
+    private:
+        struct level {
+            uint32_t page_no;
+            std::vector<uint8_t> page;
+            int hdr;        // offset of the b-tree page header
+            int cell_count;
+            int idx;        // current cell; for interior levels below the top, the child taken
+            bool is_leaf() { return page[hdr] == 10 || page[hdr] == 13; }
+            bool is_index() { return page[hdr] == 2 || page[hdr] == 10; }
+            int cell_ptr(int i) { return util::read_uint16(&page[hdr + (is_leaf() ? 8 : 12) + i * 2]); }
+            uint32_t child(int i) {
+                if (i == cell_count)
+                    return util::read_uint32(&page[hdr + 8]);
+                return util::read_uint32(&page[cell_ptr(i)]);
+            }
+        };
+        int fd;
+        int page_size;
+        int usable_size;
+        uint32_t root;
+        std::vector<level> stack;
+        std::vector<uint8_t> payload;
+
+        void read_page(uint32_t page_no, std::vector<uint8_t>& buf) {
+            buf.resize(page_size);
+            if (page_no == 0 || pread(fd, buf.data(), page_size, (off_t) (page_no - 1) * page_size) != page_size)
+                throw std::runtime_error("sqlite file: cannot read page " + std::to_string(page_no));
+        }
+        void push(uint32_t page_no) {
+            if (stack.size() > 40)
+                throw std::runtime_error("sqlite file: b-tree too deep");
+            stack.emplace_back();
+            level& lv = stack.back();
+            lv.page_no = page_no;
+            read_page(page_no, lv.page);
+            lv.hdr = page_no == 1 ? 100 : 0;
+            uint8_t type = lv.page[lv.hdr];
+            if (type != 2 && type != 5 && type != 10 && type != 13)
+                throw std::runtime_error("sqlite file: bad b-tree page " + std::to_string(page_no));
+            lv.cell_count = util::read_uint16(&lv.page[lv.hdr + 3]);
+            lv.idx = 0;
+        }
+        // Locates the payload of cell i; copies it to payload if it spills to overflow pages.
+        void cell_payload(level& lv, int i, const uint8_t **out, int *out_len) {
+            int8_t vlen;
+            const uint8_t *cell = &lv.page[lv.cell_ptr(i)];
+            if (!lv.is_leaf())
+                cell += 4;
+            uint32_t len = util::read_vint32(cell, &vlen);
+            cell += vlen;
+            if (!lv.is_index()) {
+                // skip rowid varint (up to 9 bytes)
+                int n = 0;
+                while (n < 8 && (cell[n] & 0x80))
+                    n++;
+                cell += n + 1;
+            }
+            int max_local = lv.is_index() ? (usable_size - 12) * 64 / 255 - 23 : usable_size - 35;
+            if ((int) len <= max_local) {
+                *out = cell;
+                *out_len = len;
+                return;
+            }
+            int min_local = (usable_size - 12) * 32 / 255 - 23;
+            int local = min_local + (len - min_local) % (usable_size - 4);
+            if (local > max_local)
+                local = min_local;
+            payload.assign(cell, cell + local);
+            uint32_t ovfl = util::read_uint32(cell + local);
+            std::vector<uint8_t> buf;
+            while (payload.size() < len && ovfl) {
+                read_page(ovfl, buf);
+                size_t n = std::min((size_t) usable_size - 4, len - payload.size());
+                payload.insert(payload.end(), buf.begin() + 4, buf.begin() + 4 + n);
+                ovfl = util::read_uint32(buf.data());
+            }
+            if (payload.size() < len)
+                throw std::runtime_error("sqlite file: truncated overflow chain");
+            *out = payload.data();
+            *out_len = len;
+        }
+        void descend_first(uint32_t page_no) {
+            push(page_no);
+            while (!stack.back().is_leaf()) {
+                stack.back().idx = 0;
+                push(stack.back().child(0));
+            }
+            stack.back().idx = 0;
+        }
+        void descend_last(uint32_t page_no) {
+            push(page_no);
+            while (!stack.back().is_leaf()) {
+                stack.back().idx = stack.back().cell_count;
+                push(stack.back().child(stack.back().cell_count));
+            }
+            stack.back().idx = stack.back().cell_count - 1;
+        }
+        // After the top leaf ran past its last cell: the next entry is the
+        // first ancestor interior cell not yet visited.
+        void up_forward() {
+            while (!stack.empty() && stack.back().idx >= stack.back().cell_count) {
+                stack.pop_back();
+                if (stack.empty())
+                    break;
+                level& lv = stack.back();
+                if (!lv.is_index() && ++lv.idx <= lv.cell_count)
+                    descend_first(lv.child(lv.idx));    // table interior cells hold no rows
+            }
+        }
+        void up_backward() {
+            while (!stack.empty() && stack.back().idx < 0) {
+                stack.pop_back();
+                if (stack.empty())
+                    break;
+                level& lv = stack.back();
+                if (--lv.idx >= 0 && !lv.is_index())
+                    descend_last(lv.child(lv.idx));
+            }
+        }
+        // Leaves the top at the first entry that compares > key (after_equal)
+        // or >= key, possibly one past the end of a leaf.
+        void descend_key(const std::vector<key_val>& key, bool prefix, bool after_equal) {
+            stack.clear();
+            push(root);
+            while (true) {
+                level& lv = stack.back();
+                if (!lv.is_index())
+                    throw std::runtime_error("sqlite file: key bounds need an index b-tree (WITHOUT ROWID table or index)");
+                int lo = 0, hi = lv.cell_count;
+                while (lo < hi) {
+                    int mid = (lo + hi) / 2;
+                    const uint8_t *rec;
+                    int rec_len;
+                    cell_payload(lv, mid, &rec, &rec_len);
+                    int cmp = compare_key(rec, rec_len, key, prefix);
+                    if (after_equal ? cmp <= 0 : cmp < 0)
+                        lo = mid + 1;
+                    else
+                        hi = mid;
+                }
+                lv.idx = lo;
+                if (lv.is_leaf())
+                    break;
+                push(lv.child(lo));
+            }
+        }
+
+    public:
+        sqlite_btree_cursor(const char *fname, const std::string& tbl_name)
+                : fd (-1) {
+            fd = open(fname, O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                throw std::runtime_error(std::string("cannot open ") + fname);
+            uint8_t hdr[100];
+            if (pread(fd, hdr, sizeof(hdr), 0) != sizeof(hdr) || memcmp(hdr, "SQLite format 3", 16) != 0) {
+                ::close(fd);
+                throw std::runtime_error(std::string("not a sqlite file: ") + fname);
+            }
+            page_size = util::read_uint16(hdr + 16);
+            if (page_size == 1)
+                page_size = 65536;
+            usable_size = page_size - hdr[20];
+            root = find_root(tbl_name);
+            if (root == 0) {
+                ::close(fd);
+                throw std::runtime_error("table not found in " + std::string(fname) + ": " + tbl_name);
+            }
+        }
+        ~sqlite_btree_cursor() {
+            if (fd >= 0)
+                ::close(fd);
+        }
+        // Root page of the named table or index from sqlite_schema; with
+        // an empty name, the first table.
+        uint32_t find_root(const std::string& tbl_name) {
+            root = 1;
+            for (bool ok = first(); ok; ok = next()) {
+                const uint8_t *rec;
+                int rec_len;
+                current(&rec, &rec_len);
+                rec_reader col(rec, rec_len);
+                std::string type, name;
+                int64_t page = 0;
+                for (int c = 0; c < 4 && col.next(); c++) {
+                    if (c == 0)
+                        type.assign((const char *) col.data_ptr, col.col_len);
+                    else if (c == 1)
+                        name.assign((const char *) col.data_ptr, col.col_len);
+                    else if (c == 3 && col.is_int())
+                        page = col.int_val();
+                }
+                if (page > 0 && (tbl_name.empty() ? type == "table" : name == tbl_name)) {
+                    stack.clear();
+                    return page;
+                }
+            }
+            stack.clear();
+            return 0;
+        }
+        bool valid() {
+            return !stack.empty();
+        }
+        void invalidate() {
+            stack.clear();
+        }
+        bool first() {
+            stack.clear();
+            descend_first(root);
+            up_forward();
+            return valid();
+        }
+        bool last() {
+            stack.clear();
+            descend_last(root);
+            up_backward();
+            return valid();
+        }
+        // First entry >= key (or whose leading columns match key with prefix)
+        bool seek_ge(const std::vector<key_val>& key, bool prefix) {
+            descend_key(key, prefix, false);
+            up_forward();
+            return valid();
+        }
+        // Last entry < key, or <= key with or_equal
+        bool seek_lt(const std::vector<key_val>& key, bool prefix, bool or_equal) {
+            descend_key(key, prefix, or_equal);
+            stack.back().idx--;
+            up_backward();
+            return valid();
+        }
+        bool next() {
+            level& lv = stack.back();
+            if (lv.is_leaf()) {
+                lv.idx++;
+                up_forward();
+            } else {
+                lv.idx++;
+                descend_first(lv.child(lv.idx));
+                up_forward();
+            }
+            return valid();
+        }
+        bool prev() {
+            level& lv = stack.back();
+            if (lv.is_leaf()) {
+                lv.idx--;
+                up_backward();
+            } else
+                descend_last(lv.child(lv.idx));
+            if (!stack.empty() && stack.back().idx < 0)
+                up_backward();
+            return valid();
+        }
+        // Record at the cursor. Valid until the cursor moves.
+        void current(const uint8_t **rec, int *rec_len) {
+            cell_payload(stack.back(), stack.back().idx, rec, rec_len);
+        }
+};
+
+#endif
@@ -0,0 +1,850 @@
+#ifndef SQLITE_BULK_LOAD_H
+#define SQLITE_BULK_LOAD_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sqlite_btree.h"
+
+static void write_be16(uint8_t *ptr, uint16_t val) {
+    ptr[0] = val >> 8;
+    ptr[1] = val;
+}
+
+static void write_be32(uint8_t *ptr, uint32_t val) {
+    ptr[0] = val >> 24;
+    ptr[1] = val >> 16;
+    ptr[2] = val >> 8;
+    ptr[3] = val;
+}
+
+// Builds one record in SQLite record format, column by column.
+struct rec_builder {
+    std::vector<uint8_t> hdr;
+    std::vector<uint8_t> data;
+    void clear() {
+        hdr.clear();
+        data.clear();
+    }
+    void add_serial(uint32_t serial) {
+        uint8_t buf[5];
+        int len = util::write_vint32(buf, serial);
+        hdr.insert(hdr.end(), buf, buf + len);
+    }
+    void add_null() {
+        add_serial(0);
+    }
+    void add_int(int64_t val) {
+        if (val == 0 || val == 1) {
+            add_serial(val ? 9 : 8);
+            return;
+        }
+        static const int widths[] = {1, 2, 3, 4, 6, 8};
+        int w = 0;
+        while (w < 5) {
+            int64_t lim = (int64_t) 1 << (widths[w] * 8 - 1);
+            if (val >= -lim && val < lim)
+                break;
+            w++;
+        }
+        add_serial(w + 1);
+        for (int b = widths[w] - 1; b >= 0; b--)
+            data.push_back((uint8_t) (val >> (b * 8)));
+    }
+    void add_real(double val) {
+        uint64_t bits;
+        memcpy(&bits, &val, 8);
+        add_serial(7);
+        for (int b = 7; b >= 0; b--)
+            data.push_back((uint8_t) (bits >> (b * 8)));
+    }
+    void add_text(const void *str, size_t len, bool blob = false) {
+        add_serial(len * 2 + (blob ? 12 : 13));
+        data.insert(data.end(), (const uint8_t *) str, (const uint8_t *) str + len);
+    }
+    // Appends the finished record to out and returns its length.
+    size_t finish(std::vector<uint8_t>& out) {
+        // header length includes its own varint
+        uint8_t buf[5];
+        int vlen = 1;
+        while (util::write_vint32(buf, hdr.size() + vlen) != vlen)
+            vlen++;
+        out.insert(out.end(), buf, buf + vlen);
+        out.insert(out.end(), hdr.begin(), hdr.end());
+        out.insert(out.end(), data.begin(), data.end());
+        return vlen + hdr.size() + data.size();
+    }
+};
+
+// Unlinked temporary file that all sorters append their spilled runs to.
+// A run reserves its byte range before it is written, so several threads
+// can spill at once without sharing a FILE or a file offset.
+class spill_file {
+    private:
+        std::string dir;
+        int fd = -1;
+        std::atomic<uint64_t> end {0};
+
+    public:
+        ~spill_file() {
+            if (fd >= 0)
+                close(fd);
+        }
+        // Called before the first spill, from the thread creating sorters.
+        void open(const std::string& tmp_dir) {
+            if (fd >= 0)
+                return;
+            dir = tmp_dir;
+            std::string tmpl = dir + "/sqlite_bulk_XXXXXX";
+            fd = mkstemp(&tmpl[0]);
+            if (fd < 0)
+                throw std::runtime_error("cannot create temporary file in " + dir);
+            unlink(tmpl.c_str());
+        }
+        uint64_t reserve(uint64_t len) {
+            return end.fetch_add(len);
+        }
+        void write(const uint8_t *buf, size_t len, uint64_t off) {
+            while (len) {
+                ssize_t n = pwrite(fd, buf, len, (off_t) off);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    throw std::runtime_error("cannot write temporary file in " + dir);
+                buf += n;
+                len -= n;
+                off += n;
+            }
+        }
+        void read(uint8_t *buf, size_t len, uint64_t off) {
+            while (len) {
+                ssize_t n = pread(fd, buf, len, (off_t) off);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    throw std::runtime_error("short read from temporary file");
+                buf += n;
+                len -= n;
+                off += n;
+            }
+        }
+};
+
+// Records collected by one worker, sorted by key and spilled to the
+// shared spill file whenever mem_limit is exceeded. Only the byte range
+// of each spilled run is kept.
+class run_sorter {
+    private:
+        int key_count;
+        size_t mem_limit;
+        spill_file& spill_to;
+        std::vector<uint8_t> bytes;
+        std::vector<std::pair<size_t, int>> recs;   // offset, length
+
+        void sort() {
+            const uint8_t *base = bytes.data();
+            int keys = key_count;
+            std::stable_sort(recs.begin(), recs.end(),
+                [base, keys](const std::pair<size_t, int>& a, const std::pair<size_t, int>& b) {
+                    return compare_recs(base + a.first, a.second, base + b.first, b.second, keys) < 0;
+                });
+        }
+        void write_run() {
+            sort();
+            uint64_t len = 0;
+            for (auto& r : recs)
+                len += 4 + r.second;
+            uint64_t off = spill_to.reserve(len);
+            runs.push_back(std::make_pair(off, off + len));
+            std::vector<uint8_t> out;
+            out.reserve(1 << 20);
+            for (auto& r : recs) {
+                uint8_t hdr[4];
+                write_be32(hdr, r.second);
+                out.insert(out.end(), hdr, hdr + 4);
+                out.insert(out.end(), bytes.data() + r.first, bytes.data() + r.first + r.second);
+                if (out.size() >= (1 << 20)) {
+                    spill_to.write(out.data(), out.size(), off);
+                    off += out.size();
+                    out.clear();
+                }
+            }
+            spill_to.write(out.data(), out.size(), off);
+            bytes.clear();
+            recs.clear();
+        }
+
+    public:
+        std::vector<std::pair<uint64_t, uint64_t>> runs;    // spilled, in input order
+        size_t rows = 0;
+        run_sorter(int key_count, size_t mem_limit, spill_file& spill_to)
+                : key_count (key_count), mem_limit (mem_limit), spill_to (spill_to) {
+        }
+        void add(rec_builder& rec) {
+            size_t pos = bytes.size();
+            int len = rec.finish(bytes);
+            recs.push_back(std::make_pair(pos, len));
+            rows++;
+            if (mem_bytes() > mem_limit)
+                write_run();
+        }
+        size_t mem_bytes() {
+            return bytes.size() + recs.size() * sizeof(recs[0]);
+        }
+        // Sorts what is left in memory; it stays there as the last run.
+        void finish() {
+            sort();
+        }
+        // Writes out what is left in memory and gives the memory back:
+        // the sorter takes no more records.
+        void spill() {
+            if (!recs.empty())
+                write_run();
+            std::vector<uint8_t>().swap(bytes);
+            std::vector<std::pair<size_t, int>>().swap(recs);
+        }
+        size_t mem_count() {
+            return recs.size();
+        }
+        const uint8_t *mem_rec(size_t i, int *len) {
+            *len = recs[i].second;
+            return bytes.data() + recs[i].first;
+        }
+};
+
+// Reads one sorted run, either spilled or in memory. Spilled runs are
+// read through a small window, so many runs can be merged at once.
+struct run_reader {
+    spill_file *file = NULL;
+    uint64_t pos = 0;   // next byte of the run to read into the window
+    uint64_t end = 0;
+    run_sorter *mem = NULL;
+    size_t mem_pos = 0;
+    std::vector<uint8_t> buf;
+    size_t buf_pos = 0;
+    const uint8_t *rec = NULL;
+    int rec_len = 0;
+    int order = 0;  // input order, so equal keys keep the first row
+
+    static run_reader spilled(spill_file *file, uint64_t begin, uint64_t end, int order) {
+        run_reader r;
+        r.file = file;
+        r.pos = begin;
+        r.end = end;
+        r.order = order;
+        return r;
+    }
+    static run_reader in_memory(run_sorter *mem, int order) {
+        run_reader r;
+        r.mem = mem;
+        r.order = order;
+        return r;
+    }
+    // Returns the next n bytes of the run, refilling the window as needed.
+    const uint8_t *take(size_t n) {
+        size_t have = buf.size() - buf_pos;
+        if (have < n) {
+            if (n - have > end - pos)
+                throw std::runtime_error("short read from temporary file");
+            buf.erase(buf.begin(), buf.begin() + buf_pos);
+            buf_pos = 0;
+            size_t want = std::min<uint64_t>(std::max<size_t>(n - have, 64 << 10), end - pos);
+            buf.resize(have + want);
+            file->read(buf.data() + have, want, pos);
+            pos += want;
+        }
+        const uint8_t *p = buf.data() + buf_pos;
+        buf_pos += n;
+        return p;
+    }
+    bool next() {
+        if (file) {
+            if (pos == end && buf_pos == buf.size())
+                return false;
+            rec_len = util::read_uint32(take(4));
+            rec = take(rec_len);
+            return true;
+        }
+        if (mem_pos >= mem->mem_count())
+            return false;
+        rec = mem->mem_rec(mem_pos++, &rec_len);
+        return true;
+    }
+};
+
+// Writes an index b-tree bottom up from records in key order: pages are
+// filled to fill_factor, and the cell after each full page becomes the
+// divider in the level above. That cell is held back until the next one
+// arrives, so no level is left with an empty page at the end. The root
+// always goes to page 2.
+class btree_builder {
+    private:
+        struct level {
+            std::vector<uint8_t> cells;
+            std::vector<uint32_t> offsets;
+            size_t used = 0;    // cell bytes plus pointers
+            uint32_t right = 0;
+            std::vector<uint8_t> pending;   // cell after the full page, without child pointer
+            uint32_t pending_child = 0;
+            bool has_pending = false;
+            void add(const uint8_t *cell, size_t len) {
+                offsets.push_back(cells.size());
+                cells.insert(cells.end(), cell, cell + len);
+                used += len + 2;
+            }
+            void clear() {
+                cells.clear();
+                offsets.clear();
+                used = 0;
+                right = 0;
+            }
+        };
+        int fd;
+        int page_size;
+        int usable_size;
+        double fill_factor;
+        uint32_t next_page;
+        std::vector<level> levels;
+        std::vector<uint8_t> cell;
+        std::vector<uint8_t> page;
+
+        void write_page(uint32_t page_no, const uint8_t *buf) {
+            if (pwrite(fd, buf, page_size, (off_t) (page_no - 1) * page_size) != page_size)
+                throw std::runtime_error("cannot write page " + std::to_string(page_no));
+        }
+        // Cell without child pointer: payload length, local payload and
+        // the first overflow page if the record does not fit locally.
+        void make_cell(const uint8_t *rec, int rec_len) {
+            int max_local = (usable_size - 12) * 64 / 255 - 23;
+            int min_local = (usable_size - 12) * 32 / 255 - 23;
+            int local = rec_len;
+            if (rec_len > max_local) {
+                local = min_local + (rec_len - min_local) % (usable_size - 4);
+                if (local > max_local)
+                    local = min_local;
+            }
+            cell.resize(5);
+            cell.resize(util::write_vint32(cell.data(), rec_len));
+            cell.insert(cell.end(), rec, rec + local);
+            if (local == rec_len)
+                return;
+            uint8_t ptr[4];
+            write_be32(ptr, next_page);
+            cell.insert(cell.end(), ptr, ptr + 4);
+            std::vector<uint8_t> ovfl(page_size, 0);
+            for (int pos = local; pos < rec_len; pos += usable_size - 4) {
+                int n = std::min(usable_size - 4, rec_len - pos);
+                write_be32(ovfl.data(), pos + n < rec_len ? next_page + 1 : 0);
+                memcpy(ovfl.data() + 4, rec + pos, n);
+                memset(ovfl.data() + 4 + n, 0, page_size - 4 - n);
+                write_page(next_page++, ovfl.data());
+            }
+        }
+        bool fits(level& lv, size_t len, bool leaf) {
+            size_t cap = usable_size - (leaf ? 8 : 12);
+            if (lv.offsets.empty())
+                return true;
+            return lv.used + len + 2 <= cap && lv.used + len + 2 <= cap * fill_factor;
+        }
+        uint32_t flush(int depth, uint32_t page_no) {
+            level& lv = levels[depth];
+            bool leaf = depth == 0;
+            int hdr = page_no == 1 ? 100 : 0;
+            std::fill(page.begin(), page.end(), 0);
+            int ptr_pos = hdr + (leaf ? 8 : 12);
+            int content = usable_size;
+            for (size_t i = 0; i < lv.offsets.size(); i++) {
+                size_t end = i + 1 < lv.offsets.size() ? lv.offsets[i + 1] : lv.cells.size();
+                size_t len = end - lv.offsets[i];
+                content -= len;
+                memcpy(&page[content], lv.cells.data() + lv.offsets[i], len);
+                write_be16(&page[ptr_pos + i * 2], content);
+            }
+            page[hdr] = leaf ? 10 : 2;
+            write_be16(&page[hdr + 3], lv.offsets.size());
+            write_be16(&page[hdr + 5], content == 65536 ? 0 : content);
+            if (!leaf)
+                write_be32(&page[hdr + 8], lv.right);
+            write_page(page_no, page.data());
+            lv.clear();
+            return page_no;
+        }
+        // Adds a cell to the page being built at depth; interior cells
+        // get child as their left child pointer.
+        void add_cell(size_t depth, uint32_t child, const uint8_t *cell_data, size_t len) {
+            if (levels.size() <= depth)
+                levels.emplace_back();
+            std::vector<uint8_t> full(len + (depth ? 4 : 0));
+            if (depth)
+                write_be32(full.data(), child);
+            memcpy(full.data() + (depth ? 4 : 0), cell_data, len);
+            level& lv = levels[depth];
+            if (lv.has_pending) {
+                // the held cell becomes the divider above the full page
+                std::vector<uint8_t> divider;
+                divider.swap(lv.pending);
+                lv.has_pending = false;
+                lv.right = lv.pending_child;
+                uint32_t page_no = flush(depth, next_page++);
+                add_cell(depth + 1, page_no, divider.data(), divider.size());
+            } else if (!fits(lv, full.size(), depth == 0)) {
+                lv.pending.assign(cell_data, cell_data + len);
+                lv.pending_child = child;
+                lv.has_pending = true;
+                return;
+            }
+            levels[depth].add(full.data(), full.size());
+        }
+
+    public:
+        size_t rows = 0;
+        btree_builder(int fd, int page_size, double fill_factor)
+                : fd (fd), page_size (page_size), usable_size (page_size),
+                  fill_factor (fill_factor), next_page (3) {
+            levels.emplace_back();
+            page.resize(page_size);
+        }
+        void add(const uint8_t *rec, int rec_len) {
+            make_cell(rec, rec_len);
+            rows++;
+            add_cell(0, 0, cell.data(), cell.size());
+        }
+        // Writes the remaining pages and returns the number of pages in
+        // the file. Page 1 is left for the caller.
+        uint32_t finish() {
+            uint32_t child = 0;
+            for (size_t depth = 0; depth < levels.size(); depth++) {
+                if (levels[depth].has_pending) {
+                    // nothing came after the held cell: the last cell of
+                    // the full page becomes the divider instead
+                    level& lv = levels[depth];
+                    uint32_t pos = lv.offsets.back();
+                    std::vector<uint8_t> last(lv.cells.begin() + pos + (depth ? 4 : 0), lv.cells.end());
+                    if (depth)
+                        lv.right = util::read_uint32(&lv.cells[pos]);
+                    lv.used -= lv.cells.size() - pos + 2;
+                    lv.cells.resize(pos);
+                    lv.offsets.pop_back();
+                    std::vector<uint8_t> held;
+                    held.swap(lv.pending);
+                    uint32_t held_child = lv.pending_child;
+                    lv.has_pending = false;
+                    uint32_t page_no = flush(depth, next_page++);
+                    add_cell(depth + 1, page_no, last.data(), last.size());
+                    add_cell(depth, held_child, held.data(), held.size());
+                }
+                if (depth > 0)
+                    levels[depth].right = child;
+                bool top = depth == levels.size() - 1;
+                child = flush(depth, top ? 2 : next_page++);
+            }
+            return next_page - 1;
+        }
+        // Page 1: database header and sqlite_schema with the table.
+        void write_header(const std::string& tbl_name, const std::string& sql, uint32_t page_count) {
+            rec_builder rec;
+            rec.add_text("table", 5);
+            rec.add_text(tbl_name.data(), tbl_name.size());
+            rec.add_text(tbl_name.data(), tbl_name.size());
+            rec.add_int(2);
+            rec.add_text(sql.data(), sql.size());
+            std::vector<uint8_t> payload;
+            rec.finish(payload);
+            if (payload.size() > (size_t) usable_size - 35 - 100)
+                throw std::runtime_error("table definition too long");
+            std::fill(page.begin(), page.end(), 0);
+            uint8_t *h = page.data();
+            memcpy(h, "SQLite format 3", 16);
+            write_be16(h + 16, page_size == 65536 ? 1 : page_size);
+            h[18] = h[19] = 1;      // legacy journal
+            h[21] = 64;
+            h[22] = h[23] = 32;
+            write_be32(h + 24, 1);  // change counter
+            write_be32(h + 28, page_count);
+            write_be32(h + 40, 1);  // schema cookie
+            write_be32(h + 44, 4);  // schema format
+            write_be32(h + 56, 1);  // UTF-8
+            write_be32(h + 92, 1);
+            write_be32(h + 96, 3039004);
+            // one table leaf cell: payload length, rowid 1, record
+            std::vector<uint8_t> schema_cell(5);
+            schema_cell.resize(util::write_vint32(schema_cell.data(), payload.size()));
+            schema_cell.push_back(1);
+            schema_cell.insert(schema_cell.end(), payload.begin(), payload.end());
+            int content = usable_size - schema_cell.size();
+            memcpy(h + content, schema_cell.data(), schema_cell.size());
+            h[100] = 13;
+            write_be16(h + 103, 1);
+            write_be16(h + 105, content);
+            write_be16(h + 108, content);
+            write_page(1, h);
+        }
+};
+
+// Splits one CSV line into fields; quoted fields have "" unescaped into
+// scratch. Fields are (pointer, length, quoted).
+struct csv_field {
+    const char *ptr;
+    size_t len;
+    bool quoted;
+};
+
+static void split_csv_line(const char *p, const char *end, char delim,
+                std::vector<csv_field>& fields, std::string& scratch) {
+    fields.clear();
+    scratch.clear();
+    // quoted fields point into scratch, so reserve enough to never reallocate
+    scratch.reserve(end - p);
+    while (true) {
+        csv_field f;
+        if (p < end && *p == '"') {
+            size_t start = scratch.size();
+            p++;
+            while (p < end) {
+                if (*p == '"') {
+                    if (p + 1 < end && p[1] == '"') {
+                        scratch.push_back('"');
+                        p += 2;
+                        continue;
+                    }
+                    p++;
+                    break;
+                }
+                scratch.push_back(*p++);
+            }
+            f.ptr = scratch.data() + start;
+            f.len = scratch.size() - start;
+            f.quoted = true;
+            while (p < end && *p != delim)
+                p++;
+        } else {
+            const char *q = (const char *) memchr(p, delim, end - p);
+            if (!q)
+                q = end;
+            f.ptr = p;
+            f.len = q - p;
+            f.quoted = false;
+            p = q;
+        }
+        fields.push_back(f);
+        if (p >= end)
+            break;
+        p++;    // delimiter
+    }
+}
+
+// Unquoted fields that parse as a whole as integer or real are stored as
+// numbers, empty unquoted fields as NULL, everything else as text.
+static void add_csv_field(rec_builder& rec, const csv_field& f) {
+    if (f.quoted) {
+        rec.add_text(f.ptr, f.len);
+        return;
+    }
+    if (f.len == 0) {
+        rec.add_null();
+        return;
+    }
+    char num[64];
+    if (f.len < sizeof(num)) {
+        memcpy(num, f.ptr, f.len);
+        num[f.len] = 0;
+        char *num_end;
+        bool digits = false;
+        for (size_t i = 0; i < f.len; i++) {
+            if (num[i] >= '0' && num[i] <= '9')
+                digits = true;
+            else if (num[i] != '-' && num[i] != '+' && num[i] != '.' && num[i] != 'e' && num[i] != 'E')
+                digits = false, i = f.len;
+        }
+        if (digits) {
+            errno = 0;
+            long long ival = strtoll(num, &num_end, 10);
+            if (*num_end == 0 && errno == 0) {
+                rec.add_int(ival);
+                return;
+            }
+            double dval = strtod(num, &num_end);
+            if (*num_end == 0) {
+                rec.add_real(dval);
+                return;
+            }
+        }
+    }
+    rec.add_text(f.ptr, f.len);
+}
+
+// Options and driver for a bulk load: rows are turned into records with
+// the key columns first (the WITHOUT ROWID layout), sorted in runs on
+// several threads, merged and written bottom up as a new index file.
+struct bulk_load_opts {
+    std::string tbl_name = "kv";
+    int page_size = 4096;
+    double fill_factor = 0.9;
+    int threads = 0;
+    size_t mem_limit = (size_t) 1 << 30;
+    std::string tmp_dir;
+    char delimiter = ',';
+    bool header = true;
+};
+
+struct bulk_load_result {
+    size_t rows = 0;
+    size_t duplicates = 0;
+    uint32_t pages = 0;
+    size_t runs = 0;
+};
+
+class sqlite_bulk_loader {
+    private:
+        bulk_load_opts opts;
+        std::vector<std::string> col_names;
+        std::vector<int> col_order;     // record column -> input column
+        int key_count;
+        spill_file spill;
+        std::vector<std::unique_ptr<run_sorter>> sorters;
+
+    public:
+        sqlite_bulk_loader(const bulk_load_opts& o) : opts (o), key_count (0) {
+            if (opts.page_size < 512 || opts.page_size > 65536 || (opts.page_size & (opts.page_size - 1)))
+                throw std::invalid_argument("page_size must be a power of 2 from 512 to 65536");
+            opts.fill_factor = std::max(0.5, std::min(1.0, opts.fill_factor));
+            if (opts.threads <= 0)
+                opts.threads = std::max(1u, std::thread::hardware_concurrency());
+            if (opts.tmp_dir.empty())
+                opts.tmp_dir = "/tmp";
+        }
+        int threads() {
+            return opts.threads;
+        }
+        // Column names of the input and the key columns, by index.
+        void set_columns(const std::vector<std::string>& names, const std::vector<int>& keys) {
+            col_names = names;
+            if (keys.empty())
+                throw std::invalid_argument("at least one key column is needed");
+            col_order.clear();
+            for (int k : keys) {
+                if (k < 0 || (size_t) k >= names.size())
+                    throw std::out_of_range("key column out of range");
+                if (std::find(col_order.begin(), col_order.end(), k) != col_order.end())
+                    throw std::invalid_argument("key column given twice");
+                col_order.push_back(k);
+            }
+            for (size_t c = 0; c < names.size(); c++) {
+                if (std::find(keys.begin(), keys.end(), (int) c) == keys.end())
+                    col_order.push_back(c);
+            }
+            key_count = keys.size();
+        }
+        const std::vector<int>& record_order() {
+            return col_order;
+        }
+        // New sorter for one worker; each gets an equal share of memory.
+        run_sorter *new_sorter() {
+            spill.open(opts.tmp_dir);
+            sorters.emplace_back(new run_sorter(key_count, opts.mem_limit / opts.threads, spill));
+            return sorters.back().get();
+        }
+        // Column names from the first line of a CSV file: its fields with
+        // a header, else c1, c2, ... as many as it has fields.
+        std::vector<std::string> csv_columns(const char *line, const char *line_end) {
+            std::vector<csv_field> fields;
+            std::string scratch;
+            std::vector<std::string> names;
+            split_csv_line(line, line_end, opts.delimiter, fields, scratch);
+            for (size_t c = 0; c < fields.size(); c++) {
+                if (opts.header)
+                    names.push_back(std::string(fields[c].ptr, fields[c].len));
+                else
+                    names.push_back("c" + std::to_string(c + 1));
+            }
+            return names;
+        }
+        std::vector<std::string> csv_columns(const std::string& path) {
+            FILE *fp = fopen(path.c_str(), "rb");
+            if (!fp)
+                throw std::runtime_error("cannot open " + path);
+            std::string line;
+            char buf[65536];
+            while (fgets(buf, sizeof(buf), fp)) {
+                line += buf;
+                if (line.back() == '\n')
+                    break;
+            }
+            fclose(fp);
+            while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+                line.pop_back();
+            return csv_columns(line.data(), line.data() + line.size());
+        }
+        // Parses a CSV file on all threads. Chunks start at line breaks,
+        // so quoted fields must not contain newlines.
+        void parse_csv(const std::string& path) {
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                throw std::runtime_error("cannot open " + path);
+            struct stat st;
+            fstat(fd, &st);
+            size_t size = st.st_size;
+            const char *map = size ? (const char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : "";
+            close(fd);
+            if (map == MAP_FAILED)
+                throw std::runtime_error("cannot map " + path);
+            if (size)
+                madvise((void *) map, size, MADV_SEQUENTIAL);
+            const char *end = map + size;
+            const char *body = map;
+            // first line: names, or just the column count
+            const char *eol = (const char *) memchr(map, '\n', size);
+            const char *line_end = eol ? eol : end;
+            if (line_end > map && line_end[-1] == '\r')
+                line_end--;
+            if (col_names.empty())
+                col_names = csv_columns(map, line_end);
+            if (opts.header)
+                body = eol ? eol + 1 : end;
+            std::vector<const char *> bounds;
+            bounds.push_back(body);
+            for (int t = 1; t < opts.threads; t++) {
+                const char *p = body + (end - body) * t / opts.threads;
+                if (p < bounds.back())
+                    p = bounds.back();
+                const char *nl = (const char *) memchr(p, '\n', end - p);
+                bounds.push_back(nl ? nl + 1 : end);
+            }
+            bounds.push_back(end);
+            std::vector<run_sorter *> workers;
+            for (int t = 0; t < opts.threads; t++)
+                workers.push_back(new_sorter());
+            std::vector<std::exception_ptr> errors(opts.threads);
+            std::vector<std::thread> pool;
+            for (int t = 0; t < opts.threads; t++) {
+                pool.emplace_back([this, t, &bounds, &workers, &errors]() {
+                    try {
+                        std::vector<csv_field> fields;
+                        std::string scratch;
+                        rec_builder rec;
+                        const char *p = bounds[t];
+                        while (p < bounds[t + 1]) {
+                            const char *nl = (const char *) memchr(p, '\n', bounds[t + 1] - p);
+                            const char *line_end = nl ? nl : bounds[t + 1];
+                            const char *next = nl ? nl + 1 : bounds[t + 1];
+                            if (line_end > p && line_end[-1] == '\r')
+                                line_end--;
+                            if (line_end > p) {
+                                split_csv_line(p, line_end, opts.delimiter, fields, scratch);
+                                rec.clear();
+                                for (int c : col_order) {
+                                    if ((size_t) c < fields.size())
+                                        add_csv_field(rec, fields[c]);
+                                    else
+                                        rec.add_null();
+                                }
+                                workers[t]->add(rec);
+                            }
+                            p = next;
+                        }
+                        workers[t]->finish();
+                    } catch (...) {
+                        errors[t] = std::current_exception();
+                    }
+                });
+            }
+            for (auto& th : pool)
+                th.join();
+            if (size)
+                munmap((void *) map, size);
+            for (auto& e : errors) {
+                if (e)
+                    std::rethrow_exception(e);
+            }
+        }
+        const std::vector<std::string>& columns() {
+            return col_names;
+        }
+        // Merges all runs and writes the file.
+        bulk_load_result write(const std::string& filename) {
+            std::vector<run_reader> readers;
+            for (auto& s : sorters) {
+                for (auto& run : s->runs)
+                    readers.push_back(run_reader::spilled(&spill, run.first, run.second, readers.size()));
+                readers.push_back(run_reader::in_memory(s.get(), readers.size()));
+            }
+            bulk_load_result result;
+            result.runs = readers.size();
+            int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0)
+                throw std::runtime_error("cannot create " + filename);
+            try {
+                btree_builder builder(fd, opts.page_size, opts.fill_factor);
+                int keys = key_count;
+                auto greater = [keys](run_reader *a, run_reader *b) {
+                    int cmp = compare_recs(a->rec, a->rec_len, b->rec, b->rec_len, keys);
+                    return cmp ? cmp > 0 : a->order > b->order;
+                };
+                std::priority_queue<run_reader *, std::vector<run_reader *>, decltype(greater)> heap(greater);
+                for (auto& r : readers) {
+                    if (r.next())
+                        heap.push(&r);
+                }
+                std::vector<uint8_t> prev;
+                while (!heap.empty()) {
+                    run_reader *r = heap.top();
+                    heap.pop();
+                    if (!prev.empty() && compare_recs(prev.data(), prev.size(), r->rec, r->rec_len, keys) == 0)
+                        result.duplicates++;
+                    else {
+                        builder.add(r->rec, r->rec_len);
+                        prev.assign(r->rec, r->rec + r->rec_len);
+                    }
+                    if (r->next())
+                        heap.push(r);
+                }
+                result.rows = builder.rows;
+                result.pages = builder.finish();
+                builder.write_header(opts.tbl_name, create_sql(), result.pages);
+                if (fsync(fd) != 0)
+                    throw std::runtime_error("cannot sync " + filename);
+            } catch (...) {
+                close(fd);
+                throw;
+            }
+            close(fd);
+            sorters.clear();
+            return result;
+        }
+        static std::string quote_name(const std::string& name) {
+            std::string quoted = "\"";
+            for (char ch : name) {
+                quoted += ch;
+                if (ch == '"')
+                    quoted += ch;
+            }
+            return quoted + "\"";
+        }
+        std::string create_sql() {
+            std::string sql = "CREATE TABLE " + quote_name(opts.tbl_name) + " (";
+            for (size_t c = 0; c < col_names.size(); c++)
+                sql += (c ? ", " : "") + quote_name(col_names[c]);
+            sql += ", PRIMARY KEY (";
+            for (int k = 0; k < key_count; k++)
+                sql += (k ? ", " : "") + quote_name(col_names[col_order[k]]);
+            sql += ")) WITHOUT ROWID";
+            return sql;
+        }
+};
+
+#endif
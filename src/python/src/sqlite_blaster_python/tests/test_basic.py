@@ -0,0 +1,80 @@
+import array
+import sqlite3
+import threading
+
+import pytest
+
+import sqlite_blaster_python as sb
+
+
+def make_kv(path, n=100):
+    db = sqlite3.connect(path)
+    db.execute("create table kv(k text, n integer, v text, primary key(k)) without rowid")
+    db.executemany("insert into kv values(?,?,?)", [("k%03d" % i, i, "v%d" % i) for i in range(n)])
+    db.commit()
+    db.close()
+
+
+def test_scan_repeated_cols(tmp_path):
+    fn = str(tmp_path / "t.db")
+    make_kv(fn)
+    rows = [r for b in sb.scan(fn, cols=[1, 1]) for r in b]
+    assert rows == [[i, i] for i in range(100)]
+
+
+def test_columnar_repeated_cols(tmp_path):
+    fn = str(tmp_path / "t.db")
+    make_kv(fn)
+    n = []
+    for b in sb.scan(fn, cols=[1, 1, 2], columnar=True):
+        assert b.num_cols == 3
+        first = memoryview(b.values(0)).tolist()
+        assert memoryview(b.values(1)).tolist() == first
+        assert memoryview(b.valid(0)).tolist() == [1] * len(b)
+        assert memoryview(b.valid(1)).tolist() == [1] * len(b)
+        n += first
+    assert n == list(range(100))
+
+
+def test_bulk_load_unsigned_overflow(tmp_path):
+    fn = str(tmp_path / "t.db")
+    big = array.array("Q", [1, 2 ** 63 - 1])
+    sb.bulk_load(fn, {"k": big}, "k")
+    db = sqlite3.connect(fn)
+    assert db.execute("select k from kv").fetchall() == [(1,), (2 ** 63 - 1,)]
+    db.close()
+    with pytest.raises(OverflowError):
+        sb.bulk_load(fn, {"k": array.array("Q", [1, 2 ** 63])}, "k")
+    with pytest.raises(OverflowError):
+        sb.bulk_load(fn, [(1,), (2 ** 64,)], 0)
+
+
+def test_bulk_load_csv_header(tmp_path):
+    src = tmp_path / "in.csv"
+    src.write_text("id,name\r\n2,b\r\n1,a\r\n")
+    fn = str(tmp_path / "t.db")
+    sb.bulk_load(fn, str(src), "id")
+    db = sqlite3.connect(fn)
+    assert db.execute("select id, name from kv").fetchall() == [(1, "a"), (2, "b")]
+    db.close()
+
+
+def test_rec_threads(tmp_path):
+    ix = sb.sqlite_index_blaster(3, 1, "k, n, v", "kv", 4096, 40, str(tmp_path / "ix.db"))
+
+    def work(t):
+        for i in range(500):
+            ix.put_rec(["t%d_%d" % (t, i), i, 0.5 * i])
+            assert ix.get_rec(["t%d_%d" % (t, i)]) == ["t%d_%d" % (t, i), i, 0.5 * i]
+        ix.put_recs([["b%d_%d" % (t, i), i, "x" * i] for i in range(200)])
+
+    threads = [threading.Thread(target=work, args=(t,)) for t in range(4)]
+    for th in threads:
+        th.start()
+    for th in threads:
+        th.join()
+    assert ix.get_recs([["t3_499"], ["b0_7"], ["none"]]) == [["t3_499", 499, 249.5], ["b0_7", 7, "x" * 7], []]
+    with pytest.raises(Exception):
+        ix.put_rec(["bad", None])
+    assert ix.get_rec(["t0_1"]) == ["t0_1", 1, 0.5]
+    ix.close()